@@ -8,7 +8,9 @@
 #include <sys/stat.h>
 #endif
 
+#include <algorithm>
 #include <array>
+#include <string_view>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -379,6 +381,387 @@ bool filter_manager::FilenameFilteredByFilter(CFilter const& filter, std::wstrin
 	return false;
 }
 
+namespace {
+// If the regular expression matches nothing but a literal string, optionally
+// anchored to the start or end, returns that string.
+bool literal_regex(std::wstring const& r, bool matchCase, std::wstring & literal, bool & begin, bool & end)
+{
+	literal.clear();
+	begin = false;
+	end = false;
+
+	size_t i = 0;
+	if (!r.empty() && r[0] == '^') {
+		begin = true;
+		++i;
+	}
+	for (; i < r.size(); ++i) {
+		wchar_t c = r[i];
+		if (c == '\\') {
+			if (++i == r.size()) {
+				return false;
+			}
+			// Escaped punctuation stands for itself, anything else is
+			// a character class, backreference or similar.
+			c = r[i];
+			if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+				return false;
+			}
+		}
+		else if (c == '$' && i + 1 == r.size()) {
+			end = true;
+			break;
+		}
+		else if (std::wstring_view(L"^$.*+?()[]{}|").find(c) != std::wstring_view::npos) {
+			return false;
+		}
+
+		if (c > 127 && !matchCase) {
+			// Case-insensitive regex matching might not agree with str_tolower
+			return false;
+		}
+		literal += c;
+	}
+
+	return true;
+}
+}
+
+compiled_filters::compiled_filters(std::vector<CFilter> const& filters)
+{
+	for (auto const& f : filters) {
+		filter & out = filters_.emplace_back();
+		out.matchType_ = f.matchType;
+		out.filterFiles_ = f.filterFiles;
+		out.filterDirs_ = f.filterDirs;
+		out.empty_ = f.filters.empty();
+
+		for (auto const& c : f.filters) {
+			condition cond;
+			switch (c.type) {
+			case filter_name:
+			case filter_path:
+				cond.path_ = c.type == filter_path;
+				cond.lower_ = !f.matchCase;
+				cond.value_ = f.matchCase ? c.strValue : c.lowerValue;
+				switch (c.condition) {
+				case 0:
+					cond.op_ = op::contains;
+					break;
+				case 1:
+					cond.op_ = op::equals;
+					break;
+				case 2:
+					cond.op_ = op::begins;
+					break;
+				case 3:
+					cond.op_ = op::ends;
+					break;
+				case 4:
+					{
+						bool begin, end;
+						if (c.pRegEx && literal_regex(c.strValue, f.matchCase, cond.value_, begin, end)) {
+							if (!f.matchCase) {
+								cond.value_ = fz::str_tolower(cond.value_);
+							}
+							if (begin && end) {
+								cond.op_ = op::equals;
+							}
+							else if (begin) {
+								cond.op_ = op::begins;
+							}
+							else if (end) {
+								cond.op_ = op::ends;
+							}
+							else {
+								cond.op_ = op::contains;
+							}
+						}
+						else {
+							cond.op_ = op::regex;
+							cond.lower_ = false;
+							cond.regex_ = c.pRegEx;
+						}
+					}
+					break;
+				case 5:
+					cond.op_ = op::not_contains;
+					break;
+				default:
+					// Never matches
+					cond.op_ = op::regex;
+					cond.lower_ = false;
+					break;
+				}
+				break;
+			case filter_size:
+				cond.number_ = c.value;
+				switch (c.condition) {
+				case 0:
+					cond.op_ = op::size_greater;
+					break;
+				case 1:
+					cond.op_ = op::size_equal;
+					break;
+				case 2:
+					cond.op_ = op::size_not_equal;
+					break;
+				case 3:
+					cond.op_ = op::size_less;
+					break;
+				default:
+					// Never matches for known sizes
+					cond.op_ = op::size_equal;
+					cond.number_ = -1;
+					break;
+				}
+				break;
+#ifdef FZ_WINDOWS
+			case filter_attributes:
+				cond.op_ = op::attribute;
+				cond.number_ = c.value;
+				switch (c.condition) {
+				case 0:
+					cond.flag_ = FILE_ATTRIBUTE_ARCHIVE;
+					break;
+				case 1:
+					cond.flag_ = FILE_ATTRIBUTE_COMPRESSED;
+					break;
+				case 2:
+					cond.flag_ = FILE_ATTRIBUTE_ENCRYPTED;
+					break;
+				case 3:
+					cond.flag_ = FILE_ATTRIBUTE_HIDDEN;
+					break;
+				case 4:
+					cond.flag_ = FILE_ATTRIBUTE_READONLY;
+					break;
+				case 5:
+					cond.flag_ = FILE_ATTRIBUTE_SYSTEM;
+					break;
+				}
+				break;
+#else
+			case filter_permissions:
+				cond.op_ = op::attribute;
+				cond.number_ = c.value;
+				switch (c.condition) {
+				case 0:
+					cond.flag_ = S_IRUSR;
+					break;
+				case 1:
+					cond.flag_ = S_IWUSR;
+					break;
+				case 2:
+					cond.flag_ = S_IXUSR;
+					break;
+				case 3:
+					cond.flag_ = S_IRGRP;
+					break;
+				case 4:
+					cond.flag_ = S_IWGRP;
+					break;
+				case 5:
+					cond.flag_ = S_IXGRP;
+					break;
+				case 6:
+					cond.flag_ = S_IROTH;
+					break;
+				case 7:
+					cond.flag_ = S_IWOTH;
+					break;
+				case 8:
+					cond.flag_ = S_IXOTH;
+					break;
+				}
+				break;
+#endif
+			case filter_date:
+				cond.date_ = c.date;
+				switch (c.condition) {
+				case 0:
+					cond.op_ = op::date_before;
+					break;
+				case 1:
+					cond.op_ = op::date_equal;
+					break;
+				case 2:
+					cond.op_ = op::date_not_equal;
+					break;
+				case 3:
+					cond.op_ = op::date_after;
+					break;
+				default:
+					// Never matches
+					cond.op_ = op::regex;
+					break;
+				}
+				break;
+			default:
+				// Conditions for attributes of the other platform are always skipped
+				continue;
+			}
+			out.conditions_.emplace_back(std::move(cond));
+		}
+
+		// The outcome does not depend on the order of the conditions
+		std::stable_sort(out.conditions_.begin(), out.conditions_.end(), [](condition const& lhs, condition const& rhs) { return lhs.op_ < rhs.op_; });
+	}
+}
+
+bool compiled_filters::filtered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const
+{
+	std::wstring lowerName;
+	std::wstring lowerPath;
+	bool haveLowerName{};
+	bool haveLowerPath{};
+
+	for (auto const& f : filters_) {
+		if (dir ? !f.filterDirs_ : !f.filterFiles_) {
+			continue;
+		}
+
+		bool result{};
+		bool decided{};
+		for (auto const& c : f.conditions_) {
+			bool match = false;
+
+			switch (c.op_) {
+			case op::size_greater:
+			case op::size_equal:
+			case op::size_not_equal:
+			case op::size_less:
+				if (size == -1) {
+					continue;
+				}
+				switch (c.op_) {
+				case op::size_greater:
+					match = size > c.number_;
+					break;
+				case op::size_equal:
+					match = size == c.number_;
+					break;
+				case op::size_not_equal:
+					match = size != c.number_;
+					break;
+				default:
+					match = size < c.number_;
+					break;
+				}
+				break;
+			case op::attribute:
+#ifdef FZ_WINDOWS
+				if (!attributes) {
+					continue;
+				}
+#else
+				if (attributes == -1) {
+					continue;
+				}
+#endif
+				match = ((c.flag_ & attributes) ? 1 : 0) == c.number_;
+				break;
+			case op::date_before:
+			case op::date_equal:
+			case op::date_not_equal:
+			case op::date_after:
+				if (!date.empty()) {
+					int const cmp = date.compare(c.date_);
+					switch (c.op_) {
+					case op::date_before:
+						match = cmp < 0;
+						break;
+					case op::date_equal:
+						match = cmp == 0;
+						break;
+					case op::date_not_equal:
+						match = cmp != 0;
+						break;
+					default:
+						match = cmp > 0;
+						break;
+					}
+				}
+				break;
+			default:
+				{
+					std::wstring const* subject = c.path_ ? &path : &name;
+					if (c.lower_) {
+						if (c.path_) {
+							if (!haveLowerPath) {
+								lowerPath = fz::str_tolower(path);
+								haveLowerPath = true;
+							}
+							subject = &lowerPath;
+						}
+						else {
+							if (!haveLowerName) {
+								lowerName = fz::str_tolower(name);
+								haveLowerName = true;
+							}
+							subject = &lowerName;
+						}
+					}
+
+					switch (c.op_) {
+					case op::equals:
+						match = *subject == c.value_;
+						break;
+					case op::begins:
+						match = fz::starts_with(*subject, c.value_);
+						break;
+					case op::ends:
+						match = fz::ends_with(*subject, c.value_);
+						break;
+					case op::contains:
+						match = subject->find(c.value_) != std::wstring::npos;
+						break;
+					case op::not_contains:
+						match = subject->find(c.value_) == std::wstring::npos;
+						break;
+					default:
+						match = c.regex_ && regex_ns::regex_search(*subject, *std::static_pointer_cast<regex_ns::wregex>(c.regex_));
+						break;
+					}
+				}
+				break;
+			}
+
+			if (match) {
+				if (f.matchType_ == CFilter::any) {
+					result = true;
+					decided = true;
+					break;
+				}
+				else if (f.matchType_ == CFilter::none) {
+					decided = true;
+					break;
+				}
+			}
+			else {
+				if (f.matchType_ == CFilter::all) {
+					decided = true;
+					break;
+				}
+				else if (f.matchType_ == CFilter::not_all) {
+					result = true;
+					decided = true;
+					break;
+				}
+			}
+		}
+
+		if (!decided) {
+			result = f.matchType_ != CFilter::not_all && (f.matchType_ != CFilter::any || f.empty_);
+		}
+		if (result) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool load_filter(pugi::xml_node& element, CFilter& filter)
 {
 	filter.name = GetTextElement(element, "Name").substr(0, 255);
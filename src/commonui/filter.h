@@ -5,7 +5,7 @@
 #include <libfilezilla/time.hpp>
 
 #include <memory>
-
+#include <string>
 #include <vector>
 
 enum t_filterType
@@ -94,6 +94,72 @@ public:
 	static bool FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date);
 };
 
+// Prepared form of a list of filters for evaluating it against many files,
+// e.g. during recursive operations. Gives the same results as
+// filter_manager::FilenameFiltered.
+//
+// Conditions are checked cheapest first, names and paths get lowercased at
+// most once per file and regular expressions that only match a literal
+// string are evaluated as plain string comparisons.
+class FZCUI_PUBLIC_SYMBOL compiled_filters final
+{
+public:
+	compiled_filters() = default;
+	explicit compiled_filters(std::vector<CFilter> const& filters);
+
+	bool empty() const { return filters_.empty(); }
+
+	// Note: Under non-windows, attributes are permissions
+	bool filtered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const;
+
+private:
+	// Ordered by the cost of evaluating the condition
+	enum class op : unsigned char
+	{
+		size_greater,
+		size_equal,
+		size_not_equal,
+		size_less,
+		attribute,
+		date_before,
+		date_equal,
+		date_not_equal,
+		date_after,
+		equals,
+		begins,
+		ends,
+		contains,
+		not_contains,
+		regex
+	};
+
+	struct condition final
+	{
+		op op_{};
+		bool path_{}; // Compared against the path instead of the name
+		bool lower_{}; // Compared against the lowercased subject
+
+		std::wstring value_;
+		int64_t number_{};
+		int flag_{};
+		fz::datetime date_;
+		std::shared_ptr<void> regex_;
+	};
+
+	struct filter final
+	{
+		std::vector<condition> conditions_;
+		CFilter::t_matchType matchType_{CFilter::all};
+		bool filterFiles_{};
+		bool filterDirs_{};
+
+		// If the original filter had no conditions at all
+		bool empty_{};
+	};
+
+	std::vector<filter> filters_;
+};
+
 typedef std::pair<std::vector<CFilter>, std::vector<CFilter>> ActiveFilters;
 
 struct FZCUI_PUBLIC_SYMBOL filter_data final {
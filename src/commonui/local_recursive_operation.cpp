@@ -2,6 +2,15 @@
 
 #include <libfilezilla/local_filesys.hpp>
 
+#include <algorithm>
+#include <thread>
+
+namespace {
+// Enumerating a directory mostly waits on the file system, more workers
+// than this rarely help even on fast storage.
+unsigned int const max_workers = 8;
+}
+
 local_recursive_operation::local_recursive_operation()
 {}
 
@@ -65,12 +74,27 @@ bool local_recursive_operation::do_start_recursive_operation(OperationMode mode,
 	m_filters = filters;
 	m_ignoreLinks = ignore_links;
 
+	pending_.clear();
+	first_pending_ = 0;
+	delivering_ = false;
+
 	if (pool_) {
-		thread_ = pool_->spawn([this] { thread_entry(); });
-		if (!thread_) {
+		unsigned int const count = std::clamp(std::thread::hardware_concurrency(), 1u, max_workers);
+		for (unsigned int i = 0; i < count; ++i) {
+			auto worker = pool_->spawn([this] { thread_entry(); });
+			if (!worker) {
+				break;
+			}
+			workers_.emplace_back(std::move(worker));
+		}
+		if (workers_.empty()) {
 			m_operationMode = recursive_none;
 			return false;
 		}
+		running_ = static_cast<int>(workers_.size());
+	}
+	else {
+		running_ = 1;
 	}
 
 	return true;
@@ -90,12 +114,22 @@ void local_recursive_operation::StopRecursiveOperation()
 		m_processedFiles = 0;
 		m_processedDirectories = 0;
 
+		// Wake up idle workers
+		cond_.signal(l);
 	}
 
-	thread_.join();
+	join();
 	m_listedDirectories.clear();
 }
 
+void local_recursive_operation::join()
+{
+	for (auto & worker : workers_) {
+		worker.join();
+	}
+	workers_.clear();
+}
+
 void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, bool recurse)
 {
 	if (recursion_roots_.empty()) {
@@ -132,37 +166,80 @@ void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, lis
 	}
 }
 
+void local_recursive_operation::DeliverEnumeratedListings(fz::scoped_lock& l)
+{
+	if (delivering_) {
+		// The worker already delivering also picks up the new listings
+		return;
+	}
+	delivering_ = true;
+
+	while (!pending_.empty() && !recursion_roots_.empty()) {
+		auto & front = pending_.front();
+		if (!front.chunks.empty()) {
+			listing d = std::move(front.chunks.front());
+			front.chunks.pop_front();
+			EnqueueEnumeratedListing(l, std::move(d), front.recurse);
+		}
+		else if (front.done) {
+			pending_.pop_front();
+			++first_pending_;
+		}
+		else {
+			break;
+		}
+	}
+
+	delivering_ = false;
+
+	// New directories to visit may have been queued
+	cond_.signal(l);
+}
+
 void local_recursive_operation::thread_entry()
 {
 	{
 		fz::scoped_lock l(mutex_);
 
-		// Make copy, as it is used in the unlocked section
-		auto filters = m_filters.first;
+		// Prepared copy, as it is used in the unlocked section
+		compiled_filters const filters(m_filters.first);
 
 		while (!recursion_roots_.empty()) {
 			listing d;
-			bool recurse{true};
+			uint64_t ticket{};
 
 			{
 				auto& root = recursion_roots_.front();
 				if (root.m_dirsToVisit.empty()) {
+					if (!pending_.empty()) {
+						// Directories still being enumerated may contain further
+						// subdirectories to visit.
+						cond_.wait(l);
+						continue;
+					}
 					recursion_roots_.pop_front();
+					cond_.signal(l);
 					continue;
 				}
 
 				auto const& dir = root.m_dirsToVisit.front();
 				d.localPath = dir.localPath;
 				d.remotePath = dir.remotePath;
-				recurse = dir.recurse;
+
+				ticket = first_pending_ + pending_.size();
+				pending_.emplace_back().recurse = dir.recurse;
 
 				root.m_dirsToVisit.pop_front();
+				if (!root.m_dirsToVisit.empty()) {
+					cond_.signal(l);
+				}
 			}
 
 			// Do the slow part without holding mutex
 			l.unlock();
 
 			bool sentPartial = false;
+			bool cancelled = false;
 			fz::local_filesys fs;
 			fz::native_string localPath = fz::to_native(d.localPath.GetPath());
 
@@ -177,7 +254,7 @@ void local_recursive_operation::thread_entry()
 					}
 					entry.name = fz::to_wstring(name);
 
-					if (!filter_manager::FilenameFiltered(filters, entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
+					if (!filters.filtered(entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
 						if (t == fz::local_filesys::dir) {
 							d.dirs.emplace_back(std::move(entry));
 						}
@@ -197,9 +274,11 @@ void local_recursive_operation::thread_entry()
 							// Check for cancellation
 							if (recursion_roots_.empty()) {
 								l.unlock();
+								cancelled = true;
 								break;
 							}
-							EnqueueEnumeratedListing(l, std::move(d), recurse);
+							pending_[ticket - first_pending_].chunks.emplace_back(std::move(d));
+							DeliverEnumeratedListings(l);
 							l.unlock();
 							d = next;
 						}
@@ -212,12 +291,23 @@ void local_recursive_operation::thread_entry()
 
 			l.lock();
 			// Check for cancellation
-			if (recursion_roots_.empty()) {
+			if (cancelled || recursion_roots_.empty()) {
 				break;
 			}
+			auto & pending = pending_[ticket - first_pending_];
 			if (!sentPartial || !d.files.empty() || !d.dirs.empty()) {
-				EnqueueEnumeratedListing(l, std::move(d), recurse);
+				pending.chunks.emplace_back(std::move(d));
 			}
+			pending.done = true;
+			DeliverEnumeratedListings(l);
+		}
+
+		// Pass on the wakeup, other workers need to notice the end as well
+		cond_.signal(l);
+
+		// Last worker signals the end of the operation
+		if (--running_) {
+			return;
 		}
 
 		listing d;
@@ -226,4 +316,3 @@ void local_recursive_operation::thread_entry()
 
 	on_listed_directory();
 }
-
@@ -14,6 +14,7 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 class FZCUI_PUBLIC_SYMBOL local_recursion_root final
 {
@@ -62,7 +63,7 @@ public:
 
 	// when default constructed, thread_entry must be called to process the files
 	local_recursive_operation();
-	// spawns async task when start_recursive_operation called to process the files
+	// spawns async tasks when start_recursive_operation called to process the files
 	local_recursive_operation(fz::thread_pool& pool);
 	virtual ~local_recursive_operation();
 
@@ -71,7 +72,8 @@ public:
 
 	virtual void StopRecursiveOperation() override;
 
-	// thread entry point for processing files
+	// thread entry point for processing files. With a thread pool, several
+	// of these enumerate directories concurrently.
 	void thread_entry();
 
 protected:
@@ -87,6 +89,12 @@ protected:
 protected:
 	void EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, bool recurse);
 
+	// Hands off the enumerated listings in the order the directories got
+	// taken from the queue of directories to visit
+	void DeliverEnumeratedListings(fz::scoped_lock& l);
+
+	void join();
+
 	std::deque<local_recursion_root> recursion_roots_;
 
 	fz::mutex mutex_;
@@ -95,7 +103,24 @@ protected:
 	std::deque<listing> m_listedDirectories;
 	bool m_ignoreLinks{};
 
-	fz::async_task thread_;
+	// Directories being enumerated or not yet handed off, oldest first
+	class pending_dir final
+	{
+	public:
+		std::deque<listing> chunks;
+		bool recurse{true};
+		bool done{};
+	};
+	std::deque<pending_dir> pending_;
+	uint64_t first_pending_{};
+	bool delivering_{};
+
+	// Wakes a single idle worker, which passes it on if there is more
+	// for the others to pick up.
+	fz::condition cond_;
+	int running_{};
+
+	std::vector<fz::async_task> workers_;
 };
 
 #endif
@@ -5,6 +5,14 @@
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/recursive_remove.hpp>
 
+#include <algorithm>
+
+namespace {
+// How far ahead in the list of directories to visit to look for
+// directories to prefetch
+size_t const prefetch_lookahead = 1000;
+}
+
 recursion_root::recursion_root(CServerPath const& start_dir, bool allow_parent)
 	: m_remoteStartDir(start_dir)
 	, m_allowParent(allow_parent)
@@ -70,6 +78,8 @@ void remote_recursive_operation::start_recursive_operation(OperationMode mode, A
 	m_operationMode = mode;
 
 	listFlags_ = refrshListings ? LIST_FLAG_REFRESH : 0;
+	prefetching_.clear();
+	prefetched_.clear();
 
 	do_start_recursive_operation(mode, filters);
 }
@@ -77,6 +87,7 @@ void remote_recursive_operation::start_recursive_operation(OperationMode mode, A
 void remote_recursive_operation::do_start_recursive_operation(OperationMode, ActiveFilters const& filters)
 {
 	m_filters = filters;
+	remote_filters_ = compiled_filters(filters.second);
 	NextOperation();
 }
 
@@ -97,13 +108,24 @@ bool remote_recursive_operation::NextOperation()
 				continue;
 			}
 
-			process_command(std::make_unique<CListCommand>(dirToVisit.parent, dirToVisit.subdir, listFlags_ | (dirToVisit.link ? LIST_FLAG_LINK : 0)));
+			int flags = listFlags_;
+			if (prefetched_.erase(std::make_pair(dirToVisit.parent, dirToVisit.subdir))) {
+				// Listed on another connection during this operation, the cached listing is recent.
+				flags &= ~LIST_FLAG_REFRESH;
+				flags |= LIST_FLAG_PREFETCHED;
+			}
+			process_command(std::make_unique<CListCommand>(dirToVisit.parent, dirToVisit.subdir, flags | (dirToVisit.link ? LIST_FLAG_LINK : 0)));
+			PrefetchListings();
 			return true;
 		}
 
 		recursion_roots_.pop_front();
 	}
 
+	if (has_pending_commands()) {
+		return true;
+	}
+
 	StopRecursiveOperation();
 	operation_finished();
 
@@ -154,7 +176,7 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 				continue;
 			}
 		}
-		else if (filter_manager::FilenameFiltered(m_filters.second, entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
+		else if (remote_filters_.filtered(entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
 			continue;
 		}
 
@@ -281,6 +303,51 @@ void remote_recursive_operation::ProcessDirectoryListing(CDirectoryListing const
 	NextOperation();
 }
 
+void remote_recursive_operation::PrefetchListings()
+{
+	if (m_operationMode == recursive_none || recursion_roots_.empty()) {
+		return;
+	}
+
+	size_t capacity = prefetch_capacity();
+	if (!capacity) {
+		return;
+	}
+
+	// The first directory is the one being listed by the operation itself
+	auto & root = recursion_roots_.front();
+	size_t const end = std::min(root.m_dirsToVisit.size(), prefetch_lookahead);
+	for (size_t i = 1; i < end && capacity; ++i) {
+		auto const& dir = root.m_dirsToVisit[i];
+		if (!dir.doVisit || dir.link || dir.restricted || dir.subdir.empty()) {
+			continue;
+		}
+
+		auto key = std::make_pair(dir.parent, dir.subdir);
+		if (!prefetching_.insert(key).second) {
+			continue;
+		}
+
+		if (!prefetch_listing(dir.parent, dir.subdir, listFlags_)) {
+			prefetching_.erase(key);
+			break;
+		}
+		--capacity;
+	}
+}
+
+void remote_recursive_operation::PrefetchFinished(CServerPath const& parent, std::wstring const& subdir, bool success)
+{
+	if (m_operationMode == recursive_none) {
+		return;
+	}
+
+	if (success) {
+		prefetched_.emplace(parent, subdir);
+	}
+	PrefetchListings();
+}
+
 void remote_recursive_operation::SetChmodData(std::unique_ptr<ChmodData>&& chmodData)
 {
 	chmodData_ = std::move(chmodData);
@@ -293,6 +360,8 @@ void remote_recursive_operation::StopRecursiveOperation()
 	}
 	recursion_roots_.clear();
 	chmodData_.reset();
+	prefetching_.clear();
+	prefetched_.clear();
 }
 
 void remote_recursive_operation::ListingFailed(int error)
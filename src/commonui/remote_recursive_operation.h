@@ -103,6 +103,27 @@ protected:
 	// called after non-recoverable listing failure
 	virtual void handle_listing_failed() = 0;
 
+	// Returns how many more directories can currently be listed ahead of the
+	// operation using prefetch_listing. By default none are.
+	virtual size_t prefetch_capacity() { return 0; }
+
+	// List directory on a different connection such that its listing is already
+	// cached once the operation gets to it. Call PrefetchFinished once done.
+	// Returns false if the listing could not be started.
+	virtual bool prefetch_listing(CServerPath const&, std::wstring const&, int) { return false; }
+
+	// Returns true while commands passed to process_command are still being
+	// executed outside of the regular command flow. Once all directories have
+	// been visited, the operation only finishes with the next call to
+	// NextOperation after this returns false.
+	virtual bool has_pending_commands() { return false; }
+
+	// Call when a listing started through prefetch_listing has finished
+	void PrefetchFinished(CServerPath const& parent, std::wstring const& subdir, bool success);
+
+	// Starts listings of the directories about to be visited, up to prefetch_capacity
+	void PrefetchListings();
+
 	// Call this when engine indicates that link was tried to be listed as directory but is not one
 	void LinkIsNotDir(Site const& site);
 
@@ -125,6 +146,14 @@ protected:
 	std::unique_ptr<ChmodData> chmodData_;
 
 	int listFlags_{};
+
+	// m_filters.second, prepared for evaluating it against every entry
+	compiled_filters remote_filters_;
+
+	// Directories for which prefetch_listing has been called, and those which
+	// got successfully listed that way
+	std::set<std::pair<CServerPath, std::wstring>> prefetching_;
+	std::set<std::pair<CServerPath, std::wstring>> prefetched_;
 };
 
 #endif
@@ -46,6 +46,11 @@ int CFileZillaEngine::CacheLookup(const CServerPath& path, CDirectoryListing& li
 	return impl_->CacheLookup(path, listing);
 }
 
+int CFileZillaEngine::CacheLookup(CServer const& server, CServerPath const& path, CDirectoryListing& listing)
+{
+	return impl_->CacheLookup(server, path, listing);
+}
+
 int CFileZillaEngine::Cancel()
 {
 	return impl_->Cancel();
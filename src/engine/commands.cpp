@@ -62,8 +62,8 @@ CFileTransferCommand::CFileTransferCommand(fz::reader_factory_holder const& read
 }
 
 CFileTransferCommand::CFileTransferCommand(fz::writer_factory_holder const& writer,
-	CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags, std::string const& persistentState)
-	: writer_(writer), m_remotePath(remotePath), m_remoteFile(remoteFile), extraFlags_(extraFlags), persistentState_(persistentState), flags_(flags)
+	CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags, std::string const& persistentState, transfer_range const& range)
+	: writer_(writer), m_remotePath(remotePath), m_remoteFile(remoteFile), extraFlags_(extraFlags), persistentState_(persistentState), range_(range), flags_(flags)
 {
 }
 
@@ -87,6 +87,10 @@ bool CFileTransferCommand::valid() const
 		return false;
 	}
 
+	if (range_ && !Download()) {
+		return false;
+	}
+
 	return true;
 }
 
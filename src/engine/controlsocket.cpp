@@ -240,15 +240,40 @@ void CControlSocket::UpdateCache(COpData const &, CServerPath const& serverPath,
 {
 	bool updated = engine_.GetDirectoryCache().UpdateFile(currentServer_, serverPath, remoteFile, true, CDirectoryCache::file, fileSize);
 	if (updated) {
-		SendDirectoryListingNotification(serverPath, false);
+		if (std::find(changedDirectories_.cbegin(), changedDirectories_.cend(), serverPath) == changedDirectories_.cend()) {
+			changedDirectories_.push_back(serverPath);
+		}
+		if (!changedDirectoriesTimer_) {
+			changedDirectoriesTimer_ = add_timer(fz::duration::from_milliseconds(250), true);
+		}
+	}
+}
+
+void CControlSocket::FlushChangedDirectories()
+{
+	if (changedDirectoriesTimer_) {
+		stop_timer(changedDirectoriesTimer_);
+		changedDirectoriesTimer_ = 0;
 	}
+
+	if (currentServer_) {
+		// Not the result of a list command, even if one is running
+		for (auto const& path : changedDirectories_) {
+			engine_.AddNotification(std::make_unique<CDirectoryListingNotification>(path, false, false));
+		}
+	}
+	changedDirectories_.clear();
 }
 
 int CControlSocket::DoClose(int nErrorCode)
 {
 	log(logmsg::debug_debug, L"CControlSocket::DoClose(%d)", nErrorCode);
 	currentPath_.clear();
-	return ResetOperation(FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED | nErrorCode);
+	int const res = ResetOperation(FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED | nErrorCode);
+
+	// Includes the change from an upload interrupted by closing
+	FlushChangedDirectories();
+	return res;
 }
 
 std::wstring CControlSocket::ConvertDomainName(std::wstring const& domain)
@@ -378,6 +403,14 @@ int CControlSocket::CheckOverwriteFile()
 		if (data.localFileSize_ == fz::aio_base::nosize && data.localFileTime_.empty()) {
 			return FZ_REPLY_OK;
 		}
+
+		if (data.range_) {
+			// The local file only holds a part of the remote file, it can
+			// only have been created by a previous attempt at the same range.
+			log(logmsg::debug_info, L"Resuming partial download of byte range");
+			data.resume_ = true;
+			return FZ_REPLY_OK;
+		}
 	}
 
 	CDirentry entry;
@@ -463,6 +496,7 @@ CFileTransferOpData::CFileTransferOpData(wchar_t const* name, CFileTransferComma
 	, localName_(reader_factory_ ? reader_factory_.name() : writer_factory_.name())
 	, remoteFile_(cmd.GetRemoteFile())
 	, remotePath_(cmd.GetRemotePath())
+	, range_(cmd.GetRange())
 {
 	localFileSize_ = download() ? writer_factory_.size() : reader_factory_.size();
 	localFileTime_ = download() ? writer_factory_.mtime() : reader_factory_.mtime();
@@ -530,8 +564,14 @@ std::string CControlSocket::ConvToServer(std::wstring const& str, bool force_utf
 	return ret;
 }
 
-void CControlSocket::OnTimer(fz::timer_id)
+void CControlSocket::OnTimer(fz::timer_id id)
 {
+	if (id == changedDirectoriesTimer_) {
+		changedDirectoriesTimer_ = 0;
+		FlushChangedDirectories();
+		return;
+	}
+
 	m_timer = 0; // It's a one-shot timer, no need to stop it
 
 	int const timeout = engine_.GetOptions().get_int(OPTION_TIMEOUT);
@@ -1160,6 +1200,56 @@ void CControlSocket::SendDirectoryListingNotification(CServerPath const& path, b
 	engine_.AddNotification(std::make_unique<CDirectoryListingNotification>(path, operations_.size() == 1 && operations_.back()->opId == Command::list, failed));
 }
 
+void CControlSocket::FlushDeletedFiles(CServerPath const& path, std::vector<std::wstring> & deleted, uint64_t & failed, bool sendListing)
+{
+	if (deleted.empty() && !failed) {
+		return;
+	}
+
+	if (!deleted.empty()) {
+		engine_.GetDirectoryCache().RemoveFiles(currentServer_, path, deleted);
+		if (sendListing) {
+			SendDirectoryListingNotification(path, false);
+		}
+	}
+
+	engine_.AddNotification(std::make_unique<CDeleteProgressNotification>(path, deleted.size(), failed));
+
+	deleted.clear();
+	failed = 0;
+}
+
+bool CControlSocket::SendCachedDirectoryListing(CServerPath const& path, std::wstring const& subDir, int flags)
+{
+	if (path.empty() || !(flags & LIST_FLAG_PREFETCHED) || (flags & (LIST_FLAG_REFRESH | LIST_FLAG_LINK))) {
+		return false;
+	}
+
+	CServerPath const target = subDir.empty() ? path : engine_.GetPathCache().Lookup(currentServer_, path, subDir);
+	if (target.empty()) {
+		return false;
+	}
+
+	CDirectoryListing listing;
+	bool is_outdated = false;
+	if (!engine_.GetDirectoryCache().Lookup(listing, currentServer_, target, false, is_outdated) || is_outdated) {
+		return false;
+	}
+
+	SendDirectoryListingNotification(listing.path, false);
+	return true;
+}
+
+void CControlSocket::SendPartialDirectoryListingNotification(CDirectoryListing && partial)
+{
+	if (!currentServer_ || operations_.empty() || operations_.front()->opId != Command::list) {
+		return;
+	}
+
+	partial.m_flags |= CDirectoryListing::listing_partial;
+	engine_.AddNotification(std::make_unique<CDirectoryListingNotification>(std::make_shared<CDirectoryListing>(std::move(partial))));
+}
+
 void CControlSocket::CallSetAsyncRequestReply(CAsyncRequestNotification *pNotification)
 {
 	if (operations_.empty() || operations_.back()->async_request_state_ == async_request_state::none) {
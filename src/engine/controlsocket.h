@@ -151,6 +151,8 @@ public:
 	std::wstring remoteFile_;
 	CServerPath remotePath_;
 
+	transfer_range range_;
+
 	uint64_t localFileSize_{fz::aio_base::nosize};
 	fz::datetime localFileTime_;
 
@@ -226,6 +228,9 @@ public:
 	void CallSetAsyncRequestReply(CAsyncRequestNotification *pNotification);
 	bool SetFileExistsAction(CFileExistsNotification *pFileExistsNotification);
 
+	// Only sent if a listing is the primary operation
+	void SendPartialDirectoryListingNotification(CDirectoryListing && partial);
+
 	CServer const& GetCurrentServer() const;
 
 	// Conversion function which convert between local and server charset.
@@ -286,6 +291,16 @@ protected:
 	virtual bool SetAsyncRequestReply(CAsyncRequestNotification *pNotification) = 0;
 	void SendDirectoryListingNotification(CServerPath const& path, bool failed);
 
+	// Used by the delete operations. Removes the files deleted since the
+	// previous call from the directory cache in one go and reports the
+	// progress. Clears the passed files and failure count.
+	void FlushDeletedFiles(CServerPath const& path, std::vector<std::wstring> & deleted, uint64_t & failed, bool sendListing);
+
+	// For listings with LIST_FLAG_PREFETCHED, sends the notification without
+	// changing the directory first if the target directory is known and has
+	// a recent cached listing.
+	bool SendCachedDirectoryListing(CServerPath const& path, std::wstring const& subDir, int flags);
+
 	fz::duration GetInferredTimezoneOffset() const;
 
 	virtual int DoClose(int nErrorCode = FZ_REPLY_DISCONNECTED | FZ_REPLY_ERROR);
@@ -293,6 +308,11 @@ protected:
 	virtual int ResetOperation(int nErrorCode);
 	virtual void UpdateCache(COpData const& data, CServerPath const& serverPath, std::wstring const& remoteFile, int64_t fileSize);
 
+	// Sends the listing notifications for the directories changed in the
+	// cache by finished uploads. Instead of once per file, these are sent
+	// together a short while after the first change.
+	void FlushChangedDirectories();
+
 	void LogTransferResultMessage(int nErrorCode, CFileTransferOpData *pData);
 
 	// Called by ResetOperation if there's a queued operation
@@ -326,6 +346,9 @@ protected:
 	fz::timer_id m_timer{};
 	fz::monotonic_clock m_lastActivity;
 
+	std::vector<CServerPath> changedDirectories_;
+	fz::timer_id changedDirectoriesTimer_{};
+
 	OpLockManager & opLockManager_;
 
 	bool m_invalidateCurrentPath{};
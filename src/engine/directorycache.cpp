@@ -1,70 +1,337 @@
 #include "filezilla.h"
 #include "directorycache.h"
+#include "directorylistingparser.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <algorithm>
 
 #include <assert.h>
 
-CDirectoryCache::CDirectoryCache()
+namespace {
+// Snapshot layout, all integers little endian:
+//   magic, version
+//   per server: key, size of block, block
+// A block holds a sequence of listings:
+//   path, list time (ms since epoch), flags, entry count, entries
+uint32_t const snapshot_magic = 0x43445a46; // "FZDC"
+uint32_t const snapshot_version = 1;
+
+class snapshot_writer final
 {
+public:
+	void u8(uint8_t v) { data_ += static_cast<char>(v); }
+
+	void u32(uint32_t v)
+	{
+		for (int i = 0; i < 4; ++i) {
+			u8(static_cast<uint8_t>(v >> (i * 8)));
+		}
+	}
+
+	void i64(int64_t v)
+	{
+		uint64_t const u = static_cast<uint64_t>(v);
+		for (int i = 0; i < 8; ++i) {
+			u8(static_cast<uint8_t>(u >> (i * 8)));
+		}
+	}
+
+	void str(std::string_view const& v)
+	{
+		u32(static_cast<uint32_t>(v.size()));
+		data_ += v;
+	}
+
+	void str(std::wstring_view const& v)
+	{
+		str(fz::to_utf8(v));
+	}
+
+	std::string data_;
+};
+
+class snapshot_reader final
+{
+public:
+	explicit snapshot_reader(std::string_view const& data)
+		: data_(data)
+	{}
+
+	uint8_t u8()
+	{
+		if (data_.empty()) {
+			failed_ = true;
+			return 0;
+		}
+		uint8_t v = static_cast<uint8_t>(data_[0]);
+		data_.remove_prefix(1);
+		return v;
+	}
+
+	uint32_t u32()
+	{
+		uint32_t v{};
+		for (int i = 0; i < 4; ++i) {
+			v |= static_cast<uint32_t>(u8()) << (i * 8);
+		}
+		return v;
+	}
+
+	int64_t i64()
+	{
+		uint64_t v{};
+		for (int i = 0; i < 8; ++i) {
+			v |= static_cast<uint64_t>(u8()) << (i * 8);
+		}
+		return static_cast<int64_t>(v);
+	}
+
+	std::string_view raw()
+	{
+		uint32_t const len = u32();
+		if (failed_ || len > data_.size()) {
+			failed_ = true;
+			return {};
+		}
+		std::string_view v = data_.substr(0, len);
+		data_.remove_prefix(len);
+		return v;
+	}
+
+	std::wstring str()
+	{
+		return fz::to_wstring_from_utf8(raw());
+	}
+
+	bool empty() const { return data_.empty(); }
+	bool failed() const { return failed_; }
+	size_t remaining() const { return data_.size(); }
+
+private:
+	std::string_view data_;
+	bool failed_{};
+};
+
+std::string make_server_key(CServer const& server)
+{
+	snapshot_writer w;
+	w.u32(static_cast<uint32_t>(server.GetProtocol()));
+	w.str(server.GetHost());
+	w.u32(server.GetPort());
+	w.str(server.GetUser());
+	auto const& commands = server.GetPostLoginCommands();
+	w.u32(static_cast<uint32_t>(commands.size()));
+	for (auto const& command : commands) {
+		w.str(command);
+	}
+	for (auto const& trait : ExtraServerParameterTraits(server.GetProtocol())) {
+		if (!(trait.flags_ & ParameterTraits::content_transparent)) {
+			w.str(server.GetExtraParameter(trait.name_));
+		}
+	}
+	w.u32(static_cast<uint32_t>(server.GetTimezoneOffset()));
+	w.u32(static_cast<uint32_t>(server.GetEncodingType()));
+	w.str(server.GetCustomEncoding());
+	return std::move(w.data_);
 }
 
-CDirectoryCache::~CDirectoryCache()
+fz::datetime const epoch(0, fz::datetime::milliseconds);
+
+void write_listing(snapshot_writer & w, CDirectoryListing const& listing, fz::datetime const& listTime)
+{
+	w.str(listing.path.GetSafePath());
+	w.i64((listTime - epoch).get_milliseconds());
+	w.u32(static_cast<uint32_t>(listing.m_flags));
+	w.u32(static_cast<uint32_t>(listing.size()));
+	for (size_t i = 0; i < listing.size(); ++i) {
+		CDirentry const& entry = listing[i];
+		w.str(entry.name);
+		w.i64(entry.size);
+		w.str(*entry.permissions);
+		w.str(*entry.ownerGroup);
+		w.u32(static_cast<uint32_t>(entry.flags));
+		if (entry.target) {
+			w.u8(1);
+			w.str(*entry.target);
+		}
+		else {
+			w.u8(0);
+		}
+		if (entry.has_date()) {
+			w.u8(static_cast<uint8_t>(entry.time.get_accuracy()) + 1);
+			w.i64((entry.time - epoch).get_milliseconds());
+		}
+		else {
+			w.u8(0);
+		}
+	}
+}
+
+bool read_listing(snapshot_reader & r, CStringCache & strings, CDirectoryListing & listing, fz::datetime & listTime)
 {
-	for (auto & serverEntry : m_serverList) {
-		for (auto & cacheEntry : serverEntry.cacheList) {
-#ifndef NDEBUG
-			m_totalFileCount -= cacheEntry.listing.size();
-#endif
-			tLruList::iterator* lruIt = (tLruList::iterator*)cacheEntry.lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
+	if (!listing.path.SetSafePath(r.str())) {
+		return false;
+	}
+	listTime = epoch + fz::duration::from_milliseconds(r.i64());
+	listing.m_flags = static_cast<int>(r.u32());
+
+	uint32_t const count = r.u32();
+	if (r.failed()) {
+		return false;
+	}
+
+	// Smallest serialized entry: name, size, permissions, owner/group,
+	// flags, target marker and date accuracy. Guards against corrupt counts.
+	size_t const min_entry_size = 4 + 8 + 4 + 4 + 4 + 1 + 1;
+	if (count > r.remaining() / min_entry_size) {
+		return false;
+	}
+
+	std::vector<CDirentry> entries;
+	entries.reserve(count);
+	for (uint32_t i = 0; i < count && !r.failed(); ++i) {
+		CDirentry entry;
+		entry.name = r.str();
+		entry.size = r.i64();
+		entry.permissions = strings.get(r.str());
+		entry.ownerGroup = strings.get(r.str());
+		entry.flags = static_cast<int>(r.u32());
+		if (r.u8()) {
+			entry.target = fz::sparse_optional<std::wstring>(r.str());
+		}
+		uint8_t const accuracy = r.u8();
+		if (accuracy) {
+			int64_t const ms = r.i64();
+			if (accuracy > fz::datetime::milliseconds + 1) {
+				return false;
+			}
+			entry.time = fz::datetime(static_cast<time_t>(ms / 1000), static_cast<fz::datetime::accuracy>(accuracy - 1));
+			if (accuracy - 1 == fz::datetime::milliseconds) {
+				entry.time += fz::duration::from_milliseconds(ms % 1000);
 			}
 		}
+		entries.emplace_back(std::move(entry));
 	}
-#ifndef NDEBUG
-	assert(m_totalFileCount == 0);
-#endif
+	if (r.failed()) {
+		return false;
+	}
+
+	// Assign also recomputes the content flags
+	int const flags = listing.m_flags;
+	listing.Assign(std::move(entries));
+	listing.m_flags = flags;
+
+	return true;
 }
 
-void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& server)
+// Reads the blocks of a snapshot file, keyed by server fingerprint
+bool read_snapshot(std::wstring const& file, std::map<std::string, std::string> & pending)
+{
+	fz::file f(fz::to_native(file), fz::file::reading, fz::file::existing);
+	if (!f.opened()) {
+		return false;
+	}
+
+	int64_t const size = f.size();
+	if (size < 8 || size > 2048ll * 1024 * 1024) {
+		return false;
+	}
+
+	std::string data;
+	data.resize(static_cast<size_t>(size));
+	size_t pos{};
+	while (pos < data.size()) {
+		fz::rwresult read = f.read2(data.data() + pos, data.size() - pos);
+		if (!read || !read.value_) {
+			return false;
+		}
+		pos += read.value_;
+	}
+
+	snapshot_reader r(data);
+	if (r.u32() != snapshot_magic || r.u32() != snapshot_version) {
+		return false;
+	}
+
+	while (!r.empty()) {
+		std::string key(r.raw());
+		std::string block(r.raw());
+		if (r.failed()) {
+			return false;
+		}
+		pending[std::move(key)] = std::move(block);
+	}
+
+	return true;
+}
+
+bool over_limits(int64_t listings, int64_t files)
+{
+	return (listings > 50000) ||
+		(files > 1000000 && listings > 1000) ||
+		(files > 5000000 && listings > 100);
+}
+}
+
+
+CDirectoryCache::CDirectoryCache()
 {
-	fz::scoped_lock lock(mutex_);
+}
 
-	tServerIter sit = CreateServerEntry(server);
-	assert(sit != m_serverList.end());
+CDirectoryCache::~CDirectoryCache()
+{
+}
+
+CDirectoryCache::Shard& CDirectoryCache::GetShard(std::string const& key)
+{
+	return shards_[std::hash<std::string>{}(key) % shard_count];
+}
+
+fz::duration CDirectoryCache::ttl() const
+{
+	return fz::duration::from_milliseconds(ttl_);
+}
+
+void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& server)
+{
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	m_totalFileCount += listing.size();
+	CServerEntry & sentry = CreateServerEntry(shard, key, server);
 
 	tCacheIter cit;
 	bool unused;
-	if (Lookup(cit, sit, listing.path, true, unused)) {
-		auto & entry = const_cast<CCacheEntry&>(*cit);
-		entry.modificationTime = fz::monotonic_clock::now();
+	if (Lookup(cit, shard, sentry, listing.path, true, unused)) {
+		cit->modificationTime = fz::monotonic_clock::now();
 
-		m_totalFileCount -= cit->listing.size();
-		entry.listing = listing;
+		UpdateCounts(shard, 0, static_cast<int64_t>(listing.size()) - static_cast<int64_t>(cit->listing.size()));
+		cit->listing = listing;
 
+		Prune(shard, cit);
 		return;
 	}
 
-	cit = sit->cacheList.emplace_hint(cit, listing);
-
-	UpdateLru(sit, cit);
+	cit = AddEntry(shard, sentry, listing);
 
-	Prune();
+	Prune(shard, cit);
 }
 
 bool CDirectoryCache::Lookup(CDirectoryListing &listing, CServer const& server, const CServerPath &path, bool allowUnsureEntries, bool& is_outdated)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return false;
 	}
 
 	tCacheIter iter;
-	if (Lookup(iter, sit, path, allowUnsureEntries, is_outdated)) {
+	if (Lookup(iter, shard, *sentry, path, allowUnsureEntries, is_outdated)) {
 		listing = iter->listing;
 		return true;
 	}
@@ -72,41 +339,37 @@ bool CDirectoryCache::Lookup(CDirectoryListing &listing, CServer const& server,
 	return false;
 }
 
-bool CDirectoryCache::Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated)
+bool CDirectoryCache::Lookup(tCacheIter &cacheIter, Shard & shard, CServerEntry & sentry, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated)
 {
-	CCacheEntry dummy;
-	dummy.listing.path = path;
-	cacheIter = sit->cacheList.lower_bound(dummy);
-
-	if (cacheIter != sit->cacheList.end()) {
-		CCacheEntry const& entry = *cacheIter;
-
-		if (entry.listing.path == path) {
-			UpdateLru(sit, cacheIter);
+	auto it = sentry.entries.find(path.GetSafePath());
+	if (it == sentry.entries.end()) {
+		return false;
+	}
 
-			if (!allowUnsureEntries && entry.listing.get_unsure_flags()) {
-				return false;
-			}
+	cacheIter = it->second;
+	UpdateLru(shard, cacheIter);
 
-			is_outdated = (fz::monotonic_clock::now() - entry.listing.m_firstListTime) > ttl_;
-			return true;
-		}
+	if (!allowUnsureEntries && cacheIter->listing.get_unsure_flags()) {
+		return false;
 	}
 
-	return false;
+	is_outdated = (fz::monotonic_clock::now() - cacheIter->listing.m_firstListTime) > ttl();
+	return true;
 }
 
 bool CDirectoryCache::DoesExist(CServer const& server, CServerPath const& path, int &hasUnsureEntries, bool &is_outdated)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return false;
 	}
 
 	tCacheIter iter;
-	if (Lookup(iter, sit, path, true, is_outdated)) {
+	if (Lookup(iter, shard, *sentry, path, true, is_outdated)) {
 		hasUnsureEntries = iter->listing.get_unsure_flags();
 		return true;
 	}
@@ -119,16 +382,18 @@ std::tuple<LookupResults, CDirentry> CDirectoryCache::LookupFile(CServer const&
 	LookupResults results{};
 	CDirentry entry;
 
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return {results, entry};
 	}
 
 	tCacheIter iter;
 	bool outdated{};
-	if (!Lookup(iter, sit, path, true, outdated)) {
+	if (!Lookup(iter, shard, *sentry, path, true, outdated)) {
 		return {results, entry};
 	}
 
@@ -141,8 +406,7 @@ std::tuple<LookupResults, CDirentry> CDirectoryCache::LookupFile(CServer const&
 
 	results |= LookupResults::direxists;
 
-	CCacheEntry const& cacheEntry = *iter;
-	CDirectoryListing const& listing = cacheEntry.listing;
+	CDirectoryListing const& listing = iter->listing;
 
 	size_t i = listing.FindFile_CmpCase(filename);
 	if (i != std::string::npos) {
@@ -164,16 +428,18 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 {
 	std::vector<std::tuple<LookupResults, CDirentry>> ret;
 
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return ret;
 	}
 
 	tCacheIter iter;
 	bool outdated{};
-	if (!Lookup(iter, sit, path, true, outdated)) {
+	if (!Lookup(iter, shard, *sentry, path, true, outdated)) {
 		return ret;
 	}
 
@@ -188,8 +454,7 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 
 	results |= LookupResults::direxists;
 
-	CCacheEntry const& cacheEntry = *iter;
-	CDirectoryListing const& listing = cacheEntry.listing;
+	CDirectoryListing const& listing = iter->listing;
 
 	ret.reserve(filenames.size());
 
@@ -216,24 +481,25 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 
 bool CDirectoryCache::LookupFile(CDirentry &entry, CServer const& server, CServerPath const& path, std::wstring const& filename, bool &dirDidExist, bool &matchedCase)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		dirDidExist = false;
 		return false;
 	}
 
 	tCacheIter iter;
 	bool unused;
-	if (!Lookup(iter, sit, path, true, unused)) {
+	if (!Lookup(iter, shard, *sentry, path, true, unused)) {
 		dirDidExist = false;
 		return false;
 	}
 	dirDidExist = true;
 
-	const CCacheEntry &cacheEntry = *iter;
-	const CDirectoryListing &listing = cacheEntry.listing;
+	const CDirectoryListing &listing = iter->listing;
 
 	size_t i = listing.FindFile_CmpCase(filename);
 	if (i != std::string::npos) {
@@ -251,36 +517,53 @@ bool CDirectoryCache::LookupFile(CDirentry &entry, CServer const& server, CServe
 	return false;
 }
 
+namespace {
+// Collects the entries whose path matches case-insensitively
+template<typename Index>
+std::vector<typename Index::mapped_type> find_nocase(Index const& index, CServerPath const& path)
+{
+	std::vector<typename Index::mapped_type> ret;
+	auto const range = index.equal_range(fz::str_tolower(path.GetSafePath()));
+	for (auto it = range.first; it != range.second; ++it) {
+		ret.push_back(it->second);
+	}
+	return ret;
+}
+}
+
 bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return false;
 	}
 
 	bool const cmpCase = server.GetCaseSensitivity() == CaseSensitivity::yes;
 	bool dir{};
 
-	auto const now = fz::monotonic_clock::now();
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
-
-		if (cmpCase) {
-			if (path != entry.listing.path) {
-				continue;
-			}
-		}
-		else {
-			if (!path.equal_nocase(entry.listing.path)) {
-				continue;
-			}
+	std::vector<tCacheIter> matches;
+	if (cmpCase) {
+		auto it = sentry->entries.find(path.GetSafePath());
+		if (it != sentry->entries.end()) {
+			matches.push_back(it->second);
 		}
+	}
+	else {
+		matches = find_nocase(sentry->entries_nocase, path);
+	}
+
+	auto const now = fz::monotonic_clock::now();
+	for (auto const& iter : matches) {
+		auto & entry = *iter;
 
-		UpdateLru(sit, iter);
+		UpdateLru(shard, iter);
 
-		for (unsigned int i = 0; i < entry.listing.size(); i++) {
+		size_t const first = cmpCase ? entry.listing.FindFile_CmpCase(filename) : entry.listing.FindFile_CmpNoCase(filename);
+		for (size_t i = first; i < entry.listing.size(); i++) {
 			bool same;
 			if (cmpCase) {
 				same = filename == entry.listing[i].name;
@@ -302,8 +585,8 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 	if (dir) {
 		CServerPath child = path;
 		if (child.ChangePath(filename)) {
-			for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
-				auto & entry = const_cast<CCacheEntry&>(*iter);
+			for (auto & [k, iter] : sentry->entries) {
+				auto & entry = *iter;
 				if (path.IsParentOf(entry.listing.path, !cmpCase, true)) {
 					entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
 					entry.modificationTime = now;
@@ -317,33 +600,38 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 
 bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return false;
 	}
 
 	bool updated = false;
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
-		if (!path.equal_nocase(entry.listing.path)) {
-			continue;
-		}
-
-		UpdateLru(sit, iter);
-
-		bool matchCase = false;
-		size_t i;
-		for (i = 0; i < entry.listing.size(); ++i) {
-			if (!fz::stricmp(filename, entry.listing[i].name)) {
-				entry.listing.get(i).flags |= CDirentry::flag_unsure;
-				if (entry.listing[i].name == filename) {
-					matchCase = true;
-					break;
+	for (auto const& iter : find_nocase(sentry->entries_nocase, path)) {
+		auto & entry = *iter;
+
+		UpdateLru(shard, iter);
+
+		// Marks all entries matching case-insensitively up to the first
+		// exact match as unsure. Using the name index, only the rare case
+		// of multiple such entries needs to look at all entries.
+		size_t i = entry.listing.FindFile_CmpCase(filename);
+		bool const matchCase = i != std::wstring::npos;
+		size_t const first = entry.listing.FindFile_CmpNoCase(filename);
+		if (first != std::wstring::npos) {
+			size_t const end = matchCase ? i : entry.listing.size();
+			for (size_t j = first; j < end; ++j) {
+				if (!fz::stricmp(filename, entry.listing[j].name)) {
+					entry.listing.get(j).flags |= CDirentry::flag_unsure;
 				}
 			}
+			if (matchCase) {
+				entry.listing.get(i).flags |= CDirentry::flag_unsure;
+			}
 		}
 
 		if (matchCase) {
@@ -384,7 +672,7 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 			}
 			entry.listing.Append(std::move(direntry));
 
-			++m_totalFileCount;
+			UpdateCounts(shard, 0, 1);
 		}
 		else {
 			entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
@@ -399,44 +687,32 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 
 bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return false;
 	}
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
-		if (!path.equal_nocase(entry.listing.path)) {
-			continue;
-		}
-
-		UpdateLru(sit, iter);
+	for (auto const& iter : find_nocase(sentry->entries_nocase, path)) {
+		auto & entry = *iter;
 
-		bool matchCase = false;
-		for (size_t i = 0; i < entry.listing.size(); ++i) {
-			if (entry.listing[i].name == filename) {
-				matchCase = true;
-			}
-		}
-
-		if (matchCase) {
-			size_t i;
-			for (i = 0; i < entry.listing.size(); ++i) {
-				if (entry.listing[i].name == filename) {
-					break;
-				}
-			}
-			assert(i != entry.listing.size());
+		UpdateLru(shard, iter);
 
+		size_t const i = entry.listing.FindFile_CmpCase(filename);
+		if (i != std::wstring::npos) {
 			entry.listing.RemoveEntry(i); // This does set m_hasUnsureEntries
-			--m_totalFileCount;
+			UpdateCounts(shard, 0, -1);
 		}
 		else {
-			for (size_t i = 0; i < entry.listing.size(); ++i) {
-				if (!fz::stricmp(filename, entry.listing[i].name)) {
-					entry.listing.get(i).flags |= CDirentry::flag_unsure;
+			size_t const first = entry.listing.FindFile_CmpNoCase(filename);
+			if (first != std::wstring::npos) {
+				for (size_t j = first; j < entry.listing.size(); ++j) {
+					if (!fz::stricmp(filename, entry.listing[j].name)) {
+						entry.listing.get(j).flags |= CDirentry::flag_unsure;
+					}
 				}
 			}
 			entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
@@ -447,42 +723,95 @@ bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path,
 	return true;
 }
 
-void CDirectoryCache::InvalidateServer(CServer const& server)
+bool CDirectoryCache::RemoveFiles(CServer const& server, CServerPath const& path, std::vector<std::wstring> const& filenames)
 {
-	fz::scoped_lock lock(mutex_);
+	if (filenames.empty()) {
+		return true;
+	}
 
-	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (!iter->server.SameContent(server)) {
-			continue;
-		}
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-		for (tCacheIter cit = iter->cacheList.begin(); cit != iter->cacheList.end(); ++cit) {
-			tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
+		return false;
+	}
+
+	for (auto const& iter : find_nocase(sentry->entries_nocase, path)) {
+		auto & entry = *iter;
+
+		UpdateLru(shard, iter);
+
+		std::vector<size_t> indexes;
+		indexes.reserve(filenames.size());
+		for (auto const& filename : filenames) {
+			size_t const i = entry.listing.FindFile_CmpCase(filename);
+			if (i != std::wstring::npos) {
+				indexes.push_back(i);
+				continue;
 			}
 
-			m_totalFileCount -= cit->listing.size();
+			if (entry.listing.FindFile_CmpNoCase(filename) != std::wstring::npos) {
+				for (size_t j = 0; j < entry.listing.size(); ++j) {
+					if (!fz::stricmp(filename, entry.listing[j].name)) {
+						entry.listing.get(j).flags |= CDirentry::flag_unsure;
+					}
+				}
+			}
+			entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
 		}
 
-		m_serverList.erase(iter);
-		break;
+		std::sort(indexes.begin(), indexes.end());
+		indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+		size_t const removed = entry.listing.RemoveEntries(indexes); // This does set m_hasUnsureEntries
+		UpdateCounts(shard, 0, -static_cast<int64_t>(removed));
+		entry.modificationTime = fz::monotonic_clock::now();
 	}
+
+	return true;
+}
+
+void CDirectoryCache::InvalidateServer(CServer const& server)
+{
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
+
+	if (hasPending_) {
+		fz::scoped_lock l(snapshotMutex_);
+		ReadSnapshot();
+		pending_.erase(key);
+	}
+
+	auto it = shard.servers_.find(key);
+	if (it == shard.servers_.end()) {
+		return;
+	}
+
+	for (auto & [k, iter] : it->second.entries) {
+		UpdateCounts(shard, -1, -static_cast<int64_t>(iter->listing.size()));
+		shard.lru_.erase(iter);
+	}
+
+	shard.servers_.erase(it);
 }
 
 bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& server, CServerPath const& path)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return false;
 	}
 
 	tCacheIter iter;
 	bool unused;
-	if (Lookup(iter, sit, path, true, unused)) {
+	if (Lookup(iter, shard, *sentry, path, true, unused)) {
 		time = iter->modificationTime;
 		return true;
 	}
@@ -492,13 +821,15 @@ bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& se
 
 void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename, CServerPath const&)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
 	// TODO: This is not 100% foolproof and may not work properly
 	// Perhaps just throw away the complete cache?
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return;
 	}
 
@@ -507,20 +838,16 @@ void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path,
 		absolutePath.clear();
 	}
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
+	if (!absolutePath.empty()) {
 		// Delete exact matches and subdirs
-		if (!absolutePath.empty() && (entry.listing.path == absolutePath || absolutePath.IsParentOf(entry.listing.path, true))) {
-			m_totalFileCount -= entry.listing.size();
-			tLruList::iterator* lruIt = (tLruList::iterator*)iter->lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
+		std::vector<tCacheIter> remove;
+		for (auto const& [k, iter] : sentry->entries) {
+			if (iter->listing.path == absolutePath || absolutePath.IsParentOf(iter->listing.path, true)) {
+				remove.push_back(iter);
 			}
-			sit->cacheList.erase(iter++);
 		}
-		else {
-			++iter;
+		for (auto const& iter : remove) {
+			RemoveEntry(shard, iter);
 		}
 	}
 
@@ -529,18 +856,20 @@ void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path,
 
 void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom, std::wstring const& fileFrom, CServerPath const& pathTo, std::wstring const& fileTo)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return;
 	}
 
 	tCacheIter iter;
 	bool is_outdated = false;
-	bool found = Lookup(iter, sit, pathFrom, true, is_outdated);
+	bool found = Lookup(iter, shard, *sentry, pathFrom, true, is_outdated);
 	if (found) {
-		auto & listing = const_cast<CDirectoryListing&>(iter->listing);
+		auto & listing = iter->listing;
 		if (pathFrom == pathTo) {
 			RemoveFile(server, pathFrom, fileTo);
 			size_t i;
@@ -591,18 +920,20 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 
 void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const& path, std::wstring const& filename, std::wstring& ownerGroup)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string const key = make_server_key(server);
+	Shard & shard = GetShard(key);
+	fz::scoped_lock lock(shard.mutex_);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	CServerEntry* sentry = GetServerEntry(shard, key, server);
+	if (!sentry) {
 		return;
 	}
 
 	tCacheIter iter;
 	bool is_outdated = false;
-	bool found = Lookup(iter, sit, path, true, is_outdated);
+	bool found = Lookup(iter, shard, *sentry, path, true, is_outdated);
 	if (found) {
-		auto & listing = const_cast<CDirectoryListing&>(iter->listing);
+		auto & listing = iter->listing;
 		size_t i;
 		for (i = 0; i < listing.size(); ++i) {
 			if (listing[i].name == filename) {
@@ -623,75 +954,303 @@ void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const&
 }
 
 
-CDirectoryCache::tServerIter CDirectoryCache::CreateServerEntry(CServer const& server)
+CDirectoryCache::CServerEntry& CDirectoryCache::CreateServerEntry(Shard & shard, std::string const& key, CServer const& server)
 {
-	for (tServerIter iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (iter->server.SameContent(server)) {
-			return iter;
-		}
+	LoadPending(shard, key, server);
+
+	return shard.servers_.try_emplace(key, server).first->second;
+}
+
+CDirectoryCache::CServerEntry* CDirectoryCache::GetServerEntry(Shard & shard, std::string const& key, CServer const& server)
+{
+	LoadPending(shard, key, server);
+
+	auto it = shard.servers_.find(key);
+	if (it == shard.servers_.end()) {
+		return nullptr;
 	}
-	m_serverList.emplace_back(server);
 
-	return --m_serverList.end();
+	return &it->second;
 }
 
-CDirectoryCache::tServerIter CDirectoryCache::GetServerEntry(CServer const& server)
+CDirectoryCache::tCacheIter CDirectoryCache::AddEntry(Shard & shard, CServerEntry & sentry, CDirectoryListing const& listing)
 {
-	tServerIter iter;
-	for (iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (iter->server.SameContent(server)) {
+	tCacheIter iter = shard.lru_.emplace(shard.lru_.end(), listing, sentry);
+	iter->key = listing.path.GetSafePath();
+	iter->key_nocase = fz::str_tolower(iter->key);
+	iter->lastUse = ++useCounter_;
+
+	sentry.entries.emplace(iter->key, iter);
+	sentry.entries_nocase.emplace(iter->key_nocase, iter);
+
+	UpdateCounts(shard, 1, listing.size());
+
+	return iter;
+}
+
+void CDirectoryCache::RemoveEntry(Shard & shard, tCacheIter const& iter)
+{
+	CServerEntry & sentry = *iter->server;
+
+	auto range = sentry.entries_nocase.equal_range(iter->key_nocase);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == iter) {
+			sentry.entries_nocase.erase(it);
 			break;
 		}
 	}
+	sentry.entries.erase(iter->key);
 
-	return iter;
+	UpdateCounts(shard, -1, -static_cast<int64_t>(iter->listing.size()));
+
+	shard.lru_.erase(iter);
+
+	if (sentry.entries.empty()) {
+		for (auto it = shard.servers_.begin(); it != shard.servers_.end(); ++it) {
+			if (&it->second == &sentry) {
+				shard.servers_.erase(it);
+				break;
+			}
+		}
+	}
+}
+
+void CDirectoryCache::UpdateLru(Shard & shard, tCacheIter const& iter)
+{
+	shard.lru_.splice(shard.lru_.end(), shard.lru_, iter);
+	iter->lastUse = ++useCounter_;
 }
 
-void CDirectoryCache::UpdateLru(tServerIter const& sit, tCacheIter const& cit)
+void CDirectoryCache::UpdateCounts(Shard & shard, int64_t listings, int64_t files)
 {
-	tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
-	if (lruIt) {
-		m_leastRecentlyUsedList.splice(m_leastRecentlyUsedList.end(), m_leastRecentlyUsedList, *lruIt);
-		**lruIt = std::make_pair(sit, cit);
+	shard.listingCount_ += listings;
+	shard.fileCount_ += files;
+	m_totalListingCount += listings;
+	m_totalFileCount += files;
+}
+
+void CDirectoryCache::Prune(Shard & shard, tCacheIter const& keep)
+{
+	// The limits are global, but a shard only holds its own lock. While the
+	// cache as a whole is over the limits, evict from this shard until it is
+	// within its share, the remainder is left to the other shards.
+	while (!shard.lru_.empty() && shard.lru_.begin() != keep &&
+		over_limits(m_totalListingCount, m_totalFileCount) &&
+		over_limits(shard.listingCount_ * shard_count, shard.fileCount_ * shard_count))
+	{
+		RemoveEntry(shard, shard.lru_.begin());
+	}
+}
+
+void CDirectoryCache::SetTtl(fz::duration const& ttl)
+{
+	if (ttl < fz::duration::from_seconds(30)) {
+		ttl_ = fz::duration::from_seconds(30).get_milliseconds();
+	}
+	else if (ttl > fz::duration::from_days(1)) {
+		ttl_ = fz::duration::from_days(1).get_milliseconds();
 	}
 	else {
-		auto & entry = const_cast<CCacheEntry&>(*cit);
-		entry.lruIt = (void*)new tLruList::iterator(m_leastRecentlyUsedList.emplace(m_leastRecentlyUsedList.end(), sit, cit));
+		ttl_ = ttl.get_milliseconds();
 	}
 }
 
-void CDirectoryCache::Prune()
+void CDirectoryCache::SetSnapshotFile(std::wstring const& file)
+{
+	fz::scoped_lock l(snapshotMutex_);
+	snapshotFile_ = file;
+	hasPending_ = !snapshotFile_.empty() || !pending_.empty();
+}
+
+bool CDirectoryCache::Load()
 {
-	while ((m_leastRecentlyUsedList.size() > 50000) ||
-		(m_totalFileCount > 1000000 && m_leastRecentlyUsedList.size() > 1000) ||
-		(m_totalFileCount > 5000000 && m_leastRecentlyUsedList.size() > 100))
+	fz::scoped_lock l(snapshotMutex_);
+	return ReadSnapshot();
+}
+
+bool CDirectoryCache::ReadSnapshot()
+{
+	if (snapshotFile_.empty()) {
+		return true;
+	}
+	std::wstring const file = std::move(snapshotFile_);
+	snapshotFile_.clear();
+
+	bool const ret = read_snapshot(file, pending_);
+
+	hasPending_ = !pending_.empty();
+	return ret;
+}
+
+void CDirectoryCache::LoadPending(Shard & shard, std::string const& key, CServer const& server)
+{
+	if (!hasPending_) {
+		return;
+	}
+
+	std::string block;
 	{
-		tFullEntryPosition pos = m_leastRecentlyUsedList.front();
-		tLruList::iterator* lruIt = (tLruList::iterator*)pos.second->lruIt;
-		delete lruIt;
+		fz::scoped_lock l(snapshotMutex_);
+		ReadSnapshot();
+
+		auto it = pending_.find(key);
+		if (it == pending_.end()) {
+			return;
+		}
+
+		block = std::move(it->second);
+		pending_.erase(it);
+		hasPending_ = !pending_.empty();
+	}
+
+	CServerEntry* sentry{};
+
+	auto const now = fz::datetime::now();
+	auto const monotonic_now = fz::monotonic_clock::now();
+	auto const maxAge = ttl();
 
-		m_totalFileCount -= pos.second->listing.size();
+	CStringCache strings;
 
-		pos.first->cacheList.erase(pos.second);
-		if (pos.first->cacheList.empty()) {
-			m_serverList.erase(pos.first);
+	snapshot_reader r(block);
+	while (!r.empty()) {
+		CDirectoryListing listing;
+		fz::datetime listTime;
+		if (!read_listing(r, strings, listing, listTime)) {
+			break;
 		}
 
-		m_leastRecentlyUsedList.pop_front();
+		auto const age = now - listTime;
+		if (age < fz::duration() || age > maxAge) {
+			continue;
+		}
+		listing.m_firstListTime = monotonic_now - age;
+
+		if (!sentry) {
+			sentry = &shard.servers_.try_emplace(key, server).first->second;
+		}
+		else if (sentry->entries.find(listing.path.GetSafePath()) != sentry->entries.end()) {
+			continue;
+		}
+
+		tCacheIter iter = AddEntry(shard, *sentry, listing);
+		iter->modificationTime = listing.m_firstListTime;
+	}
+
+	if (sentry && sentry->entries.empty()) {
+		shard.servers_.erase(key);
 	}
+
+	Prune(shard, shard.lru_.end());
 }
 
-void CDirectoryCache::SetTtl(fz::duration const& ttl)
+bool CDirectoryCache::Save(std::wstring const& file, int64_t maxSize)
 {
-	fz::scoped_lock lock(mutex_);
+	std::string data;
+	{
+		// Always locked in the same order, no other code path holds
+		// more than one shard lock.
+		for (auto & shard : shards_) {
+			shard.mutex_.lock();
+		}
+		fz::scoped_lock l(snapshotMutex_);
+		ReadSnapshot();
+
+		auto const now = fz::datetime::now();
+		auto const monotonic_now = fz::monotonic_clock::now();
+		auto const maxAge = ttl();
+
+		// Merge the shards by recency
+		std::vector<CCacheEntry const*> entries;
+		entries.reserve(static_cast<size_t>(m_totalListingCount));
+		for (auto const& shard : shards_) {
+			for (auto const& entry : shard.lru_) {
+				entries.push_back(&entry);
+			}
+		}
+		std::sort(entries.begin(), entries.end(), [](CCacheEntry const* lhs, CCacheEntry const* rhs) {
+			return lhs->lastUse > rhs->lastUse;
+		});
+
+		// Pick most recently used listings until the size limit is reached
+		std::map<CServerEntry const*, std::vector<std::string>> blocks;
+		int64_t total{8};
+		for (auto const* entry : entries) {
+			if (total >= maxSize) {
+				break;
+			}
+			if (entry->listing.get_unsure_flags() || entry->listing.failed()) {
+				continue;
+			}
+			auto const age = monotonic_now - entry->listing.m_firstListTime;
+			if (age > maxAge) {
+				continue;
+			}
 
-	if (ttl < fz::duration::from_seconds(30)) {
-		ttl_ = fz::duration::from_seconds(30);
-	}
-	else if (ttl > fz::duration::from_days(1)) {
-		ttl_ = fz::duration::from_days(1);
+			snapshot_writer w;
+			write_listing(w, entry->listing, now - age);
+			total += w.data_.size();
+			if (total > maxSize) {
+				break;
+			}
+			blocks[entry->server].emplace_back(std::move(w.data_));
+		}
+
+		snapshot_writer w;
+		w.u32(snapshot_magic);
+		w.u32(snapshot_version);
+
+		for (auto const& shard : shards_) {
+			for (auto const& [key, serverEntry] : shard.servers_) {
+				auto it = blocks.find(&serverEntry);
+				if (it == blocks.end()) {
+					continue;
+				}
+				std::string block;
+				// Oldest first, so that loading restores the LRU order
+				for (auto lit = it->second.rbegin(); lit != it->second.rend(); ++lit) {
+					block += *lit;
+				}
+				w.str(key);
+				w.str(block);
+			}
+		}
+
+		// Keep data of servers not accessed during this session
+		for (auto const& [key, block] : pending_) {
+			if (total + static_cast<int64_t>(key.size() + block.size()) > maxSize) {
+				continue;
+			}
+			total += key.size() + block.size();
+			w.str(key);
+			w.str(block);
+		}
+
+		data = std::move(w.data_);
+
+		for (auto & shard : shards_) {
+			shard.mutex_.unlock();
+		}
 	}
-	else {
-		ttl_ = ttl;
+
+	std::wstring const tmp = file + L".tmp";
+	{
+		fz::file f(fz::to_native(tmp), fz::file::writing, fz::file::empty);
+		if (!f.opened()) {
+			return false;
+		}
+		char const* p = data.data();
+		size_t left = data.size();
+		while (left) {
+			fz::rwresult written = f.write2(p, left);
+			if (!written) {
+				f.close();
+				fz::remove_file(fz::to_native(tmp));
+				return false;
+			}
+			p += written.value_;
+			left -= written.value_;
+		}
 	}
+
+	return fz::rename_file(fz::to_native(tmp), fz::to_native(file));
 }
@@ -18,8 +18,12 @@ version.
 
 #include <libfilezilla/mutex.hpp>
 
+#include <array>
+#include <atomic>
 #include <list>
-#include <set>
+#include <map>
+#include <string_view>
+#include <unordered_map>
 
 enum class LookupFlags
 {
@@ -95,6 +99,10 @@ public:
 	bool InvalidateFile(CServer const& server, CServerPath const& path, std::wstring const& filename);
 	bool UpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type = file, int64_t size = -1, std::wstring const& ownerGroup = std::wstring{});
 	bool RemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename);
+
+	// Same as calling RemoveFile for each of the files, but takes the lock
+	// and rebuilds the affected listings only once
+	bool RemoveFiles(CServer const& server, CServerPath const& path, std::vector<std::wstring> const& filenames);
 	void InvalidateServer(CServer const& server);
 	void RemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename, CServerPath const& target);
 	void Rename(CServer const& server, CServerPath const& pathFrom, std::wstring const& fileFrom, CServerPath const& pathTo, std::wstring const& fileTo);
@@ -102,70 +110,118 @@ public:
 
 	void SetTtl(fz::duration const& ttl);
 
+	// Sets the snapshot written by Save to restore the cache from. The file
+	// is read by Load, or by the first access to the cache if Load has not
+	// run yet. The listings of a server are only decoded once that server is
+	// first accessed, entries older than the TTL are discarded at that point.
+	void SetSnapshotFile(std::wstring const& file);
+	bool Load();
+
+	// Writes the cache to the given file, most recently used listings
+	// first, until maxSize bytes are reached.
+	bool Save(std::wstring const& file, int64_t maxSize);
+
 protected:
+	class CServerEntry;
 
 	class CCacheEntry final
 	{
 	public:
-		CCacheEntry() = default;
-		CCacheEntry(CCacheEntry const& entry) = default;
-		CCacheEntry(CCacheEntry && entry) noexcept = default;
-
-		explicit CCacheEntry(CDirectoryListing const& l)
+		CCacheEntry(CDirectoryListing const& l, CServerEntry & s)
 			: listing(l)
 			, modificationTime(fz::monotonic_clock::now())
+			, server(&s)
 		{}
 
 		CDirectoryListing listing;
 		fz::monotonic_clock modificationTime;
 
-		CCacheEntry& operator=(CCacheEntry const& a) = default;
-		CCacheEntry& operator=(CCacheEntry && a) noexcept = default;
+		CServerEntry* server{};
 
-		void* lruIt{}; // void* to break cyclic declaration dependency
+		// Interned keys of the path, referenced by the server's indexes
+		std::wstring key;
+		std::wstring key_nocase;
 
-		bool operator<(CCacheEntry const& op) const noexcept {
-			return listing.path < op.listing.path;
-		}
+		// Stamp of the last access, orders entries across shards
+		uint64_t lastUse{};
 	};
 
+	// All entries of a shard, least recently used first. Being a list,
+	// entries can be moved to the back in constant time without
+	// invalidating iterators.
+	typedef std::list<CCacheEntry> tLruList;
+	typedef tLruList::iterator tCacheIter;
+
 	class CServerEntry final
 	{
 	public:
-		CServerEntry() {}
 		explicit CServerEntry(CServer const& s)
 			: server(s)
 		{}
 
 		CServer server;
-		std::set<CCacheEntry> cacheList;
+		std::unordered_map<std::wstring_view, tCacheIter> entries;
+		std::unordered_multimap<std::wstring_view, tCacheIter> entries_nocase;
+	};
+
+	// Servers are distributed over the shards by their fingerprint, each
+	// shard having its own lock. Recency is tracked per shard.
+	class Shard final
+	{
+	public:
+		fz::mutex mutex_;
+
+		// Keyed by server fingerprint
+		std::unordered_map<std::string, CServerEntry> servers_;
+
+		tLruList lru_;
+
+		// This shard's part of the totals
+		int64_t listingCount_{};
+		int64_t fileCount_{};
 	};
 
-	typedef std::list<CServerEntry>::iterator tServerIter;
+	Shard& GetShard(std::string const& key);
+
+	CServerEntry& CreateServerEntry(Shard & shard, std::string const& key, CServer const& server);
+	CServerEntry* GetServerEntry(Shard & shard, std::string const& key, CServer const& server);
+
+	// Decodes the snapshot data of the given server, if any
+	void LoadPending(Shard & shard, std::string const& key, CServer const& server);
+
+	// Reads the snapshot file unless already done, requires snapshotMutex_
+	bool ReadSnapshot();
+
+	bool Lookup(tCacheIter &cacheIter, Shard & shard, CServerEntry & sentry, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
 
-	tServerIter CreateServerEntry(const CServer& server);
-	tServerIter GetServerEntry(const CServer& server);
+	tCacheIter AddEntry(Shard & shard, CServerEntry & sentry, CDirectoryListing const& listing);
+	void RemoveEntry(Shard & shard, tCacheIter const& iter);
 
-	typedef std::set<CCacheEntry>::iterator tCacheIter;
-	typedef std::set<CCacheEntry>::const_iterator tCacheConstIter;
+	void UpdateLru(Shard & shard, tCacheIter const& iter);
 
-	bool Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
+	void UpdateCounts(Shard & shard, int64_t listings, int64_t files);
 
-	fz::mutex mutex_;
+	// Evicts least recently used entries of the shard, never keep
+	void Prune(Shard & shard, tCacheIter const& keep);
 
-	std::list<CServerEntry> m_serverList;
+	fz::duration ttl() const;
 
-	void UpdateLru(tServerIter const& sit, tCacheIter const& cit);
+	static constexpr size_t shard_count = 16;
+	std::array<Shard, shard_count> shards_;
 
-	void Prune();
+	std::atomic<int64_t> m_totalListingCount{};
+	std::atomic<int64_t> m_totalFileCount{};
+	std::atomic<uint64_t> useCounter_{};
 
-	typedef std::pair<tServerIter, tCacheIter> tFullEntryPosition;
-	typedef std::list<tFullEntryPosition> tLruList;
-	tLruList m_leastRecentlyUsedList;
+	std::atomic<int64_t> ttl_{600 * 1000}; // In milliseconds
 
-	int64_t m_totalFileCount{};
+	// Only ever locked after shard locks, not the other way around
+	fz::mutex snapshotMutex_;
+	std::wstring snapshotFile_; // Not yet read if non-empty
 
-	fz::duration ttl_{fz::duration::from_seconds(600)};
+	// Not yet decoded snapshot data, keyed by server fingerprint
+	std::map<std::string, std::string> pending_;
+	std::atomic<bool> hasPending_{};
 };
 
 #endif
@@ -3,6 +3,8 @@
 #include <libfilezilla/format.hpp>
 
 #include <algorithm>
+#include <cmath>
+#include <string_view>
 
 void CDirentry::clear()
 {
@@ -55,36 +57,60 @@ bool CDirentry::operator==(const CDirentry &op) const
 	return true;
 }
 
+std::pair<size_t, size_t> CDirectoryListing::entry_blocks::locate(size_t index) const
+{
+	if (offsets_.empty()) {
+		return {index >> block_shift, index & block_mask};
+	}
+
+	size_t const b = static_cast<size_t>(std::upper_bound(offsets_.cbegin(), offsets_.cend(), index) - offsets_.cbegin()) - 1;
+	return {b, index - offsets_[b]};
+}
+
 const CDirentry& CDirectoryListing::operator[](size_t index) const
 {
-	return *(*m_entries)[index];
+	auto const [b, i] = m_entries->locate(index);
+	return (*m_entries->blocks_[b])[i];
 }
 
 CDirentry& CDirectoryListing::get(size_t index)
 {
 	// Commented out, too heavy speed penalty
 	// assert(index < m_entryCount);
-	return m_entries.get()[index].get();
+	entry_blocks & entries = m_entries.get();
+	auto const [b, i] = entries.locate(index);
+	return entries.blocks_[b].get()[i];
 }
 
-void CDirectoryListing::Assign(std::vector<fz::shared_value<CDirentry>> && entries)
+void CDirectoryListing::Assign(std::vector<CDirentry> && entries)
 {
-	std::vector<fz::shared_value<CDirentry>> & own_entries = m_entries.get();
-	own_entries = std::move(entries);
+	entry_blocks & own_entries = m_entries.get();
+	own_entries.blocks_.clear();
+	own_entries.blocks_.reserve((entries.size() + block_mask) >> block_shift);
+	own_entries.offsets_.clear();
+	own_entries.size_ = entries.size();
 
 	m_flags &= ~(listing_has_dirs | listing_has_perms | listing_has_usergroup);
 
-	for (auto const& entry : own_entries) {
-		if (entry->is_dir()) {
+	for (size_t i = 0; i < entries.size(); ++i) {
+		CDirentry & entry = entries[i];
+		if (entry.is_dir()) {
 			m_flags |= listing_has_dirs;
 		}
-		if (!entry->permissions->empty()) {
+		if (!entry.permissions->empty()) {
 			m_flags |= listing_has_perms;
 		}
-		if (!entry->ownerGroup->empty()) {
+		if (!entry.ownerGroup->empty()) {
 			m_flags |= listing_has_usergroup;
 		}
+
+		if (!(i & block_mask)) {
+			own_entries.blocks_.emplace_back();
+			own_entries.blocks_.back().get().reserve(std::min(block_size, entries.size() - i));
+		}
+		own_entries.blocks_.back().get().emplace_back(std::move(entry));
 	}
+	entries.clear();
 
 	m_searchmap_case.clear();
 	m_searchmap_nocase.clear();
@@ -96,121 +122,356 @@ bool CDirectoryListing::RemoveEntry(size_t index)
 		return false;
 	}
 
-	m_searchmap_case.clear();
-	m_searchmap_nocase.clear();
+	RemoveEntries({index});
+
+	return true;
+}
 
-	std::vector<fz::shared_value<CDirentry> >& entries = m_entries.get();
-	std::vector<fz::shared_value<CDirentry> >::iterator iter = entries.begin() + index;
-	if ((*iter)->is_dir()) {
-		m_flags |= CDirectoryListing::unsure_dir_removed;
+size_t CDirectoryListing::RemoveEntries(std::vector<size_t> const& indexes)
+{
+	if (indexes.empty() || indexes.front() >= size()) {
+		return 0;
 	}
-	else {
-		m_flags |= CDirectoryListing::unsure_file_removed;
+
+	entry_blocks & entries = m_entries.get();
+
+	if (entries.offsets_.empty()) {
+		entries.offsets_.reserve(entries.blocks_.size());
+		for (size_t b = 0; b < entries.blocks_.size(); ++b) {
+			entries.offsets_.push_back(b << block_shift);
+		}
 	}
-	entries.erase(iter);
 
-	return true;
+	// Erase within the affected blocks only, all other blocks stay shared
+	std::vector<size_t> removed;
+	removed.reserve(indexes.size());
+	std::vector<bool> touched(entries.blocks_.size());
+	size_t const first_block = entries.locate(indexes.front()).first;
+
+	auto it = indexes.cbegin();
+	while (it != indexes.cend() && *it < entries.size_) {
+		size_t const b = entries.locate(*it).first;
+		size_t const offset = entries.offsets_[b];
+		touched[b] = true;
+
+		auto & block = entries.blocks_[b].get();
+		size_t out = *it - offset;
+		for (size_t in = out; in < block.size(); ++in) {
+			if (it != indexes.cend() && *it == offset + in) {
+				if (block[in].is_dir()) {
+					m_flags |= CDirectoryListing::unsure_dir_removed;
+				}
+				else {
+					m_flags |= CDirectoryListing::unsure_file_removed;
+				}
+				removed.push_back(*it);
+				while (it != indexes.cend() && *it == offset + in) {
+					++it;
+				}
+				continue;
+			}
+			if (out != in) {
+				block[out] = std::move(block[in]);
+			}
+			++out;
+		}
+		block.erase(block.begin() + out, block.end());
+	}
+
+	// Drop emptied blocks and merge small ones into their predecessor if
+	// one of them was modified anyway.
+	size_t kept = first_block;
+	for (size_t b = first_block; b < entries.blocks_.size(); ++b) {
+		if (entries.blocks_[b]->empty()) {
+			continue;
+		}
+		if (kept) {
+			auto & prev = entries.blocks_[kept - 1];
+			if ((touched[b] || touched[kept - 1]) && prev->size() + entries.blocks_[b]->size() <= block_size) {
+				auto const& cur = *entries.blocks_[b];
+				prev.get().insert(prev.get().end(), cur.cbegin(), cur.cend());
+				touched[kept - 1] = true;
+				continue;
+			}
+		}
+		if (kept != b) {
+			entries.blocks_[kept] = std::move(entries.blocks_[b]);
+			touched[kept] = touched[b];
+		}
+		++kept;
+	}
+	entries.blocks_.resize(kept);
+	entries.size_ -= removed.size();
+
+	// Renumber the blocks, go back to implicit offsets if possible
+	entries.offsets_.resize(kept);
+	bool uniform = true;
+	for (size_t b = first_block; b < kept; ++b) {
+		entries.offsets_[b] = b ? (entries.offsets_[b - 1] + entries.blocks_[b - 1]->size()) : 0;
+		if (b + 1 < kept && entries.blocks_[b]->size() != block_size) {
+			uniform = false;
+		}
+	}
+	for (size_t b = 0; b < first_block && b + 1 < kept && uniform; ++b) {
+		if (entries.blocks_[b]->size() != block_size) {
+			uniform = false;
+		}
+	}
+	if (uniform) {
+		entries.offsets_.clear();
+	}
+
+	if (m_searchmap_case) {
+		m_searchmap_case.get().remove(removed);
+	}
+	if (m_searchmap_nocase) {
+		m_searchmap_nocase.get().remove(removed);
+	}
+
+	return removed.size();
 }
 
 void CDirectoryListing::GetFilenames(std::vector<std::wstring> &names) const
 {
 	names.reserve(size());
 	for (size_t i = 0; i < size(); ++i) {
-		names.push_back((*m_entries)[i]->name);
+		names.push_back((*this)[i].name);
 	}
 }
 
-size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
+namespace {
+uint32_t hash_name(std::wstring_view const& name)
 {
-	if (!m_entries || m_entries->empty()) {
-		return std::string::npos;
+	return static_cast<uint32_t>(std::hash<std::wstring_view>()(name));
+}
+}
+
+namespace {
+void add_slot(std::vector<uint64_t> & slots, size_t & count, uint64_t slot)
+{
+	// Keep load factor at or below one half
+	if ((count + 1) * 2 > slots.size()) {
+		std::vector<uint64_t> old;
+		old.swap(slots);
+		slots.resize(old.empty() ? 64 : old.size() * 2);
+		size_t const mask = slots.size() - 1;
+		for (auto const& s : old) {
+			if (s) {
+				size_t pos = (s >> 32) & mask;
+				while (slots[pos]) {
+					pos = (pos + 1) & mask;
+				}
+				slots[pos] = s;
+			}
+		}
+	}
+
+	size_t const mask = slots.size() - 1;
+	size_t pos = (slot >> 32) & mask;
+	while (slots[pos]) {
+		pos = (pos + 1) & mask;
+	}
+	slots[pos] = slot;
+	++count;
+}
+
+// Finds the lowest index of the entries with the given hash for which
+// matches returns true, npos if there is none.
+template<typename Matches>
+size_t probe(std::vector<uint64_t> const& slots, uint32_t hash, Matches const& matches)
+{
+	size_t found = std::string::npos;
+	if (!slots.empty()) {
+		size_t const mask = slots.size() - 1;
+		for (size_t pos = hash & mask; slots[pos]; pos = (pos + 1) & mask) {
+			uint64_t const slot = slots[pos];
+			if ((slot >> 32) == hash) {
+				size_t const i = static_cast<uint32_t>(slot) - 1;
+				if (i < found && matches(i)) {
+					found = i;
+				}
+			}
+		}
 	}
+	return found;
+}
+}
+
+void CDirectoryListing::find_index::insert(uint32_t hash, size_t index)
+{
+	uint64_t const slot = (static_cast<uint64_t>(hash) << 32) | static_cast<uint32_t>(index + 1);
+	indexed_ = index + 1;
 
-	if (!m_searchmap_case) {
-		m_searchmap_case.get();
+	if (!slots_) {
+		slots_ = std::make_shared<std::vector<uint64_t>>();
 	}
+	else if (slots_.use_count() != 1) {
+		size_t const limit = std::max(size_t(64), static_cast<size_t>(std::sqrt(static_cast<double>(count_))));
+		if (recent_count_ < limit) {
+			add_slot(recent_, recent_count_, slot);
+			return;
+		}
 
-	// Search map
-	auto iter = m_searchmap_case->find(name);
-	if (iter != m_searchmap_case->end()) {
-		return iter->second;
+		// Leave the table of the other copies alone
+		slots_ = std::make_shared<std::vector<uint64_t>>(*slots_);
 	}
 
-	size_t i = m_searchmap_case->size();
-	if (i == m_entries->size()) {
-		return std::string::npos;
+	for (auto const& s : recent_) {
+		if (s) {
+			add_slot(*slots_, count_, s);
+		}
 	}
+	recent_.clear();
+	recent_count_ = 0;
 
-	auto & searchmap_case = m_searchmap_case.get();
+	add_slot(*slots_, count_, slot);
+}
 
-	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring const& entry_name = (*entry_iter)->name;
-		searchmap_case.emplace(entry_name, i);
+void CDirectoryListing::find_index::remove(std::vector<size_t> const& indexes)
+{
+	if (indexes.empty()) {
+		return;
+	}
 
-		if (entry_name == name) {
-			return i;
+	// The slots hold the hashes, renumbering does not need the names
+	auto const rebuild = [&indexes](std::vector<uint64_t> const& old, size_t & count) {
+		std::vector<uint64_t> slots;
+		count = 0;
+		for (auto const& s : old) {
+			if (!s) {
+				continue;
+			}
+			size_t const i = static_cast<uint32_t>(s) - 1;
+			auto const pos = std::lower_bound(indexes.cbegin(), indexes.cend(), i);
+			if (pos != indexes.cend() && *pos == i) {
+				continue;
+			}
+			size_t const shifted = i - static_cast<size_t>(pos - indexes.cbegin());
+			add_slot(slots, count, (s & 0xffffffff00000000ull) | static_cast<uint32_t>(shifted + 1));
 		}
+		return slots;
+	};
+
+	if (slots_) {
+		slots_ = std::make_shared<std::vector<uint64_t>>(rebuild(*slots_, count_));
 	}
+	recent_ = rebuild(recent_, recent_count_);
 
-	// Map is complete, item not in it
-	return std::string::npos;
+	indexed_ -= static_cast<size_t>(std::lower_bound(indexes.cbegin(), indexes.cend(), indexed_) - indexes.cbegin());
 }
 
-size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
+size_t CDirectoryListing::FindFile(std::wstring const& name, bool nocase) const
 {
-	if (!m_entries || m_entries->empty()) {
+	if (!size()) {
 		return std::string::npos;
 	}
 
-	if (!m_searchmap_nocase) {
-		m_searchmap_nocase.get();
+	auto & searchmap = nocase ? m_searchmap_nocase : m_searchmap_case;
+	if (!searchmap) {
+		searchmap.get();
 	}
 
-	std::wstring lwr = fz::str_tolower(name);
+	std::wstring lwr;
+	if (nocase) {
+		lwr = fz::str_tolower(name);
+	}
+	std::wstring const& key = nocase ? lwr : name;
+	uint32_t const hash = hash_name(key);
 
-	// Search map
-	auto iter = m_searchmap_nocase->find(lwr);
-	if (iter != m_searchmap_nocase->end()) {
-		return iter->second;
+	auto const matches = [&](size_t i) {
+		if (nocase) {
+			return fz::str_tolower((*this)[i].name) == key;
+		}
+		return (*this)[i].name == key;
+	};
+
+	// Search index. As there may be multiple entries with the same name,
+	// the whole probe sequence is checked for the one with the lowest index.
+	// Entries in the table of recently indexed entries all come after those
+	// in the main table.
+	if (searchmap->slots_) {
+		size_t const found = probe(*searchmap->slots_, hash, matches);
+		if (found != std::string::npos) {
+			return found;
+		}
+	}
+	size_t const found = probe(searchmap->recent_, hash, matches);
+	if (found != std::string::npos) {
+		return found;
 	}
 
-	size_t i = m_searchmap_nocase->size();
-	if (i == m_entries->size()) {
+	size_t i = searchmap->indexed_;
+	if (i == size()) {
 		return std::string::npos;
 	}
 
-	auto& searchmap_nocase = m_searchmap_nocase.get();
-
-	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring entry_lrw = fz::str_tolower((*entry_iter)->name);
-		searchmap_nocase.emplace(entry_lrw, i);
-
-		if (entry_lrw == lwr) {
-			return i;
+	auto & index = searchmap.get();
+
+	// Extend index if not yet complete
+	for (; i < size(); ++i) {
+		if (nocase) {
+			std::wstring entry_lwr = fz::str_tolower((*this)[i].name);
+			uint32_t const entry_hash = hash_name(entry_lwr);
+			index.insert(entry_hash, i);
+			if (entry_hash == hash && entry_lwr == key) {
+				return i;
+			}
+		}
+		else {
+			std::wstring const& entry_name = (*this)[i].name;
+			uint32_t const entry_hash = hash_name(entry_name);
+			index.insert(entry_hash, i);
+			if (entry_hash == hash && entry_name == key) {
+				return i;
+			}
 		}
 	}
 
-	// Map is complete, item not in it
+	// Index is complete, item not in it
 	return std::string::npos;
 }
 
-void CDirectoryListing::ClearFindMap()
+size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
 {
-	if (!m_searchmap_case) {
-		return;
-	}
+	return FindFile(name, false);
+}
 
+size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
+{
+	return FindFile(name, true);
+}
+
+void CDirectoryListing::ClearFindMap()
+{
 	m_searchmap_case.clear();
 	m_searchmap_nocase.clear();
 }
 
 void CDirectoryListing::Append(CDirentry&& entry)
 {
-	m_entries.get().emplace_back(entry);
+	entry_blocks & own_entries = m_entries.get();
+	if (own_entries.blocks_.empty() || own_entries.blocks_.back()->size() >= block_size) {
+		if (!own_entries.offsets_.empty()) {
+			own_entries.offsets_.push_back(own_entries.size_);
+		}
+		own_entries.blocks_.emplace_back();
+		own_entries.blocks_.back().get().reserve(block_size);
+	}
+	own_entries.blocks_.back().get().emplace_back(std::move(entry));
+	++own_entries.size_;
+}
+
+void CDirectoryListing::Append(CDirectoryListing const& other)
+{
+	if (!other.size()) {
+		return;
+	}
+
+	for (size_t i = 0; i < other.size(); ++i) {
+		Append(CDirentry(other[i]));
+	}
+
+	m_flags |= other.m_flags & (listing_has_dirs | listing_has_perms | listing_has_usergroup);
 }
 
 bool CheckInclusion(const CDirectoryListing& listing1, const CDirectoryListing& listing2)
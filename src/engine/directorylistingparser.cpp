@@ -12,6 +12,18 @@
 #include <assert.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LISTING_SCAN_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LISTING_SCAN_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 std::map<std::wstring, int> CDirectoryListingParser::m_MonthNamesMap;
 
 //#define LISTDEBUG_MVS
@@ -23,37 +35,106 @@ static char const data[][150]={
 
 #endif
 
-namespace {
-struct ObjectCache
+fz::shared_value<std::wstring> const& CStringCache::get(std::wstring const& v)
 {
-	fz::shared_value<std::wstring> const& get(std::wstring const& v)
-	{
-		auto it = std::lower_bound(cache.begin(), cache.end(), v);
+	auto it = std::lower_bound(cache_.begin(), cache_.end(), v);
+
+	if (it == cache_.end() || !(*it == v)) {
+		it = cache_.emplace(it, v);
+	}
+	return *it;
+}
+
+fz::shared_value<std::wstring> const& CStringCache::get(std::wstring && v)
+{
+	auto it = std::lower_bound(cache_.begin(), cache_.end(), v);
+
+	if (it == cache_.end() || !(*it == v)) {
+		it = cache_.emplace(it, std::move(v));
+	}
+	return *it;
+}
+
+namespace {
 
-		if (it == cache.end() || !(*it == v)) {
-			it = cache.emplace(it, v);
+// Returns the offset of the first line delimiter, that is CR, LF or NUL,
+// or len if there is none.
+size_t scalar_line_end(char const* p, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		char const c = p[i];
+		if (c == '\n' || c == '\r' || !c) {
+			return i;
 		}
-		return *it;
 	}
+	return len;
+}
 
-	fz::shared_value<std::wstring> const& get(std::wstring && v)
-	{
-		auto it = std::lower_bound(cache.begin(), cache.end(), v);
+#ifdef LISTING_SCAN_SSE2
+unsigned int lowest_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+size_t sse2_line_end(char const* p, size_t len)
+{
+	__m128i const cr = _mm_set1_epi8('\r');
+	__m128i const lf = _mm_set1_epi8('\n');
+	__m128i const nul = _mm_setzero_si128();
 
-		if (it == cache.end() || !(*it == v)) {
-			it = cache.emplace(it, std::move(v));
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+		__m128i const m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)), _mm_cmpeq_epi8(v, nul));
+		unsigned int const mask = static_cast<unsigned int>(_mm_movemask_epi8(m));
+		if (mask) {
+			return i + lowest_bit(mask);
 		}
-		return *it;
 	}
+	return i + scalar_line_end(p + i, len - i);
+}
+#endif
 
-	// Vector coupled with binary search and sorted insertion is fastest
-	// alternative as we expect a relatively low amount of inserts.
-	// Note that we cannot use set, as it it cannot search based on a different type.
-	std::vector<fz::shared_value<std::wstring>> cache;
-};
+#ifdef LISTING_SCAN_AVX2
+__attribute__((target("avx2"))) size_t avx2_line_end(char const* p, size_t len)
+{
+	__m256i const cr = _mm256_set1_epi8('\r');
+	__m256i const lf = _mm256_set1_epi8('\n');
+	__m256i const nul = _mm256_setzero_si256();
 
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + i));
+		__m256i const m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)), _mm256_cmpeq_epi8(v, nul));
+		unsigned int const mask = static_cast<unsigned int>(_mm256_movemask_epi8(m));
+		if (mask) {
+			return i + lowest_bit(mask);
+		}
+	}
+	return i + sse2_line_end(p + i, len - i);
+}
+#endif
 
-ObjectCache objcache;
+size_t find_line_end(char const* p, size_t len)
+{
+#ifdef LISTING_SCAN_AVX2
+	static bool const has_avx2 = __builtin_cpu_supports("avx2");
+	if (has_avx2) {
+		return avx2_line_end(p, len);
+	}
+#endif
+#ifdef LISTING_SCAN_SSE2
+	return sse2_line_end(p, len);
+#else
+	return scalar_line_end(p, len);
+#endif
+}
 }
 
 class CToken final
@@ -765,8 +846,7 @@ CDirectoryListing CDirectoryListingParser::Parse(const CServerPath &path)
 
 bool CDirectoryListingParser::ParseLine(CLine &line, ServerType const serverType, bool concatenated, CDirentry const* override)
 {
-	fz::shared_value<CDirentry> refEntry;
-	CDirentry & entry = refEntry.get();
+	CDirentry entry;
 
 	bool res;
 	int ires;
@@ -926,7 +1006,7 @@ done:
 	}
 
 	if (entries_.size() < limit_) {
-		entries_.emplace_back(std::move(refEntry));
+		entries_.emplace_back(std::move(entry));
 	}
 	else {
 		if (!truncated_) {
@@ -1082,8 +1162,8 @@ bool CDirectoryListingParser::ParseAsUnix(CLine &line, CDirentry &entry, bool ex
 
 		entry.time += m_timezoneOffset;
 
-		entry.permissions = objcache.get(permissions);
-		entry.ownerGroup = objcache.get(ownerGroup);
+		entry.permissions = objcache_.get(permissions);
+		entry.ownerGroup = objcache_.get(ownerGroup);
 		return true;
 	}
 	while (numOwnerGroup--);
@@ -1580,7 +1660,7 @@ bool CDirectoryListingParser::ParseAsDos(CLine &line, CDirentry &entry)
 	entry.name = token.GetString();
 
 	entry.target.clear();
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 	entry.time += m_timezoneOffset;
 
@@ -1695,8 +1775,8 @@ bool CDirectoryListingParser::ParseAsEplf(CLine &line, CDirentry &entry)
 		fact += len + 1;
 	}
 
-	entry.permissions = objcache.get(permissions);
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.permissions = objcache_.get(permissions);
+	entry.ownerGroup = objcache_.get(std::wstring());
 	return true;
 }
 
@@ -1859,8 +1939,8 @@ bool CDirectoryListingParser::ParseAsVms(CLine &line, CDirentry &entry)
 			ownerGroup += token.GetString();
 		}
 	}
-	entry.permissions = objcache.get(permissions);
-	entry.ownerGroup = objcache.get(ownerGroup);
+	entry.permissions = objcache_.get(permissions);
+	entry.ownerGroup = objcache_.get(ownerGroup);
 
 	entry.time += m_timezoneOffset;
 
@@ -1912,8 +1992,8 @@ bool CDirectoryListingParser::ParseAsIbm(CLine &line, CDirentry &entry)
 		entry.flags |= CDirentry::flag_dir;
 	}
 
-	entry.ownerGroup = objcache.get(ownerGroupToken.GetString());
-	entry.permissions = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(ownerGroupToken.GetString());
+	entry.permissions = objcache_.get(std::wstring());
 
 	entry.time += m_timezoneOffset;
 
@@ -1987,8 +2067,8 @@ bool CDirectoryListingParser::ParseOther(CLine &line, CDirentry &entry)
 		entry.name = token.GetString();
 		entry.target.clear();
 
-		entry.permissions = objcache.get(firstToken.GetString());
-		entry.ownerGroup = objcache.get(ownerGroup);
+		entry.permissions = objcache_.get(firstToken.GetString());
+		entry.ownerGroup = objcache_.get(ownerGroup);
 	}
 	else {
 		// Possible conflict with multiline VMS listings
@@ -2108,7 +2188,7 @@ bool CDirectoryListingParser::ParseOther(CLine &line, CDirentry &entry)
 			}
 		}
 		entry.target.clear();
-		entry.ownerGroup = objcache.get(std::wstring());
+		entry.ownerGroup = objcache_.get(std::wstring());
 		entry.permissions = entry.ownerGroup;
 		entry.time += m_timezoneOffset;
 	}
@@ -2127,7 +2207,9 @@ bool CDirectoryListingParser::AddData(char *pData, int len)
 		return true;
 	}
 
-	return ParseData(true);
+	bool const ret = ParseData(true);
+	DeliverPartial();
+	return ret;
 }
 
 bool CDirectoryListingParser::AddLine(std::wstring && line, std::wstring && name, fz::datetime const& time)
@@ -2142,9 +2224,41 @@ bool CDirectoryListingParser::AddLine(std::wstring && line, std::wstring && name
 	CLine l(std::move(line));
 	ParseLine(l, m_server.GetType(), true, &override);
 
+	DeliverPartial();
+
 	return true;
 }
 
+void CDirectoryListingParser::SetPartialDelivery(CServerPath const& path)
+{
+	partialPath_ = path;
+	partialStart_ = fz::monotonic_clock::now();
+	lastPartial_ = partialStart_;
+	partialDelivered_ = 0;
+}
+
+void CDirectoryListingParser::DeliverPartial()
+{
+	if (partialPath_.empty() || !m_pControlSocket || entries_.size() <= partialDelivered_) {
+		return;
+	}
+
+	// Small listings complete before the first partial delivery
+	auto const now = fz::monotonic_clock::now();
+	if (now - lastPartial_ < fz::duration::from_seconds(1)) {
+		return;
+	}
+	lastPartial_ = now;
+
+	CDirectoryListing partial;
+	partial.path = partialPath_;
+	partial.m_firstListTime = partialStart_;
+	partial.Assign(std::vector<CDirentry>(entries_.cbegin() + partialDelivered_, entries_.cend()));
+	partialDelivered_ = entries_.size();
+
+	m_pControlSocket->SendPartialDirectoryListingNotification(std::move(partial));
+}
+
 CLine *CDirectoryListingParser::GetLine(bool breakAtEnd, bool &error)
 {
 	while (!m_DataList.empty()) {
@@ -2175,28 +2289,30 @@ CLine *CDirectoryListingParser::GetLine(bool breakAtEnd, bool &error)
 		int reslen = 0;
 
 		int currentOffset = m_currentOffset;
-		while (iter->p[currentOffset] != '\n' && iter->p[currentOffset] != '\r' && iter->p[currentOffset]) {
-			++reslen;
+		while (true) {
+			int const n = static_cast<int>(find_line_end(iter->p + currentOffset, len - currentOffset));
+			reslen += n;
+			currentOffset += n;
+			if (currentOffset < len) {
+				break;
+			}
 
-			++currentOffset;
-			if (currentOffset >= len) {
-				++iter;
-				if (iter == m_DataList.end()) {
-					if (reslen > 10000) {
-						if (m_pControlSocket) {
-							m_pControlSocket->log(logmsg::error, _("Received a line exceeding 10000 characters, aborting."));
-						}
-						error = true;
-						return nullptr;
-					}
-					if (breakAtEnd) {
-						return nullptr;
+			++iter;
+			if (iter == m_DataList.end()) {
+				if (reslen > 10000) {
+					if (m_pControlSocket) {
+						m_pControlSocket->log(logmsg::error, _("Received a line exceeding 10000 characters, aborting."));
 					}
-					break;
+					error = true;
+					return nullptr;
 				}
-				len = iter->len;
-				currentOffset = 0;
+				if (breakAtEnd) {
+					return nullptr;
+				}
+				break;
 			}
+			len = iter->len;
+			currentOffset = 0;
 		}
 
 		if (reslen > 10000) {
@@ -2210,61 +2326,74 @@ CLine *CDirectoryListingParser::GetLine(bool breakAtEnd, bool &error)
 
 		// Reslen is now the length of the line, including any terminating whitespace
 		int const buflen = reslen;
-		char *res = new char[buflen + 1];
-		res[buflen] = 0;
-
-		int respos = 0;
-
-		// Copy line data
-		auto i = m_DataList.begin();
-		while (i != iter && reslen) {
-			int copylen = i->len - startpos;
-			if (copylen > reslen) {
-				copylen = reslen;
-			}
-			memcpy(&res[respos], &i->p[startpos], copylen);
-			reslen -= copylen;
-			respos += i->len - startpos;
-			startpos = 0;
-
-			delete [] i->p;
-			++i;
-		};
 
-		// Copy last chunk
-		if (iter != m_DataList.end() && reslen) {
-			int copylen = m_currentOffset-startpos;
-			if (copylen > reslen) {
-				copylen = reslen;
-			}
-			memcpy(&res[respos], &iter->p[startpos], copylen);
-			if (reslen >= iter->len) {
-				delete [] iter->p;
-				m_DataList.erase(m_DataList.begin(), ++iter);
+		auto convert = [this](char const* p, size_t len) {
+			std::wstring buffer;
+			if (m_pControlSocket) {
+				buffer = m_pControlSocket->ConvToLocal(p, len);
+				m_pControlSocket->log_raw(logmsg::listing, buffer);
 			}
 			else {
-				m_DataList.erase(m_DataList.begin(), iter);
+				buffer = fz::to_wstring_from_utf8(p, len);
+				if (buffer.empty()) {
+					buffer = fz::to_wstring(std::string_view(p, len));
+					if (buffer.empty()) {
+						buffer = std::wstring(p, p + len);
+					}
+				}
 			}
-		}
-		else {
-			m_DataList.erase(m_DataList.begin(), iter);
-		}
+			return buffer;
+		};
 
 		std::wstring buffer;
-		if (m_pControlSocket) {
-			buffer = m_pControlSocket->ConvToLocal(res, buflen);
-			m_pControlSocket->log_raw(logmsg::listing, buffer);
+		if (iter == m_DataList.begin()) {
+			// The line lies within a single chunk, convert it without copying
+			buffer = convert(iter->p + startpos, buflen);
 		}
 		else {
-			buffer = fz::to_wstring_from_utf8(res);
-			if (buffer.empty()) {
-				buffer = fz::to_wstring(res);
-				if (buffer.empty()) {
-					buffer = std::wstring(res, res + strlen(res));
+			char *res = new char[buflen + 1];
+			res[buflen] = 0;
+
+			int respos = 0;
+
+			// Copy line data
+			auto i = m_DataList.begin();
+			while (i != iter && reslen) {
+				int copylen = i->len - startpos;
+				if (copylen > reslen) {
+					copylen = reslen;
+				}
+				memcpy(&res[respos], &i->p[startpos], copylen);
+				reslen -= copylen;
+				respos += i->len - startpos;
+				startpos = 0;
+
+				delete [] i->p;
+				++i;
+			};
+
+			// Copy last chunk
+			if (iter != m_DataList.end() && reslen) {
+				int copylen = m_currentOffset-startpos;
+				if (copylen > reslen) {
+					copylen = reslen;
+				}
+				memcpy(&res[respos], &iter->p[startpos], copylen);
+				if (reslen >= iter->len) {
+					delete [] iter->p;
+					m_DataList.erase(m_DataList.begin(), ++iter);
+				}
+				else {
+					m_DataList.erase(m_DataList.begin(), iter);
 				}
 			}
+			else {
+				m_DataList.erase(m_DataList.begin(), iter);
+			}
+
+			buffer = convert(res, buflen);
+			delete [] res;
 		}
-		delete [] res;
 
 		// Strip BOM
 		if (buffer[0] == 0xfeff) {
@@ -2322,7 +2451,7 @@ bool CDirectoryListingParser::ParseAsWfFtp(CLine &line, CDirentry &entry)
 	if (!ParseTime(token, entry))
 		return false;
 
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 	entry.time += m_timezoneOffset;
 
@@ -2361,7 +2490,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS(CLine &line, CDirentry &entry)
 			return false;
 
 		entry.size = -1;
-		entry.ownerGroup = objcache.get(std::wstring());
+		entry.ownerGroup = objcache_.get(std::wstring());
 		entry.permissions = entry.ownerGroup;
 
 		return true;
@@ -2420,7 +2549,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS(CLine &line, CDirentry &entry)
 
 	entry.name = token.GetString();
 
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 
 	return true;
@@ -2483,7 +2612,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_PDS(CLine &line, CDirentry &entry)
 	if (!line.GetToken(index++, token, true))
 		return false;
 
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 	entry.time += m_timezoneOffset;
 
@@ -2514,7 +2643,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_Migrated(CLine &line, CDirentry &en
 
 	entry.flags = 0;
 	entry.size = -1;
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 
 	return true;
@@ -2531,7 +2660,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_PDS2(CLine &line, CDirentry &entry)
 	entry.name = token.GetString();
 
 	entry.flags = 0;
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 	entry.size = -1;
 
@@ -2625,8 +2754,8 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_Tape(CLine &line, CDirentry &entry)
 
 	entry.name = token.GetString();
 	entry.flags = 0;
-	entry.ownerGroup = objcache.get(std::wstring());
-	entry.permissions = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(std::wstring());
+	entry.permissions = objcache_.get(std::wstring());
 	entry.size = -1;
 
 	if (line.GetToken(index++, token)) {
@@ -2899,8 +3028,8 @@ int CDirectoryListingParser::ParseAsMlsd(CLine &line, CDirentry &entry)
 	}
 
 	entry.name = nameToken.GetString();
-	entry.ownerGroup = objcache.get(std::move(ownerGroup));
-	entry.permissions = objcache.get(std::move(permissions));
+	entry.ownerGroup = objcache_.get(std::move(ownerGroup));
+	entry.permissions = objcache_.get(std::move(permissions));
 
 	return 1;
 }
@@ -2965,8 +3094,8 @@ bool CDirectoryListingParser::ParseAsOS9(CLine &line, CDirentry &entry)
 		return false;
 
 	entry.name = token.GetString();
-	entry.ownerGroup = objcache.get(ownerGroupToken.GetString());
-	entry.permissions = objcache.get(permToken.GetString());
+	entry.ownerGroup = objcache_.get(ownerGroupToken.GetString());
+	entry.permissions = objcache_.get(permToken.GetString());
 
 	return true;
 }
@@ -3062,8 +3191,8 @@ bool CDirectoryListingParser::ParseAsZVM(CLine &line, CDirentry &entry)
 	if (line.GetToken(++index, token))
 		return false;
 
-	entry.ownerGroup = objcache.get(ownerGroupToken.GetString());
-	entry.permissions = objcache.get(std::wstring());
+	entry.ownerGroup = objcache_.get(ownerGroupToken.GetString());
+	entry.permissions = objcache_.get(std::wstring());
 	entry.target.clear();
 	entry.time += m_timezoneOffset;
 
@@ -3130,8 +3259,8 @@ bool CDirectoryListingParser::ParseAsHPNonstop(CLine &line, CDirentry &entry)
 	if (line.GetToken(++index, token))
 		return false;
 
-	entry.permissions = objcache.get(permToken.GetString());
-	entry.ownerGroup = objcache.get(ownerGroup);
+	entry.permissions = objcache_.get(permToken.GetString());
+	entry.ownerGroup = objcache_.get(ownerGroup);
 
 	return true;
 }
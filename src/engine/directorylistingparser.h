@@ -38,6 +38,21 @@
 #include <deque>
 #include <vector>
 
+// Interns strings repeating across many entries, like permissions or
+// owner and group, such that these entries share a single copy.
+class CStringCache final
+{
+public:
+	fz::shared_value<std::wstring> const& get(std::wstring const& v);
+	fz::shared_value<std::wstring> const& get(std::wstring && v);
+
+private:
+	// Vector coupled with binary search and sorted insertion is fastest
+	// alternative as we expect a relatively low amount of inserts.
+	// Note that we cannot use set, as it it cannot search based on a different type.
+	std::vector<fz::shared_value<std::wstring>> cache_;
+};
+
 class CLine;
 class CToken;
 class CControlSocket;
@@ -53,6 +68,7 @@ namespace listingEncoding
 }
 
 
+
 class FZC_PUBLIC_SYMBOL CDirectoryListingParser final
 {
 public:
@@ -73,6 +89,10 @@ public:
 
 	void SetServer(const CServer& server) { m_server = server; };
 
+	// While data is being added, periodically hands the entries parsed so
+	// far to the control socket as partial listing of the given path.
+	void SetPartialDelivery(CServerPath const& path);
+
 protected:
 	CLine *GetLine(bool breakAtEnd, bool& error);
 
@@ -113,6 +133,8 @@ protected:
 
 	bool GetMonthFromName(std::wstring const& name, int &month);
 
+	void DeliverPartial();
+
 	void DeduceEncoding();
 	void ConvertEncoding(char *pData, int len);
 
@@ -134,9 +156,11 @@ protected:
 	int m_currentOffset{};
 
 	std::deque<t_list> m_DataList;
-	std::vector<fz::shared_value<CDirentry>> entries_;
+	std::vector<CDirentry> entries_;
 	int64_t m_totalData{};
 
+	CStringCache objcache_;
+
 	CLine *m_prevLine{};
 
 	CServer m_server;
@@ -152,6 +176,11 @@ protected:
 
 	size_t limit_{size_t(-1)};
 	bool truncated_{};
+
+	CServerPath partialPath_;
+	fz::monotonic_clock partialStart_;
+	fz::monotonic_clock lastPartial_;
+	size_t partialDelivered_{};
 };
 
 #endif
@@ -92,14 +92,27 @@ public:
 		: options_(options)
 		, rate_limit_mgr_(loop_)
 		, tlsSystemTrustStore_(pool_)
-		, logfile_writer_(options_, loop_)
+		, logfile_writer_(options_, loop_, pool_)
 	{
 		directory_cache_.SetTtl(fz::duration::from_seconds(options.get_int(OPTION_CACHE_TTL)));
+		auto const cacheFile = options_.get_string(OPTION_CACHE_FILE);
+		if (!cacheFile.empty() && options_.get_int(OPTION_CACHE_FILE_SIZELIMIT) > 0) {
+			// Read in the background, lookups wait for it if needed
+			directory_cache_.SetSnapshotFile(cacheFile);
+			cacheLoadTask_ = pool_.spawn([this]() { directory_cache_.Load(); });
+		}
 		rate_limit_mgr_.add(&rate_limiter_);
 	}
 
 	~Impl()
 	{
+		cacheLoadTask_.join();
+
+		auto const cacheFile = options_.get_string(OPTION_CACHE_FILE);
+		auto const sizeLimit = options_.get_int(OPTION_CACHE_FILE_SIZELIMIT);
+		if (!cacheFile.empty() && sizeLimit > 0) {
+			directory_cache_.Save(cacheFile, static_cast<int64_t>(sizeLimit) * 1024 * 1024);
+		}
 	}
 
 	COptionsBase& options_;
@@ -109,6 +122,7 @@ public:
 	fz::rate_limiter rate_limiter_;
 	option_change_handler option_change_handler_{options_, loop_, rate_limit_mgr_, rate_limiter_};
 	CDirectoryCache directory_cache_;
+	fz::async_task cacheLoadTask_;
 	CPathCache path_cache_;
 	OpLockManager opLockManager_;
 	fz::tls_system_trust_store tlsSystemTrustStore_;
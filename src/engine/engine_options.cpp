@@ -58,6 +58,9 @@ unsigned int register_engine_options()
 			}
 		},
 		{ "FTP Keep-alive commands", false, option_flags::normal },
+		{ "FTP compression", false, option_flags::normal },
+		{ "FTP compression file types", L"txt|log|csv|tsv|xml|json|htm|html|css|js|sql|md|ini|cfg|conf|yml|yaml|sh|c|cpp|h|hpp|py|java|php|pl|rb|svg", option_flags::normal },
+		{ "FTP pipeline depth", 8, option_flags::numeric_clamp, 1, 64 },
 		{ "FTP Proxy type", 0, option_flags::normal, 0, 4 },
 		{ "FTP Proxy host", L"", option_flags::normal },
 		{ "FTP Proxy user", L"", option_flags::normal },
@@ -79,7 +82,9 @@ unsigned int register_engine_options()
 		{ "TCP Keepalive Interval", 15, option_flags::numeric_clamp, 1, 10000 },
 		{ "Cache TTL", 600, option_flags::numeric_clamp, 30, 60*60*24 },
 		{ "Minimum TLS Version", 2, option_flags::numeric_clamp, 0, 3 },
-		{ "Directory listing item limit", 10000000, option_flags::numeric_clamp, 1000000, 2000000000 }
+		{ "Directory listing item limit", 10000000, option_flags::numeric_clamp, 1000000, 2000000000 },
+		{ "Directory cache file", L"", option_flags::platform },
+		{ "Directory cache file size limit", 64, option_flags::numeric_clamp, 0, 2048 }
 	});
 	return value;
 }
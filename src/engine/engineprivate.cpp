@@ -833,6 +833,16 @@ int CFileZillaEnginePrivate::CacheLookup(const CServerPath& path, CDirectoryList
 	return FZ_REPLY_OK;
 }
 
+int CFileZillaEnginePrivate::CacheLookup(CServer const& server, CServerPath const& path, CDirectoryListing& listing)
+{
+	bool is_outdated = false;
+	if (!directory_cache_.Lookup(listing, server, path, true, is_outdated)) {
+		return FZ_REPLY_ERROR;
+	}
+
+	return FZ_REPLY_OK;
+}
+
 int CFileZillaEnginePrivate::Cancel()
 {
 	fz::scoped_lock lock(mutex_);
@@ -75,6 +75,7 @@ public:
 	CTransferStatus GetTransferStatus(bool &changed);
 
 	int CacheLookup(CServerPath const& path, CDirectoryListing& listing);
+	int CacheLookup(CServer const& server, CServerPath const& path, CDirectoryListing& listing);
 
 	// Add new pending notification
 	void AddNotification(fz::scoped_lock& lock, std::unique_ptr<CNotification> && notification);
@@ -0,0 +1,184 @@
+#include "../filezilla.h"
+
+#if HAVE_ZLIB
+
+#include "deflate_layer.h"
+
+#include <errno.h>
+
+namespace {
+// Size of the chunks read from the next layer
+size_t const read_chunk_size = 64 * 1024;
+
+// Compressed data not yet accepted by the next layer. Beyond this no
+// further data is accepted.
+size_t const max_pending_output = 256 * 1024;
+}
+
+deflate_layer::deflate_layer(fz::event_handler* handler, fz::socket_interface& next_layer, int level)
+	: fz::socket_layer(handler, next_layer, true)
+{
+	next_layer.set_event_handler(handler);
+
+	if (inflateInit(&inflate_) == Z_OK) {
+		if (deflateInit(&deflate_, level) == Z_OK) {
+			initialized_ = true;
+		}
+		else {
+			inflateEnd(&inflate_);
+		}
+	}
+}
+
+deflate_layer::~deflate_layer()
+{
+	if (initialized_) {
+		inflateEnd(&inflate_);
+		deflateEnd(&deflate_);
+	}
+	next_layer_.set_event_handler(nullptr);
+}
+
+int deflate_layer::read(void* buffer, unsigned int size, int& error)
+{
+	if (!initialized_) {
+		error = ENOTCONN;
+		return -1;
+	}
+
+	inflate_.next_out = static_cast<Bytef*>(buffer);
+	inflate_.avail_out = size;
+
+	for (;;) {
+		if (!inflate_finished_ && (!in_.empty() || inflate_has_output_)) {
+			inflate_.next_in = in_.get();
+			inflate_.avail_in = static_cast<uInt>(in_.size());
+
+			int const res = inflate(&inflate_, Z_NO_FLUSH);
+			in_.consume(in_.size() - inflate_.avail_in);
+
+			if (res == Z_STREAM_END) {
+				inflate_finished_ = true;
+				in_.clear();
+			}
+			else if (res != Z_OK && res != Z_BUF_ERROR) {
+				error = EPROTO;
+				return -1;
+			}
+
+			// If the output got filled completely, zlib might have more
+			inflate_has_output_ = !inflate_.avail_out;
+
+			unsigned int const produced = size - inflate_.avail_out;
+			if (produced) {
+				return static_cast<int>(produced);
+			}
+		}
+
+		int const read = next_layer_.read(in_.get(read_chunk_size), static_cast<unsigned int>(read_chunk_size), error);
+		if (read < 0) {
+			return read;
+		}
+		if (!read) {
+			if (inflate_finished_) {
+				return 0;
+			}
+
+			// Connection closed in the middle of the stream
+			error = EPROTO;
+			return -1;
+		}
+		if (!inflate_finished_) {
+			// Anything after the end of the stream gets discarded
+			in_.add(static_cast<size_t>(read));
+		}
+	}
+}
+
+int deflate_layer::write(void const* buffer, unsigned int size, int& error)
+{
+	if (!initialized_ || deflate_finished_) {
+		error = ENOTCONN;
+		return -1;
+	}
+
+	if (!flush(error)) {
+		if (error != EAGAIN || out_.size() >= max_pending_output) {
+			return -1;
+		}
+	}
+
+	deflate_.next_in = static_cast<Bytef*>(const_cast<void*>(buffer));
+	deflate_.avail_in = size;
+	while (deflate_.avail_in) {
+		size_t const chunk = deflateBound(&deflate_, deflate_.avail_in);
+		deflate_.next_out = out_.get(chunk);
+		deflate_.avail_out = static_cast<uInt>(chunk);
+
+		int const res = deflate(&deflate_, Z_NO_FLUSH);
+		out_.add(chunk - deflate_.avail_out);
+		if (res != Z_OK && res != Z_BUF_ERROR) {
+			error = EPROTO;
+			return -1;
+		}
+	}
+
+	// The data has been taken, the next layer signals once it can take
+	// the rest of the compressed data.
+	if (!flush(error) && error != EAGAIN) {
+		return -1;
+	}
+
+	return static_cast<int>(size);
+}
+
+int deflate_layer::shutdown()
+{
+	if (!initialized_) {
+		return ENOTCONN;
+	}
+
+	if (!deflate_finished_) {
+		deflate_.next_in = nullptr;
+		deflate_.avail_in = 0;
+
+		int res;
+		do {
+			size_t const chunk = 16 * 1024;
+			deflate_.next_out = out_.get(chunk);
+			deflate_.avail_out = static_cast<uInt>(chunk);
+			res = deflate(&deflate_, Z_FINISH);
+			out_.add(chunk - deflate_.avail_out);
+		}
+		while (res == Z_OK);
+
+		if (res != Z_STREAM_END) {
+			return EPROTO;
+		}
+		deflate_finished_ = true;
+	}
+
+	int error{};
+	if (!flush(error)) {
+		return error;
+	}
+
+	return next_layer_.shutdown();
+}
+
+bool deflate_layer::flush(int& error)
+{
+	while (!out_.empty()) {
+		int const written = next_layer_.write(out_.get(), static_cast<unsigned int>(std::min(out_.size(), size_t(1024 * 1024))), error);
+		if (written <= 0) {
+			if (!written) {
+				error = EAGAIN;
+			}
+			return false;
+		}
+		out_.consume(static_cast<size_t>(written));
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef FILEZILLA_ENGINE_FTP_DEFLATE_LAYER_HEADER
+#define FILEZILLA_ENGINE_FTP_DEFLATE_LAYER_HEADER
+
+#include <libfilezilla/buffer.hpp>
+#include <libfilezilla/socket.hpp>
+
+#include <zlib.h>
+
+// Compresses data written and decompresses data read using zlib,
+// as used by the FTP MODE Z transfer mode. Each data connection carries
+// exactly one zlib stream per direction.
+class deflate_layer final : public fz::socket_layer
+{
+public:
+	deflate_layer(fz::event_handler* handler, fz::socket_interface& next_layer, int level = Z_DEFAULT_COMPRESSION);
+	virtual ~deflate_layer();
+
+	// Returns false if zlib could not be initialized
+	bool initialized() const { return initialized_; }
+
+	virtual int read(void* buffer, unsigned int size, int& error) override;
+	virtual int write(void const* buffer, unsigned int size, int& error) override;
+
+	// Finishes the compressed stream before shutting down the next layer
+	virtual int shutdown() override;
+
+private:
+	// Writes out pending compressed data, false if not all could be written
+	bool flush(int& error);
+
+	z_stream inflate_{};
+	z_stream deflate_{};
+	bool initialized_{};
+
+	fz::buffer in_;
+	fz::buffer out_;
+
+	bool inflate_finished_{};
+	bool inflate_has_output_{};
+	bool deflate_finished_{};
+};
+
+#endif
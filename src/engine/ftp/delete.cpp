@@ -2,6 +2,7 @@
 
 #include "delete.h"
 #include "../directorycache.h"
+#include "../servercapabilities.h"
 
 namespace {
 enum rmdStates
@@ -20,21 +21,35 @@ int CFtpDeleteOpData::Send()
 		return FZ_REPLY_CONTINUE;
 	}
 	else if (opState == del_del) {
-		std::wstring const& file = files_.back();
-		if (file.empty()) {
-			log(logmsg::debug_info, L"Empty filename");
-			return FZ_REPLY_INTERNALERROR;
+		// DELE commands are independent of each other, keep up to the
+		// pipeline depth in flight. The depth is fixed, it only drops to
+		// one for the rest of the session if the server mishandles pipelining.
+		size_t const depth = static_cast<size_t>(controlSocket_.GetPipelineDepth());
+		while (!files_.empty() && pending_.size() < depth) {
+			std::wstring const& file = files_.back();
+			if (file.empty()) {
+				log(logmsg::debug_info, L"Empty filename");
+				return FZ_REPLY_INTERNALERROR;
+			}
+
+			std::wstring filename = path_.FormatFilename(file, omitPath_);
+			if (filename.empty()) {
+				log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
+				return FZ_REPLY_ERROR;
+			}
+
+			engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+
+			int res = controlSocket_.SendCommand(L"DELE " + filename);
+			if (res != FZ_REPLY_WOULDBLOCK) {
+				return res;
+			}
+
+			pending_.push_back(std::move(files_.back()));
+			files_.pop_back();
 		}
 
-		std::wstring filename = path_.FormatFilename(file, omitPath_);
-		if (filename.empty()) {
-			log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
-			return FZ_REPLY_ERROR;
-		}
-
-		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
-
-		return controlSocket_.SendCommand(L"DELE " + filename);
+		return FZ_REPLY_WOULDBLOCK;
 	}
 
 	log(logmsg::debug_warning, L"Unkown op state %d", opState);
@@ -43,32 +58,44 @@ int CFtpDeleteOpData::Send()
 
 int CFtpDeleteOpData::ParseResponse()
 {
+	if (pending_.empty()) {
+		log(logmsg::debug_warning, L"Reply without pending DELE command");
+		return FZ_REPLY_INTERNALERROR;
+	}
+
 	int code = controlSocket_.GetReplyCode();
+	if (code == 1) {
+		// Not a valid reply to DELE. Wait for the final reply, but don't
+		// pipeline commands to this server anymore.
+		if (pending_.size() > 1) {
+			log(logmsg::debug_warning, L"Unexpected preliminary reply to DELE, disabling command pipelining");
+		}
+		CServerCapabilities::SetCapability(currentServer_, command_pipelining, no);
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
 	if (code != 2 && code != 3) {
 		deleteFailed_ = true;
+		++failed_;
 	}
 	else {
-		std::wstring const& file = files_.back();
-
-		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, file);
+		deleted_.push_back(std::move(pending_.front()));
+	}
 
-		auto now = fz::monotonic_clock::now();
-		if (time_ && (now - time_).get_seconds() >= 1) {
-			controlSocket_.SendDirectoryListingNotification(path_, false);
-			time_ = now;
-			needSendListing_ = false;
-		}
-		else {
-			needSendListing_ = true;
-		}
+	// Update the cache and the UI in batches, not for every single file
+	auto now = fz::monotonic_clock::now();
+	if (time_ && (now - time_).get_seconds() >= 1) {
+		controlSocket_.FlushDeletedFiles(path_, deleted_, failed_, true);
+		time_ = now;
 	}
 
-	files_.pop_back();
+	pending_.pop_front();
 
-	if (!files_.empty()) {
+	if (!files_.empty() || !pending_.empty()) {
 		return FZ_REPLY_CONTINUE;
 	}
 
+	controlSocket_.FlushDeletedFiles(path_, deleted_, failed_, true);
 	return deleteFailed_ ? FZ_REPLY_ERROR : FZ_REPLY_OK;
 }
 
@@ -91,8 +118,13 @@ int CFtpDeleteOpData::SubcommandResult(int prevResult, COpData const&)
 
 int CFtpDeleteOpData::Reset(int result)
 {
-	if (needSendListing_ && !(result & FZ_REPLY_DISCONNECTED)) {
-		controlSocket_.SendDirectoryListingNotification(path_, false);
+	if ((result & FZ_REPLY_TIMEOUT) == FZ_REPLY_TIMEOUT && pending_.size() > 1) {
+		// Some servers silently drop commands received while still busy
+		log(logmsg::debug_warning, L"Timeout with pipelined commands pending, disabling command pipelining");
+		CServerCapabilities::SetCapability(currentServer_, command_pipelining, no);
 	}
+
+	failed_ += files_.size() + pending_.size();
+	controlSocket_.FlushDeletedFiles(path_, deleted_, failed_, !(result & FZ_REPLY_DISCONNECTED));
 	return result;
 }
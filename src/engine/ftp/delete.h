@@ -5,6 +5,8 @@
 
 #include "../../include/serverpath.h"
 
+#include <deque>
+
 class CFtpDeleteOpData final : public COpData, public CFtpOpData
 {
 public:
@@ -22,11 +24,16 @@ public:
 	std::vector<std::wstring> files_;
 	bool omitPath_{};
 
+	// Files for which DELE has been sent, in order of the expected replies
+	std::deque<std::wstring> pending_;
+
 	// Set to fz::monotonic_clock::now initially and after
 	// sending an updated listing to the UI.
 	fz::monotonic_clock time_;
 
-	bool needSendListing_{};
+	// Files deleted and number of failures since the last update
+	std::vector<std::wstring> deleted_;
+	uint64_t failed_{};
 
 	// Set to true if deletion of at least one file failed
 	bool deleteFailed_{};
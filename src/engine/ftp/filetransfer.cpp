@@ -49,6 +49,11 @@ int CFtpFileTransferOpData::Send()
 			log(logmsg::status, _("Starting upload of %s"), localName_);
 		}
 
+		if (range_ && !binary) {
+			log(logmsg::debug_warning, L"Byte ranges cannot be transferred in ASCII mode");
+			return FZ_REPLY_INTERNALERROR;
+		}
+
 		localFileSize_ = download() ? writer_factory_.size() : reader_factory_.size();
 
 		opState = filetransfer_waitcwd;
@@ -85,7 +90,7 @@ int CFtpFileTransferOpData::Send()
 					resumeOffset = fileDidExist_ ? static_cast<int64_t>(localFileSize_) : 0;
 
 					// Check resume capabilities
-					if (opState == filetransfer_resumetest) {
+					if (opState == filetransfer_resumetest && !range_) {
 						int res = TestResumeCapability();
 						if (res != FZ_REPLY_CONTINUE || opState != filetransfer_resumetest) {
 							return res;
@@ -96,7 +101,16 @@ int CFtpFileTransferOpData::Send()
 					localFileSize_ = 0;
 				}
 
-				engine_.transfer_status_.Init(remoteFileSize_, resumeOffset, false);
+				if (range_) {
+					if (static_cast<uint64_t>(resumeOffset) >= range_.length) {
+						log(logmsg::debug_info, L"Byte range has already been fully downloaded.");
+						return FZ_REPLY_OK;
+					}
+					engine_.transfer_status_.Init(range_.length, resumeOffset, false);
+				}
+				else {
+					engine_.transfer_status_.Init(remoteFileSize_, resumeOffset, false);
+				}
 			}
 			else {
 				if (resume_) {
@@ -130,14 +144,22 @@ int CFtpFileTransferOpData::Send()
 				if (!writer) {
 					return FZ_REPLY_CRITICALERROR;
 				}
+				int64_t const end = range_ ? static_cast<int64_t>(range_.length) : remoteFileSize_;
 				if (options_.get_int(OPTION_PREALLOCATE_SPACE)) {
-					if (remoteFileSize_ >= 0 && remoteFileSize_ > resumeOffset) {
-						if (writer->preallocate(static_cast<uint64_t>(remoteFileSize_ - resumeOffset)) != fz::aio_result::ok) {
+					if (end >= 0 && end > resumeOffset) {
+						if (writer->preallocate(static_cast<uint64_t>(end - resumeOffset)) != fz::aio_result::ok) {
 							return FZ_REPLY_ERROR;
 						}
 					}
 				}
 				controlSocket_.m_pTransferSocket->set_writer(std::move(writer), flags_ & ftp_transfer_flags::ascii);
+
+				if (range_) {
+					// The REST offset is relative to the remote file, whereas the writer
+					// got opened relative to the start of the range.
+					controlSocket_.m_pTransferSocket->set_download_limit(range_.length - static_cast<uint64_t>(resumeOffset));
+					resumeOffset += static_cast<int64_t>(range_.offset);
+				}
 			}
 			else {
 				auto reader = reader_factory_->open(*controlSocket_.buffer_pool_, resumeOffset, fz::aio_base::nosize, controlSocket_.max_buffer_count());
@@ -146,6 +168,9 @@ int CFtpFileTransferOpData::Send()
 				}
 				controlSocket_.m_pTransferSocket->set_reader(std::move(reader), flags_ & ftp_transfer_flags::ascii);
 			}
+
+			// Offsets of restarted transfers are ambiguous with MODE Z, only compress whole files
+			compress = !resumeOffset && !range_ && controlSocket_.UseCompression(remoteFile_);
 		}
 
 		if (download()) {
@@ -222,6 +247,7 @@ int CFtpFileTransferOpData::TestResumeCapability()
 
 					opState = filetransfer_waitresumetest;
 					resumeOffset = remoteFileSize_ - 1;
+					compress = false;
 
 					controlSocket_.m_pTransferSocket = std::make_unique<CTransferSocket>(engine_, controlSocket_, TransferMode::resumetest);
 
@@ -442,7 +468,7 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 					return FZ_REPLY_CONTINUE;
 				}
 			}
-			else if (download() && !remoteFileTime_.empty()) {
+			else if (download() && !remoteFileTime_.empty() && !range_) {
 				if (!writer_factory_->set_mtime(remoteFileTime_)) {
 					log(logmsg::debug_warning, L"Could not set modification time");
 				}
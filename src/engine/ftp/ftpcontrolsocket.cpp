@@ -188,6 +188,7 @@ void CFtpControlSocket::ParseLine(std::wstring line)
 void CFtpControlSocket::OnConnect()
 {
 	m_lastTypeBinary = -1;
+	m_lastModeZ = 0;
 	m_sentRestartOffset = false;
 
 	SetAlive();
@@ -397,6 +398,48 @@ bool CFtpControlSocket::CanSendNextCommand()
 	return true;
 }
 
+bool CFtpControlSocket::UseCompression(std::wstring const& file) const
+{
+#if HAVE_ZLIB
+	if (!options_.get_int(OPTION_FTP_COMPRESSION)) {
+		return false;
+	}
+	if (CServerCapabilities::GetCapability(currentServer_, mode_z_support) != yes) {
+		return false;
+	}
+
+	if (file.empty()) {
+		// Listings are text and compress well
+		return true;
+	}
+
+	size_t const pos = file.rfind('.');
+	if (pos == std::wstring::npos || pos + 1 == file.size()) {
+		return false;
+	}
+	std::wstring const ext = fz::str_tolower_ascii(std::wstring_view(file).substr(pos + 1));
+
+	std::wstring const types = options_.get_string(OPTION_FTP_COMPRESSION_TYPES);
+	for (auto const& type : fz::strtok_view(types, L"|")) {
+		if (fz::str_tolower_ascii(type) == ext) {
+			return true;
+		}
+	}
+#else
+	(void)file;
+#endif
+
+	return false;
+}
+
+int CFtpControlSocket::GetPipelineDepth() const
+{
+	if (CServerCapabilities::GetCapability(currentServer_, command_pipelining) == no) {
+		return 1;
+	}
+	return std::max(1, options_.get_int(OPTION_FTP_PIPELINE_DEPTH));
+}
+
 void CFtpControlSocket::ChangeDir(CServerPath const& path, std::wstring const& subDir, bool link_discovery)
 {
 	auto pData = std::make_unique<CFtpChangeDirOpData>(*this);
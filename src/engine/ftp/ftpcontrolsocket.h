@@ -114,6 +114,17 @@ protected:
 
 	int m_lastTypeBinary{-1};
 
+	// 1 if MODE Z is in effect, 0 for MODE S, -1 if unknown
+	int m_lastModeZ{-1};
+
+	// Whether to transfer the file with the given name compressed.
+	// Pass an empty name for directory listings.
+	bool UseCompression(std::wstring const& file) const;
+
+	// Number of independent commands that may be sent before their replies
+	// have arrived. 1 if the server cannot handle pipelining.
+	int GetPipelineDepth() const;
+
 	// Used by keepalive code so that we're not using keep alive
 	// till the end of time. Stop after a couple of minutes.
 	fz::monotonic_clock m_lastCommandCompletionTime;
@@ -154,6 +165,7 @@ public:
 
 	int64_t resumeOffset{};
 	bool binary{true};
+	bool compress{};
 };
 
 #endif
@@ -68,6 +68,10 @@ int CFtpListOpData::Send()
 			log(logmsg::status, _("Retrieving directory listing of \"%s\"..."), newPath.GetPath());
 		}
 
+		if (controlSocket_.SendCachedDirectoryListing(path_, subDir_, flags_)) {
+			return FZ_REPLY_OK;
+		}
+
 		controlSocket_.ChangeDir(path_, subDir_, (flags_ & LIST_FLAG_LINK));
 		opState = list_waitcwd;
 		return FZ_REPLY_CONTINUE;
@@ -107,6 +111,7 @@ int CFtpListOpData::Send()
 
 		listing_parser_->SetTimezoneOffset(controlSocket_.GetInferredTimezoneOffset());
 		controlSocket_.m_pTransferSocket->m_pDirectoryListingParser = listing_parser_.get();
+		compress = controlSocket_.UseCompression(std::wstring());
 
 		engine_.transfer_status_.Init(-1, 0, true);
 
@@ -135,6 +140,10 @@ int CFtpListOpData::Send()
 				controlSocket_.Transfer(L"LIST", this);
 			}
 		}
+		if (!viewHiddenCheck_) {
+			// Otherwise the listing might get replaced by the one from LIST -a
+			listing_parser_->SetPartialDelivery(currentPath_);
+		}
 		return FZ_REPLY_CONTINUE;
 	}
 	if (opState == list_mdtm) {
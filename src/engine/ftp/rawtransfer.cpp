@@ -24,7 +24,7 @@ int CFtpRawTransferOpData::Send()
 		if ((pOldData->binary && controlSocket_.m_lastTypeBinary == 1) ||
 			(!pOldData->binary && controlSocket_.m_lastTypeBinary == 0))
 		{
-			opState = rawtransfer_port_pasv;
+			opState = ModeChangeNeeded() ? rawtransfer_mode : rawtransfer_port_pasv;
 		}
 		else {
 			opState = rawtransfer_type;
@@ -65,7 +65,11 @@ int CFtpRawTransferOpData::Send()
 		}
 		measureRTT = true;
 		break;
+	case rawtransfer_mode:
+		cmd = pOldData->compress ? L"MODE Z" : L"MODE S";
+		break;
 	case rawtransfer_port_pasv:
+		controlSocket_.m_pTransferSocket->set_compression(controlSocket_.m_lastModeZ == 1);
 		if (bPasv) {
 			cmd = GetPassiveCommand();
 		}
@@ -142,7 +146,16 @@ int CFtpRawTransferOpData::ParseResponse()
 		return FZ_REPLY_ERROR;
 	}
 
-	int const code = controlSocket_.GetReplyCode();
+	int code = controlSocket_.GetReplyCode();
+
+	if (code == 4 && (opState == rawtransfer_waitfinish || opState == rawtransfer_waittransferpre || opState == rawtransfer_waittransfer)) {
+		if (controlSocket_.m_pTransferSocket && controlSocket_.m_pTransferSocket->download_limit_reached()) {
+			// We closed the data connection ourselves after receiving the requested byte range,
+			// servers usually respond to that with 426.
+			log(logmsg::debug_verbose, L"Ignoring failure reply after download limit has been reached");
+			code = 2;
+		}
+	}
 
 	bool error = false;
 	switch (opState)
@@ -152,8 +165,26 @@ int CFtpRawTransferOpData::ParseResponse()
 			error = true;
 		}
 		else {
-			opState = rawtransfer_port_pasv;
 			controlSocket_.m_lastTypeBinary = pOldData->binary ? 1 : 0;
+			opState = ModeChangeNeeded() ? rawtransfer_mode : rawtransfer_port_pasv;
+		}
+		break;
+	case rawtransfer_mode:
+		if (code == 2 || code == 3) {
+			controlSocket_.m_lastModeZ = pOldData->compress ? 1 : 0;
+			opState = rawtransfer_port_pasv;
+		}
+		else if (pOldData->compress) {
+			// Not fatal, transfer uncompressed instead
+			log(logmsg::status, _("Server does not accept MODE Z, transferring without compression"));
+			CServerCapabilities::SetCapability(currentServer_, mode_z_support, no);
+			pOldData->compress = false;
+			if (!ModeChangeNeeded()) {
+				opState = rawtransfer_port_pasv;
+			}
+		}
+		else {
+			error = true;
 		}
 		break;
 	case rawtransfer_port_pasv:
@@ -294,6 +325,11 @@ int CFtpRawTransferOpData::ParseResponse()
 	return FZ_REPLY_CONTINUE;
 }
 
+bool CFtpRawTransferOpData::ModeChangeNeeded() const
+{
+	return controlSocket_.m_lastModeZ != (pOldData->compress ? 1 : 0);
+}
+
 bool CFtpRawTransferOpData::ParseEpsvResponse()
 {
 	size_t pos = controlSocket_.m_Response.find(L"(|||");
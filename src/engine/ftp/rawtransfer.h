@@ -8,6 +8,7 @@ enum type
 {
         rawtransfer_init = 0,
         rawtransfer_type,
+        rawtransfer_mode,
         rawtransfer_port_pasv,
         rawtransfer_rest,
         rawtransfer_transfer,
@@ -43,6 +44,9 @@ public:
 	bool bTriedActive{};
 
 private:
+	// Whether MODE needs to be sent before the transfer
+	bool ModeChangeNeeded() const;
+
 	std::wstring host_;
 	unsigned short port_{};
 };
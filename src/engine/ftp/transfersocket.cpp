@@ -8,6 +8,9 @@
 
 #include "ftpcontrolsocket.h"
 #include "transfersocket.h"
+#if HAVE_ZLIB
+#include "deflate_layer.h"
+#endif
 
 #include "../../include/engine_options.h"
 
@@ -56,6 +59,12 @@ void CTransferSocket::set_writer(std::unique_ptr<fz::writer_base> && writer, [[m
 	writer_ = std::move(writer);
 }
 
+void CTransferSocket::set_download_limit(uint64_t limit)
+{
+	download_limit_ = limit;
+	limit_reached_ = false;
+}
+
 void CTransferSocket::ResetSocket()
 {
 	socketServer_.reset();
@@ -64,6 +73,9 @@ void CTransferSocket::ResetSocket()
 
 #if HAVE_ASCII_TRANSFORM
 	ascii_layer_.reset();
+#endif
+#if HAVE_ZLIB
+	deflate_layer_.reset();
 #endif
 	tls_layer_.reset();
 	proxy_layer_.reset();
@@ -311,12 +323,20 @@ bool CTransferSocket::OnReceive()
 			return false;
 		}
 		else if (m_transferMode == TransferMode::download) {
+			if (limit_reached_) {
+				FinalizeWrite();
+				return false;
+			}
+
 			if (!CheckGetNextWriteBuffer()) {
 				return false;
 			}
 
 			int error{};
 			size_t to_read = buffer_->capacity() - buffer_->size();
+			if (download_limit_ && to_read > download_limit_) {
+				to_read = static_cast<size_t>(download_limit_);
+			}
 			int numread = active_layer_->read(buffer_->get(to_read), static_cast<unsigned int>(to_read), error);
 
 			if (numread < 0) {
@@ -337,6 +357,15 @@ bool CTransferSocket::OnReceive()
 				}
 				else {
 					buffer_->add(static_cast<size_t>(numread));
+					if (download_limit_) {
+						download_limit_ -= static_cast<uint64_t>(numread);
+						if (!download_limit_) {
+							controlSocket_.log(logmsg::debug_verbose, L"Download limit reached, ending transfer");
+							limit_reached_ = true;
+							FinalizeWrite();
+							return false;
+						}
+					}
 					return true;
 				}
 			}
@@ -551,6 +580,21 @@ bool CTransferSocket::InitLayers(bool active)
 		}
 	}
 
+	if (compress_) {
+#if HAVE_ZLIB
+		// Compression sits above TLS, encrypted data does not compress
+		deflate_layer_ = std::make_unique<deflate_layer>(nullptr, *active_layer_);
+		if (!deflate_layer_->initialized()) {
+			controlSocket_.log(logmsg::error, _("Could not initialize compression"));
+			return false;
+		}
+		active_layer_ = deflate_layer_.get();
+#else
+		controlSocket_.log(logmsg::debug_warning, L"Compression requested, but not supported by this build");
+		return false;
+#endif
+	}
+
 #if HAVE_ASCII_TRANSFORM
 	if (use_ascii_) {
 		ascii_layer_ = std::make_unique<fz::ascii_layer>(event_loop_, nullptr, *active_layer_);
@@ -591,7 +635,8 @@ void CTransferSocket::TransferEnd(TransferEndReason reason)
 	}
 	m_transferEndReason = reason;
 
-	if (reason != TransferEndReason::successful) {
+	if (reason != TransferEndReason::successful || limit_reached_) {
+		// If the download limit got reached, the server may still be sending.
 		ResetSocket();
 	}
 	else {
@@ -736,7 +781,7 @@ void CTransferSocket::FinalizeWrite()
 	}
 
 	auto res = fz::aio_result::ok;
-	if (!buffer_->empty()) {
+	if (buffer_ && !buffer_->empty()) {
 		res = writer_->add_buffer(std::move(buffer_), *this);
 	}
 	if (res == fz::aio_result::ok) {
@@ -24,6 +24,10 @@ class ascii_layer;
 #endif
 }
 
+#if HAVE_ZLIB
+class deflate_layer;
+#endif
+
 class CTransferSocket final : public fz::event_handler
 {
 public:
@@ -44,6 +48,15 @@ public:
 	void set_reader(std::unique_ptr<fz::reader_base> && reader, bool ascii);
 	void set_writer(std::unique_ptr<fz::writer_base> && writer, bool ascii);
 
+	// Downloads end successfully once limit bytes have been received,
+	// the data connection is then closed without waiting for the server.
+	void set_download_limit(uint64_t limit);
+	bool download_limit_reached() const { return limit_reached_; }
+
+	// Data is compressed (MODE Z). Has to be set before the data connection
+	// gets established.
+	void set_compression(bool compress) { compress_ = compress; }
+
 	void ContinueWithoutSesssionResumption();
 
 protected:
@@ -94,6 +107,10 @@ protected:
 	std::unique_ptr<fz::rate_limited_layer> ratelimit_layer_;
 	std::unique_ptr<CProxySocket> proxy_layer_;
 	std::unique_ptr<fz::tls_layer> tls_layer_;
+#if HAVE_ZLIB
+	std::unique_ptr<deflate_layer> deflate_layer_;
+#endif
+	bool compress_{};
 #if HAVE_ASCII_TRANSFORM
 	std::unique_ptr<fz::ascii_layer> ascii_layer_;
 	bool use_ascii_{};
@@ -110,6 +127,9 @@ protected:
 	std::unique_ptr<fz::writer_base> writer_;
 	fz::buffer_lease buffer_;
 	size_t resumetest_{};
+
+	uint64_t download_limit_{};
+	bool limit_reached_{};
 };
 
 #endif
@@ -13,15 +13,33 @@
 #include <fcntl.h>
 #endif
 
-logfile_writer::logfile_writer(COptionsBase & options, fz::event_loop & loop)
+namespace {
+// Beyond this, logging threads wait for the writing thread to catch up
+size_t const max_buffer_size = 4 * 1024 * 1024;
+}
+
+logfile_writer::logfile_writer(COptionsBase & options, fz::event_loop & loop, fz::thread_pool & pool)
     : fz::event_handler(loop)
     , options_(options)
+    , pool_(pool)
 #if FZ_WINDOWS
     , pid_(static_cast<unsigned int>(GetCurrentProcessId()))
 #else
     , pid_(static_cast<unsigned int>(getpid()))
 #endif
 {
+	prefixes_[fz::bitscan_reverse(fz::logmsg::status)] = fz::to_utf8(fztranslate("Status:"));
+	prefixes_[fz::bitscan_reverse(fz::logmsg::error)] = fz::to_utf8(fztranslate("Error:"));
+	prefixes_[fz::bitscan_reverse(fz::logmsg::command)] = fz::to_utf8(fztranslate("Command:"));
+	prefixes_[fz::bitscan_reverse(fz::logmsg::reply)] = fz::to_utf8(fztranslate("Response:"));
+	prefixes_[fz::bitscan_reverse(fz::logmsg::debug_warning)] = fz::to_utf8(fztranslate("Trace:"));
+	prefixes_[fz::bitscan_reverse(fz::logmsg::debug_info)] = prefixes_[fz::bitscan_reverse(fz::logmsg::debug_warning)];
+	prefixes_[fz::bitscan_reverse(fz::logmsg::debug_verbose)] = prefixes_[fz::bitscan_reverse(fz::logmsg::debug_warning)];
+	prefixes_[fz::bitscan_reverse(fz::logmsg::debug_debug)] = prefixes_[fz::bitscan_reverse(fz::logmsg::debug_warning)];
+	prefixes_[fz::bitscan_reverse(logmsg::listing)] = fz::to_utf8(fztranslate("Listing:"));
+
+	enabled_ = !options_.get_string(OPTION_LOGGING_FILE).empty();
+
 	options.watch(OPTION_LOGGING_FILE, this);
 	options.watch(OPTION_LOGGING_FILE_SIZELIMIT, this);
 }
@@ -30,16 +48,33 @@ logfile_writer::~logfile_writer()
 {
 	remove_handler();
 	options_.unwatch_all(this);
+
+	{
+		fz::scoped_lock l(mtx_);
+		quit_ = true;
+		writer_cond_.signal(l);
+		progress_cond_.signal(l);
+	}
+	thread_.join();
 }
 
 void logfile_writer::operator()(fz::event_base const&)
 {
+	bool const enabled = !options_.get_string(OPTION_LOGGING_FILE).empty();
+
 	fz::scoped_lock l(mtx_);
-	file_.close();
-	initialized_ = false;
+	enabled_ = enabled;
+	reopen_ = true;
+	writer_cond_.signal(l);
+}
+
+void logfile_writer::report_error(std::wstring const& error)
+{
+	fz::scoped_lock l(mtx_);
+	error_ = error;
 }
 
-bool logfile_writer::rotate(fz::scoped_lock & l, fz::logger_interface * error_logger)
+bool logfile_writer::rotate()
 {
 #ifdef FZ_WINDOWS
 	if (max_size_ && max_size_ < file_.size()) {
@@ -50,15 +85,12 @@ bool logfile_writer::rotate(fz::scoped_lock & l, fz::logger_interface * error_lo
 		HANDLE hMutex = ::CreateMutexW(nullptr, true, L"FileZilla 3 Logrotate Mutex");
 		if (!hMutex) {
 			DWORD err = GetLastError();
-			l.unlock();
-			if (error_logger) {
-				error_logger->log(fz::logmsg::error, fztranslate("Could not create logging mutex: %s"), GetSystemErrorDescription(err));
-			}
+			report_error(fz::sprintf(fztranslate("Could not create logging mutex: %s"), GetSystemErrorDescription(err)));
 			return false;
 		}
 
 		fz::native_string name = fz::to_native(options_.get_string(OPTION_LOGGING_FILE));
-		if (!do_open(l, error_logger, name)) {
+		if (!do_open(name)) {
 			// Oh dear..
 			ReleaseMutex(hMutex);
 			CloseHandle(hMutex);
@@ -89,7 +121,7 @@ bool logfile_writer::rotate(fz::scoped_lock & l, fz::logger_interface * error_lo
 				}
 			}
 			MoveFileExW(name.c_str(), (name + L".1").c_str(), MOVEFILE_REPLACE_EXISTING);
-			ret = do_open(l, error_logger, name, true);
+			ret = do_open(name, true);
 		}
 
 		ReleaseMutex(hMutex);
@@ -116,7 +148,7 @@ bool logfile_writer::rotate(fz::scoped_lock & l, fz::logger_interface * error_lo
 		rc = fstat(old_fd, &buf);
 
 		fz::native_string name = fz::to_native(options_.get_string(OPTION_LOGGING_FILE));
-		if (!do_open(l, error_logger, name)) {
+		if (!do_open(name)) {
 			close(old_fd);
 			return false;
 		}
@@ -137,7 +169,7 @@ bool logfile_writer::rotate(fz::scoped_lock & l, fz::logger_interface * error_lo
 
 		// Closing any descriptor releases the lock, hence keep this also until after creation
 		int old_fd2 = file_.detach();
-		bool ret = do_open(l, error_logger, name, true);
+		bool ret = do_open(name, true);
 
 		close(old_fd2);
 		close(old_fd);
@@ -152,39 +184,164 @@ bool logfile_writer::rotate(fz::scoped_lock & l, fz::logger_interface * error_lo
 
 void logfile_writer::log(fz::logmsg::type type, std::wstring const& msg, fz::datetime const& now, size_t id, fz::logger_interface * error_logger)
 {
-	fz::scoped_lock l(mtx_);
-
-	if (!file_.opened()) {
-		if (initialized_ || !init(l, error_logger)) {
-			return;
-		}
-	}
-
-	if (!rotate(l, error_logger)) {
+	if (!enabled_) {
 		return;
 	}
 
-	std::string out;
+	// Everything but the timestamp is formatted without holding the lock
+	std::string line;
 	if (id) {
-		out = fz::sprintf("%s %u %u %s %s"
+		line = fz::sprintf(" %u %u %s %s"
 #ifdef FZ_WINDOWS
 		"\r\n",
 #else
 		"\n",
 #endif
-		now.format("%Y-%m-%d %H:%M:%S", fz::datetime::local), pid_, id, prefixes_[fz::bitscan_reverse(type)], fz::to_utf8(msg));
+		pid_, id, prefixes_[fz::bitscan_reverse(type)], fz::to_utf8(msg));
 	}
 	else {
-		out = fz::sprintf("%s %u %s %s"
+		line = fz::sprintf(" %u %s %s"
 #ifdef FZ_WINDOWS
 		"\r\n",
 #else
 		"\n",
 #endif
-		now.format("%Y-%m-%d %H:%M:%S", fz::datetime::local), pid_, prefixes_[fz::bitscan_reverse(type)], fz::to_utf8(msg));
+		pid_, prefixes_[fz::bitscan_reverse(type)], fz::to_utf8(msg));
+	}
+
+	std::wstring error;
+	{
+		fz::scoped_lock l(mtx_);
+
+		if (!thread_) {
+			thread_ = pool_.spawn([this]() { entry(); });
+			if (!thread_) {
+				enabled_ = false;
+				return;
+			}
+		}
+
+		if (buffer_.size() >= max_buffer_size && !quit_) {
+			l.unlock();
+			fz::scoped_lock w(wait_mtx_);
+			l.lock();
+			while (buffer_.size() >= max_buffer_size && !quit_) {
+				progress_cond_.wait(l);
+			}
+		}
+
+		int64_t const time = now.get_time_t();
+		if (time != timestamp_time_) {
+			timestamp_time_ = time;
+			timestamp_ = now.format("%Y-%m-%d %H:%M:%S", fz::datetime::local);
+		}
+
+		if (buffer_.empty()) {
+			writer_cond_.signal(l);
+		}
+		buffer_ += timestamp_;
+		buffer_ += line;
+		++queued_;
+
+		error.swap(error_);
+	}
+
+	if (!error.empty() && error_logger) {
+		error_logger->log_raw(fz::logmsg::error, error);
+	}
+}
+
+void logfile_writer::flush()
+{
+	fz::scoped_lock w(wait_mtx_);
+	fz::scoped_lock l(mtx_);
+
+	uint64_t const target = queued_;
+	while (written_ < target && thread_) {
+		progress_cond_.wait(l);
 	}
+}
 
-	std::string_view o = out;
+bool logfile_writer::flush(fz::duration const& timeout)
+{
+	// Polls, the lock might be held by a thread that is not going to
+	// release it anymore, or the writing thread itself might be stuck.
+	fz::monotonic_clock const deadline = fz::monotonic_clock::now() + timeout;
+
+	bool have_target{};
+	uint64_t target{};
+	while (true) {
+		if (mtx_.try_lock()) {
+			if (!have_target) {
+				have_target = true;
+				target = queued_;
+			}
+			bool const done = written_ >= target || !thread_;
+			mtx_.unlock();
+			if (done) {
+				return true;
+			}
+		}
+
+		if (deadline <= fz::monotonic_clock::now()) {
+			return false;
+		}
+		fz::sleep(fz::duration::from_milliseconds(10));
+	}
+}
+
+void logfile_writer::entry()
+{
+	fz::scoped_lock l(mtx_);
+	while (true) {
+		if (reopen_) {
+			reopen_ = false;
+			l.unlock();
+			file_.close();
+			initialized_ = false;
+			l.lock();
+			continue;
+		}
+
+		if (buffer_.empty()) {
+			if (quit_) {
+				break;
+			}
+			writer_cond_.wait(l);
+			continue;
+		}
+
+		// Logging threads keep appending to the other buffer meanwhile
+		writing_.swap(buffer_);
+		uint64_t const queued = queued_;
+		progress_cond_.signal(l);
+
+		l.unlock();
+		write(writing_);
+		writing_.clear();
+		l.lock();
+
+		written_ = queued;
+		progress_cond_.signal(l);
+	}
+}
+
+void logfile_writer::write(std::string const& data)
+{
+	if (!file_.opened()) {
+		if (initialized_ || !init()) {
+			enabled_ = false;
+			return;
+		}
+	}
+
+	// Rotation is checked once per chunk of messages. The file may exceed the
+	// size limit by at most the amount of messages buffered.
+	if (!rotate()) {
+		return;
+	}
+
+	std::string_view o = data;
 	while (!o.empty()) {
 		fz::rwresult r = file_.write2(o.data(), o.size());
 		if (!r || !r.value_) {
@@ -195,25 +352,12 @@ void logfile_writer::log(fz::logmsg::type type, std::wstring const& msg, fz::dat
 	}
 }
 
-bool logfile_writer::init(fz::scoped_lock & l, fz::logger_interface * error_logger)
+bool logfile_writer::init()
 {
-	[[maybe_unused]] static bool const once = [&]() {
-		prefixes_[fz::bitscan_reverse(fz::logmsg::status)] = fz::to_utf8(fztranslate("Status:"));
-		prefixes_[fz::bitscan_reverse(fz::logmsg::error)] = fz::to_utf8(fztranslate("Error:"));
-		prefixes_[fz::bitscan_reverse(fz::logmsg::command)] = fz::to_utf8(fztranslate("Command:"));
-		prefixes_[fz::bitscan_reverse(fz::logmsg::reply)] = fz::to_utf8(fztranslate("Response:"));
-		prefixes_[fz::bitscan_reverse(fz::logmsg::debug_warning)] = fz::to_utf8(fztranslate("Trace:"));
-		prefixes_[fz::bitscan_reverse(fz::logmsg::debug_info)] = prefixes_[fz::bitscan_reverse(fz::logmsg::debug_warning)];
-		prefixes_[fz::bitscan_reverse(fz::logmsg::debug_verbose)] = prefixes_[fz::bitscan_reverse(fz::logmsg::debug_warning)];
-		prefixes_[fz::bitscan_reverse(fz::logmsg::debug_debug)] = prefixes_[fz::bitscan_reverse(fz::logmsg::debug_warning)];
-		prefixes_[fz::bitscan_reverse(logmsg::listing)] = fz::to_utf8(fztranslate("Listing:"));
-		return true;
-	}();
-
 	initialized_ = true;
 
 	fz::native_string name = fz::to_native(options_.get_string(OPTION_LOGGING_FILE));
-	if (!do_open(l, error_logger, name)) {
+	if (!do_open(name)) {
 		return false;
 	}
 
@@ -223,7 +367,7 @@ bool logfile_writer::init(fz::scoped_lock & l, fz::logger_interface * error_logg
 	return true;
 }
 
-bool logfile_writer::do_open(fz::scoped_lock & l, fz::logger_interface * error_logger, fz::native_string const& name, bool empty)
+bool logfile_writer::do_open(fz::native_string const& name, bool empty)
 {
 	file_.close();
 
@@ -233,10 +377,7 @@ bool logfile_writer::do_open(fz::scoped_lock & l, fz::logger_interface * error_l
 
 	fz::result r = file_.open(name, fz::file::appending, empty ? fz::file::empty : fz::file::existing);
 	if (!r) {
-		l.unlock();
-		if (error_logger) {
-			error_logger->log(fz::logmsg::error, fztranslate("Could not open log file for writing."));
-		}
+		report_error(fztranslate("Could not open log file for writing."));
 		return false;
 	}
 	return true;
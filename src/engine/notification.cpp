@@ -5,6 +5,11 @@ CDirectoryListingNotification::CDirectoryListingNotification(CServerPath const&
 {
 }
 
+CDirectoryListingNotification::CDirectoryListingNotification(std::shared_ptr<CDirectoryListing> const& partial)
+	: primary_(true), m_path(partial->path), partial_(partial)
+{
+}
+
 RequestId CFileExistsNotification::GetRequestID() const
 {
 	return reqId_fileexists;
@@ -950,6 +950,15 @@ std::vector<ParameterTraits> const& ExtraServerParameterTraits(ServerProtocol pr
 			}();
 			return ret;
 		}
+	case SFTP:
+		{
+			static std::vector<ParameterTraits> const ret = []() {
+				std::vector<ParameterTraits> ret;
+				ret.emplace_back(ParameterTraits{"sftp_window", ParameterSection::extra, ParameterTraits::optional | ParameterTraits::custom | ParameterTraits::content_transparent, std::wstring(), std::wstring()});
+				return ret;
+			}();
+			return ret;
+		}
 	case GOOGLE_CLOUD:
 		{
 			static std::vector<ParameterTraits> const ret = []() {
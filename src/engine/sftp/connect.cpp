@@ -27,6 +27,7 @@ enum connectStates
 	connect_init,
 	connect_proxy,
 	connect_keys,
+	connect_window,
 	connect_open
 };
 }
@@ -63,6 +64,11 @@ int CSftpConnectOpData::Send()
 
 			keyfile_ = keyfiles_.cbegin();
 
+			window_ = fz::to_integral<uint64_t>(currentServer_.GetExtraParameter("sftp_window"));
+			if (window_ > 1024) {
+				window_ = 1024;
+			}
+
 			auto executable = fz::to_native(options_.get_string(OPTION_FZSFTP_EXECUTABLE));
 			if (executable.empty()) {
 				executable = fzT("fzsftp");
@@ -129,6 +135,8 @@ int CSftpConnectOpData::Send()
 		break;
 	case connect_keys:
 		return controlSocket_.SendCommand(L"keyfile \"" + *(keyfile_++) + L"\"");
+	case connect_window:
+		return controlSocket_.SendCommand(fz::sprintf(L"window %d", window_ * 1024 * 1024));
 	case connect_open:
 		{
 			std::wstring user = (controlSocket_.credentials_.logonType_ == LogonType::anonymous) ? L"anonymous" : currentServer_.GetUser();
@@ -162,7 +170,7 @@ int CSftpConnectOpData::ParseResponse()
 			opState = connect_keys;
 		}
 		else {
-			opState = connect_open;
+			opState = window_ ? connect_window : connect_open;
 		}
 		break;
 	case connect_proxy:
@@ -170,14 +178,17 @@ int CSftpConnectOpData::ParseResponse()
 			opState = connect_keys;
 		}
 		else {
-			opState = connect_open;
+			opState = window_ ? connect_window : connect_open;
 		}
 		break;
 	case connect_keys:
 		if (keyfile_ == keyfiles_.cend()) {
-			opState = connect_open;
+			opState = window_ ? connect_window : connect_open;
 		}
 		break;
+	case connect_window:
+		opState = connect_open;
+		break;
 	case connect_open:
 		engine_.AddNotification(std::make_unique<CSftpEncryptionNotification>(controlSocket_.m_sftpEncryptionDetails));
 		return FZ_REPLY_OK;
@@ -22,6 +22,9 @@ public:
 
 	std::vector<std::wstring> keyfiles_;
 	std::vector<std::wstring>::const_iterator keyfile_;
+
+	// Maximum outstanding request data in MiB, 0 for automatic
+	uint64_t window_{};
 };
 
 #endif
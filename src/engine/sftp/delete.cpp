@@ -30,21 +30,17 @@ int CSftpDeleteOpData::ParseResponse()
 {
 	if (controlSocket_.result_ != FZ_REPLY_OK) {
 		deleteFailed_ = true;
+		++failed_;
 	}
 	else {
-		std::wstring const& file = files_.back();
-
-		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, file);
+		deleted_.push_back(files_.back());
+	}
 
-		auto const now = fz::datetime::now();
-		if (!time_.empty() && (now - time_).get_seconds() >= 1) {
-			controlSocket_.SendDirectoryListingNotification(path_, false);
-			time_ = now;
-			needSendListing_ = false;
-		}
-		else {
-			needSendListing_ = true;
-		}
+	// Update the cache and the UI in batches, not for every single file
+	auto const now = fz::datetime::now();
+	if (!time_.empty() && (now - time_).get_seconds() >= 1) {
+		controlSocket_.FlushDeletedFiles(path_, deleted_, failed_, true);
+		time_ = now;
 	}
 
 	files_.pop_back();
@@ -53,6 +49,7 @@ int CSftpDeleteOpData::ParseResponse()
 		return FZ_REPLY_CONTINUE;
 	}
 
+	controlSocket_.FlushDeletedFiles(path_, deleted_, failed_, true);
 	return deleteFailed_ ? FZ_REPLY_ERROR : FZ_REPLY_OK;
 }
 
@@ -63,8 +60,7 @@ int CSftpDeleteOpData::SubcommandResult(int, COpData const&)
 
 int CSftpDeleteOpData::Reset(int result)
 {
-	if (needSendListing_ && !(result & FZ_REPLY_DISCONNECTED)) {
-		controlSocket_.SendDirectoryListingNotification(path_, false);
-	}
+	failed_ += files_.size();
+	controlSocket_.FlushDeletedFiles(path_, deleted_, failed_, !(result & FZ_REPLY_DISCONNECTED));
 	return result;
 }
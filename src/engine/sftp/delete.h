@@ -23,7 +23,9 @@ public:
 	// sending an updated listing to the UI.
 	fz::datetime time_;
 
-	bool needSendListing_{};
+	// Files deleted and number of failures since the last update
+	std::vector<std::wstring> deleted_;
+	uint64_t failed_{};
 
 	// Set to true if deletion of at least one file failed
 	bool deleteFailed_{};
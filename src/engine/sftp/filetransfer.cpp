@@ -62,7 +62,12 @@ int CSftpFileTransferOpData::Send()
 			logstr = L"re";
 		}
 		if (download()) {
-			engine_.transfer_status_.Init(remoteFileSize_, resume_ ? localFileSize_ : 0, false);
+			if (range_) {
+				engine_.transfer_status_.Init(range_.length, resume_ ? localFileSize_ : 0, false);
+			}
+			else {
+				engine_.transfer_status_.Init(remoteFileSize_, resume_ ? localFileSize_ : 0, false);
+			}
 			cmd += "get ";
 			logstr += L"get ";
 			
@@ -77,6 +82,12 @@ int CSftpFileTransferOpData::Send()
 			std::wstring localFile = controlSocket_.QuoteFilename(localName_);
 			cmd += fz::to_utf8(localFile);
 			logstr += localFile;
+
+			if (range_) {
+				std::wstring const range = fz::sprintf(L" %d %d", range_.offset, range_.length);
+				cmd += fz::to_utf8(range);
+				logstr += range;
+			}
 		}
 		else {
 			engine_.transfer_status_.Init(localFileSize_, resume_ ? remoteFileSize_ : 0, false);
@@ -133,7 +144,7 @@ int CSftpFileTransferOpData::ParseResponse()
 		writer_.reset();
 		if (controlSocket_.result_ == FZ_REPLY_OK && options_.get_int(OPTION_PRESERVE_TIMESTAMPS)) {
 			if (download()) {
-				if (!remoteFileTime_.empty()) {
+				if (!remoteFileTime_.empty() && !range_) {
 					if (!writer_factory_->set_mtime(remoteFileTime_)) {
 						log(logmsg::debug_warning, L"Could not set modification time");
 					}
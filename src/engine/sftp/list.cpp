@@ -32,6 +32,10 @@ int CSftpListOpData::Send()
 			log(logmsg::status, _("Retrieving directory listing of \"%s\"..."), newPath.GetPath());
 		}
 
+		if (controlSocket_.SendCachedDirectoryListing(path_, subDir_, flags_)) {
+			return FZ_REPLY_OK;
+		}
+
 		controlSocket_.ChangeDir(path_, subDir_, (flags_ & LIST_FLAG_LINK) != 0);
 		opState = list_waitcwd;
 		return FZ_REPLY_CONTINUE;
@@ -63,6 +67,7 @@ int CSftpListOpData::Send()
 	}
 	else if (opState == list_list) {
 		listing_parser_ = std::make_unique<CDirectoryListingParser>(&controlSocket_, currentServer_, listingEncoding::unknown);
+		listing_parser_->SetPartialDelivery(currentPath_);
 		return controlSocket_.SendCommand(L"ls");
 	}
 
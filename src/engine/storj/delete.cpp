@@ -46,21 +46,17 @@ int CStorjDeleteOpData::ParseResponse()
 {
 	if (controlSocket_.result_ != FZ_REPLY_OK) {
 		deleteFailed_ = true;
+		++failed_;
 	}
 	else {
-		std::wstring const& file = files_.back();
-
-		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, file);
+		deleted_.push_back(files_.back());
+	}
 
-		auto const now = fz::datetime::now();
-		if (!time_.empty() && (now - time_).get_seconds() >= 1) {
-			controlSocket_.SendDirectoryListingNotification(path_, false);
-			time_ = now;
-			needSendListing_ = false;
-		}
-		else {
-			needSendListing_ = true;
-		}
+	// Update the cache and the UI in batches, not for every single file
+	auto const now = fz::datetime::now();
+	if (!time_.empty() && (now - time_).get_seconds() >= 1) {
+		controlSocket_.FlushDeletedFiles(path_, deleted_, failed_, true);
+		time_ = now;
 	}
 
 	files_.pop_back();
@@ -319,11 +319,10 @@ int CStorjControlSocket::ResetOperation(int nErrorCode)
 			log(logmsg::error, _("fzstorj could not be started"));
 		}
 	}
-	if (!operations_.empty() && operations_.back()->opId == Command::del && !(nErrorCode & FZ_REPLY_DISCONNECTED)) {
+	if (!operations_.empty() && operations_.back()->opId == Command::del) {
 		auto &data = static_cast<CStorjDeleteOpData &>(*operations_.back());
-		if (data.needSendListing_) {
-			SendDirectoryListingNotification(data.path_, false);
-		}
+		data.failed_ += data.files_.size();
+		FlushDeletedFiles(data.path_, data.deleted_, data.failed_, !(nErrorCode & FZ_REPLY_DISCONNECTED));
 	}
 
 	return CControlSocket::ResetOperation(nErrorCode);
@@ -54,6 +54,10 @@ public:
 
 	int CacheLookup(CServerPath const& path, CDirectoryListing& listing);
 
+	// Looks up the listing of the given server, does not need a connection.
+	// The cache is shared by all engines of the same context.
+	int CacheLookup(CServer const& server, CServerPath const& path, CDirectoryListing& listing);
+
 private:
 	std::unique_ptr<CFileZillaEnginePrivate> impl_;
 };
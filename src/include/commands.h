@@ -133,6 +133,7 @@ typedef CBasicCommand<Command::disconnect> CDisconnectCommand;
 #define LIST_FLAG_FALLBACK_CURRENT 4
 #define LIST_FLAG_LINK 8
 #define LIST_FLAG_CLEARCACHE 16
+#define LIST_FLAG_PREFETCHED 32
 class FZC_PUBLIC_SYMBOL CListCommand final : public CCommandHelper<CListCommand, Command::list>
 {
 	// Without a given directory, the current directory will be listed.
@@ -152,6 +153,11 @@ class FZC_PUBLIC_SYMBOL CListCommand final : public CCommandHelper<CListCommand,
 	// LIST_FLAG_LINK is used for symlink discovery. There's unfortunately
 	// no sane way to distinguish between symlinks to files and symlinks to
 	// directories.
+	//
+	// LIST_FLAG_PREFETCHED is set by recursive operations for directories
+	// that have just been listed on another connection. If the cache holds
+	// a current listing of the directory, it is sent without changing into
+	// the directory first.
 public:
 	explicit CListCommand(int flags = 0);
 	explicit CListCommand(CServerPath path, std::wstring const& subDir = std::wstring(), int flags = 0);
@@ -221,17 +227,30 @@ namespace ftp_transfer_flags
 	auto constexpr ascii = transfer_flags::protocol_reserved_max;
 }
 
+// Restricts a download to a byte range of the remote file.
+// The writer only receives the bytes inside the range, the first byte
+// of the range is written at the writer's offset 0.
+// A range with a length of 0 denotes the entire file.
+struct FZC_PUBLIC_SYMBOL transfer_range final
+{
+	uint64_t offset{};
+	uint64_t length{};
+
+	explicit operator bool() const { return length != 0; }
+};
+
 class FZC_PUBLIC_SYMBOL CFileTransferCommand final : public CCommandHelper<CFileTransferCommand, Command::transfer>
 {
 public:
 	CFileTransferCommand(fz::reader_factory_holder const& reader, CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraflags = {}, std::string const& persistentState = {});
-	CFileTransferCommand(fz::writer_factory_holder const& writer, CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags = {}, std::string const& persistentState = {});
+	CFileTransferCommand(fz::writer_factory_holder const& writer, CServerPath const& remotePath, std::wstring const& remoteFile, transfer_flags const& flags, std::wstring const& extraFlags = {}, std::string const& persistentState = {}, transfer_range const& range = {});
 
 	CServerPath GetRemotePath() const;
 	std::wstring GetRemoteFile() const;
 	bool Download() const { return flags_ & transfer_flags::download; }
 	transfer_flags const& GetFlags() const { return flags_; }
 	std::wstring const& GetExtraFlags() const { return extraFlags_; }
+	transfer_range const& GetRange() const { return range_; }
 
 	bool valid() const;
 
@@ -245,6 +264,7 @@ protected:
 	std::wstring const m_remoteFile;
 	std::wstring const extraFlags_;
 	std::string const persistentState_;
+	transfer_range const range_;
 	transfer_flags const flags_;
 };
 
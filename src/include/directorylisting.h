@@ -8,6 +8,8 @@
 #include <libfilezilla/time.hpp>
 
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 class FZC_PUBLIC_SYMBOL CDirentry
 {
@@ -88,10 +90,13 @@ public:
 	// entry if you do not call ClearFindMap afterwards
 	CDirentry& get(size_t index);
 
-	size_t size() const { return m_entries ? m_entries->size() : 0; }
+	size_t size() const { return m_entries ? m_entries->size_ : 0; }
 
 	void Append(CDirentry&& entry);
 
+	// Appends copies of the entries of the other listing
+	void Append(CDirectoryListing const& other);
+
 	size_t FindFile_CmpCase(std::wstring const& name) const;
 	size_t FindFile_CmpNoCase(std::wstring const& name) const;
 
@@ -127,7 +132,10 @@ public:
 		listing_failed = 0x100,
 		listing_has_dirs = 0x200,
 		listing_has_perms = 0x400,
-		listing_has_usergroup = 0x800
+		listing_has_usergroup = 0x800,
+
+		// Set on listings that are still being retrieved
+		listing_partial = 0x1000
 	};
 
 	int get_unsure_flags() const { return m_flags & unsure_mask; }
@@ -135,19 +143,73 @@ public:
 	bool has_dirs() const { return (m_flags & listing_has_dirs) != 0; }
 	bool has_perms() const { return (m_flags & listing_has_perms) != 0; }
 	bool has_usergroup() const { return (m_flags & listing_has_usergroup) != 0; }
+	bool partial() const { return (m_flags & listing_partial) != 0; }
 
-	void Assign(std::vector<fz::shared_value<CDirentry>> && entries);
+	void Assign(std::vector<CDirentry> && entries);
 
 	bool RemoveEntry(size_t index);
 
+	// Removes the entries at the given indexes, which need to be sorted in
+	// ascending order. Cheaper than repeated calls to RemoveEntry.
+	// Returns the number of removed entries.
+	size_t RemoveEntries(std::vector<size_t> const& indexes);
+
 	void GetFilenames(std::vector<std::wstring> &names) const;
 
 protected:
 
-	fz::shared_optional<std::vector<fz::shared_value<CDirentry>>> m_entries;
+	// Entries are stored in blocks of up to block_size entries instead of
+	// individually. Copies of a listing share the blocks, modifying or
+	// removing an entry only copies the block containing it.
+	static constexpr size_t block_shift = 7;
+	static constexpr size_t block_size = size_t(1) << block_shift;
+	static constexpr size_t block_mask = block_size - 1;
+
+	struct entry_blocks final
+	{
+		// Block and position within it of the entry at the given index
+		std::pair<size_t, size_t> locate(size_t index) const;
+
+		std::vector<fz::shared_value<std::vector<CDirentry>>> blocks_;
+
+		// Index of the first entry of each block. Only filled once removals
+		// left a block other than the last one partially filled.
+		std::vector<size_t> offsets_;
+
+		size_t size_{};
+	};
+
+	fz::shared_optional<entry_blocks> m_entries;
+
+	// Open addressing hash index over the names of the first indexed_
+	// entries, extended on demand by the lookups. Each slot holds the hash of
+	// the name in the upper and the entry index plus one in the lower half,
+	// empty slots are zero.
+	// The table is shared by the copies of the listing. Entries indexed
+	// while it is shared go into a small table of their own, which only
+	// gets merged into a new copy of the shared table once it has grown
+	// to about the square root of its size.
+	struct find_index final
+	{
+		void insert(uint32_t hash, size_t index);
+
+		// Drops the given entries, which need to be sorted in ascending
+		// order, and renumbers the following ones.
+		void remove(std::vector<size_t> const& indexes);
+
+		std::shared_ptr<std::vector<uint64_t>> slots_;
+		size_t count_{};
+
+		std::vector<uint64_t> recent_;
+		size_t recent_count_{};
+
+		size_t indexed_{};
+	};
+
+	size_t FindFile(std::wstring const& name, bool nocase) const;
 
-	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_case;
-	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_nocase;
+	mutable fz::shared_optional<find_index> m_searchmap_case;
+	mutable fz::shared_optional<find_index> m_searchmap_nocase;
 
 public:
 	int m_flags{};
@@ -52,6 +52,11 @@ enum engineOptions : unsigned int
 
 	OPTION_FTP_SENDKEEPALIVE,
 
+	OPTION_FTP_COMPRESSION,
+	OPTION_FTP_COMPRESSION_TYPES,	// File extensions separated by |
+
+	OPTION_FTP_PIPELINE_DEPTH,	// Maximum number of independent commands sent without waiting for their replies
+
 	OPTION_FTP_PROXY_TYPE,
 	OPTION_FTP_PROXY_HOST,
 	OPTION_FTP_PROXY_USER,
@@ -83,6 +88,9 @@ enum engineOptions : unsigned int
 
 	OPTION_DIRECTORY_LISTING_ITEM_LIMIT,
 
+	OPTION_CACHE_FILE,		// If set, directory cache gets saved to and restored from this file
+	OPTION_CACHE_FILE_SIZELIMIT,	// In MiB, 0 disables the cache file
+
 	OPTIONS_ENGINE_NUM
 };
 
@@ -6,30 +6,85 @@
 #include <libfilezilla/event_handler.hpp>
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/logger.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
 
+#include <atomic>
+
+// Writes the log messages of all engines into the log file.
+//
+// The logging threads only format the message and append it to a buffer,
+// a thread of its own writes the buffer out in large chunks and rotates
+// the file. That way engines do not wait on each other's disk writes.
 class logfile_writer final : public fz::event_handler
 {
 public:
-	logfile_writer(COptionsBase & options, fz::event_loop & loop);
+	logfile_writer(COptionsBase & options, fz::event_loop & loop, fz::thread_pool & pool);
+
+	// Writes out all pending messages
 	~logfile_writer();
 
 	void FZC_PUBLIC_SYMBOL log(fz::logmsg::type type, std::wstring const& msg, fz::datetime const& now, size_t id = 0, fz::logger_interface * error_logger = nullptr);
 
+	// Waits until all messages logged so far have been written
+	void FZC_PUBLIC_SYMBOL flush();
+
+	// As above, but gives up after the timeout. Does not block on the lock
+	// either, so it can be used after a crash in any thread.
+	bool FZC_PUBLIC_SYMBOL flush(fz::duration const& timeout);
+
 private:
-	bool init(fz::scoped_lock & l, fz::logger_interface * error_logger);
-	bool rotate(fz::scoped_lock & l, fz::logger_interface * error_logger);
-	bool do_open(fz::scoped_lock & l, fz::logger_interface * error_logger, fz::native_string const& name, bool empty = false);
+	void entry();
+
+	// The following are only called from the writing thread
+	void write(std::string const& data);
+	bool init();
+	bool rotate();
+	bool do_open(fz::native_string const& name, bool empty = false);
+
+	// Remembered until passed to the error logger of the next message
+	void report_error(std::wstring const& error);
 
 	void operator()(fz::event_base const& ev);
 	COptionsBase & options_;
+	fz::thread_pool & pool_;
 
 	fz::mutex mtx_{false};
-	fz::file file_;
-	bool initialized_{};
+
+	// Wakes the writing thread
+	fz::condition writer_cond_;
+
+	// Signalled whenever the writing thread made progress. As fz::condition
+	// wakes a single thread, only the holder of wait_mtx_ waits on it.
+	fz::condition progress_cond_;
+	fz::mutex wait_mtx_{false};
+	fz::async_task thread_;
+	bool quit_{};
+
+	// No point in formatting messages if there is no log file
+	std::atomic<bool> enabled_{};
+
+	// Messages not yet taken by the writing thread
+	std::string buffer_;
+	std::string writing_;
+	uint64_t queued_{};
+	uint64_t written_{};
+
+	bool reopen_{};
+	std::wstring error_;
+
+	// The formatted timestamp changes at most once per second
+	int64_t timestamp_time_{-1};
+	std::string timestamp_;
 
 	std::string prefixes_[sizeof(fz::logmsg::type) * 8];
 
 	unsigned int const pid_;
+
+	// Only accessed by the writing thread
+	fz::file file_;
+	bool initialized_{};
 	int64_t max_size_{};
 };
 
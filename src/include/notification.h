@@ -37,7 +37,8 @@ enum NotificationId : unsigned int
 	nId_local_dir_created, // local directory has been created
 	nId_serverchange,      // With some protocols, actual server identity isn't known until after logon
 	nId_persistent_state,  // See PersistentStateNotification
-	nId_ftp_tls_resumption
+	nId_ftp_tls_resumption,
+	nId_delete_progress    // files deleted by a CDeleteCommand since the previous notification
 };
 
 // Async request IDs
@@ -120,19 +121,29 @@ public:
 //
 // Primary notifications are those resulting from a CListCommand, other ones
 // can happen spontaneously through other actions.
+//
+// While retrieving large primary listings, partial notifications carrying
+// the entries received since the previous partial notification may be sent.
+// They are always followed by a regular notification for the same path.
 class CDirectoryListing;
 class FZC_PUBLIC_SYMBOL CDirectoryListingNotification final : public CNotificationHelper<nId_listing>
 {
 public:
 	explicit CDirectoryListingNotification(CServerPath const& path, bool const primary, bool const failed = false);
+	explicit CDirectoryListingNotification(std::shared_ptr<CDirectoryListing> const& partial);
 	bool Primary() const { return primary_; }
 	bool Failed() const { return m_failed; }
 	const CServerPath GetPath() const { return m_path; }
 
+	// If set, the notification is partial. The listing holds the new entries,
+	// its m_firstListTime identifies the listing being retrieved.
+	std::shared_ptr<CDirectoryListing> const& GetPartialListing() const { return partial_; }
+
 protected:
 	bool const primary_{};
 	bool m_failed{};
 	CServerPath m_path;
+	std::shared_ptr<CDirectoryListing> partial_;
 };
 
 class FZC_PUBLIC_SYMBOL CAsyncRequestNotification : public CNotificationHelper<nId_asyncrequest>
@@ -380,6 +391,22 @@ public:
 	bool allow_{};
 };
 
+// Sent periodically while processing a CDeleteCommand and once more at its
+// end, counting the files deleted and failed since the previous notification.
+class FZC_PUBLIC_SYMBOL CDeleteProgressNotification final : public CNotificationHelper<nId_delete_progress>
+{
+public:
+	CDeleteProgressNotification(CServerPath const& path, uint64_t deleted, uint64_t failed)
+	    : path_(path)
+	    , deleted_(deleted)
+	    , failed_(failed)
+	{}
+
+	CServerPath const path_;
+	uint64_t const deleted_{};
+	uint64_t const failed_{};
+};
+
 // Can be sent by the engine while processing a CFileTransferCommand.
 // Should the transfer fail, the persistent state can be passed in a subsequent
 // transfer command as the "state" member.
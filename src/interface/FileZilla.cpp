@@ -14,6 +14,7 @@
 #include "wxfilesystem_blob_handler.h"
 #include "renderer.h"
 #include "../commonui/fz_paths.h"
+#include "../include/logfile_writer.h"
 #include "../include/version.h"
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/translate.hpp>
@@ -399,6 +400,11 @@ wxString CFileZillaApp::GetCurrentLanguageCode() const
 #if wxUSE_DEBUGREPORT && wxUSE_ON_FATAL_EXCEPTION
 void CFileZillaApp::OnFatalException()
 {
+	// Keep the messages leading up to the crash, as far as possible
+	auto * frame = dynamic_cast<CMainFrame*>(GetTopWindow());
+	if (frame) {
+		frame->GetEngineContext().GetLogFileWriter().flush(fz::duration::from_seconds(2));
+	}
 }
 #endif
 
@@ -280,6 +280,8 @@ CLocalListView::CLocalListView(CView* pParent, CState& state, CQueueView *pQueue
 	m_parentView(pParent)
 {
 	wxGetApp().AddStartupProfileRecord("CLocalListView::CLocalListView"sv);
+	sortPool_ = &state.pool_;
+
 	m_state.RegisterHandler(this, STATECHANGE_LOCAL_DIR);
 	m_state.RegisterHandler(this, STATECHANGE_APPLYFILTER);
 	m_state.RegisterHandler(this, STATECHANGE_LOCAL_REFRESH_FILE);
@@ -1170,6 +1172,7 @@ bool CLocalListView::OnAcceptRename(const wxListEvent& event)
 	}
 
 	data->name = newname;
+	data->sortKeyMode = NameSortMode::case_sensitive;
 #ifdef __WXMSW__
 	data->label.clear();
 #endif
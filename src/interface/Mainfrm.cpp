@@ -1124,6 +1124,11 @@ void CMainFrame::OnEngineEvent(CFileZillaEngine* engine)
 				pState->ChangeServer(notification.newServer_);
 			}
 			break;
+		case nId_delete_progress:
+			if (pState->GetRemoteRecursiveOperation()) {
+				pState->GetRemoteRecursiveOperation()->ProcessDeleteProgress(static_cast<CDeleteProgressNotification const&>(*pNotification));
+			}
+			break;
 		case nId_ftp_tls_resumption: {
 			auto const& notification = static_cast<FtpTlsResumptionNotification const&>(*pNotification.get());
 			cert_store_->SetSessionResumptionSupport(fz::to_utf8(notification.server_.GetHost()), notification.server_.GetPort(), true, true);
@@ -69,6 +69,8 @@ public:
 	CFileZillaEngineContext& GetEngineContext() { return m_engineContext; }
 	void OnEngineEvent(CFileZillaEngine* engine);
 
+	CAsyncRequestQueue& GetAsyncRequestQueue() { return *async_request_queue_; }
+
 private:
 	void UpdateLayout();
 	void FixTabOrder();
@@ -44,6 +44,7 @@ static unsigned int register_interface_options()
 		{ "Language Code", L"", option_flags::normal, 50 },
 		{ "Concurrent download limit", 0, option_flags::numeric_clamp, 0, 10 },
 		{ "Concurrent upload limit", 0, option_flags::numeric_clamp, 0, 10 },
+		{ "Recursive listing connections", 2, option_flags::numeric_clamp, 0, 10 },
 		{ "Show debug menu", false, option_flags::normal },
 		{ "File exists action download", 0, option_flags::normal, 0, 7 },
 		{ "File exists action upload", 0, option_flags::normal, 0, 7 },
@@ -115,7 +116,9 @@ static unsigned int register_interface_options()
 		{ "Drag and Drop disabled", false, option_flags::normal },
 		{ "Disable update footer", false, option_flags::normal },
 		{ "Tab data", L"", option_flags::normal | option_flags::sensitive_data, option_type::xml },
-		{ "Highest shown overlay id", 0, option_flags::normal }
+		{ "Highest shown overlay id", 0, option_flags::normal },
+		{ "Segmented download count", 1, option_flags::numeric_clamp, 1, 10 },
+		{ "Segmented download min size", 64, option_flags::numeric_clamp, 1, 1024 * 1024 }
 	});
 	return value;
 }
@@ -152,6 +155,14 @@ COptions::COptions()
 		wxString msg = error + L"\n\n" + _("For this session the default settings will be used. Any changes to the settings will not be saved.");
 		wxMessageBoxEx(msg, _("Error loading xml file"), wxICON_ERROR);
 	}
+
+	// Keep the directory cache in the settings directory unless configured otherwise
+	if (get_string(OPTION_CACHE_FILE).empty()) {
+		std::wstring const dir = get_string(OPTION_DEFAULT_SETTINGSDIR);
+		if (!dir.empty()) {
+			set(OPTION_CACHE_FILE, dir + L"directorycache.dat");
+		}
+	}
 }
 
 COptions::~COptions()
@@ -16,6 +16,7 @@ enum interfaceOptions : unsigned int
 	OPTION_LANGUAGE,
 	OPTION_CONCURRENTDOWNLOADLIMIT,
 	OPTION_CONCURRENTUPLOADLIMIT,
+	OPTION_RECURSIVE_LIST_CONNECTIONS,
 	OPTION_DEBUG_MENU,
 	OPTION_FILEEXISTS_DOWNLOAD,
 	OPTION_FILEEXISTS_UPLOAD,
@@ -86,6 +87,8 @@ enum interfaceOptions : unsigned int
 	OPTION_DISABLE_UPDATE_FOOTER,
 	OPTION_TAB_DATA,
 	OPTION_SHOWN_OVERLAY,
+	OPTION_SEGMENTED_DOWNLOAD_COUNT,
+	OPTION_SEGMENTED_DOWNLOAD_MINSIZE,
 
 	// Has to be last element
 	OPTIONS_NUM
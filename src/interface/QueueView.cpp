@@ -27,7 +27,9 @@
 #include "../commonui/auto_ascii_files.h"
 #include "../commonui/misc.h"
 
+#include <libfilezilla/file.hpp>
 #include <libfilezilla/glue/wxinvoker.hpp>
+#include <libfilezilla/local_filesys.hpp>
 
 #if WITH_LIBDBUS
 #include "../dbus/desktop_notification.h"
@@ -253,6 +255,7 @@ CQueueView::CQueueView(CQueue* parent, int index, CMainFrame* pMainFrame, CAsync
 #endif
 
 	m_resize_timer.SetOwner(this);
+	changed_directories_timer_.SetOwner(this);
 }
 
 CQueueView::~CQueueView()
@@ -260,7 +263,10 @@ CQueueView::~CQueueView()
 	options_.unwatch_all(this);
 	DeleteEngines();
 
+	m_segmentAssemblyTasks.clear();
+
 	m_resize_timer.Stop();
+	changed_directories_timer_.Stop();
 }
 
 bool CQueueView::QueueFile(bool const queueOnly, bool const download,
@@ -297,6 +303,10 @@ bool CQueueView::QueueFile(bool const queueOnly, bool const download,
 		flags -= custom_flags_mask;
 		flags |= custom_flags;
 
+		if (edit == CEditHandler::none && QueueSegmentedDownload(pServerItem, flags, sourceFile, targetFile, localPath, remotePath, size, extraFlags, priority)) {
+			return true;
+		}
+
 		fileItem = new CFileItem(pServerItem, flags, sourceFile, targetFile, localPath, remotePath, size, extraFlags);
 		fileItem->m_edit = edit;
 		if (edit != CEditHandler::none) {
@@ -310,6 +320,308 @@ bool CQueueView::QueueFile(bool const queueOnly, bool const download,
 	return true;
 }
 
+bool CQueueView::QueueSegmentedDownload(CServerItem* pServerItem, transfer_flags const& flags,
+	std::wstring const& sourceFile, std::wstring const& targetFile,
+	CLocalPath const& localPath, CServerPath const& remotePath, int64_t size,
+	std::wstring const& extraFlags, QueuePriority priority)
+{
+	if (!(flags & transfer_flags::download) || (flags & ftp_transfer_flags::ascii) || size <= 0) {
+		return false;
+	}
+
+	int count = options_.get_int(OPTION_SEGMENTED_DOWNLOAD_COUNT);
+	if (count < 2) {
+		return false;
+	}
+
+	Site const& site = pServerItem->GetSite();
+	switch (site.server.GetProtocol()) {
+	case FTP:
+	case FTPS:
+	case FTPES:
+	case INSECURE_FTP:
+	case SFTP:
+		break;
+	default:
+		return false;
+	}
+
+	int64_t const minSize = static_cast<int64_t>(options_.get_int(OPTION_SEGMENTED_DOWNLOAD_MINSIZE)) * 1024 * 1024;
+	if (size < minSize) {
+		return false;
+	}
+
+	int const maxConnections = site.server.MaximumMultipleConnections();
+	if (maxConnections > 0 && count > maxConnections) {
+		count = maxConnections;
+	}
+	if (count < 2) {
+		return false;
+	}
+
+	// Segments are only used for fresh downloads, resuming and overwrite
+	// prompts would otherwise apply to the parts rather than the target.
+	std::wstring const localFile = localPath.GetPath() + (targetFile.empty() ? sourceFile : targetFile);
+	if (fz::local_filesys::get_file_type(fz::to_native(localFile)) != fz::local_filesys::unknown) {
+		return false;
+	}
+
+	int64_t const segmentSize = size / count;
+	for (int i = 0; i < count; ++i) {
+		file_segment segment;
+		segment.offset = segmentSize * i;
+		segment.length = (i == count - 1) ? (size - segment.offset) : segmentSize;
+		segment.file_size = size;
+
+		CFileItem* fileItem = new CFileItem(pServerItem, flags, sourceFile, targetFile, localPath, remotePath, segment.length, extraFlags, std::string(), segment);
+		fileItem->SetPriorityRaw(priority);
+		InsertItem(pServerItem, fileItem);
+	}
+
+	return true;
+}
+
+void CQueueView::TrackSegment(CFileItem const& item)
+{
+	file_segment const segment = item.GetSegment();
+	if (!segment) {
+		return;
+	}
+
+	auto & file = m_segmentedFiles[item.GetLocalPath().GetPath() + item.GetLocalFile()];
+	++file.queued;
+	file.size = segment.file_size;
+}
+
+void CQueueView::RemoveSegment(CFileItem const& item, segment_result result)
+{
+	if (!item.GetSegment()) {
+		return;
+	}
+
+	std::wstring const target = item.GetLocalPath().GetPath() + item.GetLocalFile();
+	auto it = m_segmentedFiles.find(target);
+	if (it == m_segmentedFiles.end()) {
+		return;
+	}
+
+	--it->second.queued;
+	if (result == segment_result::failed) {
+		it->second.failed = true;
+	}
+	else if (result == segment_result::removed) {
+		it->second.removed = true;
+	}
+	CheckSegmentedFile(target);
+}
+
+void CQueueView::RemoveFailedSegment(CFileItem const& item)
+{
+	if (!item.GetSegment()) {
+		return;
+	}
+
+	std::wstring const target = item.GetLocalPath().GetPath() + item.GetLocalFile();
+	auto it = m_segmentedFiles.find(target);
+	if (it != m_segmentedFiles.end()) {
+		// Deleted once the queued segments are done
+		it->second.removed = true;
+	}
+	else if (!HasPendingSegments(target)) {
+		DeleteSegments(target);
+	}
+}
+
+bool CQueueView::HasPendingSegments(std::wstring const& target) const
+{
+	auto it = m_segmentedFiles.find(target);
+	if (it != m_segmentedFiles.end() && it->second.queued > 0) {
+		return true;
+	}
+
+	for (auto const* pServerItem : m_serverList) {
+		if (pServerItem->pending_.segments.find(target) != pServerItem->pending_.segments.cend()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void CQueueView::CheckSegmentedFile(std::wstring const& target)
+{
+	auto it = m_segmentedFiles.find(target);
+	if (it == m_segmentedFiles.end() || HasPendingSegments(target)) {
+		return;
+	}
+
+	segmented_file const file = it->second;
+	m_segmentedFiles.erase(it);
+
+	if (file.removed) {
+		DeleteSegments(target);
+	}
+	else if (!file.failed) {
+		StartSegmentAssembly(target, file.size);
+	}
+}
+
+namespace {
+// Number of stored files read at once per server
+int const queue_page_size = 10000;
+
+// Joins the segment parts of a file into the target file.
+// Runs on a worker thread. Returns an error description on failure.
+std::wstring AssembleSegments(std::wstring const& target, int64_t fileSize)
+{
+	std::vector<std::wstring> parts;
+	int64_t offset{};
+	while (offset < fileSize) {
+		std::wstring part = GetSegmentFileName(target, offset);
+		int64_t const partSize = fz::local_filesys::get_size(fz::to_native(part));
+		if (partSize <= 0) {
+			return fz::sprintf(fztranslate("Segment \"%s\" is missing."), part);
+		}
+		offset += partSize;
+		parts.push_back(std::move(part));
+	}
+	if (offset != fileSize) {
+		return fz::sprintf(fztranslate("Size of the segments of \"%s\" does not match the size of the file."), target);
+	}
+
+	if (fz::local_filesys::get_file_type(fz::to_native(target)) != fz::local_filesys::unknown) {
+		return fz::sprintf(fztranslate("Target file \"%s\" already exists."), target);
+	}
+	if (!wxRenameFile(parts.front(), target, false)) {
+		return fz::sprintf(fztranslate("Could not rename \"%s\"."), parts.front());
+	}
+
+	fz::file out(fz::to_native(target), fz::file::writing, fz::file::existing);
+	if (!out.opened() || out.seek(0, fz::file::end) < 0) {
+		return fz::sprintf(fztranslate("Could not open \"%s\" for writing."), target);
+	}
+
+	std::vector<uint8_t> buffer(256 * 1024);
+	for (size_t i = 1; i < parts.size(); ++i) {
+		fz::file in(fz::to_native(parts[i]), fz::file::reading, fz::file::existing);
+		if (!in.opened()) {
+			return fz::sprintf(fztranslate("Could not open \"%s\" for reading."), parts[i]);
+		}
+		while (true) {
+			fz::rwresult read = in.read2(buffer.data(), buffer.size());
+			if (!read) {
+				return fz::sprintf(fztranslate("Could not read from \"%s\"."), parts[i]);
+			}
+			if (!read.value_) {
+				break;
+			}
+			uint8_t const* p = buffer.data();
+			while (read.value_) {
+				auto const written = out.write2(p, read.value_);
+				if (!written) {
+					return fz::sprintf(fztranslate("Could not write to \"%s\"."), target);
+				}
+				read.value_ -= written.value_;
+				p += written.value_;
+			}
+		}
+		in.close();
+		wxRemoveFile(parts[i]);
+	}
+
+	if (!out.fsync()) {
+		return fz::sprintf(fztranslate("Could not write to \"%s\"."), target);
+	}
+
+	return {};
+}
+
+// Deletes all segment parts of the target file, including those of
+// earlier attempts.
+void DeleteSegmentFiles(std::wstring const& target)
+{
+	CLocalPath path(target);
+	std::wstring name;
+	if (!path.HasParent()) {
+		return;
+	}
+	path = path.GetParent(&name);
+
+	std::wstring const prefix = name + L".";
+	std::wstring const suffix = L".fzpart";
+
+	fz::local_filesys fs;
+	if (!fs.begin_find_files(fz::to_native(path.GetPath()), false)) {
+		return;
+	}
+
+	std::vector<std::wstring> parts;
+	fz::native_string native;
+	while (fs.get_next_file(native)) {
+		std::wstring const file = fz::to_wstring(native);
+		if (file.size() <= prefix.size() + suffix.size() || !fz::starts_with(file, prefix) || !fz::ends_with(file, suffix)) {
+			continue;
+		}
+		std::wstring_view const offset = std::wstring_view(file).substr(prefix.size(), file.size() - prefix.size() - suffix.size());
+		if (std::all_of(offset.cbegin(), offset.cend(), [](wchar_t c) { return c >= '0' && c <= '9'; })) {
+			parts.push_back(path.GetPath() + file);
+		}
+	}
+	fs.end_find_files();
+
+	for (auto const& part : parts) {
+		fz::remove_file(fz::to_native(part), false);
+	}
+}
+}
+
+void CQueueView::StartSegmentAssembly(std::wstring const& target, int64_t fileSize)
+{
+	int const id = ++m_segmentAssemblyId;
+	m_segmentAssemblyTasks[id] = m_pMainFrame->GetEngineContext().GetThreadPool().spawn([this, id, target, fileSize]() {
+		std::wstring error = AssembleSegments(target, fileSize);
+		CallAfter([this, id, target, error = std::move(error)]() {
+			OnSegmentAssemblyDone(id, target, error);
+		});
+	});
+	if (!m_segmentAssemblyTasks[id]) {
+		m_segmentAssemblyTasks.erase(id);
+		m_pMainFrame->GetStatusView()->AddToLog(logmsg::error, fz::sprintf(fztranslate("Could not assemble segments of \"%s\"."), target), fz::datetime::now());
+	}
+}
+
+void CQueueView::OnSegmentAssemblyDone(int id, std::wstring const& target, std::wstring const& error)
+{
+	m_segmentAssemblyTasks.erase(id);
+
+	if (!error.empty()) {
+		m_pMainFrame->GetStatusView()->AddToLog(logmsg::error, std::wstring(error), fz::datetime::now());
+		DeleteSegments(target);
+		return;
+	}
+
+	m_pMainFrame->GetStatusView()->AddToLog(logmsg::status, fz::sprintf(fztranslate("Assembled segmented download \"%s\""), target), fz::datetime::now());
+
+	const std::vector<CState*> *pStates = CContextManager::Get()->GetAllStates();
+	for (auto *pState : *pStates) {
+		pState->RefreshLocalFile(target);
+	}
+}
+
+void CQueueView::DeleteSegments(std::wstring const& target)
+{
+	int const id = ++m_segmentAssemblyId;
+	m_segmentAssemblyTasks[id] = m_pMainFrame->GetEngineContext().GetThreadPool().spawn([this, id, target]() {
+		DeleteSegmentFiles(target);
+		CallAfter([this, id]() {
+			m_segmentAssemblyTasks.erase(id);
+		});
+	});
+	if (!m_segmentAssemblyTasks[id]) {
+		m_segmentAssemblyTasks.erase(id);
+		DeleteSegmentFiles(target);
+	}
+}
+
 void CQueueView::QueueFile_Finish(const bool start)
 {
 	bool need_refresh = false;
@@ -359,6 +671,11 @@ bool CQueueView::QueueFiles(const bool queueOnly, const CLocalPath& localPath, c
 
 		flags |= GetTransferFlags(true, dataObject.GetSite().server, options_, fileInfo.name, dataObject.GetServerPath());
 
+		std::wstring const targetFile = (fileInfo.name != localFile) ? localFile : std::wstring();
+		if (QueueSegmentedDownload(pServerItem, flags, fileInfo.name, targetFile, localPath, dataObject.GetServerPath(), fileInfo.size, {}, QueuePriority::normal)) {
+			continue;
+		}
+
 		CFileItem* fileItem = new CFileItem(pServerItem, flags,
 			fileInfo.name, (fileInfo.name != localFile) ? localFile : std::wstring(),
 			localPath, dataObject.GetServerPath(), fileInfo.size, {});
@@ -514,10 +831,13 @@ void CQueueView::ProcessNotification(t_EngineData *pEngineData, std::unique_ptr<
 	case nId_listing:
 		{
 			auto const& listingNotification = static_cast<CDirectoryListingNotification const&>(*pNotification);
-			if (!listingNotification.GetPath().empty() && !listingNotification.Failed() && pEngineData->pEngine) {
-				std::shared_ptr<CDirectoryListing> pListing = std::make_shared<CDirectoryListing>();
-				if (pEngineData->pEngine->CacheLookup(listingNotification.GetPath(), *pListing) == FZ_REPLY_OK) {
-					CContextManager::Get()->ProcessDirectoryListing(pEngineData->lastSite.server, pListing, 0);
+			if (!listingNotification.GetPath().empty() && !listingNotification.Failed() && !listingNotification.GetPartialListing() && pEngineData->pEngine) {
+				auto entry = std::make_pair(pEngineData->lastSite.server, listingNotification.GetPath());
+				if (std::find(changed_directories_.cbegin(), changed_directories_.cend(), entry) == changed_directories_.cend()) {
+					changed_directories_.emplace_back(std::move(entry));
+				}
+				if (!changed_directories_timer_.IsRunning()) {
+					changed_directories_timer_.Start(250, true);
 				}
 			}
 		}
@@ -677,11 +997,15 @@ bool CQueueView::TryStartNextTransfer()
 			continue;
 		}
 
-		if (!bestMatch.fileItem || newFileItem->GetPriority() > bestMatch.fileItem->GetPriority()) {
+		// Among files of the same priority, share the transfers fairly
+		// between the servers: prefer the one with fewer active transfers.
+		if (!bestMatch.fileItem || newFileItem->GetPriority() > bestMatch.fileItem->GetPriority() ||
+			(newFileItem->GetPriority() == bestMatch.fileItem->GetPriority() && currentServerItem->m_activeCount < bestMatch.serverItem->m_activeCount))
+		{
 			bestMatch.serverItem = currentServerItem;
 			bestMatch.fileItem = newFileItem;
 			bestMatch.pEngineData = pEngineData;
-			if (newFileItem->GetPriority() == QueuePriority::highest) {
+			if (newFileItem->GetPriority() == QueuePriority::highest && !currentServerItem->m_activeCount) {
 				break;
 			}
 		}
@@ -1062,6 +1386,9 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 				Site const site = ((CServerItem*)data.pItem->GetTopLevelItem())->GetSite();
 
 				RemoveItem(data.pItem, false);
+				if (data.pItem->GetType() == QueueItemType::File) {
+					RemoveSegment(static_cast<CFileItem const&>(*data.pItem), segment_result::failed);
+				}
 
 				CQueueViewFailed* pQueueViewFailed = m_pQueue->GetQueueView_Failed();
 				CServerItem* pNewServerItem = pQueueViewFailed->CreateServerItem(site);
@@ -1072,6 +1399,10 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 			}
 		}
 		else if (reason == ResetReason::success) {
+			if (data.pItem->GetType() == QueueItemType::File) {
+				RemoveSegment(static_cast<CFileItem const&>(*data.pItem), segment_result::success);
+			}
+
 			if (data.pItem->GetType() == QueueItemType::File || data.pItem->GetType() == QueueItemType::Folder) {
 				CQueueViewSuccessful* pQueueViewSuccessful = m_pQueue->GetQueueView_Successful();
 				if (pQueueViewSuccessful->AutoClear()) {
@@ -1096,6 +1427,9 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 			}
 		}
 		else if (reason != ResetReason::retry) {
+			if (data.pItem->GetType() == QueueItemType::File) {
+				RemoveSegment(static_cast<CFileItem const&>(*data.pItem), segment_result::removed);
+			}
 			RemoveItem(data.pItem, true);
 		}
 		data.pItem = 0;
@@ -1152,6 +1486,14 @@ bool CQueueView::RemoveItem(CQueueItem* item, bool destroy, bool updateItemCount
 		}
 	}
 
+	if (item->GetType() == QueueItemType::File || item->GetType() == QueueItemType::Folder) {
+		auto & server = static_cast<CServerItem&>(*item->GetTopLevelItem());
+		// The server item stays while it has stored files left
+		if (server.pending_.count && server.GetChildrenCount(false) < queue_page_size / 4) {
+			RequestPendingItems(server);
+		}
+	}
+
 	bool didRemoveParent = CQueueViewBase::RemoveItem(item, destroy, updateItemCount, updateSelections, forward);
 
 	UpdateStatusLinePositions();
@@ -1275,8 +1617,14 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 				res = engineData.pEngine->Execute(cmd);
 			}
 			else {
-				auto cmd = CFileTransferCommand(fz::file_writer_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
-					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags, persistentState);
+				transfer_range range;
+				file_segment const segment = fileItem->GetSegment();
+				if (segment) {
+					range.offset = static_cast<uint64_t>(segment.offset);
+					range.length = static_cast<uint64_t>(segment.length);
+				}
+				auto cmd = CFileTransferCommand(fz::file_writer_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetTransferLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
+					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags, persistentState, range);
 				res = engineData.pEngine->Execute(cmd);
 			}
 
@@ -1456,6 +1804,11 @@ void CQueueView::CheckQueueState()
 	if (m_activeCount)
 		return;
 
+	if (m_activeMode && !m_quit && !pending_load_requests_.empty()) {
+		// Continues once the stored files have been loaded
+		return;
+	}
+
 	if (m_activeMode) {
 		m_activeMode = 0;
 		/* Users don't seem to like this, so comment it out for now.
@@ -1486,6 +1839,7 @@ void CQueueView::CheckQueueState()
 bool CQueueView::IncreaseErrorCount(t_EngineData& engineData)
 {
 	++engineData.pItem->m_errorCount;
+	engineData.pItem->storage_dirty_ = true;
 	if (engineData.pItem->m_errorCount <= options_.get_int(OPTION_RECONNECTCOUNT)) {
 		return true;
 	}
@@ -1582,12 +1936,28 @@ void CQueueView::LoadQueue()
 	// to the same file or one is reading while the other one writes.
 	CInterProcessMutex mutex(MUTEX_QUEUE);
 
+	// The queue stays in the database while this instance is running, it only
+	// writes the changes when saving. Other instances start with an empty
+	// queue, otherwise several instances would transfer the same files.
+	queue_owner_mutex_ = std::make_unique<CInterProcessMutex>(MUTEX_QUEUEOWNER, false);
+	int const owner = queue_owner_mutex_->TryLock();
+	if (owner != 1) {
+		queue_owner_mutex_.reset();
+		if (!owner) {
+			return;
+		}
+	}
+
 	bool error = false;
 
 	if (!m_queue_storage.BeginTransaction()) {
 		error = true;
 	}
 	else {
+		if (!m_queue_storage.PurgeUnusedPaths()) {
+			error = true;
+		}
+
 		Site site;
 		int64_t const first_id = m_queue_storage.GetServer(site, true);
 		auto id = first_id;
@@ -1596,18 +1966,45 @@ void CQueueView::LoadQueue()
 			m_insertionCount = 0;
 			CServerItem *pServerItem = CreateServerItem(site);
 
-			CFileItem* fileItem = 0;
-			int64_t fileId;
-			for (fileId = m_queue_storage.GetFile(&fileItem, id); fileItem; fileId = m_queue_storage.GetFile(&fileItem, 0)) {
-				fileItem->SetParent(pServerItem);
-				fileItem->SetPriority(fileItem->GetPriority());
-				InsertItem(pServerItem, fileItem);
+			// If merged into an item of another stored server, the files get
+			// stored anew with that one.
+			if (pServerItem->storage_id_ && pServerItem->storage_id_ != id) {
+				CFileItem* fileItem = 0;
+				int64_t fileId;
+				for (fileId = m_queue_storage.GetFile(&fileItem, id); fileItem; fileId = m_queue_storage.GetFile(&fileItem, 0)) {
+					fileItem->SetParent(pServerItem);
+					fileItem->SetPriority(fileItem->GetPriority());
+					InsertItem(pServerItem, fileItem);
+				}
+				if (fileId < 0) {
+					error = true;
+				}
 			}
-			if (fileId < 0) {
-				error = true;
+			else {
+				// Only the first page of files is loaded, the rest once needed
+				pServerItem->storage_id_ = id;
+				if (m_queue_storage.GetPendingFiles(id, pServerItem->pending_)) {
+					m_fileCount += pServerItem->pending_.count;
+					m_totalQueueSize += pServerItem->pending_.size;
+					m_filesWithUnknownSize += pServerItem->pending_.unknown_size;
+				}
+				else {
+					error = true;
+				}
+
+				// Files of invalid sites are skipped, keep going until something got loaded
+				while (!pServerItem->GetChild(0) && m_queue_storage.HasPendingFiles(id)) {
+					if (!LoadPendingItems(*pServerItem)) {
+						error = true;
+						break;
+					}
+				}
 			}
 
 			if (!pServerItem->GetChild(0)) {
+				m_fileCount -= pServerItem->pending_.count;
+				m_totalQueueSize -= pServerItem->pending_.size;
+				m_filesWithUnknownSize -= pServerItem->pending_.unknown_size;
 				m_itemCount--;
 				m_serverList.pop_back();
 				delete pServerItem;
@@ -1617,11 +2014,10 @@ void CQueueView::LoadQueue()
 			error = true;
 		}
 
-		if (error || first_id > 0) {
-			if (options_.get_int(OPTION_DEFAULT_KIOSKMODE) != 2) {
-				if (!m_queue_storage.Clear()) {
-					error = true;
-				}
+		if (first_id > 0 && m_serverList.empty() && options_.get_int(OPTION_DEFAULT_KIOSKMODE) != 2) {
+			// Nothing usable was stored, start over with an empty database
+			if (!m_queue_storage.Clear()) {
+				error = true;
 			}
 
 			if (!m_queue_storage.EndTransaction()) {
@@ -1633,8 +2029,8 @@ void CQueueView::LoadQueue()
 			}
 		}
 		else {
-			// Queue was already empty. No need to commit
-			if (!m_queue_storage.EndTransaction(true)) {
+			// Rows of invalid items are left for SaveQueue to delete
+			if (!m_queue_storage.EndTransaction()) {
 				error = true;
 			}
 		}
@@ -1650,6 +2046,175 @@ void CQueueView::LoadQueue()
 	}
 }
 
+bool CQueueView::LoadPendingItems(CServerItem & server)
+{
+	loading_pending_ = true;
+
+	pending_items loaded;
+
+	CFileItem* fileItem = 0;
+	int64_t fileId;
+	for (fileId = m_queue_storage.GetFile(&fileItem, server.storage_id_, queue_page_size); fileItem; fileId = m_queue_storage.GetFile(&fileItem, 0)) {
+		fileItem->SetParent(&server);
+		fileItem->SetPriority(fileItem->GetPriority());
+		InsertItem(&server, fileItem);
+		fileItem->storage_id_ = fileId;
+		fileItem->storage_dirty_ = false;
+
+		++loaded.count;
+		if (fileItem->GetType() == QueueItemType::File) {
+			if (fileItem->GetSegment()) {
+				// Now counted in m_segmentedFiles
+				auto it = server.pending_.segments.find(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile());
+				if (it != server.pending_.segments.end() && !--it->second) {
+					server.pending_.segments.erase(it);
+				}
+			}
+
+			int64_t const size = fileItem->GetSize();
+			if (size < 0) {
+				++loaded.unknown_size;
+			}
+			else {
+				loaded.size += size;
+			}
+		}
+	}
+
+	// InsertItem has counted the loaded items already
+	pending_items const old = server.pending_;
+	if (fileId < 0 || !m_queue_storage.HasPendingFiles(server.storage_id_)) {
+		server.pending_ = pending_items();
+	}
+	else {
+		server.pending_.count = std::max(0, old.count - loaded.count);
+		server.pending_.size = std::max(int64_t(0), old.size - loaded.size);
+		server.pending_.unknown_size = std::max(0, old.unknown_size - loaded.unknown_size);
+	}
+	m_fileCount -= old.count - server.pending_.count;
+	m_totalQueueSize -= old.size - server.pending_.size;
+	m_filesWithUnknownSize -= old.unknown_size - server.pending_.unknown_size;
+	m_fileCountChanged = true;
+
+	loading_pending_ = false;
+
+	return fileId >= 0;
+}
+
+bool CQueueView::LoadAllPendingItems(CServerItem & server)
+{
+	while (server.pending_.count && m_queue_storage.HasPendingFiles(server.storage_id_)) {
+		if (!LoadPendingItems(server)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void CQueueView::DiscardPendingItems(CServerItem & server)
+{
+	if (!server.pending_.count && !m_queue_storage.HasPendingFiles(server.storage_id_)) {
+		return;
+	}
+
+	m_fileCount -= server.pending_.count;
+	m_totalQueueSize -= server.pending_.size;
+	m_filesWithUnknownSize -= server.pending_.unknown_size;
+	m_fileCountChanged = true;
+	auto const segments = std::move(server.pending_.segments);
+	server.pending_ = pending_items();
+
+	m_queue_storage.DiscardPendingFiles(server.storage_id_);
+
+	for (auto const& segment : segments) {
+		m_segmentedFiles[segment.first].removed = true;
+		CheckSegmentedFile(segment.first);
+	}
+}
+
+void CQueueView::RequestPendingItems(CServerItem & server)
+{
+	if (std::find(pending_load_requests_.cbegin(), pending_load_requests_.cend(), &server) != pending_load_requests_.cend()) {
+		return;
+	}
+
+	if (pending_load_requests_.empty()) {
+		CallAfter(&CQueueView::OnLoadPendingItems);
+	}
+	pending_load_requests_.push_back(&server);
+}
+
+void CQueueView::OnLoadPendingItems()
+{
+	// The requesting servers might have been removed meanwhile, only
+	// compare against the pointers.
+	auto const requests = std::move(pending_load_requests_);
+	pending_load_requests_.clear();
+
+	bool loaded{};
+	bool removed{};
+	for (auto it = m_serverList.begin(); it != m_serverList.end(); ) {
+		auto * server = *it;
+		if (std::find(requests.cbegin(), requests.cend(), server) == requests.cend()) {
+			++it;
+			continue;
+		}
+
+		if (m_queue_storage.HasPendingFiles(server->storage_id_)) {
+			LoadPendingItems(*server);
+			CommitChanges();
+			loaded = true;
+		}
+
+		if (!server->GetChild(0) && !server->pending_.count) {
+			// All its loaded items got removed and nothing is left to load
+			UpdateSelections_ItemRangeRemoved(GetItemIndex(server), 1);
+			delete server;
+			it = m_serverList.erase(it);
+			--m_itemCount;
+			removed = true;
+			continue;
+		}
+		++it;
+	}
+
+	if (removed) {
+		SaveSetItemCount(m_itemCount);
+	}
+	if (loaded || removed) {
+		DisplayNumberQueuedFiles();
+		UpdateStatusLinePositions();
+		RefreshListOnly();
+	}
+	if (loaded) {
+		RequestVisiblePendingItems();
+	}
+	if (m_activeMode) {
+		// Also lets CheckQueueState finish if nothing got loaded
+		AdvanceQueue(false);
+	}
+}
+
+void CQueueView::RequestVisiblePendingItems()
+{
+	int const top = GetTopItem();
+	int const bottom = top + GetCountPerPage();
+
+	int index = 0;
+	for (auto * server : m_serverList) {
+		if (index > bottom) {
+			break;
+		}
+
+		// Load the next page once the last loaded item of a server is in view
+		int const last = index + static_cast<int>(server->GetChildrenCount(true));
+		if (server->pending_.count && last >= top && last <= bottom) {
+			RequestPendingItems(*server);
+		}
+		index = last + 1;
+	}
+}
+
 void CQueueView::ImportQueue(pugi::xml_node element, bool updateSelections)
 {
 	auto xServer = element.child("Server");
@@ -1705,10 +2270,23 @@ void CQueueView::ImportQueue(pugi::xml_node element, bool updateSelections)
 						previousRemotePath = remotePath;
 					}
 
+					file_segment segment;
+					if (flags & transfer_flags::download) {
+						auto xSegment = file.child("Segment");
+						if (xSegment) {
+							segment.offset = GetTextElementInt(xSegment, "Offset", -1);
+							segment.length = GetTextElementInt(xSegment, "Length");
+							segment.file_size = GetTextElementInt(xSegment, "FileSize");
+							if (segment.offset < 0 || segment.length <= 0 || segment.offset + segment.length > segment.file_size) {
+								segment = file_segment();
+							}
+						}
+					}
+
 					CFileItem* fileItem = new CFileItem(pServerItem, flags,
 						(flags & transfer_flags::download) ? remoteFile : localFileName,
 						(remoteFile != localFileName) ? ((flags & transfer_flags::download) ? localFileName : remoteFile) : std::wstring(),
-						previousLocalPath, previousRemotePath, size, extraFlags);
+						previousLocalPath, previousRemotePath, size, extraFlags, std::string(), segment);
 					fileItem->SetPriorityRaw(QueuePriority(priority));
 					fileItem->m_errorCount = errorCount;
 					InsertItem(pServerItem, fileItem);
@@ -1786,6 +2364,7 @@ void CQueueView::OnPostScroll()
 	if (GetTopItem() != m_lastTopItem) {
 		UpdateStatusLinePositions();
 	}
+	RequestVisiblePendingItems();
 }
 
 void CQueueView::OnContextMenu(wxContextMenuEvent&)
@@ -1944,6 +2523,17 @@ void CQueueView::RemoveAll()
 	std::vector<CServerItem*> newServerList;
 	m_itemCount = 0;
 	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
+		DiscardPendingItems(**iter);
+
+		// Active items only get removed once stopped
+		auto const& children = (*iter)->GetChildren();
+		for (size_t i = static_cast<size_t>((*iter)->GetRemovedAtFront()); i < children.size(); ++i) {
+			auto const* pItem = children[i];
+			if (pItem->GetType() == QueueItemType::File && !static_cast<CFileItem const*>(pItem)->IsActive()) {
+				RemoveSegment(static_cast<CFileItem const&>(*pItem), segment_result::removed);
+			}
+		}
+
 		if ((*iter)->TryRemoveAll()) {
 			delete *iter;
 		}
@@ -2016,6 +2606,7 @@ void CQueueView::OnRemoveSelected(wxCommandEvent&)
 		}
 		else if (pItem->GetType() == QueueItemType::Server) {
 			CServerItem* pServer = (CServerItem*)pItem;
+			DiscardPendingItems(*pServer);
 			StopItem(pServer, false);
 
 			// Server items get deleted automatically if all children are gone
@@ -2046,6 +2637,9 @@ void CQueueView::OnRemoveSelected(wxCommandEvent&)
 		// Finding the child position is O(n) in the worst case, making deletion quadratic. However we already know item's displayed position, use it as guide.
 		// Remark: I suppose this could be further improved by using the displayed position directly, but probably isn't worth the effort.
 		bool forward = selectedItem.first < (topItemIndex + static_cast<int>(pTopLevelItem->GetChildrenCount(false)) / 2);
+		if (pItem->GetType() == QueueItemType::File) {
+			RemoveSegment(static_cast<CFileItem const&>(*pItem), segment_result::removed);
+		}
 		RemoveItem(pItem, true, false, false, forward);
 	}
 	DisplayNumberQueuedFiles();
@@ -2108,6 +2702,9 @@ bool CQueueView::StopItem(CServerItem* pServerItem, bool updateSelections)
 			wxASSERT(false);
 		}
 
+		if (pItem->GetType() == QueueItemType::File) {
+			RemoveSegment(static_cast<CFileItem const&>(*pItem), segment_result::removed);
+		}
 		if (RemoveItem(pItem, true, false, updateSelections, false)) {
 			DisplayNumberQueuedFiles();
 			SaveSetItemCount(m_itemCount);
@@ -2228,12 +2825,14 @@ void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
 						break;
 					}
 					pFileItem->m_defaultFileExistsAction = downloadAction;
+					pFileItem->storage_dirty_ = true;
 				}
 				else {
 					if (!has_upload) {
 						break;
 					}
 					pFileItem->m_defaultFileExistsAction = uploadAction;
+					pFileItem->storage_dirty_ = true;
 				}
 			}
 			break;
@@ -2301,6 +2900,17 @@ t_EngineData* CQueueView::GetIdleEngine(Site const& site, bool allowTransient)
 }
 
 
+int CQueueView::GetConnectionCount(CServer const& server) const
+{
+	int count = 0;
+	for (auto const* data : m_engineData) {
+		if (!data->transient && data->pEngine && data->lastSite.server == server && data->pEngine->IsConnected()) {
+			++count;
+		}
+	}
+	return count;
+}
+
 t_EngineData* CQueueView::GetEngineData(CFileZillaEngine const* pEngine)
 {
 	for (unsigned int i = 0; i < m_engineData.size(); ++i) {
@@ -2491,8 +3101,22 @@ void CQueueView::AdvanceQueue(bool refresh)
 
 void CQueueView::InsertItem(CServerItem* pServerItem, CQueueItem* pItem)
 {
+	if (!loading_pending_ && pServerItem->pending_.count) {
+		// New items go after the stored ones
+		LoadAllPendingItems(*pServerItem);
+	}
+
 	CQueueViewBase::InsertItem(pServerItem, pItem);
 
+	if (pItem->GetType() == QueueItemType::File) {
+		TrackSegment(static_cast<CFileItem const&>(*pItem));
+	}
+
+	if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder) {
+		// Items coming from the other queue tabs are not in the database
+		static_cast<CFileItem*>(pItem)->storage_id_ = 0;
+	}
+
 	if (pItem->GetType() == QueueItemType::File) {
 		CFileItem* pFileItem = (CFileItem*)pItem;
 
@@ -2531,6 +3155,11 @@ void CQueueView::OnTimer(wxTimerEvent& event)
 		return;
 	}
 
+	if (id == changed_directories_timer_.GetId()) {
+		ProcessChangedDirectories();
+		return;
+	}
+
 	for (auto & pData : m_engineData) {
 		if (pData->m_idleDisconnectTimer && !pData->m_idleDisconnectTimer->IsRunning()) {
 			delete pData->m_idleDisconnectTimer;
@@ -2545,6 +3174,26 @@ void CQueueView::OnTimer(wxTimerEvent& event)
 	event.Skip();
 }
 
+void CQueueView::ProcessChangedDirectories()
+{
+	auto changed = std::move(changed_directories_);
+	changed_directories_.clear();
+
+	// The cache is shared, any engine can look up the listings. The engine
+	// that made the change may have disconnected in the meantime.
+	auto const it = std::find_if(m_engineData.cbegin(), m_engineData.cend(), [](t_EngineData const* engineData) { return engineData->pEngine != nullptr; });
+	if (it == m_engineData.cend()) {
+		return;
+	}
+
+	for (auto const& [server, path] : changed) {
+		auto listing = std::make_shared<CDirectoryListing>();
+		if ((*it)->pEngine->CacheLookup(server, path, *listing) == FZ_REPLY_OK) {
+			CContextManager::Get()->ProcessDirectoryListing(server, listing, 0);
+		}
+	}
+}
+
 void CQueueView::DeleteEngines()
 {
 	for (auto & engineData : m_engineData) {
@@ -3080,6 +3729,7 @@ void CQueueView::OnStateChange(CState*, t_statechange_notifications notification
 						site = (*it)->GetSite(); // Credentials aren't in ==
 						unprotect(site.credentials, loginManager->GetDecryptor(site.credentials.encrypted_), true);
 						(*it)->GetCredentials() = site.credentials;
+						(*it)->storage_dirty_ = true;
 						break;
 					}
 				}
@@ -3091,6 +3741,7 @@ void CQueueView::OnStateChange(CState*, t_statechange_notifications notification
 			}
 
 			protect((*it)->GetCredentials());
+			(*it)->storage_dirty_ = true;
 			++it;
 		}
 	}
@@ -3108,6 +3759,11 @@ void CQueueView::OnColumnClicked(wxListEvent &event)
 	bool const reverse = wxGetKeyState(WXK_SHIFT);
 
 	for (auto * serverItem : m_serverList) {
+		// Sorted items are stored anew, after any stored ones not loaded yet
+		if (serverItem->pending_.count) {
+			LoadAllPendingItems(*serverItem);
+			CommitChanges();
+		}
 		serverItem->Sort(col, reverse);
 	}
 
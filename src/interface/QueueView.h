@@ -14,7 +14,10 @@
 
 #include <wx/progdlg.h>
 
+#include <libfilezilla/thread_pool.hpp>
+
 #include <list>
+#include <map>
 #include <set>
 
 namespace ActionAfterState {
@@ -85,6 +88,7 @@ struct t_EngineData final
 class CMainFrame;
 class CStatusLineCtrl;
 class CAsyncRequestQueue;
+class CInterProcessMutex;
 class CQueue;
 #if WITH_LIBDBUS
 class CDesktopNotification;
@@ -158,6 +162,9 @@ public:
 
 	std::shared_ptr<CActionAfterBlocker> GetActionAfterBlocker();
 
+	// Number of connections the queue currently holds to the given server
+	int GetConnectionCount(CServer const& server) const;
+
 protected:
 
 #ifdef __WXMSW__
@@ -269,8 +276,66 @@ protected:
 
 	wxTimer m_resize_timer;
 
+	// Directories changed by the transfer engines. Their listings are
+	// passed on to the views together after a short delay, so that many
+	// small transfers into the same directory do not refresh the views
+	// once per file.
+	void ProcessChangedDirectories();
+	std::vector<std::pair<CServer, CServerPath>> changed_directories_;
+	wxTimer changed_directories_timer_;
+
 	void ReleaseExclusiveEngineLock(CFileZillaEngine* pEngine);
 
+	// Splits a download into several segments if enabled and applicable.
+	// Returns false if the file should be queued as a single item.
+	bool QueueSegmentedDownload(CServerItem* pServerItem, transfer_flags const& flags,
+		std::wstring const& sourceFile, std::wstring const& targetFile,
+		CLocalPath const& localPath, CServerPath const& remotePath, int64_t size,
+		std::wstring const& extraFlags, QueuePriority priority);
+
+	// Segments of a file, by target file, that are still in the queue or
+	// stored but not loaded yet.
+	struct segmented_file final
+	{
+		int queued{};
+		int64_t size{};
+
+		// Set if a segment failed. The parts are kept instead of assembled,
+		// the failed segments can be requeued.
+		bool failed{};
+
+		// Set if a segment got removed, the parts get deleted instead of
+		// assembled.
+		bool removed{};
+	};
+	std::map<std::wstring, segmented_file> m_segmentedFiles;
+
+	void TrackSegment(CFileItem const& item);
+
+	enum class segment_result
+	{
+		success,
+		failed,
+		removed
+	};
+
+	// Call for each segment that leaves the queue. Once no segments of the
+	// file are left, the parts get assembled, kept or deleted.
+	void RemoveSegment(CFileItem const& item, segment_result result);
+
+	// Call for each segment removed from the failed transfers. The parts
+	// get deleted once no other segments of the file are left.
+	void RemoveFailedSegment(CFileItem const& item);
+	void CheckSegmentedFile(std::wstring const& target);
+	bool HasPendingSegments(std::wstring const& target) const;
+
+	void StartSegmentAssembly(std::wstring const& target, int64_t fileSize);
+	void OnSegmentAssemblyDone(int id, std::wstring const& target, std::wstring const& error);
+	void DeleteSegments(std::wstring const& target);
+
+	std::map<int, fz::async_task> m_segmentAssemblyTasks;
+	int m_segmentAssemblyId{};
+
 #if WITH_LIBDBUS
 	std::unique_ptr<CDesktopNotification> m_desktop_notification;
 #elif defined(__WXGTK__) || defined(__WXMSW__)
@@ -279,6 +344,26 @@ protected:
 
 	CQueueStorage m_queue_storage;
 
+	// Held while this instance's queue is the one stored in m_queue_storage
+	std::unique_ptr<CInterProcessMutex> queue_owner_mutex_;
+
+	// Stored files are loaded page by page. Reads the next page of the
+	// server's files, returns false on error.
+	bool LoadPendingItems(CServerItem & server);
+	bool LoadAllPendingItems(CServerItem & server);
+	bool loading_pending_{};
+
+	// Drops the files of the server that have not been loaded yet
+	void DiscardPendingItems(CServerItem & server);
+
+	// Loads the next page once back in the event loop
+	void RequestPendingItems(CServerItem & server);
+	void OnLoadPendingItems();
+	std::vector<CServerItem*> pending_load_requests_;
+
+	// Requests the next page of the servers whose last loaded item is visible
+	void RequestVisiblePendingItems();
+
 	void OnEngineEvent(CFileZillaEngine* engine);
 
 	void OnAskPassword();
@@ -26,6 +26,7 @@
 #include <wx/menu.h>
 
 #include <algorithm>
+#include <iterator>
 
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/local_filesys.hpp>
@@ -319,6 +320,8 @@ CRemoteListView::CRemoteListView(CView* pParent, CState& state, CQueueView* pQue
 	, CStateEventHandler(state)
 	, m_parentView(pParent)
 {
+	sortPool_ = &state.pool_;
+
 	state.RegisterHandler(this, STATECHANGE_REMOTE_DIR);
 	state.RegisterHandler(this, STATECHANGE_APPLYFILTER);
 	state.RegisterHandler(this, STATECHANGE_REMOTE_LINKNOTDIR);
@@ -493,192 +496,233 @@ void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryLis
 	wxASSERT(m_indexMapping.size() <= pDirectoryListing->size() + 1);
 }
 
-void CRemoteListView::UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
+bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
 {
-	size_t const countRemoved = m_pDirectoryListing->size() - pDirectoryListing->size();
-	if (!countRemoved) {
-		m_pDirectoryListing = pDirectoryListing;
-		UpdateSortComparisonObject();
-		return;
+	if ((pDirectoryListing->get_unsure_flags() & CDirectoryListing::unsure_invalid) || pDirectoryListing->failed()) {
+		return false;
 	}
-	wxASSERT(!IsComparing());
 
-	std::vector<size_t> removedItems;
-	{
-		// Get indexes of the removed items in the listing
-		size_t j = 0;
-		size_t i = 0;
-		while (i < pDirectoryListing->size() && j < m_pDirectoryListing->size()) {
-			const CDirentry& oldEntry = (*m_pDirectoryListing)[j];
-			const wxString& oldName = oldEntry.name;
-			const wxString& newName = (*pDirectoryListing)[i].name;
-			if (oldName == newName) {
-				++i;
-				++j;
-				continue;
-			}
+	// Keeps the old listing alive until done
+	std::shared_ptr<CDirectoryListing> const previous = m_pDirectoryListing;
+	CDirectoryListing const& oldListing = *previous;
+	CDirectoryListing const& newListing = *pDirectoryListing;
 
-			removedItems.push_back(j++);
-		}
-		for (; j < m_pDirectoryListing->size(); ++j) {
-			removedItems.push_back(j);
+	unsigned int const none = static_cast<unsigned int>(-1);
+
+	// Match the entries of both listings by name. Entries in blocks shared by
+	// both listings are unchanged, others need to be compared.
+	std::vector<unsigned int> oldToNew(oldListing.size(), none);
+	std::vector<unsigned int> newToOld(newListing.size(), none);
+	std::vector<bool> changed(oldListing.size());
+	for (size_t i = 0; i < oldListing.size(); ++i) {
+		CDirentry const& oldEntry = oldListing[i];
+		size_t const j = newListing.FindFile_CmpCase(oldEntry.name);
+		if (j == std::wstring::npos || newToOld[j] != none) {
+			continue;
 		}
+		newToOld[j] = static_cast<unsigned int>(i);
+		oldToNew[i] = static_cast<unsigned int>(j);
 
-		wxASSERT(removedItems.size() == countRemoved);
+		CDirentry const& newEntry = newListing[j];
+		changed[i] = &oldEntry != &newEntry && !(oldEntry == newEntry);
 	}
 
-	std::list<int> selectedItems;
-
-	// Number of items left to remove
-	unsigned int toRemove = countRemoved;
-
-	std::list<int> removedIndexes;
+	// If comparing, the sorted items are in m_originalIndexMapping and
+	// m_indexMapping holds the rows of the comparison.
+	bool const compared = !m_originalIndexMapping.empty();
+	std::vector<unsigned int> & sorted = compared ? m_originalIndexMapping : m_indexMapping;
 
-	const int size = m_indexMapping.size();
-	for (int i = size - 1; i >= 0; --i) {
-		bool removed = false;
-
-		unsigned int& index = m_indexMapping[i];
-
-		// j is the offset the index has to be adjusted
-		int j = 0;
-		for (auto iter = removedItems.cbegin(); iter != removedItems.cend(); ++iter, ++j) {
-			if (*iter > index) {
-				break;
-			}
+	std::vector<bool> visible(oldListing.size());
+	for (auto const& index : sorted) {
+		if (index < oldListing.size()) {
+			visible[index] = true;
+		}
+	}
 
-			if (*iter == index) {
-				removedIndexes.push_back(i);
-				removed = true;
-				--toRemove;
-				break;
+	std::vector<bool> selected(oldListing.size());
+	bool has_selections{};
+#ifndef __WXMSW__
+	// GetNextItem is O(n) if nothing is selected, GetSelectedItemCount() is O(1)
+	if (GetSelectedItemCount())
+#endif
+	{
+		int item = -1;
+		while ((item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) != -1) {
+			unsigned int const index = m_indexMapping[item];
+			if (index < oldListing.size()) {
+				selected[index] = true;
+				has_selections = true;
 			}
 		}
+	}
 
-		// Get old selection
-		bool isSelected = GetItemState(i, wxLIST_STATE_SELECTED) != 0;
+	int focused_item = -1;
+	unsigned int focused_index = none;
+	if (!compared) {
+		focused_item = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED);
+		if (focused_item > 0 && m_indexMapping[focused_item] < oldListing.size()) {
+			focused_index = oldToNew[m_indexMapping[focused_item]];
+		}
+	}
 
-		// Update statusbar info
-		if (removed && m_pFilelistStatusBar) {
-			const CDirentry& oldEntry = (*m_pDirectoryListing)[index];
-			if (isSelected) {
-				if (oldEntry.is_dir()) {
+	// Take the removed and changed items out of the status bar counts
+	for (size_t i = 0; i < oldListing.size(); ++i) {
+		if (!visible[i] || (oldToNew[i] != none && !changed[i])) {
+			continue;
+		}
+		CDirentry const& entry = oldListing[i];
+		if (m_pFilelistStatusBar) {
+			if (entry.is_dir()) {
+				if (selected[i]) {
 					m_pFilelistStatusBar->UnselectDirectory();
 				}
-				else {
-					m_pFilelistStatusBar->UnselectFile(oldEntry.size);
-				}
-			}
-			if (oldEntry.is_dir()) {
 				m_pFilelistStatusBar->RemoveDirectory();
 			}
 			else {
-				m_pFilelistStatusBar->RemoveFile(oldEntry.size);
+				if (selected[i]) {
+					m_pFilelistStatusBar->UnselectFile(entry.size);
+				}
+				m_pFilelistStatusBar->RemoveFile(entry.size);
 			}
 		}
+	}
 
-		// Update index
-		index -= j;
-
-		// Update selections
-		bool needSelection;
-		if (selectedItems.empty()) {
-			needSelection = false;
-		}
-		else if (selectedItems.front() == i) {
-			needSelection = true;
-			selectedItems.pop_front();
-		}
-		else {
-			needSelection = false;
+	// Unchanged items keep their data, changed ones at least the sort key of their name
+	std::vector<CGenericFileData> fileData;
+	fileData.reserve(newListing.size() + m_fileData.size() - oldListing.size());
+	for (size_t j = 0; j < newListing.size(); ++j) {
+		unsigned int const i = newToOld[j];
+		if (i != none && !changed[i]) {
+			fileData.emplace_back(std::move(m_fileData[i]));
+			continue;
 		}
 
-		if (isSelected) {
-			if (!needSelection && (toRemove || removed)) {
-				SetSelection(i, false);
-			}
-
-			if (!removed) {
-				selectedItems.push_back(i - toRemove);
+		CDirentry const& entry = newListing[j];
+		CGenericFileData data;
+		if (entry.is_dir()) {
+			data.icon = m_dirIcon;
+#ifndef __WXMSW__
+			if (entry.is_link()) {
+				data.icon += 3;
 			}
+#endif
 		}
-		else if (needSelection) {
-			SetSelection(i, true);
+		if (i != none) {
+			data.sortKey = std::move(m_fileData[i].sortKey);
+			data.sortKeyMode = m_fileData[i].sortKeyMode;
 		}
+		fileData.emplace_back(std::move(data));
 	}
 
-	// Erase file data
-	for (auto iter = removedItems.crbegin(); iter != removedItems.crend(); ++iter) {
-		m_fileData.erase(m_fileData.begin() + *iter);
+	// The parent directory and, if comparing, the fill item
+	for (size_t i = oldListing.size(); i < m_fileData.size(); ++i) {
+		fileData.emplace_back(std::move(m_fileData[i]));
 	}
 
-	// Erase indexes
-	wxASSERT(!toRemove);
-	wxASSERT(removedIndexes.size() == countRemoved);
-	for (auto const& removedIndex : removedIndexes) {
-		m_indexMapping.erase(m_indexMapping.begin() + removedIndex);
+	// Unchanged items stay in order
+	std::vector<unsigned int> kept;
+	kept.reserve(sorted.size());
+	for (auto const& index : sorted) {
+		if (index < oldListing.size() && oldToNew[index] != none && !changed[index]) {
+			kept.push_back(oldToNew[index]);
+		}
 	}
 
-	wxASSERT(m_indexMapping.size() == pDirectoryListing->size() + 1);
-
 	m_pDirectoryListing = pDirectoryListing;
+	m_fileData = std::move(fileData);
 	UpdateSortComparisonObject();
+	SetInfoText();
 
-	if (m_pFilelistStatusBar) {
-		m_pFilelistStatusBar->SetHidden(m_pDirectoryListing->size() + 1 - m_indexMapping.size());
-	}
+	CFilterManager const& filter = m_state.GetStateFilterManager();
+	std::wstring const path = newListing.path.GetPath();
+
+	std::vector<bool> newSelected(m_fileData.size());
+	std::vector<unsigned int> inserted;
+	for (size_t j = 0; j < newListing.size(); ++j) {
+		unsigned int const i = newToOld[j];
+		if (i != none && !changed[i]) {
+			newSelected[j] = selected[i];
+			continue;
+		}
 
-	SaveSetItemCount(m_indexMapping.size());
-}
+		CDirentry const& entry = newListing[j];
+		if (filter.FilenameFiltered(entry.name, path, entry.is_dir(), entry.size, false, 0, entry.time)) {
+			continue;
+		}
 
-bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
-{
-	assert(!IsComparing());
+		inserted.push_back(static_cast<unsigned int>(j));
+		bool const keep_selected = i != none && selected[i];
+		newSelected[j] = keep_selected;
+		if (m_pFilelistStatusBar) {
+			if (entry.is_dir()) {
+				m_pFilelistStatusBar->AddDirectory();
+				if (keep_selected) {
+					m_pFilelistStatusBar->SelectDirectory();
+				}
+			}
+			else {
+				m_pFilelistStatusBar->AddFile(entry.size);
+				if (keep_selected) {
+					m_pFilelistStatusBar->SelectFile(entry.size);
+				}
+			}
+		}
+	}
 
-	const int unsure = pDirectoryListing->get_unsure_flags() & ~(CDirectoryListing::unsure_unknown);
+	// Merge the new and changed items into the sorted ones
+	auto & compare = GetSortComparisonObject();
+	std::sort(inserted.begin(), inserted.end(), SortPredicate(compare));
 
-	if (!unsure) {
-		return false;
-	}
+	sorted.clear();
+	sorted.reserve(kept.size() + inserted.size() + 1);
+	sorted.push_back(newListing.size());
+	std::merge(kept.begin(), kept.end(), inserted.begin(), inserted.end(), std::back_inserter(sorted), SortPredicate(compare));
 
-	if (unsure & CDirectoryListing::unsure_invalid) {
-		return false;
+	if (m_pFilelistStatusBar) {
+		m_pFilelistStatusBar->SetHidden(newListing.size() + 1 - sorted.size());
 	}
 
-	if (!(unsure & ~(CDirectoryListing::unsure_dir_changed | CDirectoryListing::unsure_file_changed))) {
-		if (m_sortColumn != 0 && m_sortColumn != 2) {
-			// If not sorted by file or type, changing file attributes can influence
-			// sort order.
-			return false;
+	if (compared) {
+		// Keep the comparison rows valid until the comparison gets refreshed
+		for (auto & index : m_indexMapping) {
+			if (index < oldListing.size()) {
+				index = oldToNew[index] != none ? oldToNew[index] : newListing.size() + 1;
+			}
+			else {
+				index += newListing.size() - oldListing.size();
+			}
 		}
+		RefreshComparison();
+		return true;
+	}
 
-		if (CFilterManager::HasActiveFilters()) {
-			return false;
-		}
+	if (focused_item > 0 && (static_cast<size_t>(focused_item) >= m_indexMapping.size() || m_indexMapping[focused_item] != focused_index)) {
+		SetItemState(focused_item, 0, wxLIST_STATE_FOCUSED);
+	}
+	else {
+		focused_index = none;
+	}
+	SaveSetItemCount(m_indexMapping.size());
 
-		assert(pDirectoryListing->size() == m_pDirectoryListing->size());
-		if (pDirectoryListing->size() != m_pDirectoryListing->size()) {
-			return false;
+	if (has_selections || focused_index != none) {
+		for (unsigned int i = 1; i < m_indexMapping.size(); ++i) {
+			unsigned int const index = m_indexMapping[i];
+			if (index == focused_index) {
+				SetItemState(i, wxLIST_STATE_FOCUSED, wxLIST_STATE_FOCUSED);
+			}
+			if (has_selections) {
+				bool const is_selected = GetItemState(i, wxLIST_STATE_SELECTED) != 0;
+				if (is_selected != newSelected[index]) {
+					SetSelection(i, newSelected[index]);
+				}
+			}
 		}
-
-		m_pDirectoryListing = pDirectoryListing;
-		UpdateSortComparisonObject();
-
-		// We don't have to do anything
-		return true;
 	}
 
-	if (unsure & (CDirectoryListing::unsure_dir_added | CDirectoryListing::unsure_file_added))
-	{
-		if (unsure & (CDirectoryListing::unsure_dir_removed | CDirectoryListing::unsure_file_removed)) {
-			return false; // Cannot handle both at the same time unfortunately
-		}
-		UpdateDirectoryListing_Added(pDirectoryListing);
-		return true;
+	if (IsComparing()) {
+		RefreshComparison();
 	}
 
-	assert(pDirectoryListing->size() <= m_pDirectoryListing->size());
-	UpdateDirectoryListing_Removed(pDirectoryListing);
 	return true;
 }
 
@@ -693,20 +737,27 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	else if (m_pDirectoryListing->path != pDirectoryListing->path) {
 		reset = true;
 	}
-	else if (m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime && !IsComparing()
-		&& m_pDirectoryListing->size() > 200)
+	else if (m_pDirectoryListing->partial() && m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime && !IsComparing()
+		&& pDirectoryListing->size() >= m_pDirectoryListing->size())
 	{
-		// Updated directory listing. Check if we can use process it in a different,
-		// more efficient way.
+		// More entries of a listing that is still being retrieved
+		UpdateDirectoryListing_Added(pDirectoryListing);
+		RefreshListOnly();
+		return;
+	}
+	else if (m_pDirectoryListing->size() > 200) {
+		// Updated directory listing. Apply the differences to the sorted items
+		// instead of sorting everything again.
 		// Makes only sense for big listings though.
 		if (UpdateDirectoryListing(pDirectoryListing)) {
 			wxASSERT(GetItemCount() == (int)m_indexMapping.size());
-			wxASSERT(GetItemCount() <= (int)m_fileData.size());
-			wxASSERT(GetItemCount() == (int)m_fileData.size() || CFilterManager::HasActiveFilters());
-			wxASSERT(m_pDirectoryListing->size() + 1 >= (size_t)GetItemCount());
-			wxASSERT(m_indexMapping[0] == m_pDirectoryListing->size());
+			if (!IsComparing()) {
+				wxASSERT(GetItemCount() <= (int)m_fileData.size());
+				wxASSERT(m_pDirectoryListing->size() + 1 >= (size_t)GetItemCount());
+				wxASSERT(m_indexMapping[0] == m_pDirectoryListing->size());
 
-			RefreshListOnly();
+				RefreshListOnly();
+			}
 
 			return;
 		}
@@ -2559,7 +2610,7 @@ wxString CRemoteListView::GetItemText(int item, unsigned int column)
 
 void CRemoteListView::UpdateSortComparisonObject()
 {
-	CFileListCtrlSort<CDirectoryListing>::DirSortMode dirSortMode = GetDirSortMode();
+	CFileListCtrlSortBase::DirSortMode dirSortMode = GetDirSortMode();
 	NameSortMode nameSortMode = GetNameSortMode();
 
 	static CDirectoryListing const empty;
@@ -270,7 +270,12 @@ CRemoteTreeView::~CRemoteTreeView()
 void CRemoteTreeView::OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data2)
 {
 	if (notification == STATECHANGE_REMOTE_DIR) {
-		SetDirectoryListing(m_state.GetRemoteDir(), data2 ? *reinterpret_cast<bool const*>(data2) : true);
+		auto const listing = m_state.GetRemoteDir();
+		if (listing && listing->partial()) {
+			// Wait for the complete listing
+			return;
+		}
+		SetDirectoryListing(listing, data2 ? *reinterpret_cast<bool const*>(data2) : true);
 	}
 	else if (notification == STATECHANGE_APPLYFILTER) {
 		ApplyFilters(false);
@@ -5,16 +5,20 @@
 
 #include <libfilezilla/util.hpp>
 
+#include <wx/clipbrd.h>
 #include <wx/dcclient.h>
 #include <wx/menu.h>
 
 #define MAX_LINECOUNT 1000
-#define LINECOUNT_REMOVAL 10
+
+// Minimum time between two updates of the text control
+#define UPDATE_INTERVAL 100
 
 BEGIN_EVENT_TABLE(CStatusView, wxNavigationEnabled<wxWindow>)
 EVT_SIZE(CStatusView::OnSize)
 EVT_MENU(XRCID("ID_CLEARALL"), CStatusView::OnClear)
 EVT_MENU(XRCID("ID_COPYTOCLIPBOARD"), CStatusView::OnCopy)
+EVT_TIMER(wxID_ANY, CStatusView::OnTimer)
 END_EVENT_TABLE()
 
 class CFastTextCtrl final : public wxNavigationEnabled<wxTextCtrl>
@@ -119,6 +123,9 @@ CStatusView::CStatusView(wxWindow* parent, COptionsBase & options)
 
 	m_shown = IsShown();
 
+	m_lines.resize(MAX_LINECOUNT);
+	m_updateTimer.SetOwner(this);
+
 	SetBackgroundStyle(wxBG_STYLE_SYSTEM);
 
 	options_.watch(OPTION_MESSAGELOG_TIMESTAMP, this);
@@ -127,6 +134,7 @@ CStatusView::CStatusView(wxWindow* parent, COptionsBase & options)
 CStatusView::~CStatusView()
 {
 	options_.unwatch_all(this);
+	m_updateTimer.Stop();
 }
 
 void CStatusView::OnSize(wxSizeEvent &)
@@ -144,26 +152,89 @@ void CStatusView::AddToLog(CLogmsgNotification && notification)
 
 void CStatusView::AddToLog(logmsg::type messagetype, std::wstring && message, fz::datetime const& time)
 {
-	if (!m_shown) {
-		if (m_hiddenLines.size() >= MAX_LINECOUNT) {
-			auto it = m_hiddenLines.begin();
-			it->messagetype = messagetype;
-			it->message = message;
-			it->time = time;
-			m_hiddenLines.splice(m_hiddenLines.end(), m_hiddenLines, it );
+	t_line * line;
+	if (m_bufferedLines < m_lines.size()) {
+		line = &GetLine(m_bufferedLines++);
+	}
+	else {
+		// Re-use the oldest line
+		line = &GetLine(0);
+		m_firstLine = (m_firstLine + 1) % m_lines.size();
+		if (m_pendingLines == m_bufferedLines) {
+			--m_pendingLines;
 		}
 		else {
-			t_line line;
-			line.messagetype = messagetype;
-			line.message = message;
-			line.time = time;
-			m_hiddenLines.push_back(line);
+			++m_removedLines;
+			m_removedLength += line->length + 1;
 		}
+	}
+	line->messagetype = messagetype;
+	line->message = std::move(message);
+	line->time = time;
+	line->length = 0;
+	++m_pendingLines;
+
+	if (!m_shown || m_updateTimer.IsRunning()) {
+		return;
+	}
+
+	auto const elapsed = (fz::monotonic_clock::now() - m_lastUpdate).get_milliseconds();
+	if (elapsed >= UPDATE_INTERVAL) {
+		UpdateTextCtrl();
+	}
+	else {
+		m_updateTimer.Start(UPDATE_INTERVAL - elapsed, true);
+	}
+}
+
+void CStatusView::OnTimer(wxTimerEvent&)
+{
+	UpdateTextCtrl();
+}
+
+void CStatusView::UpdateTextCtrl()
+{
+	m_updateTimer.Stop();
+	m_lastUpdate = fz::monotonic_clock::now();
+
+	if (!m_pTextCtrl || (!m_pendingLines && !m_removedLines)) {
 		return;
 	}
 
-	size_t const messageLength = message.size();
+#ifndef __WXGTK__
+	m_pTextCtrl->Freeze();
+#endif
+
+	if (m_removedLines) {
+		if (m_removedLines >= m_nLineCount) {
+			m_pTextCtrl->Clear();
+			m_nLineCount = 0;
+		}
+		else {
+			m_pTextCtrl->Remove(0, m_removedLength);
+			m_nLineCount -= m_removedLines;
+		}
+		m_removedLines = 0;
+		m_removedLength = 0;
+	}
+
+	for (size_t i = m_bufferedLines - m_pendingLines; i < m_bufferedLines; ++i) {
+		AppendLine(GetLine(i));
+	}
+	m_pendingLines = 0;
+
+#ifdef __WXGTK3__
+	// Some smooth scrolling oddities prevent auto-scrolling. Manuall tell it to scroll.
+	m_pTextCtrl->ShowPosition(m_pTextCtrl->GetInsertionPoint());
+#endif
+
+#ifndef __WXGTK__
+	m_pTextCtrl->Thaw();
+#endif
+}
 
+void CStatusView::AppendLine(t_line & line)
+{
 	// This does not clear storage
 	m_formattedMessage.clear();
 
@@ -175,36 +246,24 @@ void CStatusView::AddToLog(logmsg::type messagetype, std::wstring && message, fz
 #endif
 	}
 
-	if (m_nLineCount >= MAX_LINECOUNT) {
-#ifndef __WXGTK__
-		m_pTextCtrl->Freeze();
-#endif //__WXGTK__
-		int oldLength = 0;
-		auto it = m_lineLengths.begin();
-		for (int i = 0; i < LINECOUNT_REMOVAL; ++i) {
-			oldLength += *(it++) + 1;
-		}
-		m_unusedLineLengths.splice(m_unusedLineLengths.end(), m_lineLengths, m_lineLengths.begin(), it);
-		m_pTextCtrl->Remove(0, oldLength);
-	}
 #ifdef __WXMAC__
 	if (m_pTextCtrl->GetInsertionPoint() != m_pTextCtrl->GetLastPosition()) {
 		m_pTextCtrl->SetInsertionPointEnd();
 	}
 #endif
 
-	uint64_t const cache_index = fz::bitscan(messagetype);
+	uint64_t const cache_index = fz::bitscan(line.messagetype);
 
-	size_t lineLength = m_attributeCache[cache_index].len + messageLength;
+	size_t lineLength = m_attributeCache[cache_index].len + line.message.size();
 
 	if (m_showTimestamps) {
-		if (time != m_lastTime) {
-			m_lastTime = time;
+		if (line.time != m_lastTime) {
+			m_lastTime = line.time;
 #ifndef __WXMAC__
-			m_lastTimeString = time.format(_T("%H:%M:%S\t"), fz::datetime::local);
+			m_lastTimeString = line.time.format(_T("%H:%M:%S\t"), fz::datetime::local);
 #else
 			// Tabs on OS X cannot be freely positioned
-			m_lastTimeString = time.format(_T("%H:%M:%S "), fz::datetime::local);
+			m_lastTimeString = line.time.format(_T("%H:%M:%S "), fz::datetime::local);
 #endif
 		}
 		m_formattedMessage += m_lastTimeString;
@@ -229,7 +288,7 @@ void CStatusView::AddToLog(logmsg::type messagetype, std::wstring && message, fz
 		//const wxChar LTR_OVERRIDE = 0x202D;
 		//const wxChar RTL_OVERRIDE = 0x202E;
 
-		if (messagetype == logmsg::command || messagetype == logmsg::reply || messagetype >= logmsg::debug_warning) {
+		if (line.messagetype == logmsg::command || line.messagetype == logmsg::reply || line.messagetype >= logmsg::debug_warning) {
 			// Commands, responses and debug message contain English text,
 			// set LTR reading order for them.
 			m_formattedMessage += LTR_MARK;
@@ -238,7 +297,7 @@ void CStatusView::AddToLog(logmsg::type messagetype, std::wstring && message, fz
 		}
 	}
 
-	m_formattedMessage += message;
+	m_formattedMessage += line.message;
 #if defined(__WXGTK__)
 	// AppendText always calls SetInsertionPointEnd, which is very expensive.
 	// This check however is negligible.
@@ -248,32 +307,14 @@ void CStatusView::AddToLog(logmsg::type messagetype, std::wstring && message, fz
 	else {
 		m_pTextCtrl->WriteText(m_formattedMessage);
 	}
-	#ifdef __WXGTK3__
-		// Some smooth scrolling oddities prevent auto-scrolling. Manuall tell it to scroll.
-		m_pTextCtrl->ShowPosition(m_pTextCtrl->GetInsertionPoint());
-	#endif
 #elif defined(__WXMAC__)
 	m_pTextCtrl->WriteText(m_formattedMessage);
 #else
 	m_pTextCtrl->AppendText(m_formattedMessage, m_nLineCount, m_attributeCache[cache_index].cf);
 #endif
 
-	if (m_nLineCount >= MAX_LINECOUNT) {
-		m_nLineCount -= LINECOUNT_REMOVAL - 1;
-#ifndef __WXGTK__
-		m_pTextCtrl->Thaw();
-#endif
-	}
-	else {
-		m_nLineCount++;
-	}
-	if (m_unusedLineLengths.empty()) {
-		m_lineLengths.push_back(lineLength);
-	}
-	else {
-		m_unusedLineLengths.front() = lineLength;
-		m_lineLengths.splice(m_lineLengths.end(), m_unusedLineLengths, m_unusedLineLengths.begin());
-	}
+	m_nLineCount++;
+	line.length = static_cast<int>(lineLength);
 }
 
 void CStatusView::InitDefAttr()
@@ -475,7 +516,11 @@ void CStatusView::OnClear(wxCommandEvent&)
 		m_pTextCtrl->Clear();
 	}
 	m_nLineCount = 0;
-	m_lineLengths.clear();
+	m_bufferedLines = 0;
+	m_firstLine = 0;
+	m_pendingLines = 0;
+	m_removedLines = 0;
+	m_removedLength = 0;
 }
 
 void CStatusView::OnCopy(wxCommandEvent&)
@@ -488,14 +533,31 @@ void CStatusView::OnCopy(wxCommandEvent&)
 	m_pTextCtrl->GetSelection(&from, &to);
 	if (from != to) {
 		m_pTextCtrl->Copy();
+		return;
 	}
-	else {
-		m_pTextCtrl->Freeze();
-		m_pTextCtrl->SetSelection(-1, -1);
-		m_pTextCtrl->Copy();
-		m_pTextCtrl->SetSelection(from, to);
-		m_pTextCtrl->Thaw();
+
+	// Copy everything from the buffer, including the lines not yet shown
+	std::wstring text;
+	for (size_t i = 0; i < m_bufferedLines; ++i) {
+		t_line const& line = GetLine(i);
+		if (m_showTimestamps) {
+			text += line.time.format(L"%H:%M:%S\t", fz::datetime::local);
+		}
+		text += m_attributeCache[fz::bitscan(line.messagetype)].prefix;
+		text += line.message;
+#ifdef __WXMSW__
+		text += L"\r\n";
+#else
+		text += L"\n";
+#endif
 	}
+
+	if (text.empty() || !wxTheClipboard->Open()) {
+		return;
+	}
+	wxTheClipboard->SetData(new wxTextDataObject(text));
+	wxTheClipboard->Flush();
+	wxTheClipboard->Close();
 }
 
 void CStatusView::SetFocus()
@@ -507,17 +569,8 @@ bool CStatusView::Show(bool show)
 {
 	m_shown = show;
 
-	if (show && m_pTextCtrl) {
-		if (m_hiddenLines.size() >= MAX_LINECOUNT) {
-			m_pTextCtrl->Clear();
-			m_nLineCount = 0;
-			m_unusedLineLengths.splice(m_unusedLineLengths.end(), m_lineLengths, m_lineLengths.begin(), m_lineLengths.end());
-		}
-
-		for (auto & line : m_hiddenLines) {
-			AddToLog(line.messagetype, std::move(line.message), line.time);
-		}
-		m_hiddenLines.clear();
+	if (show) {
+		UpdateTextCtrl();
 	}
 
 	return wxWindow::Show(show);
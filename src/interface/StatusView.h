@@ -9,8 +9,6 @@
 
 #include <wx/timer.h>
 
-#include <list>
-
 class CFastTextCtrl;
 class CStatusView final : public wxNavigationEnabled<wxWindow>, public COptionChangeEventHandler
 {
@@ -29,6 +27,7 @@ public:
 
 private:
 
+	// Number of lines in the text control
 	int m_nLineCount{};
 	CFastTextCtrl *m_pTextCtrl{};
 
@@ -41,9 +40,6 @@ private:
 	void OnCopy(wxCommandEvent& );
 	void OnTimer(wxTimerEvent&);
 
-	std::list<int> m_lineLengths;
-	std::list<int> m_unusedLineLengths;
-
 	struct t_attributeCache
 	{
 		std::wstring prefix;
@@ -58,15 +54,38 @@ private:
 
 	bool m_shown{};
 
-	// Don't update actual log window if not shown,
-	// do it later when showing the window.
+	// The most recent messages, oldest first, in a ring buffer of fixed
+	// capacity. New messages are only added to the text control at a
+	// bounded rate and not at all while the window is hidden. At high
+	// message rates, this turns many small updates of the text control
+	// into few larger ones, and messages that are pushed out of the buffer
+	// before the next update never get added at all.
 	struct t_line
 	{
 		logmsg::type messagetype;
 		std::wstring message;
 		fz::datetime time;
+		int length{}; // In the text control, without the line break
 	};
-	std::list<t_line> m_hiddenLines;
+	std::vector<t_line> m_lines;
+	size_t m_firstLine{};
+	size_t m_bufferedLines{};
+
+	// The last of the lines in the buffer that are not yet in the text control
+	size_t m_pendingLines{};
+
+	// Lines in the text control that are no longer in the buffer
+	int m_removedLines{};
+	long m_removedLength{};
+
+	t_line& GetLine(size_t index) { return m_lines[(m_firstLine + index) % m_lines.size()]; }
+
+	// Brings the text control up to date with the buffer
+	void UpdateTextCtrl();
+	void AppendLine(t_line & line);
+
+	wxTimer m_updateTimer;
+	fz::monotonic_clock m_lastUpdate;
 
 	bool m_showTimestamps{};
 	fz::datetime m_lastTime;
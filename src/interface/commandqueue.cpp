@@ -120,6 +120,7 @@ bool CCommandQueue::Cancel()
 	}
 	else {
 		m_CommandList.clear();
+		m_state.EndPartialRemoteDir();
 		m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
 		return true;
 	}
@@ -290,6 +291,13 @@ void CCommandQueue::ProcessDirectoryListing(CDirectoryListingNotification const&
 	auto const firstListing = std::find_if(m_CommandList.begin(), m_CommandList.end(), [](CommandInfo const& v) { return v.command->GetId() == Command::list; });
 	bool const listingIsRecursive = firstListing != m_CommandList.end() && firstListing->origin == recursiveOperation;
 
+	if (listingNotification.GetPartialListing()) {
+		if (!listingIsRecursive) {
+			m_state.AppendRemoteDir(*listingNotification.GetPartialListing());
+		}
+		return;
+	}
+
 	std::shared_ptr<CDirectoryListing> pListing;
 	if (!listingNotification.GetPath().empty()) {
 		pListing = std::make_shared<CDirectoryListing>();
@@ -395,7 +395,8 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 	}
 	UpdateSortComparisonObject();
 	auto & object = GetSortComparisonObject();
-	std::sort(start, m_indexMapping.end(), SortPredicate(object));
+	object.Prepare();
+	ParallelSort(start, m_indexMapping.end(), SortPredicate(object), sortPool_);
 
 	if (updateSelections) {
 		SortList_UpdateSelections(selected, focused_item, focused_index);
@@ -691,14 +692,14 @@ template<class CFileData> void CFileListCtrl<CFileData>::OnExitComparisonMode()
 	RefreshListOnly();
 }
 
-template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEntryFlags flags)
+template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEntryFlags flags, size_t item)
 {
 	if (flags == fill) {
 		m_indexMapping.push_back(m_fileData.size() - 1);
 		return;
 	}
 
-	int index = m_originalIndexMapping[m_comparisonIndex];
+	int index = m_originalIndexMapping[item];
 	m_fileData[index].comparison_flags = flags;
 
 	m_indexMapping.push_back(index);
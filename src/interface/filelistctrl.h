@@ -5,9 +5,13 @@
 #include "systemimagelist.h"
 #include "listingcomparison.h"
 
+#include <libfilezilla/thread_pool.hpp>
+
+#include <algorithm>
 #include <cstring>
 #include <deque>
 #include <memory>
+#include <thread>
 
 class CQueueView;
 class CFileListCtrl_SortComparisonObject;
@@ -25,6 +29,11 @@ public:
 	// t_fileEntryFlags is defined in listingcomparison.h as it will be used for
 	// both local and remote listings
 	CComparableListing::t_fileEntryFlags comparison_flags{CComparableListing::normal};
+
+	// Collation key of the name, built on demand for the name sort mode in
+	// sortKeyMode. Keys are never built for case sensitive sorting.
+	std::wstring sortKey;
+	NameSortMode sortKeyMode{NameSortMode::case_sensitive};
 };
 
 class CFileListCtrlSortBase
@@ -44,6 +53,10 @@ public:
 	virtual bool operator()(int a, int b) const = 0;
 	virtual ~CFileListCtrlSortBase() {} // Without this empty destructor GCC complains
 
+	// Fills in everything the comparisons would otherwise compute on demand,
+	// afterwards the object can be used from multiple threads at once.
+	virtual void Prepare() {}
+
 	#define CMP(f, data1, data2) \
 		{\
 			int res = this->f(data1, data2);\
@@ -139,6 +152,71 @@ public:
 		return res;         //same length, compare first different digit in the sequence*/
 	}
 
+	// Builds a key from the name such that CmpSortKey orders names the same way
+	// as CmpNoCase or CmpNatural, without case folding or parsing digits again on
+	// each comparison. Where the key cannot represent the order exactly, such as
+	// non-ASCII characters for CmpNoCase, it ends early. Names whose keys are
+	// equal or a prefix of each other need to be compared in full.
+	static std::wstring MakeSortKey(std::wstring_view const& name, NameSortMode mode)
+	{
+		std::wstring key;
+		key.reserve(name.size() + 4);
+		if (mode == NameSortMode::case_insensitive) {
+			for (wchar_t const c : name) {
+				if (c >= 0x80) {
+					break;
+				}
+				key += (c >= 'A' && c <= 'Z') ? static_cast<wchar_t>(c + 'a' - 'A') : c;
+			}
+		}
+		else if (mode == NameSortMode::natural) {
+			size_t i = 0;
+			while (i < name.size()) {
+				if (!wxIsdigit(name[i])) {
+					key += static_cast<wchar_t>(wxTolower(name[i++]));
+					continue;
+				}
+
+				// Same leading zero handling as in CmpNatural
+				size_t zeros = 0;
+				for (; name[i] == '0' && i + 1 < name.size() && wxIsdigit(name[i + 1]); ++i) {
+					++zeros;
+				}
+				size_t end = i;
+				for (; end < name.size() && wxIsdigit(name[end]); ++end) {
+					if (name[end] < '0' || name[end] > '9') {
+						return key;
+					}
+				}
+				if (end - i >= 0xffff || zeros >= 0xffff) {
+					break;
+				}
+
+				// A digit compares against any other character like '0' does.
+				// Longer numbers are larger, then the digits decide. At equal
+				// numbers the next character comes first, then the number of
+				// leading zeros.
+				key += '0';
+				key += static_cast<wchar_t>(end - i);
+				key.append(name.substr(i, end - i));
+				if (end == name.size()) {
+					break;
+				}
+				key += static_cast<wchar_t>(wxTolower(name[end]));
+				key += static_cast<wchar_t>(zeros);
+				i = end + 1;
+			}
+		}
+		return key;
+	}
+
+	// Returns 0 if the keys are equal or one is a prefix of the other
+	static int CmpSortKey(std::wstring const& key1, std::wstring const& key2)
+	{
+		size_t const size = std::min(key1.size(), key2.size());
+		return std::wstring_view(key1.data(), size).compare(std::wstring_view(key2.data(), size));
+	}
+
 	typedef int (* CompareFunction)(std::wstring_view const&, std::wstring_view const&);
 	static CompareFunction GetCmpFunction(NameSortMode mode)
 	{
@@ -175,18 +253,28 @@ inline int DoCmpName(value_type const& data1, value_type const& data2, NameSortM
 	}
 }
 
-template<typename Listing>
+template<typename Listing, typename DataEntry>
 class CFileListCtrlSort : public CFileListCtrlSortBase
 {
 public:
 	typedef Listing List;
 	typedef typename Listing::value_type value_type;
 
-	CFileListCtrlSort(Listing const& listing, DirSortMode dirSortMode, NameSortMode nameSortMode)
-		: m_listing(listing), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
+	CFileListCtrlSort(Listing const& listing, std::vector<DataEntry>& fileData, DirSortMode dirSortMode, NameSortMode nameSortMode)
+		: m_listing(listing), m_fileData(fileData), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
 	{
 	}
 
+	virtual void Prepare() override
+	{
+		if (m_nameSortMode != NameSortMode::case_sensitive) {
+			size_t const count = std::min(m_listing.size(), m_fileData.size());
+			for (size_t i = 0; i < count; ++i) {
+				SortKey(i);
+			}
+		}
+	}
+
 	inline int CmpDir(value_type const& data1, value_type const& data2) const
 	{
 		switch (m_dirSortMode)
@@ -231,10 +319,25 @@ public:
 		}
 	}
 
-	template<typename value_type>
-	inline int CmpName(value_type const& data1, value_type const& data2) const
+	inline int CmpName(int a, int b) const
 	{
-		return DoCmpName(data1, data2, m_nameSortMode);
+		if (m_nameSortMode != NameSortMode::case_sensitive) {
+			int const res = CmpSortKey(SortKey(a), SortKey(b));
+			if (res) {
+				return res;
+			}
+		}
+		return DoCmpName(m_listing[a], m_listing[b], m_nameSortMode);
+	}
+
+	inline std::wstring const& SortKey(size_t index) const
+	{
+		DataEntry & data = m_fileData[index];
+		if (data.sortKeyMode != m_nameSortMode) {
+			data.sortKey = MakeSortKey(m_listing[index].name, m_nameSortMode);
+			data.sortKeyMode = m_nameSortMode;
+		}
+		return data.sortKey;
 	}
 
 	inline int CmpSize(const value_type &data1, const value_type &data2) const
@@ -271,6 +374,7 @@ public:
 
 protected:
 	Listing const& m_listing;
+	std::vector<DataEntry>& m_fileData;
 
 	DirSortMode const m_dirSortMode;
 	NameSortMode const m_nameSortMode;
@@ -293,11 +397,11 @@ public:
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortName : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortName : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -308,16 +412,16 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortSize : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortSize : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -330,19 +434,28 @@ public:
 
 		CMP(CmpSize, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortType : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortType : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortType(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode), m_pListView(pListView), m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode), m_pListView(pListView)
 	{
 	}
 
+	virtual void Prepare() override
+	{
+		size_t const count = std::min(this->m_listing.size(), this->m_fileData.size());
+		for (size_t i = 0; i < count; ++i) {
+			Type(i);
+		}
+		CFileListCtrlSort<Listing, DataEntry>::Prepare();
+	}
+
 	bool operator()(int a, int b) const
 	{
 		typename Listing::value_type const& data1 = this->m_listing[a];
@@ -350,31 +463,30 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		DataEntry &type1 = m_fileData[a];
-		DataEntry &type2 = m_fileData[b];
-		if (type1.fileType.empty()) {
-			type1.fileType = m_pListView->GetType(data1.name, data1.is_dir());
-		}
-		if (type2.fileType.empty()) {
-			type2.fileType = m_pListView->GetType(data2.name, data2.is_dir());
-		}
-
-		CMP(CmpStringNoCase, type1.fileType, type2.fileType);
+		CMP(CmpStringNoCase, Type(a), Type(b));
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 
 protected:
+	std::wstring const& Type(size_t index) const
+	{
+		DataEntry & data = this->m_fileData[index];
+		if (data.fileType.empty()) {
+			data.fileType = m_pListView->GetType(this->m_listing[index].name, this->m_listing[index].is_dir());
+		}
+		return data.fileType;
+	}
+
 	CFileListCtrl<DataEntry>* const m_pListView;
-	std::vector<DataEntry>& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortTime : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortTime : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -387,16 +499,16 @@ public:
 
 		CMP(CmpTime, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -409,16 +521,16 @@ public:
 
 		CMP(CmpStringNoCase, *data1.permissions, *data2.permissions);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -431,17 +543,16 @@ public:
 
 		CMP(CmpStringNoCase, *data1.ownerGroup, *data2.ownerGroup);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortPath : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortPath : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortPath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
-		, m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -455,18 +566,16 @@ public:
 			return res < 0;
 		}
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
-	std::vector<DataEntry>& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortNamePath : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortNamePath : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortNamePath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
-		, m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -476,11 +585,10 @@ public:
 		typename Listing::value_type const& data2 = this->m_listing[b];
 
 		CMP(CmpDir, data1, data2);
-		CMP(CmpName, data1, data2);
+		CMP(CmpName, a, b);
 
 		return data1.path.compare_case(data2.path) < 0;
 	}
-	std::vector<DataEntry>& m_fileData;
 };
 
 namespace genericTypes {
@@ -539,7 +647,7 @@ protected:
 	virtual void ScrollTopItem(int item);
 	virtual void OnPostScroll();
 	virtual void OnExitComparisonMode();
-	virtual void CompareAddFile(t_fileEntryFlags flags);
+	virtual void CompareAddFile(t_fileEntryFlags flags, size_t item);
 
 	int m_comparisonIndex{-1};
 
@@ -610,6 +718,10 @@ private:
 	COptionsBase& options_;
 
 	std::unique_ptr<CFileListCtrlSortBase> sortComparisonObject_;
+
+protected:
+	// If set, large listings get sorted using multiple threads
+	fz::thread_pool * sortPool_{};
 };
 
 class SortPredicate
@@ -631,6 +743,77 @@ public:
 	CFileListCtrlSortBase const& p_;
 };
 
+// Sorts large ranges in chunks on the threads of the pool, the sorted chunks
+// then get merged pairwise, also in parallel.
+// The comparison object needs to be prepared, see CFileListCtrlSortBase::Prepare
+template<typename Iterator, typename Predicate>
+void ParallelSort(Iterator begin, Iterator end, Predicate pred, fz::thread_pool * pool)
+{
+	size_t const min_chunk_size = 10000;
+	size_t const max_chunks = 8;
+
+	size_t const size = end - begin;
+	size_t chunks = pool ? std::min({size / min_chunk_size, max_chunks, static_cast<size_t>(std::thread::hardware_concurrency())}) : 1;
+	if (chunks < 2) {
+		std::sort(begin, end, pred);
+		return;
+	}
+
+	std::vector<Iterator> bounds;
+	for (size_t i = 0; i < chunks; ++i) {
+		bounds.push_back(begin + size * i / chunks);
+	}
+	bounds.push_back(end);
+
+	// If a task cannot be spawned, its part is done on this thread
+	std::vector<fz::async_task> tasks;
+	for (size_t i = 1; i < chunks; ++i) {
+		auto sort_chunk = [&bounds, pred, i]() {
+			std::sort(bounds[i], bounds[i + 1], pred);
+		};
+		auto task = pool->spawn(sort_chunk);
+		if (task) {
+			tasks.emplace_back(std::move(task));
+		}
+		else {
+			sort_chunk();
+		}
+	}
+	std::sort(bounds[0], bounds[1], pred);
+	for (auto & task : tasks) {
+		task.join();
+	}
+
+	while (bounds.size() > 2) {
+		tasks.clear();
+		for (size_t i = 2; i + 2 < bounds.size(); i += 2) {
+			auto merge = [&bounds, pred, i]() {
+				std::inplace_merge(bounds[i], bounds[i + 1], bounds[i + 2], pred);
+			};
+			auto task = pool->spawn(merge);
+			if (task) {
+				tasks.emplace_back(std::move(task));
+			}
+			else {
+				merge();
+			}
+		}
+		std::inplace_merge(bounds[0], bounds[1], bounds[2], pred);
+		for (auto & task : tasks) {
+			task.join();
+		}
+
+		std::vector<Iterator> merged;
+		for (size_t i = 0; i < bounds.size(); i += 2) {
+			merged.push_back(bounds[i]);
+		}
+		if (merged.back() != bounds.back()) {
+			merged.push_back(bounds.back());
+		}
+		bounds = std::move(merged);
+	}
+}
+
 #ifdef FILELISTCTRL_INCLUDE_TEMPLATE_DEFINITION
 #include "filelistctrl.cpp"
 #endif
@@ -19,6 +19,9 @@ bool CFilterManager::m_loaded = false;
 filter_data CFilterManager::global_filters_;
 bool CFilterManager::m_filters_disabled = false;
 
+compiled_filters CFilterManager::compiled_[2];
+bool CFilterManager::compiled_valid_ = false;
+
 BEGIN_EVENT_TABLE(CFilterDialog, wxDialogEx)
 EVT_BUTTON(XRCID("wxID_OK"), CFilterDialog::OnOkOrApply)
 EVT_BUTTON(XRCID("wxID_CANCEL"), CFilterDialog::OnCancel)
@@ -141,6 +144,7 @@ void CFilterDialog::OnOkOrApply(wxCommandEvent& event)
 	global_filters_.filters = m_filters;
 	global_filters_.filter_sets = m_filterSets;
 	global_filters_.current_filter_set = m_currentFilterSet;
+	compiled_valid_ = false;
 
 	SaveFilters();
 	m_filters_disabled = false;
@@ -488,19 +492,24 @@ bool CFilterManager::FilenameFiltered(std::wstring const& name, std::wstring con
 		return false;
 	}
 
-	CFilterSet const& set = global_filters_.filter_sets[global_filters_.current_filter_set];
-	auto const& active = local ? set.local : set.remote;
+	if (!compiled_valid_) {
+		CFilterSet const& set = global_filters_.filter_sets[global_filters_.current_filter_set];
 
-	// Check active filters
-	for (unsigned int i = 0; i < global_filters_.filters.size(); ++i) {
-		if (active[i]) {
-			if (FilenameFilteredByFilter(global_filters_.filters[i], name, path, dir, size, attributes, date)) {
-				return true;
+		std::vector<CFilter> active[2];
+		for (unsigned int i = 0; i < global_filters_.filters.size(); ++i) {
+			if (set.local[i]) {
+				active[0].push_back(global_filters_.filters[i]);
+			}
+			if (set.remote[i]) {
+				active[1].push_back(global_filters_.filters[i]);
 			}
 		}
+		compiled_[0] = compiled_filters(active[0]);
+		compiled_[1] = compiled_filters(active[1]);
+		compiled_valid_ = true;
 	}
 
-	return false;
+	return compiled_[local ? 0 : 1].filtered(name, path, dir, size, attributes, date);
 }
 
 void CFilterManager::LoadFilters()
@@ -521,6 +530,7 @@ void CFilterManager::LoadFilters()
 	CXmlFile xml(file);
 	auto element = xml.Load();
 	load_filters(element, global_filters_);
+	compiled_valid_ = false;
 
 	if (!element) {
 		wxString msg = xml.GetError() + _T("\n\n") + _("Any changes made to the filters will not be saved.");
@@ -550,6 +560,7 @@ void CFilterManager::Import(pugi::xml_node& element)
 void CFilterManager::LoadFilters(pugi::xml_node& element)
 {
 	load_filters(element, global_filters_);
+	compiled_valid_ = false;
 	if (global_filters_.filter_sets.empty()) {
 		CFilterSet set;
 		set.local.resize(global_filters_.filters.size(), false);
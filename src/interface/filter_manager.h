@@ -36,6 +36,11 @@ protected:
 	static filter_data global_filters_;
 
 	static bool m_filters_disabled;
+
+	// The active local and remote filters of the current filter set, prepared
+	// for FilenameFiltered. Needs to be reset whenever global_filters_ changes.
+	static compiled_filters compiled_[2];
+	static bool compiled_valid_;
 };
 
 class CMainFrame;
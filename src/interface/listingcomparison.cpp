@@ -94,83 +94,83 @@ bool CComparisonManager::CompareListings()
 	m_pLeft->StartComparison();
 	m_pRight->StartComparison();
 
-	std::wstring localPath, remotePath;
-	std::wstring_view localFile, remoteFile;
-	bool localDir = false;
-	bool remoteDir = false;
-	int64_t localSize, remoteSize;
-	fz::datetime localDate, remoteDate;
-
 	int const dirSortMode = options_.get_int(OPTION_FILELIST_DIRSORT);
 	auto const nameSortMode = static_cast<NameSortMode>(options_.get_int(OPTION_FILELIST_NAMESORT));
 
-	bool gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-	bool gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+	auto local = GetFiles(*m_pLeft);
+	auto remote = GetFiles(*m_pRight);
+	HashFiles(local, dirSortMode, nameSortMode);
+	HashFiles(remote, dirSortMode, nameSortMode);
 
-	while (gotLocal && gotRemote) {
-		int cmp = CompareFiles(dirSortMode, nameSortMode, localPath, localFile, remotePath, remoteFile, localDir, remoteDir);
-		if (!cmp) {
-			if (!m_comparisonMode) {
-				const CComparableListing::t_fileEntryFlags flag = (localDir || localSize == remoteSize) ? CComparableListing::normal : CComparableListing::different;
+	// Index the remote files by hash. Each chain lists the files in their
+	// original order, so equal files on both sides get paired in order.
+	size_t buckets = 16;
+	while (buckets < remote.size() * 2) {
+		buckets *= 2;
+	}
+	size_t const npos = static_cast<size_t>(-1);
+	std::vector<size_t> heads(buckets, npos);
+	std::vector<size_t> next(remote.size());
+	for (size_t i = remote.size(); i-- > 0; ) {
+		size_t & head = heads[remote[i].hash & (buckets - 1)];
+		next[i] = head;
+		head = i;
+	}
 
-				if (!m_hideIdentical || flag != CComparableListing::normal || localFile == L"..") {
-					m_pLeft->CompareAddFile(flag);
-					m_pRight->CompareAddFile(flag);
-				}
+	std::vector<size_t> partners(local.size(), npos);
+	std::vector<bool> matched(remote.size());
+	for (size_t i = 0; i < local.size(); ++i) {
+		auto const& l = local[i];
+		for (size_t j = heads[l.hash & (buckets - 1)]; j != npos; j = next[j]) {
+			auto const& r = remote[j];
+			if (matched[j] || l.hash != r.hash) {
+				continue;
 			}
-			else {
-				if (localDate.empty() || remoteDate.empty()) {
-					if (!m_hideIdentical || !localDate.empty() || !remoteDate.empty() || localFile == L"..") {
-						const CComparableListing::t_fileEntryFlags flag = CComparableListing::normal;
-						m_pLeft->CompareAddFile(flag);
-						m_pRight->CompareAddFile(flag);
-					}
-				}
-				else {
-					CComparableListing::t_fileEntryFlags localFlag, remoteFlag;
-
-					int const dateCmp = CompareWithThreshold(localDate, remoteDate, threshold);
-
-					localFlag = CComparableListing::normal;
-					remoteFlag = CComparableListing::normal;
-					if (dateCmp < 0 ) {
-						remoteFlag = CComparableListing::newer;
-					}
-					else if (dateCmp > 0) {
-						localFlag = CComparableListing::newer;
-					}
-					if (!m_hideIdentical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || localFile == L"..") {
-						m_pLeft->CompareAddFile(localFlag);
-						m_pRight->CompareAddFile(remoteFlag);
-					}
-				}
+
+			// Identical names need no collation
+			bool const identical = l.name == r.name && l.path == r.path && (dirSortMode == 2 || l.dir == r.dir);
+			if (identical || !CompareFiles(dirSortMode, nameSortMode, l.path, l.name, r.path, r.name, l.dir, r.dir)) {
+				matched[j] = true;
+				partners[i] = j;
+				break;
 			}
-			gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-			gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
-			continue;
 		}
+	}
 
-		if (cmp < 0) {
-			m_pLeft->CompareAddFile(CComparableListing::lonely);
-			m_pRight->CompareAddFile(CComparableListing::fill);
-			gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
+	// The remote files without a partner, split into the runs preceding each
+	// matched remote file. gaps[j] is the end of the run in front of j.
+	std::vector<size_t> lonelyRemote;
+	std::vector<size_t> gaps(remote.size());
+	for (size_t j = 0; j < remote.size(); ++j) {
+		if (matched[j]) {
+			gaps[j] = lonelyRemote.size();
 		}
 		else {
-			m_pLeft->CompareAddFile(CComparableListing::fill);
-			m_pRight->CompareAddFile(CComparableListing::lonely);
-			gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+			lonelyRemote.push_back(j);
 		}
 	}
-	while (gotLocal) {
-		m_pLeft->CompareAddFile(CComparableListing::lonely);
-		m_pRight->CompareAddFile(CComparableListing::fill);
-		gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-	}
-	while (gotRemote) {
-		m_pLeft->CompareAddFile(CComparableListing::fill);
-		m_pRight->CompareAddFile(CComparableListing::lonely);
-		gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+
+	// Matched files are output in the order of the left side. Files without
+	// partner between two matched files are merged by name. If both sides are
+	// sorted the same way, this gives the same order as merging the sorted
+	// listings in full.
+	std::vector<size_t> lonelyLocal;
+	size_t gapStart = 0;
+	for (size_t i = 0; i < local.size(); ++i) {
+		size_t const j = partners[i];
+		if (j == npos) {
+			lonelyLocal.push_back(i);
+			continue;
+		}
+
+		size_t const gapEnd = std::max(gapStart, gaps[j]);
+		MergeLonelyFiles(local, lonelyLocal, remote, lonelyRemote.cbegin() + gapStart, lonelyRemote.cbegin() + gapEnd, dirSortMode, nameSortMode);
+		lonelyLocal.clear();
+		gapStart = gapEnd;
+
+		AddFiles(local[i], i, remote[j], j, threshold);
 	}
+	MergeLonelyFiles(local, lonelyLocal, remote, lonelyRemote.cbegin() + gapStart, lonelyRemote.cend(), dirSortMode, nameSortMode);
 
 	m_pRight->FinishComparison();
 	m_pLeft->FinishComparison();
@@ -178,6 +178,142 @@ bool CComparisonManager::CompareListings()
 	return true;
 }
 
+std::vector<CComparisonManager::file_entry> CComparisonManager::GetFiles(CComparableListing & listing)
+{
+	std::vector<file_entry> files;
+
+	file_entry file;
+	while (listing.get_next_file(file.name, file.path, file.dir, file.size, file.date)) {
+		files.push_back(std::move(file));
+		file = file_entry();
+	}
+
+	return files;
+}
+
+namespace {
+size_t HashName(size_t hash, std::wstring_view const& name, NameSortMode const nameSortMode)
+{
+	// CmpNatural considers names equal that only differ in case
+	bool const fold = nameSortMode == NameSortMode::natural;
+	for (wchar_t c : name) {
+		if (fold) {
+			c = static_cast<wchar_t>(wxTolower(c));
+		}
+		hash = (hash ^ static_cast<size_t>(c)) * static_cast<size_t>(1099511628211u);
+	}
+	return hash;
+}
+}
+
+void CComparisonManager::HashFiles(std::vector<file_entry> & files, int const dirSortMode, NameSortMode const nameSortMode)
+{
+	auto const hash = [&files, dirSortMode, nameSortMode](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			auto & file = files[i];
+			size_t h = HashName(static_cast<size_t>(14695981039346656037u), file.name, nameSortMode);
+			h = HashName(h * 31, file.path, nameSortMode);
+			if (dirSortMode != 2 && file.dir) {
+				h = ~h;
+			}
+			file.hash = h;
+		}
+	};
+
+	size_t const min_chunk_size = 10000;
+	size_t const max_chunks = 8;
+
+	size_t const chunks = std::min({files.size() / min_chunk_size, max_chunks, static_cast<size_t>(std::thread::hardware_concurrency())});
+	if (chunks < 2) {
+		hash(0, files.size());
+		return;
+	}
+
+	// If a task cannot be spawned, its chunk is hashed on this thread
+	std::vector<fz::async_task> tasks;
+	for (size_t i = 1; i < chunks; ++i) {
+		size_t const begin = files.size() * i / chunks;
+		size_t const end = files.size() * (i + 1) / chunks;
+		auto task = m_state.pool_.spawn([&hash, begin, end]() {
+			hash(begin, end);
+		});
+		if (task) {
+			tasks.emplace_back(std::move(task));
+		}
+		else {
+			hash(begin, end);
+		}
+	}
+	hash(0, files.size() / chunks);
+	for (auto & task : tasks) {
+		task.join();
+	}
+}
+
+void CComparisonManager::AddFiles(file_entry const& local, size_t localItem, file_entry const& remote, size_t remoteItem, fz::duration const& threshold)
+{
+	if (!m_comparisonMode) {
+		const CComparableListing::t_fileEntryFlags flag = (local.dir || local.size == remote.size) ? CComparableListing::normal : CComparableListing::different;
+
+		if (!m_hideIdentical || flag != CComparableListing::normal || local.name == L"..") {
+			m_pLeft->CompareAddFile(flag, localItem);
+			m_pRight->CompareAddFile(flag, remoteItem);
+		}
+	}
+	else {
+		if (local.date.empty() || remote.date.empty()) {
+			if (!m_hideIdentical || !local.date.empty() || !remote.date.empty() || local.name == L"..") {
+				const CComparableListing::t_fileEntryFlags flag = CComparableListing::normal;
+				m_pLeft->CompareAddFile(flag, localItem);
+				m_pRight->CompareAddFile(flag, remoteItem);
+			}
+		}
+		else {
+			CComparableListing::t_fileEntryFlags localFlag, remoteFlag;
+
+			int const dateCmp = CompareWithThreshold(local.date, remote.date, threshold);
+
+			localFlag = CComparableListing::normal;
+			remoteFlag = CComparableListing::normal;
+			if (dateCmp < 0 ) {
+				remoteFlag = CComparableListing::newer;
+			}
+			else if (dateCmp > 0) {
+				localFlag = CComparableListing::newer;
+			}
+			if (!m_hideIdentical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || local.name == L"..") {
+				m_pLeft->CompareAddFile(localFlag, localItem);
+				m_pRight->CompareAddFile(remoteFlag, remoteItem);
+			}
+		}
+	}
+}
+
+void CComparisonManager::MergeLonelyFiles(std::vector<file_entry> const& local, std::vector<size_t> const& localItems, std::vector<file_entry> const& remote, std::vector<size_t>::const_iterator remoteBegin, std::vector<size_t>::const_iterator remoteEnd, int const dirSortMode, NameSortMode const nameSortMode)
+{
+	auto localIt = localItems.cbegin();
+	while (localIt != localItems.cend() && remoteBegin != remoteEnd) {
+		auto const& l = local[*localIt];
+		auto const& r = remote[*remoteBegin];
+		if (CompareFiles(dirSortMode, nameSortMode, l.path, l.name, r.path, r.name, l.dir, r.dir) < 0) {
+			m_pLeft->CompareAddFile(CComparableListing::lonely, *localIt++);
+			m_pRight->CompareAddFile(CComparableListing::fill, 0);
+		}
+		else {
+			m_pLeft->CompareAddFile(CComparableListing::fill, 0);
+			m_pRight->CompareAddFile(CComparableListing::lonely, *remoteBegin++);
+		}
+	}
+	for (; localIt != localItems.cend(); ++localIt) {
+		m_pLeft->CompareAddFile(CComparableListing::lonely, *localIt);
+		m_pRight->CompareAddFile(CComparableListing::fill, 0);
+	}
+	for (; remoteBegin != remoteEnd; ++remoteBegin) {
+		m_pLeft->CompareAddFile(CComparableListing::fill, 0);
+		m_pRight->CompareAddFile(CComparableListing::lonely, *remoteBegin);
+	}
+}
+
 int CComparisonManager::CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::wstring_view const& remote_path, std::wstring_view const& remote, bool localDir, bool remoteDir)
 {
 	switch (dirSortMode)
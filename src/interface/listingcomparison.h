@@ -32,7 +32,9 @@ public:
 	virtual bool CanStartComparison() = 0;
 	virtual void StartComparison() = 0;
 	virtual bool get_next_file(std::wstring_view & name, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) = 0;
-	virtual void CompareAddFile(t_fileEntryFlags flags) = 0;
+	// item is the position of the file in the order returned by get_next_file,
+	// it is not used for fill entries.
+	virtual void CompareAddFile(t_fileEntryFlags flags, size_t item) = 0;
 	virtual void FinishComparison() = 0;
 	virtual void ScrollTopItem(int item) = 0;
 	virtual void OnExitComparisonMode() = 0;
@@ -77,6 +79,23 @@ public:
 	void SetHideIdentical(bool hideIdentical) { m_hideIdentical = hideIdentical; }
 
 protected:
+	struct file_entry
+	{
+		std::wstring_view name;
+		std::wstring path;
+		int64_t size{-1};
+		fz::datetime date;
+		bool dir{};
+
+		// Equal for all files CompareFiles considers equal
+		size_t hash{};
+	};
+
+	static std::vector<file_entry> GetFiles(CComparableListing & listing);
+	void HashFiles(std::vector<file_entry> & files, int const dirSortMode, NameSortMode const nameSortMode);
+	void AddFiles(file_entry const& local, size_t localItem, file_entry const& remote, size_t remoteItem, fz::duration const& threshold);
+	void MergeLonelyFiles(std::vector<file_entry> const& local, std::vector<size_t> const& localItems, std::vector<file_entry> const& remote, std::vector<size_t>::const_iterator remoteBegin, std::vector<size_t>::const_iterator remoteEnd, int const dirSortMode, NameSortMode const nameSortMode);
+
 	int CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::wstring_view const& remote_path, std::wstring_view const& remote, bool localDir, bool remoteDir);
 
 	CState& m_state;
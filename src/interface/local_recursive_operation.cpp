@@ -17,7 +17,7 @@ CLocalRecursiveOperation::CLocalRecursiveOperation(CState& state)
 
 CLocalRecursiveOperation::~CLocalRecursiveOperation()
 {
-	thread_.join();
+	join();
 }
 
 void CLocalRecursiveOperation::StartRecursiveOperation(OperationMode mode, ActiveFilters const& filters, bool immediate, bool ignore_links)
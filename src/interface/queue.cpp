@@ -237,11 +237,11 @@ int CQueueItem::GetItemIndex() const
 CFileItem::CFileItem(CServerItem* parent, transfer_flags const& flags,
 					 std::wstring const& sourceFile, std::wstring const& targetFile,
 					 CLocalPath const& localPath, CServerPath const& remotePath, int64_t size,
-					 std::wstring const& extraFlags, std::string const& persistentState)
+					 std::wstring const& extraFlags, std::string const& persistentState, file_segment const& segment)
 	: CQueueItem(parent)
 	, flags_(flags)
 	, m_sourceFile(sourceFile)
-	, extra_data_((targetFile.empty() && extraFlags.empty() && persistentState.empty()) ? fz::sparse_optional<extra_data>() : fz::sparse_optional<extra_data>({ targetFile, extraFlags, persistentState }))
+	, extra_data_((targetFile.empty() && extraFlags.empty() && persistentState.empty() && !segment) ? fz::sparse_optional<extra_data>() : fz::sparse_optional<extra_data>({ targetFile, extraFlags, persistentState, segment }))
 	, m_localPath(localPath)
 	, m_remotePath(remotePath)
 	, m_size(size)
@@ -252,6 +252,20 @@ CFileItem::~CFileItem()
 {
 }
 
+std::wstring GetSegmentFileName(std::wstring const& file, int64_t offset)
+{
+	return file + fz::sprintf(L".%d.fzpart", offset);
+}
+
+std::wstring CFileItem::GetTransferLocalFile() const
+{
+	file_segment const segment = GetSegment();
+	if (segment) {
+		return GetSegmentFileName(GetLocalFile(), segment.offset);
+	}
+	return GetLocalFile();
+}
+
 void CFileItem::SetPriority(QueuePriority priority)
 {
 	if (priority == m_priority) {
@@ -263,11 +277,22 @@ void CFileItem::SetPriority(QueuePriority priority)
 		parent->SetChildPriority(this, m_priority, priority);
 	}
 	m_priority = priority;
+	storage_dirty_ = true;
+}
+
+void CFileItem::SetSize(int64_t size)
+{
+	if (m_parent && m_parent->GetType() == QueueItemType::Server) {
+		static_cast<CServerItem*>(m_parent)->ChildSizeChanged(m_size, size);
+	}
+	m_size = size;
+	storage_dirty_ = true;
 }
 
 void CFileItem::SetPriorityRaw(QueuePriority priority)
 {
 	m_priority = priority;
+	storage_dirty_ = true;
 }
 
 QueuePriority CFileItem::GetPriority() const
@@ -279,6 +304,9 @@ void CFileItem::SetActive(const bool active)
 {
 	if (active && !IsActive()) {
 		wxASSERT(!GetChildrenCount(false));
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, true);
+		}
 		AddChild(new CStatusItem);
 		flags_ |= queue_flags::active;
 	}
@@ -286,6 +314,9 @@ void CFileItem::SetActive(const bool active)
 		CQueueItem* pItem = GetChild(0, false);
 		RemoveChild(pItem);
 		flags_ -= queue_flags::active;
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, false);
+		}
 	}
 }
 
@@ -316,6 +347,12 @@ void CFileItem::SaveItem(pugi::xml_node& element) const
 	if (extra_data_ && !extra_data_->extraFlags_.empty()) {
 		AddTextElement(file, "ExtraFlags", extra_data_->extraFlags_);
 	}
+	if (extra_data_ && extra_data_->segment_) {
+		auto segment = file.append_child("Segment");
+		AddTextElement(segment, "Offset", extra_data_->segment_.offset);
+		AddTextElement(segment, "Length", extra_data_->segment_.length);
+		AddTextElement(segment, "FileSize", extra_data_->segment_.file_size);
+	}
 	// Intentionally not exporting persistent state.
 }
 
@@ -331,11 +368,12 @@ bool CFileItem::TryRemoveAll()
 
 void CFileItem::SetTargetFile(std::wstring const& file)
 {
+	storage_dirty_ = true;
 	if (file.empty()) {
 		if (!extra_data_) {
 			return;
 		}
-		if (extra_data_->extraFlags_.empty() && extra_data_->persistentState_.empty()) {
+		if (extra_data_->extraFlags_.empty() && extra_data_->persistentState_.empty() && !extra_data_->segment_) {
 			extra_data_.clear();
 		}
 		else {
@@ -355,6 +393,7 @@ void CFileItem::SetTargetFile(std::wstring const& file)
 
 void CFileItem::set_persistent_state(std::string && state)
 {
+	storage_dirty_ = true;
 	if (state.empty()) {
 		clear_persistent_state();
 	}
@@ -373,7 +412,8 @@ void CFileItem::clear_persistent_state()
 	if (!extra_data_) {
 		return;
 	}
-	if (extra_data_->extraFlags_.empty() && extra_data_->targetFile_.empty()) {
+	storage_dirty_ = true;
+	if (extra_data_->extraFlags_.empty() && extra_data_->targetFile_.empty() && !extra_data_->segment_) {
 		extra_data_.clear();
 	}
 	else {
@@ -435,11 +475,21 @@ void CFolderItem::SaveItem(pugi::xml_node& element) const
 
 void CFolderItem::SetActive(bool const active)
 {
+	if (active == IsActive()) {
+		return;
+	}
+
 	if (active) {
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, true);
+		}
 		flags_ |= queue_flags::active;
 	}
 	else {
 		flags_ -= queue_flags::active;
+		if (m_parent) {
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, false);
+		}
 	}
 }
 
@@ -486,29 +536,57 @@ void CServerItem::AddFileItemToList(CFileItem* pItem)
 		return;
 	}
 
-	m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+	pItem->queue_order_ = back_order_++;
+	if (!pItem->IsActive()) {
+		GetIdleList(*pItem, pItem->GetPriority()).emplace(pItem->queue_order_, pItem);
+	}
+
+	++file_count_;
+	ChildSizeChanged(0, pItem->GetSize());
 }
 
-void CServerItem::RemoveFileItemFromList(CFileItem* pItem, bool forward)
+void CServerItem::ChildSizeChanged(int64_t oldSize, int64_t newSize)
 {
-	std::deque<CFileItem*>& fileList = m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())];
-	if (forward) {
-		for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
-			if (*iter == pItem) {
-				fileList.erase(iter);
-				return;
-			}
-		}
+	if (oldSize < 0) {
+		--unknown_size_count_;
 	}
 	else {
-		for (auto iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
-			if (*iter == pItem) {
-				fileList.erase(iter.base() - 1);
-				return;
-			}
-		}
+		total_size_ -= oldSize;
+	}
+	if (newSize < 0) {
+		++unknown_size_count_;
+	}
+	else {
+		total_size_ += newSize;
+	}
+}
+
+void CServerItem::RemoveFileItemFromList(CFileItem* pItem)
+{
+	if (!pItem->IsActive()) {
+		size_t const erased = GetIdleList(*pItem, pItem->GetPriority()).erase(std::make_pair(pItem->queue_order_, pItem));
+		wxASSERT(erased);
+		(void)erased;
+	}
+
+	--file_count_;
+	ChildSizeChanged(pItem->GetSize(), 0);
+}
+
+CServerItem::idle_list& CServerItem::GetIdleList(CFileItem const& item, QueuePriority priority)
+{
+	return m_fileList[item.queued() ? 0 : 1][static_cast<int>(priority)][item.Download() ? 0 : 1];
+}
+
+void CServerItem::SetChildActive(CFileItem* pItem, bool active)
+{
+	auto & list = GetIdleList(*pItem, pItem->GetPriority());
+	if (active) {
+		list.erase(std::make_pair(pItem->queue_order_, pItem));
+	}
+	else {
+		list.emplace(pItem->queue_order_, pItem);
 	}
-	wxFAIL_MSG(_T("File item not deleted from m_fileList"));
 }
 
 void CServerItem::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAction action, const TransferDirection direction)
@@ -524,6 +602,7 @@ void CServerItem::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteA
 				continue;
 			}
 			pFileItem->m_defaultFileExistsAction = action;
+			pFileItem->storage_dirty_ = true;
 		}
 	}
 }
@@ -578,18 +657,32 @@ void CServerItem::Sort(int col, bool reverse)
 
 	std::stable_sort(m_children.begin() + m_removed_at_front, m_children.end(), fn);
 
+	// Stored items are loaded in the order they were written, write them anew
+	for (auto iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter) {
+		static_cast<CFileItem*>(*iter)->storage_id_ = 0;
+	}
+
 	m_lookupCache.clear();
 	m_maxCachedIndex = -1;
 
-	// Rebuild m_fileList
-	for (size_t i = 0; i < static_cast<size_t>(QueuePriority::count); ++i) {
-		m_fileList[0][i].clear();
-		m_fileList[1][i].clear();
+	// Rebuild m_fileList in the new order
+	for (auto & lists : m_fileList) {
+		for (auto & directions : lists) {
+			for (auto & list : directions) {
+				list.clear();
+			}
+		}
 	}
 
+	front_order_ = 0;
+	back_order_ = 0;
 	for (auto it = m_children.cbegin() + m_removed_at_front; it != m_children.cend(); ++it) {
 		CFileItem *pItem = static_cast<CFileItem*>(*it);
-		m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+		pItem->queue_order_ = back_order_++;
+		if (!pItem->IsActive()) {
+			auto & list = GetIdleList(*pItem, pItem->GetPriority());
+			list.emplace_hint(list.end(), pItem->queue_order_, pItem);
+		}
 	}
 }
 
@@ -658,27 +751,29 @@ CQueueItem* CServerItem::GetChild(unsigned int item, bool recursive)
 }
 
 namespace {
-CFileItem* DoGetIdleChild(std::deque<CFileItem*> const* fileList, TransferDirection direction)
-{
-	int i = 0;
-	for (i = static_cast<int>(QueuePriority::count) - 1; i >= 0; --i) {
-		for (auto const& item : fileList[i]) {
-			if (item->IsActive()) {
-				continue;
+CFileItem* DoGetIdleChild(std::set<std::pair<int64_t, CFileItem*>> const (&fileList)[static_cast<int>(QueuePriority::count)][2], TransferDirection direction)
+{
+	for (int i = static_cast<int>(QueuePriority::count) - 1; i >= 0; --i) {
+		auto const& downloads = fileList[i][0];
+		auto const& uploads = fileList[i][1];
+		if (direction == TransferDirection::download) {
+			if (!downloads.empty()) {
+				return downloads.begin()->second;
 			}
-
-			if (direction == TransferDirection::both) {
-				return item;
-			}
-
-			if (direction == TransferDirection::download) {
-				if (item->Download()) {
-					return item;
-				}
+		}
+		else if (direction == TransferDirection::upload) {
+			if (!uploads.empty()) {
+				return uploads.begin()->second;
 			}
-			else if (!item->Download()) {
-				return item;
+		}
+		else if (!downloads.empty()) {
+			if (!uploads.empty() && *uploads.begin() < *downloads.begin()) {
+				return uploads.begin()->second;
 			}
+			return downloads.begin()->second;
+		}
+		else if (!uploads.empty()) {
+			return uploads.begin()->second;
 		}
 	}
 	return 0;
@@ -702,7 +797,7 @@ bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 
 	if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder) {
 		CFileItem* pFileItem = static_cast<CFileItem*>(pItem);
-		RemoveFileItemFromList(pFileItem, forward);
+		RemoveFileItemFromList(pFileItem);
 	}
 
 	bool removed = CQueueItem::RemoveChild(pItem, destroy, forward);
@@ -718,21 +813,22 @@ bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy, bool forward)
 
 void CServerItem::QueueImmediateFiles()
 {
+	// Idle immediate items go in front of the queued ones, keeping their order.
+	// Active ones stay immediate.
 	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
-		std::deque<CFileItem*> activeList;
-		std::deque<CFileItem*>& fileList = m_fileList[1][i];
-		for (auto iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
-			CFileItem* item = *iter;
-			wxASSERT(!item->queued());
-			if (item->IsActive()) {
-				activeList.push_front(item);
-			}
-			else {
-				item->set_queued(true);
-				m_fileList[0][i].push_front(item);
-			}
+		std::vector<std::pair<int64_t, CFileItem*>> items;
+		for (auto & list : m_fileList[1][i]) {
+			items.insert(items.end(), list.begin(), list.end());
+			list.clear();
+		}
+		std::sort(items.begin(), items.end());
+
+		for (auto iter = items.rbegin(); iter != items.rend(); ++iter) {
+			CFileItem* item = iter->second;
+			item->set_queued(true);
+			item->queue_order_ = --front_order_;
+			GetIdleList(*item, item->GetPriority()).emplace(item->queue_order_, item);
 		}
-		std::swap(fileList, activeList);
 	}
 }
 
@@ -742,18 +838,15 @@ void CServerItem::QueueImmediateFile(CFileItem* pItem)
 		return;
 	}
 
-	std::deque<CFileItem*>& fileList = m_fileList[1][static_cast<int>(pItem->GetPriority())];
-	for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
-		if (*iter != pItem) {
-			continue;
-		}
-
-		pItem->set_queued(true);
-		fileList.erase(iter);
-		m_fileList[0][static_cast<int>(pItem->GetPriority())].push_front(pItem);
-		return;
+	bool const active = pItem->IsActive();
+	if (!active) {
+		GetIdleList(*pItem, pItem->GetPriority()).erase(std::make_pair(pItem->queue_order_, pItem));
+	}
+	pItem->set_queued(true);
+	pItem->queue_order_ = --front_order_;
+	if (!active) {
+		GetIdleList(*pItem, pItem->GetPriority()).emplace(pItem->queue_order_, pItem);
 	}
-	wxASSERT(false);
 }
 
 void CServerItem::SaveItem(pugi::xml_node& element) const
@@ -768,29 +861,10 @@ void CServerItem::SaveItem(pugi::xml_node& element) const
 
 int64_t CServerItem::GetTotalSize(int& filesWithUnknownSize, int& queuedFiles) const
 {
-	int64_t totalSize = 0;
-	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
-		for (int j = 0; j < 2; ++j) {
-			const std::deque<CFileItem*>& fileList = m_fileList[j][i];
-			for (auto const& item : fileList) {
-				int64_t size = item->GetSize();
-				if (size >= 0) {
-					totalSize += size;
-				}
-				else {
-					filesWithUnknownSize++;
-				}
-			}
-		}
-	}
-
-	for (std::vector<CQueueItem*>::const_iterator iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter) {
-		if ((*iter)->GetType() == QueueItemType::File ||
-			(*iter)->GetType() == QueueItemType::Folder)
-			queuedFiles++;
-	}
+	filesWithUnknownSize += unknown_size_count_ + pending_.unknown_size;
+	queuedFiles += file_count_ + pending_.count;
 
-	return totalSize;
+	return total_size_ + pending_.size;
 }
 
 bool CServerItem::TryRemoveAll()
@@ -806,7 +880,7 @@ bool CServerItem::TryRemoveAll()
 		if (pItem->TryRemoveAll()) {
 			if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder) {
 				CFileItem* pFileItem = static_cast<CFileItem*>(pItem);
-				RemoveFileItemFromList(pFileItem, true);
+				RemoveFileItemFromList(pFileItem);
 			}
 			delete pItem;
 		}
@@ -837,9 +911,15 @@ void CServerItem::DetachChildren()
 	m_maxCachedIndex = -1;
 	m_removed_at_front = 0;
 
-	for (int i = 0; i < 2; ++i) {
-		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
-			m_fileList[i][j].clear();
+	file_count_ = 0;
+	unknown_size_count_ = 0;
+	total_size_ = 0;
+
+	for (auto & lists : m_fileList) {
+		for (auto & directions : lists) {
+			for (auto & list : directions) {
+				list.clear();
+			}
 		}
 	}
 }
@@ -856,30 +936,27 @@ void CServerItem::SetPriority(QueuePriority priority)
 		}
 	}
 
-	for (int i = 0; i < 2; ++i)
+	// Items keep their position, they just all end up in the same lists
+	for (int i = 0; i < 2; ++i) {
 		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
 			if (j != static_cast<int>(priority)) {
-				std::move(m_fileList[i][j].begin(), m_fileList[i][j].end(), std::back_inserter(m_fileList[i][static_cast<int>(priority)]));
-				m_fileList[i][j].clear();
+				for (int k = 0; k < 2; ++k) {
+					m_fileList[i][static_cast<int>(priority)][k].insert(m_fileList[i][j][k].begin(), m_fileList[i][j][k].end());
+					m_fileList[i][j][k].clear();
+				}
 			}
 		}
+	}
 }
 
 void CServerItem::SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority)
 {
-	int i = pItem->queued() ? 0 : 1;
-
-	for (auto iter = m_fileList[i][static_cast<int>(oldPriority)].begin(); iter != m_fileList[i][static_cast<int>(oldPriority)].end(); ++iter) {
-		if (*iter != pItem) {
-			continue;
-		}
-
-		m_fileList[i][static_cast<int>(oldPriority)].erase(iter);
-		m_fileList[i][static_cast<int>(newPriority)].push_back(pItem);
-		return;
+	// Reprioritized items go to the end of their new list
+	size_t const erased = GetIdleList(*pItem, oldPriority).erase(std::make_pair(pItem->queue_order_, pItem));
+	pItem->queue_order_ = back_order_++;
+	if (erased) {
+		GetIdleList(*pItem, newPriority).emplace(pItem->queue_order_, pItem);
 	}
-
-	wxFAIL;
 }
 
 // --------------
@@ -1006,7 +1083,7 @@ wxString CQueueViewBase::OnGetItemText(CQueueItem* pItem, ColumnId column) const
 			switch (column)
 			{
 			case colLocalName:
-				return _T("  ") + pFileItem->GetLocalPath().GetPath() + pFileItem->GetLocalFile();
+				return _T("  ") + pFileItem->GetLocalPath().GetPath() + pFileItem->GetTransferLocalFile();
 			case colDirection:
 				if (pFileItem->Download()) {
 					if (pFileItem->queued()) {
@@ -1459,7 +1536,8 @@ bool CQueueViewBase::RemoveItem(CQueueItem* pItem, bool destroy, bool updateItem
 	bool didRemoveParent;
 
 	int oldCount = m_itemCount;
-	if (!topLevelItem->GetChild(0)) {
+	// Servers with stored files not loaded yet stay until those got loaded
+	if (!topLevelItem->GetChild(0) && !static_cast<CServerItem*>(topLevelItem)->pending_.count) {
 		std::vector<CServerItem*>::iterator iter;
 		for (iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
 			if (*iter == topLevelItem) {
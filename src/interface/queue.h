@@ -7,6 +7,9 @@
 
 #include <libfilezilla/optional.hpp>
 
+#include <map>
+#include <set>
+
 enum class QueuePriority : unsigned char {
 	lowest,
 	low,
@@ -78,6 +81,17 @@ private:
 	int m_removed_at_front{};
 };
 
+// Stored items of a server that have not been loaded into the queue yet
+struct pending_items final
+{
+	int count{};
+	int64_t size{};
+	int unknown_size{}; // Number of files of unknown size
+
+	// Number of download segments by target file
+	std::map<std::wstring, int> segments;
+};
+
 class CFileItem;
 class CServerItem final : public CQueueItem
 {
@@ -99,8 +113,12 @@ public:
 	virtual bool RemoveChild(CQueueItem* pItem, bool destroy = true, bool forward = true) override; // Removes a child item with is somewhere in the tree of children
 	virtual bool TryRemoveAll() override;
 
+	// O(1), includes the pending items
 	int64_t GetTotalSize(int& filesWithUnknownSize, int& queuedFiles) const;
 
+	// Called by file items if their size changes
+	void ChildSizeChanged(int64_t oldSize, int64_t newSize);
+
 	void QueueImmediateFiles();
 	void QueueImmediateFile(CFileItem* pItem);
 
@@ -114,22 +132,48 @@ public:
 
 	void SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority);
 
+	// Called by file items before they get activated or after they became idle
+	void SetChildActive(CFileItem* pItem, bool active);
+
 	int m_activeCount;
 
 	const std::vector<CQueueItem*>& GetChildren() const { return m_children; }
 
 	void Sort(int col, bool reverse);
 
+	// Row id in the queue database, 0 if not stored yet
+	int64_t storage_id_{};
+
+	// Set if the stored site needs to be written again
+	bool storage_dirty_{};
+
+	pending_items pending_;
+
 protected:
 	void AddFileItemToList(CFileItem* pItem);
-	void RemoveFileItemFromList(CFileItem* pItem, bool forward);
+	void RemoveFileItemFromList(CFileItem* pItem);
 
 	Site site_;
 
-	// array of item lists, sorted by priority. Used by scheduler to find
-	// next file to transfer
-	// First index specifies whether the item is queued (0) or immediate (1)
-	std::deque<CFileItem*> m_fileList[2][static_cast<int>(QueuePriority::count)];
+	// Idle items ordered by their position in the queue. Used by the
+	// scheduler to find the next file to transfer, the first item of the
+	// first non-empty list wins.
+	// First index specifies whether the item is queued (0) or immediate (1),
+	// last index whether it is a download (0) or an upload (1).
+	// Active items are not in the lists.
+	typedef std::set<std::pair<int64_t, CFileItem*>> idle_list;
+	idle_list m_fileList[2][static_cast<int>(QueuePriority::count)][2];
+
+	idle_list& GetIdleList(CFileItem const& item, QueuePriority priority);
+
+	// Positions handed out to items added at the front and back of the lists
+	int64_t front_order_{};
+	int64_t back_order_{};
+
+	// Totals over the file and folder items
+	int file_count_{};
+	int unknown_size_count_{};
+	int64_t total_size_{};
 
 	friend class CQueueItem;
 
@@ -155,13 +199,28 @@ namespace queue_flags
 	auto constexpr mask = static_cast<transfer_flags>(0x0f);
 }
 
+// Describes one part of a download that got split into several
+// byte ranges, each transferred over its own connection.
+struct file_segment final
+{
+	int64_t offset{-1};
+	int64_t length{};
+	int64_t file_size{}; // Size of the complete file
+
+	explicit operator bool() const { return offset >= 0; }
+};
+
+// Name of the local file holding the data of the segment starting at the given offset
+std::wstring GetSegmentFileName(std::wstring const& file, int64_t offset);
+
 class CFileItem : public CQueueItem
 {
 public:
 	CFileItem(CServerItem* parent, transfer_flags const& flags,
 		std::wstring const& sourceFile, std::wstring const& targetFile,
 		CLocalPath const& localPath, CServerPath const& remotePath, int64_t size,
-		std::wstring const& extraFlags, std::string const& persistentState = {});
+		std::wstring const& extraFlags, std::string const& persistentState = {},
+		file_segment const& segment = {});
 
 	virtual ~CFileItem();
 
@@ -173,6 +232,7 @@ public:
 		std::wstring targetFile_;
 		std::wstring extraFlags_;
 		std::string persistentState_;
+		file_segment segment_;
 	};
 
 	std::wstring const& GetLocalFile() const { return !Download() ? GetSourceFile() : (extra_data_ && !extra_data_->targetFile_.empty() ? extra_data_->targetFile_ : m_sourceFile); }
@@ -181,8 +241,13 @@ public:
 	fz::sparse_optional<extra_data> const& GetExtraData() const { return extra_data_; }
 	CLocalPath const& GetLocalPath() const { return m_localPath; }
 	CServerPath const& GetRemotePath() const { return m_remotePath; }
+	file_segment GetSegment() const { return extra_data_ ? extra_data_->segment_ : file_segment(); }
+
+	// For segments, the file the data actually gets written to
+	std::wstring GetTransferLocalFile() const;
+
 	int64_t GetSize() const { return m_size; }
-	void SetSize(int64_t size) { m_size = size; }
+	void SetSize(int64_t size);
 	inline bool Download() const { return flags_ & transfer_flags::download; }
 
 	inline transfer_flags flags() const { return flags_; }
@@ -258,6 +323,13 @@ public:
 	unsigned char m_errorCount{};
 	t_EngineData* m_pEngineData{};
 
+	// Row id in the queue database, 0 if not stored yet
+	int64_t storage_id_{};
+
+	// Set if the stored row needs to be written again. Has to be set
+	// by whoever changes m_errorCount or m_defaultFileExistsAction.
+	bool storage_dirty_{};
+
 	inline bool made_progress() const { return flags_ & queue_flags::made_progess; }
 	inline void set_made_progress(bool made_progress)
 	{
@@ -275,6 +347,11 @@ protected:
 	CLocalPath const m_localPath;
 	CServerPath const m_remotePath;
 	int64_t m_size{};
+
+	// Position in the scheduling lists of the server, see CServerItem::m_fileList
+	int64_t queue_order_{};
+
+	friend class CServerItem;
 };
 
 class CFolderItem final : public CFileItem
@@ -5,6 +5,10 @@
 
 #include <sqlite3.h>
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <set>
 #include <unordered_map>
 
 #include <libfilezilla/uri.hpp>
@@ -96,7 +100,10 @@ namespace file_table_column_names
 		flags,
 		default_exists_action,
 		extra_flags,
-		persistent_state
+		persistent_state,
+		segment_offset,
+		segment_length,
+		segment_file_size
 	};
 }
 
@@ -113,7 +120,10 @@ _column file_table_columns[] = {
 	{ "flags", Column_type::integer, 0 },
 	{ "default_exists_action", Column_type::integer, 0 },
 	{ "extra_flags", Column_type::text, 0 },
-	{ "persistent_state", Column_type::blob, 0 }
+	{ "persistent_state", Column_type::blob, 0 },
+	{ "segment_offset", Column_type::integer, 0 },
+	{ "segment_length", Column_type::integer, 0 },
+	{ "segment_file_size", Column_type::integer, 0 }
 };
 
 namespace path_table_column_names
@@ -144,10 +154,19 @@ public:
 
 	sqlite3_stmt* PrepareStatement(std::string const& query);
 	sqlite3_stmt* PrepareInsertStatement(std::string const& name, _column const*, unsigned int count);
+	sqlite3_stmt* PrepareUpdateStatement(std::string const& name, _column const*, unsigned int count);
 
-	bool SaveServer(CServerItem const& item);
-	bool SaveFile(CFileItem const& item);
-	bool SaveDirectory(CFolderItem const& item);
+	// Steps the statement until done and resets it
+	bool Execute(sqlite3_stmt* statement);
+
+	bool SaveServer(CServerItem & item);
+	bool SaveFile(CFileItem & item, int64_t server);
+
+	void BindServer(sqlite3_stmt* statement, Site const& site);
+	bool BindFile(sqlite3_stmt* statement, CFileItem const& item);
+	bool BindDirectory(sqlite3_stmt* statement, CFolderItem const& item);
+
+	bool DeleteRow(sqlite3_stmt* statement, int64_t id);
 
 	int64_t SaveLocalPath(CLocalPath const& path);
 	int64_t SaveRemotePath(CServerPath const& path);
@@ -155,6 +174,12 @@ public:
 	void ReadLocalPaths();
 	void ReadRemotePaths();
 
+	// Reads both path tables anew
+	void ReadPaths();
+
+	// Changes whenever another connection commits to the database
+	int DataVersion();
+
 	CLocalPath const& GetLocalPath(int64_t id) const;
 	CServerPath const& GetRemotePath(int64_t id) const;
 
@@ -189,10 +214,20 @@ public:
 	sqlite3_stmt* insertLocalPathQuery_{};
 	sqlite3_stmt* insertRemotePathQuery_{};
 
+	sqlite3_stmt* updateServerQuery_{};
+	sqlite3_stmt* updateFileQuery_{};
+
+	sqlite3_stmt* deleteServerQuery_{};
+	sqlite3_stmt* deleteFileQuery_{};
+	sqlite3_stmt* deleteServerFilesQuery_{};
+	sqlite3_stmt* deleteUnreadFilesQuery_{};
+
 	sqlite3_stmt* selectServersQuery_{};
 	sqlite3_stmt* selectFilesQuery_{};
 	sqlite3_stmt* selectLocalPathQuery_{};
 	sqlite3_stmt* selectRemotePathQuery_{};
+	sqlite3_stmt* selectPendingQuery_{};
+	sqlite3_stmt* selectPendingSegmentsQuery_{};
 
 	// Caches to speed up saving and loading
 	void ClearCaches();
@@ -203,6 +238,13 @@ public:
 	std::map<int64_t, CLocalPath> reverseLocalPaths_;
 	std::map<int64_t, CServerPath> reverseRemotePaths_;
 
+	// DataVersion when the paths were read
+	int dataVersion_{-1};
+
+	std::map<int64_t, stored_rows> storedFiles_;
+	int64_t loadingServer_{};
+	int loadingLimit_{};
+
 	COptionsBase & options_;
 };
 
@@ -221,6 +263,7 @@ void CQueueStorage::Impl::ReadLocalPaths()
 			std::wstring localPathRaw = GetColumnText(selectLocalPathQuery_, path_table_column_names::path);
 			CLocalPath localPath;
 			if (id > 0 && !localPathRaw.empty() && localPath.SetPath(localPathRaw)) {
+				localPaths_[localPath.GetPath()] = id;
 				reverseLocalPaths_[id] = localPath;
 			}
 		}
@@ -245,6 +288,7 @@ void CQueueStorage::Impl::ReadRemotePaths()
 			std::wstring remotePathRaw = GetColumnText(selectRemotePathQuery_, path_table_column_names::path);
 			CServerPath remotePath;
 			if (id > 0 && !remotePathRaw.empty() && remotePath.SetSafePath(remotePathRaw)) {
+				remotePaths_[remotePath.GetSafePath()] = id;
 				reverseRemotePaths_[id] = remotePath;
 			}
 		}
@@ -291,6 +335,29 @@ static int int_callback(void* p, int n, char** v, char**)
 }
 
 
+int CQueueStorage::Impl::DataVersion()
+{
+	int version = -1;
+	if (sqlite3_exec(db_, "PRAGMA data_version", int_callback, &version, 0) != SQLITE_OK) {
+		return -1;
+	}
+	return version;
+}
+
+
+void CQueueStorage::Impl::ReadPaths()
+{
+	localPaths_.clear();
+	remotePaths_.clear();
+	reverseLocalPaths_.clear();
+	reverseRemotePaths_.clear();
+
+	ReadLocalPaths();
+	ReadRemotePaths();
+	dataVersion_ = DataVersion();
+}
+
+
 bool CQueueStorage::Impl::MigrateSchema()
 {
 	if (!db_) {
@@ -306,7 +373,7 @@ bool CQueueStorage::Impl::MigrateSchema()
 	bool ret = sqlite3_exec(db_, "PRAGMA user_version", int_callback, &version, 0) == SQLITE_OK;
 
 	if (ret) {
-		if (version > 8) {
+		if (version > 9) {
 			ret = false;
 		}
 		else if (version > 0) {
@@ -345,13 +412,21 @@ bool CQueueStorage::Impl::MigrateSchema()
 				ret &= sqlite3_exec(db_, "DROP TABLE files", 0, 0, 0) == SQLITE_OK;
 				ret &= sqlite3_exec(db_, "ALTER TABLE files2 RENAME TO files", 0, 0, 0) == SQLITE_OK;
 				ret &= sqlite3_exec(db_, "ALTER TABLE files DROP COLUMN persistent_state", 0, 0, 0) == SQLITE_OK;
+				ret &= sqlite3_exec(db_, "ALTER TABLE files DROP COLUMN segment_offset", 0, 0, 0) == SQLITE_OK;
+				ret &= sqlite3_exec(db_, "ALTER TABLE files DROP COLUMN segment_length", 0, 0, 0) == SQLITE_OK;
+				ret &= sqlite3_exec(db_, "ALTER TABLE files DROP COLUMN segment_file_size", 0, 0, 0) == SQLITE_OK;
 			}
 			if (ret && version < 8) {
 				ret = sqlite3_exec(db_, "ALTER TABLE files ADD COLUMN persistent_state BLOB DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
 			}
+			if (ret && version < 9) {
+				ret = sqlite3_exec(db_, "ALTER TABLE files ADD COLUMN segment_offset INTEGER DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
+				ret &= sqlite3_exec(db_, "ALTER TABLE files ADD COLUMN segment_length INTEGER DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
+				ret &= sqlite3_exec(db_, "ALTER TABLE files ADD COLUMN segment_file_size INTEGER DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
+			}
 		}
-		if (ret && version != 8) {
-			ret = sqlite3_exec(db_, "PRAGMA user_version = 8", 0, 0, 0) == SQLITE_OK;
+		if (ret && version != 9) {
+			ret = sqlite3_exec(db_, "PRAGMA user_version = 9", 0, 0, 0) == SQLITE_OK;
 		}
 	}
 
@@ -370,6 +445,7 @@ void CQueueStorage::Impl::ClearCaches()
 	remotePaths_.clear();
 	reverseLocalPaths_.clear();
 	reverseRemotePaths_.clear();
+	storedFiles_.clear();
 }
 
 
@@ -382,14 +458,7 @@ int64_t CQueueStorage::Impl::SaveLocalPath(CLocalPath const& path)
 
 	Bind(insertLocalPathQuery_, path_table_column_names::path, path.GetPath());
 
-	int res;
-	do {
-		res = sqlite3_step(insertLocalPathQuery_);
-	} while (res == SQLITE_BUSY);
-
-	sqlite3_reset(insertLocalPathQuery_);
-
-	if (res == SQLITE_DONE) {
+	if (Execute(insertLocalPathQuery_)) {
 		int64_t id = sqlite3_last_insert_rowid(db_);
 		localPaths_[path.GetPath()] = id;
 		return id;
@@ -409,14 +478,7 @@ int64_t CQueueStorage::Impl::SaveRemotePath(CServerPath const& path)
 
 	Bind(insertRemotePathQuery_, path_table_column_names::path, safePath);
 
-	int res;
-	do {
-		res = sqlite3_step(insertRemotePathQuery_);
-	} while (res == SQLITE_BUSY);
-
-	sqlite3_reset(insertRemotePathQuery_);
-
-	if (res == SQLITE_DONE) {
+	if (Execute(insertRemotePathQuery_)) {
 		int64_t id = sqlite3_last_insert_rowid(db_);
 		remotePaths_[safePath] = id;
 		return id;
@@ -534,6 +596,29 @@ sqlite3_stmt* CQueueStorage::Impl::PrepareInsertStatement(std::string const& nam
 }
 
 
+sqlite3_stmt* CQueueStorage::Impl::PrepareUpdateStatement(std::string const& name, _column const* columns, unsigned int count)
+{
+	if (!db_) {
+		return 0;
+	}
+
+	// Parameter indexes are the same as in the insert statement, the id
+	// has index count.
+	std::string query = "UPDATE " + name + " SET ";
+	for (unsigned int i = 1; i < count; ++i) {
+		if (i > 1) {
+			query += ", ";
+		}
+		query += columns[i].name;
+		query += "=:";
+		query += columns[i].name;
+	}
+	query += " WHERE id=:id";
+
+	return PrepareStatement(query);
+}
+
+
 sqlite3_stmt* CQueueStorage::Impl::PrepareStatement(std::string const& query)
 {
 	sqlite3_stmt* ret = 0;
@@ -565,6 +650,23 @@ bool CQueueStorage::Impl::PrepareStatements()
 		return false;
 	}
 
+	updateServerQuery_ = PrepareUpdateStatement("servers", server_table_columns, sizeof(server_table_columns) / sizeof(_column));
+	updateFileQuery_ = PrepareUpdateStatement("files", file_table_columns, sizeof(file_table_columns) / sizeof(_column));
+	deleteServerQuery_ = PrepareStatement("DELETE FROM servers WHERE id=:id");
+	deleteFileQuery_ = PrepareStatement("DELETE FROM files WHERE id=:id");
+	deleteServerFilesQuery_ = PrepareStatement("DELETE FROM files WHERE server=:server");
+	deleteUnreadFilesQuery_ = PrepareStatement("DELETE FROM files WHERE server=:server AND id>:first");
+	if (!updateServerQuery_ || !updateFileQuery_ || !deleteServerQuery_ || !deleteFileQuery_ || !deleteServerFilesQuery_ || !deleteUnreadFilesQuery_) {
+		return false;
+	}
+
+	// Folders are stored with either path set to -1, they do not count as files of unknown size.
+	selectPendingQuery_ = PrepareStatement("SELECT COUNT(*), SUM(size), SUM(size IS NULL AND local_path<>-1 AND remote_path<>-1), MAX(id) FROM files WHERE server=:server AND id>:first");
+	selectPendingSegmentsQuery_ = PrepareStatement("SELECT local_path, source_file, target_file, COUNT(*) FROM files WHERE server=:server AND id>:first AND segment_offset IS NOT NULL GROUP BY local_path, source_file, target_file");
+	if (!selectPendingQuery_ || !selectPendingSegmentsQuery_) {
+		return false;
+	}
+
 	{
 		std::string query = "SELECT ";
 		for (unsigned int i = 0; i < (sizeof(server_table_columns) / sizeof(_column)); ++i) {
@@ -590,7 +692,7 @@ bool CQueueStorage::Impl::PrepareStatements()
 			query += file_table_columns[i].name;
 		}
 
-		query += " FROM files WHERE server=:server ORDER BY id ASC";
+		query += " FROM files WHERE server=:server AND id>:first AND id<=:last ORDER BY id ASC LIMIT :limit";
 
 		if (!(selectFilesQuery_ = PrepareStatement(query))) {
 			return false;
@@ -660,29 +762,27 @@ bool CQueueStorage::Impl::BindBlob(sqlite3_stmt* statement, int index, std::stri
 }
 
 
-bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
+void CQueueStorage::Impl::BindServer(sqlite3_stmt* statement, Site const& site)
 {
 	bool kiosk_mode = options_.get_int(OPTION_DEFAULT_KIOSKMODE) != 0;
 
-	Site const& site = item.GetSite();
-
-	Bind(insertServerQuery_, server_table_column_names::host, site.server.GetHost());
-	Bind(insertServerQuery_, server_table_column_names::port, static_cast<int>(site.server.GetPort()));
-	Bind(insertServerQuery_, server_table_column_names::protocol, static_cast<int>(site.server.GetProtocol()));
-	Bind(insertServerQuery_, server_table_column_names::type, static_cast<int>(site.server.GetType()));
+	Bind(statement, server_table_column_names::host, site.server.GetHost());
+	Bind(statement, server_table_column_names::port, static_cast<int>(site.server.GetPort()));
+	Bind(statement, server_table_column_names::protocol, static_cast<int>(site.server.GetProtocol()));
+	Bind(statement, server_table_column_names::type, static_cast<int>(site.server.GetType()));
 
 	ProtectedCredentials credentials = site.credentials;
 	protect(credentials);
 
 	LogonType logonType = credentials.logonType_;
 	if (logonType != LogonType::anonymous) {
-		Bind(insertServerQuery_, server_table_column_names::user, site.server.GetUser());
+		Bind(statement, server_table_column_names::user, site.server.GetUser());
 
 		if (logonType == LogonType::normal || logonType == LogonType::account || logonType == LogonType::profile) {
 			if (kiosk_mode) {
 				logonType = LogonType::ask;
-				BindNull(insertServerQuery_, server_table_column_names::password);
-				BindNull(insertServerQuery_, server_table_column_names::account);
+				BindNull(statement, server_table_column_names::password);
+				BindNull(statement, server_table_column_names::account);
 			}
 			else {
 				std::wstring pw;
@@ -691,33 +791,33 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 					pw += ' ';
 				}
 				pw += credentials.GetPass();
-				Bind(insertServerQuery_, server_table_column_names::password, pw);
+				Bind(statement, server_table_column_names::password, pw);
 
 				if (credentials.account_.empty()) {
-					BindNull(insertServerQuery_, server_table_column_names::account);
+					BindNull(statement, server_table_column_names::account);
 				}
 				else {
-					Bind(insertServerQuery_, server_table_column_names::account, credentials.account_);
+					Bind(statement, server_table_column_names::account, credentials.account_);
 				}
 			}
 		}
 		else {
-			BindNull(insertServerQuery_, server_table_column_names::password);
-			BindNull(insertServerQuery_, server_table_column_names::account);
+			BindNull(statement, server_table_column_names::password);
+			BindNull(statement, server_table_column_names::account);
 		}
 
 		if (credentials.keyFile_.empty()) {
-			BindNull(insertServerQuery_, server_table_column_names::keyfile);
+			BindNull(statement, server_table_column_names::keyfile);
 		}
 		else {
-			Bind(insertServerQuery_, server_table_column_names::keyfile, credentials.keyFile_);
+			Bind(statement, server_table_column_names::keyfile, credentials.keyFile_);
 		}
 	}
 	else {
-		BindNull(insertServerQuery_, server_table_column_names::user);
-		BindNull(insertServerQuery_, server_table_column_names::password);
-		BindNull(insertServerQuery_, server_table_column_names::account);
-		BindNull(insertServerQuery_, server_table_column_names::keyfile);
+		BindNull(statement, server_table_column_names::user);
+		BindNull(statement, server_table_column_names::password);
+		BindNull(statement, server_table_column_names::account);
+		BindNull(statement, server_table_column_names::keyfile);
 	}
 
 	{
@@ -726,36 +826,36 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 			static_assert(static_cast<int64_t>(LogonType::count) < (1ll << 62), "LogonType::count too big");
 			lt |= 1ll << 62;
 		}
-		Bind(insertServerQuery_, server_table_column_names::logontype, lt);
+		Bind(statement, server_table_column_names::logontype, lt);
 	}
 
-	Bind(insertServerQuery_, server_table_column_names::timezone_offset, site.server.GetTimezoneOffset());
+	Bind(statement, server_table_column_names::timezone_offset, site.server.GetTimezoneOffset());
 
 	switch (site.server.GetPasvMode())
 	{
 	case MODE_PASSIVE:
-		Bind(insertServerQuery_, server_table_column_names::transfer_mode, _T("passive"));
+		Bind(statement, server_table_column_names::transfer_mode, _T("passive"));
 		break;
 	case MODE_ACTIVE:
-		Bind(insertServerQuery_, server_table_column_names::transfer_mode, _T("active"));
+		Bind(statement, server_table_column_names::transfer_mode, _T("active"));
 		break;
 	default:
-		Bind(insertServerQuery_, server_table_column_names::transfer_mode, _T("default"));
+		Bind(statement, server_table_column_names::transfer_mode, _T("default"));
 		break;
 	}
-	Bind(insertServerQuery_, server_table_column_names::max_connections, site.server.MaximumMultipleConnections());
+	Bind(statement, server_table_column_names::max_connections, site.server.MaximumMultipleConnections());
 
 	switch (site.server.GetEncodingType())
 	{
 	default:
 	case ENCODING_AUTO:
-		Bind(insertServerQuery_, server_table_column_names::encoding, _T("Auto"));
+		Bind(statement, server_table_column_names::encoding, _T("Auto"));
 		break;
 	case ENCODING_UTF8:
-		Bind(insertServerQuery_, server_table_column_names::encoding, _T("UTF-8"));
+		Bind(statement, server_table_column_names::encoding, _T("UTF-8"));
 		break;
 	case ENCODING_CUSTOM:
-		Bind(insertServerQuery_, server_table_column_names::encoding, site.server.GetCustomEncoding());
+		Bind(statement, server_table_column_names::encoding, site.server.GetCustomEncoding());
 		break;
 	}
 
@@ -769,22 +869,22 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 				}
 				commands += command;
 			}
-			Bind(insertServerQuery_, server_table_column_names::post_login_commands, commands);
+			Bind(statement, server_table_column_names::post_login_commands, commands);
 		}
 		else {
-			BindNull(insertServerQuery_, server_table_column_names::post_login_commands);
+			BindNull(statement, server_table_column_names::post_login_commands);
 		}
 	}
 	else {
-		BindNull(insertServerQuery_, server_table_column_names::post_login_commands);
+		BindNull(statement, server_table_column_names::post_login_commands);
 	}
 
-	Bind(insertServerQuery_, server_table_column_names::bypass_proxy, site.server.GetBypassProxy() ? 1 : 0);
+	Bind(statement, server_table_column_names::bypass_proxy, site.server.GetBypassProxy() ? 1 : 0);
 	if (!site.GetName().empty()) {
-		Bind(insertServerQuery_, server_table_column_names::name, site.GetName());
+		Bind(statement, server_table_column_names::name, site.GetName());
 	}
 	else {
-		BindNull(insertServerQuery_, server_table_column_names::name);
+		BindNull(statement, server_table_column_names::name);
 	}
 
 	auto const& parameters = site.server.GetExtraParameters();
@@ -793,77 +893,64 @@ bool CQueueStorage::Impl::SaveServer(CServerItem const& item)
 		for (auto const& parameter : parameters) {
 			qs[parameter.first] = fz::to_utf8(parameter.second);
 		}
-		Bind(insertServerQuery_, server_table_column_names::parameters, qs.to_string(false));
+		Bind(statement, server_table_column_names::parameters, qs.to_string(false));
+	}
+	else {
+		BindNull(statement, server_table_column_names::parameters);
 	}
 
 	auto const& site_path = site.SitePath();
 	if (site_path.empty()) {
-		BindNull(insertServerQuery_, server_table_column_names::site_path);
+		BindNull(statement, server_table_column_names::site_path);
 	}
 	else {
-		Bind(insertServerQuery_, server_table_column_names::site_path, site_path);
+		Bind(statement, server_table_column_names::site_path, site_path);
 	}
-
-	int res;
-	do {
-		res = sqlite3_step(insertServerQuery_);
-	} while (res == SQLITE_BUSY);
-
-	sqlite3_reset(insertServerQuery_);
-
-	bool ret = res == SQLITE_DONE;
-	if (ret) {
-		sqlite3_int64 serverId = sqlite3_last_insert_rowid(db_);
-		Bind(insertFileQuery_, file_table_column_names::server, static_cast<int64_t>(serverId));
-
-		const std::vector<CQueueItem*>& children = item.GetChildren();
-		for (std::vector<CQueueItem*>::const_iterator it = children.begin() + item.GetRemovedAtFront(); it != children.end(); ++it) {
-			CQueueItem & childItem = **it;
-			if (childItem.GetType() == QueueItemType::File) {
-				ret &= SaveFile(static_cast<CFileItem&>(childItem));
-			}
-			else if (childItem.GetType() == QueueItemType::Folder) {
-				ret &= SaveDirectory(static_cast<CFolderItem&>(childItem));
-			}
-		}
-	}
-	return ret;
 }
 
 
-bool CQueueStorage::Impl::SaveFile(CFileItem const& file)
+bool CQueueStorage::Impl::BindFile(sqlite3_stmt* statement, CFileItem const& file)
 {
-	if (file.m_edit != CEditHandler::none) {
-		return true;
-	}
-
-	Bind(insertFileQuery_, file_table_column_names::source_file, file.GetSourceFile());
+	Bind(statement, file_table_column_names::source_file, file.GetSourceFile());
 	auto const& extra_data = file.GetExtraData();
 	if (extra_data) {
 		if (!extra_data->targetFile_.empty()) {
-			Bind(insertFileQuery_, file_table_column_names::target_file, extra_data->targetFile_);
+			Bind(statement, file_table_column_names::target_file, extra_data->targetFile_);
 		}
 		else {
-			BindNull(insertFileQuery_, file_table_column_names::target_file);
+			BindNull(statement, file_table_column_names::target_file);
 		}
 
 		if (!extra_data->extraFlags_.empty()) {
-			Bind(insertFileQuery_, file_table_column_names::extra_flags, extra_data->extraFlags_);
+			Bind(statement, file_table_column_names::extra_flags, extra_data->extraFlags_);
 		}
 		else {
-			BindNull(insertFileQuery_, file_table_column_names::extra_flags);
+			BindNull(statement, file_table_column_names::extra_flags);
 		}
 
 		if (!extra_data->persistentState_.empty()) {
-			Bind(insertFileQuery_, file_table_column_names::persistent_state, extra_data->persistentState_);
+			Bind(statement, file_table_column_names::persistent_state, extra_data->persistentState_);
 		}
 		else {
-			BindNull(insertFileQuery_, file_table_column_names::persistent_state);
+			BindNull(statement, file_table_column_names::persistent_state);
 		}
 	}
 	else {
-		BindNull(insertFileQuery_, file_table_column_names::target_file);
-		BindNull(insertFileQuery_, file_table_column_names::extra_flags);
+		BindNull(statement, file_table_column_names::target_file);
+		BindNull(statement, file_table_column_names::extra_flags);
+		BindNull(statement, file_table_column_names::persistent_state);
+	}
+
+	file_segment const segment = file.GetSegment();
+	if (segment) {
+		Bind(statement, file_table_column_names::segment_offset, segment.offset);
+		Bind(statement, file_table_column_names::segment_length, segment.length);
+		Bind(statement, file_table_column_names::segment_file_size, segment.file_size);
+	}
+	else {
+		BindNull(statement, file_table_column_names::segment_offset);
+		BindNull(statement, file_table_column_names::segment_length);
+		BindNull(statement, file_table_column_names::segment_file_size);
 	}
 
 	int64_t localPathId = SaveLocalPath(file.GetLocalPath());
@@ -872,51 +959,44 @@ bool CQueueStorage::Impl::SaveFile(CFileItem const& file)
 		return false;
 	}
 
-	Bind(insertFileQuery_, file_table_column_names::local_path, localPathId);
-	Bind(insertFileQuery_, file_table_column_names::remote_path, remotePathId);
+	Bind(statement, file_table_column_names::local_path, localPathId);
+	Bind(statement, file_table_column_names::remote_path, remotePathId);
 
 	if (file.GetSize() != -1) {
-		Bind(insertFileQuery_, file_table_column_names::size, file.GetSize());
+		Bind(statement, file_table_column_names::size, file.GetSize());
 	}
 	else {
-		BindNull(insertFileQuery_, file_table_column_names::size);
+		BindNull(statement, file_table_column_names::size);
 	}
 	if (file.m_errorCount) {
-		Bind(insertFileQuery_, file_table_column_names::error_count, file.m_errorCount);
+		Bind(statement, file_table_column_names::error_count, file.m_errorCount);
 	}
 	else {
-		BindNull(insertFileQuery_, file_table_column_names::error_count);
+		BindNull(statement, file_table_column_names::error_count);
 	}
-	Bind(insertFileQuery_, file_table_column_names::priority, static_cast<int>(file.GetPriority()));
-	Bind(insertFileQuery_, file_table_column_names::flags, static_cast<int64_t>(file.flags() - queue_flags::mask));
+	Bind(statement, file_table_column_names::priority, static_cast<int>(file.GetPriority()));
+	Bind(statement, file_table_column_names::flags, static_cast<int64_t>(file.flags() - queue_flags::mask));
 
 	if (file.m_defaultFileExistsAction != CFileExistsNotification::unknown) {
-		Bind(insertFileQuery_, file_table_column_names::default_exists_action, file.m_defaultFileExistsAction);
+		Bind(statement, file_table_column_names::default_exists_action, file.m_defaultFileExistsAction);
 	}
 	else {
-		BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
+		BindNull(statement, file_table_column_names::default_exists_action);
 	}
 
-	int res;
-	do {
-		res = sqlite3_step(insertFileQuery_);
-	} while (res == SQLITE_BUSY);
-
-	sqlite3_reset(insertFileQuery_);
-
-	return res == SQLITE_DONE;
+	return true;
 }
 
 
-bool CQueueStorage::Impl::SaveDirectory(CFolderItem const& directory)
+bool CQueueStorage::Impl::BindDirectory(sqlite3_stmt* statement, CFolderItem const& directory)
 {
 	if (directory.Download()) {
-		BindNull(insertFileQuery_, file_table_column_names::source_file);
+		BindNull(statement, file_table_column_names::source_file);
 	}
 	else {
-		Bind(insertFileQuery_, file_table_column_names::source_file, directory.GetSourceFile());
+		Bind(statement, file_table_column_names::source_file, directory.GetSourceFile());
 	}
-	BindNull(insertFileQuery_, file_table_column_names::target_file);
+	BindNull(statement, file_table_column_names::target_file);
 
 	int64_t localPathId = directory.Download() ? SaveLocalPath(directory.GetLocalPath()) : -1;
 	int64_t remotePathId = directory.Download() ? -1 : SaveRemotePath(directory.GetRemotePath());
@@ -924,32 +1004,167 @@ bool CQueueStorage::Impl::SaveDirectory(CFolderItem const& directory)
 		return false;
 	}
 
-	Bind(insertFileQuery_, file_table_column_names::local_path, localPathId);
-	Bind(insertFileQuery_, file_table_column_names::remote_path, remotePathId);
+	Bind(statement, file_table_column_names::local_path, localPathId);
+	Bind(statement, file_table_column_names::remote_path, remotePathId);
 
-	BindNull(insertFileQuery_, file_table_column_names::size);
+	BindNull(statement, file_table_column_names::size);
 	if (directory.m_errorCount) {
-		Bind(insertFileQuery_, file_table_column_names::error_count, directory.m_errorCount);
+		Bind(statement, file_table_column_names::error_count, directory.m_errorCount);
 	}
 	else {
-		BindNull(insertFileQuery_, file_table_column_names::error_count);
+		BindNull(statement, file_table_column_names::error_count);
 	}
-	Bind(insertFileQuery_, file_table_column_names::priority, static_cast<int>(directory.GetPriority()));
-	Bind(insertFileQuery_, file_table_column_names::flags, static_cast<int>(directory.flags() - queue_flags::mask));
+	Bind(statement, file_table_column_names::priority, static_cast<int>(directory.GetPriority()));
+	Bind(statement, file_table_column_names::flags, static_cast<int>(directory.flags() - queue_flags::mask));
+
+	BindNull(statement, file_table_column_names::default_exists_action);
+	BindNull(statement, file_table_column_names::extra_flags);
+	BindNull(statement, file_table_column_names::persistent_state);
+	BindNull(statement, file_table_column_names::segment_offset);
+	BindNull(statement, file_table_column_names::segment_length);
+	BindNull(statement, file_table_column_names::segment_file_size);
+
+	return true;
+}
 
-	BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
 
+bool CQueueStorage::Impl::Execute(sqlite3_stmt* statement)
+{
 	int res;
 	do {
-		res = sqlite3_step(insertFileQuery_);
+		res = sqlite3_step(statement);
 	} while (res == SQLITE_BUSY);
 
-	sqlite3_reset(insertFileQuery_);
+	sqlite3_reset(statement);
 
 	return res == SQLITE_DONE;
 }
 
 
+bool CQueueStorage::Impl::DeleteRow(sqlite3_stmt* statement, int64_t id)
+{
+	Bind(statement, 1, id);
+	return Execute(statement);
+}
+
+
+bool CQueueStorage::Impl::SaveServer(CServerItem & item)
+{
+	std::vector<CQueueItem*> const& children = item.GetChildren();
+
+	bool ret = true;
+	if (!item.storage_id_) {
+		BindServer(insertServerQuery_, item.GetSite());
+		if (Execute(insertServerQuery_)) {
+			item.storage_id_ = sqlite3_last_insert_rowid(db_);
+			item.storage_dirty_ = false;
+		}
+		else {
+			return false;
+		}
+	}
+	else if (item.storage_dirty_) {
+		BindServer(updateServerQuery_, item.GetSite());
+		Bind(updateServerQuery_, static_cast<int>(sizeof(server_table_columns) / sizeof(_column)), item.storage_id_);
+		if (Execute(updateServerQuery_)) {
+			item.storage_dirty_ = false;
+		}
+		else {
+			ret = false;
+		}
+	}
+
+	auto & stored = storedFiles_[item.storage_id_];
+
+	if (stored.take_discard()) {
+		Bind(deleteUnreadFilesQuery_, 1, item.storage_id_);
+		Bind(deleteUnreadFilesQuery_, 2, stored.last_read());
+		ret &= Execute(deleteUnreadFilesQuery_);
+	}
+
+	// Ids of the stored items still in the queue and of the newly inserted ones.
+	// Rowids of the files table are AUTOINCREMENT, new ones are larger than all
+	// previous ones.
+	std::vector<int64_t> kept;
+	kept.reserve(stored.size());
+	std::vector<int64_t> added;
+
+	for (auto it = children.begin() + item.GetRemovedAtFront(); it != children.end(); ++it) {
+		CQueueItem & childItem = **it;
+		if (childItem.GetType() != QueueItemType::File && childItem.GetType() != QueueItemType::Folder) {
+			continue;
+		}
+
+		CFileItem & file = static_cast<CFileItem&>(childItem);
+		bool const inserted = !file.storage_id_;
+		if (inserted || file.storage_dirty_) {
+			ret &= SaveFile(file, item.storage_id_);
+		}
+		if (file.storage_id_) {
+			if (inserted) {
+				added.push_back(file.storage_id_);
+			}
+			else {
+				kept.push_back(file.storage_id_);
+			}
+		}
+	}
+
+	if (!std::is_sorted(kept.begin(), kept.end())) {
+		std::sort(kept.begin(), kept.end());
+	}
+
+	bool all{};
+	auto const removed = stored.save(std::move(kept), added, all);
+	if (all) {
+		Bind(deleteServerFilesQuery_, 1, item.storage_id_);
+		ret &= Execute(deleteServerFilesQuery_);
+	}
+	for (auto const& id : removed) {
+		ret &= DeleteRow(deleteFileQuery_, id);
+	}
+
+	return ret;
+}
+
+
+bool CQueueStorage::Impl::SaveFile(CFileItem & file, int64_t server)
+{
+	if (file.m_edit != CEditHandler::none) {
+		return true;
+	}
+
+	sqlite3_stmt* statement = file.storage_id_ ? updateFileQuery_ : insertFileQuery_;
+
+	Bind(statement, file_table_column_names::server, server);
+	bool ret;
+	if (file.GetType() == QueueItemType::Folder) {
+		ret = BindDirectory(statement, static_cast<CFolderItem&>(file));
+	}
+	else {
+		ret = BindFile(statement, file);
+	}
+	if (!ret) {
+		return false;
+	}
+
+	if (file.storage_id_) {
+		Bind(statement, static_cast<int>(sizeof(file_table_columns) / sizeof(_column)), file.storage_id_);
+	}
+
+	if (!Execute(statement)) {
+		return false;
+	}
+
+	if (!file.storage_id_) {
+		file.storage_id_ = sqlite3_last_insert_rowid(db_);
+	}
+	file.storage_dirty_ = false;
+
+	return true;
+}
+
+
 std::wstring CQueueStorage::Impl::GetColumnText(sqlite3_stmt* statement, int index)
 {
 	std::wstring ret;
@@ -1184,6 +1399,16 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 
 		int overwrite_action = GetColumnInt(selectFilesQuery_, file_table_column_names::default_exists_action, CFileExistsNotification::unknown);
 
+		file_segment segment;
+		segment.offset = GetColumnInt64(selectFilesQuery_, file_table_column_names::segment_offset, -1);
+		if (segment) {
+			segment.length = GetColumnInt64(selectFilesQuery_, file_table_column_names::segment_length);
+			segment.file_size = GetColumnInt64(selectFilesQuery_, file_table_column_names::segment_file_size);
+			if (!download || segment.length <= 0 || segment.offset + segment.length > segment.file_size) {
+				return INVALID_DATA;
+			}
+		}
+
 		if (sourceFile.empty() || localPath.empty() ||
 			remotePath.empty() ||
 			size < -1 ||
@@ -1192,7 +1417,7 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 			return INVALID_DATA;
 		}
 
-		CFileItem* fileItem = new CFileItem(0, flags | queue_flags::queued, std::move(sourceFile), std::move(targetFile), std::move(localPath), std::move(remotePath), size, std::move(extraFlags), std::move(persistentState));
+		CFileItem* fileItem = new CFileItem(0, flags | queue_flags::queued, std::move(sourceFile), std::move(targetFile), std::move(localPath), std::move(remotePath), size, std::move(extraFlags), std::move(persistentState), segment);
 		*pItem = fileItem;
 		fileItem->SetPriorityRaw(QueuePriority(priority));
 		fileItem->m_errorCount = errorCount;
@@ -1231,6 +1456,14 @@ void CQueueStorage::Impl::Close()
 	sqlite3_finalize(selectFilesQuery_);
 	sqlite3_finalize(selectLocalPathQuery_);
 	sqlite3_finalize(selectRemotePathQuery_);
+	sqlite3_finalize(updateServerQuery_);
+	sqlite3_finalize(updateFileQuery_);
+	sqlite3_finalize(deleteServerQuery_);
+	sqlite3_finalize(deleteFileQuery_);
+	sqlite3_finalize(deleteServerFilesQuery_);
+	sqlite3_finalize(deleteUnreadFilesQuery_);
+	sqlite3_finalize(selectPendingQuery_);
+	sqlite3_finalize(selectPendingSegmentsQuery_);
 	insertServerQuery_ = 0;
 	insertFileQuery_ = 0;
 	insertLocalPathQuery_ = 0;
@@ -1239,6 +1472,14 @@ void CQueueStorage::Impl::Close()
 	selectFilesQuery_ = 0;
 	selectLocalPathQuery_ = 0;
 	selectRemotePathQuery_ = 0;
+	updateServerQuery_ = 0;
+	updateFileQuery_ = 0;
+	deleteServerQuery_ = 0;
+	deleteFileQuery_ = 0;
+	deleteServerFilesQuery_ = 0;
+	deleteUnreadFilesQuery_ = 0;
+	selectPendingQuery_ = 0;
+	selectPendingSegmentsQuery_ = 0;
 	sqlite3_close(db_);
 	db_ = 0;
 }
@@ -1252,6 +1493,10 @@ CQueueStorage::CQueueStorage(COptionsBase& options)
 	}
 
 	if (sqlite3_exec(d_->db_, "PRAGMA encoding=\"UTF-16le\"", 0, 0, 0) == SQLITE_OK) {
+		// Saving only writes what changed, many small transactions are cheaper
+		// with a write-ahead log.
+		sqlite3_exec(d_->db_, "PRAGMA journal_mode=WAL", 0, 0, 0);
+		sqlite3_exec(d_->db_, "PRAGMA synchronous=NORMAL", 0, 0, 0);
 		d_->MigrateSchema();
 		d_->CreateTables();
 		d_->PrepareStatements();
@@ -1266,18 +1511,39 @@ CQueueStorage::~CQueueStorage()
 
 bool CQueueStorage::SaveQueue(std::vector<CServerItem*> const& queue)
 {
-	d_->ClearCaches();
+	if (!d_->insertServerQuery_) {
+		return false;
+	}
 
 	bool ret = true;
 	if (sqlite3_exec(d_->db_, "BEGIN TRANSACTION", 0, 0, 0) == SQLITE_OK) {
+		// Another instance might have purged paths since they were read
+		if (d_->DataVersion() != d_->dataVersion_) {
+			d_->ReadPaths();
+		}
+
+		std::set<int64_t> servers;
 		for (auto const& serverItem : queue) {
 			ret &= d_->SaveServer(*serverItem);
+			if (serverItem->storage_id_) {
+				servers.insert(serverItem->storage_id_);
+			}
+		}
+
+		// Servers no longer in the queue
+		for (auto it = d_->storedFiles_.begin(); it != d_->storedFiles_.end(); ) {
+			if (servers.find(it->first) != servers.end()) {
+				++it;
+				continue;
+			}
+
+			ret &= d_->DeleteRow(d_->deleteServerFilesQuery_, it->first);
+			ret &= d_->DeleteRow(d_->deleteServerQuery_, it->first);
+			it = d_->storedFiles_.erase(it);
 		}
 
 		// Even on previous failure, we want to at least try to commit the data we have so far
 		ret &= sqlite3_exec(d_->db_, "END TRANSACTION", 0, 0, 0) == SQLITE_OK;
-
-		d_->ClearCaches();
 	}
 	else {
 		ret = false;
@@ -1292,8 +1558,7 @@ int64_t CQueueStorage::GetServer(Site& site, bool fromBeginning)
 
 	if (d_->selectServersQuery_) {
 		if (fromBeginning) {
-			d_->ReadLocalPaths();
-			d_->ReadRemotePaths();
+			d_->ReadPaths();
 			sqlite3_reset(d_->selectServersQuery_);
 		}
 
@@ -1305,6 +1570,13 @@ int64_t CQueueStorage::GetServer(Site& site, bool fromBeginning)
 			while (res == SQLITE_BUSY);
 
 			if (res == SQLITE_ROW) {
+				// Remember all rows, even invalid ones. Those not turning
+				// into queue items get deleted on save.
+				int64_t const id = d_->GetColumnInt64(d_->selectServersQuery_, server_table_column_names::id);
+				if (id > 0) {
+					d_->storedFiles_[id];
+				}
+
 				ret = d_->ParseServerFromRow(site);
 				if (ret > 0) {
 					break;
@@ -1330,15 +1602,99 @@ int64_t CQueueStorage::GetServer(Site& site, bool fromBeginning)
 }
 
 
-int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
+bool CQueueStorage::GetPendingFiles(int64_t server, pending_items & pending)
+{
+	pending = pending_items();
+
+	auto & stored = d_->storedFiles_[server];
+	if (stored.last_read() && stored.complete()) {
+		// Everything read already
+		return true;
+	}
+
+	if (!d_->selectPendingQuery_) {
+		return false;
+	}
+
+	d_->Bind(d_->selectPendingQuery_, 1, server);
+	d_->Bind(d_->selectPendingQuery_, 2, stored.last_read());
+
+	int res;
+	do {
+		res = sqlite3_step(d_->selectPendingQuery_);
+	}
+	while (res == SQLITE_BUSY);
+
+	if (res == SQLITE_ROW) {
+		pending.count = d_->GetColumnInt(d_->selectPendingQuery_, 0);
+		pending.size = d_->GetColumnInt64(d_->selectPendingQuery_, 1);
+		pending.unknown_size = d_->GetColumnInt(d_->selectPendingQuery_, 2);
+		if (pending.count) {
+			stored.set_pending(d_->GetColumnInt64(d_->selectPendingQuery_, 3));
+		}
+		else {
+			stored.set_complete();
+		}
+	}
+	sqlite3_reset(d_->selectPendingQuery_);
+
+	if (res != SQLITE_ROW) {
+		return false;
+	}
+
+	if (!pending.count) {
+		return true;
+	}
+
+	// Segmented downloads are only assembled once all their segments are done
+	d_->Bind(d_->selectPendingSegmentsQuery_, 1, server);
+	d_->Bind(d_->selectPendingSegmentsQuery_, 2, stored.last_read());
+	do {
+		res = sqlite3_step(d_->selectPendingSegmentsQuery_);
+		if (res == SQLITE_ROW) {
+			CLocalPath const& localPath = d_->GetLocalPath(d_->GetColumnInt64(d_->selectPendingSegmentsQuery_, 0));
+			std::wstring file = d_->GetColumnText(d_->selectPendingSegmentsQuery_, 2);
+			if (file.empty()) {
+				file = d_->GetColumnText(d_->selectPendingSegmentsQuery_, 1);
+			}
+			if (!localPath.empty() && !file.empty()) {
+				pending.segments[localPath.GetPath() + file] += d_->GetColumnInt(d_->selectPendingSegmentsQuery_, 3);
+			}
+		}
+	}
+	while (res == SQLITE_BUSY || res == SQLITE_ROW);
+	sqlite3_reset(d_->selectPendingSegmentsQuery_);
+
+	return res == SQLITE_DONE;
+}
+
+
+void CQueueStorage::DiscardPendingFiles(int64_t server)
+{
+	auto it = d_->storedFiles_.find(server);
+	if (it != d_->storedFiles_.end()) {
+		it->second.discard();
+	}
+}
+
+
+int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server, int limit)
 {
 	int64_t ret = -1;
 	*pItem = 0;
 
 	if (d_->selectFilesQuery_) {
 		if (server > 0) {
+			auto & stored = d_->storedFiles_[server];
+			stored.begin_page();
+
 			sqlite3_reset(d_->selectFilesQuery_);
 			sqlite3_bind_int64(d_->selectFilesQuery_, 1, server);
+			sqlite3_bind_int64(d_->selectFilesQuery_, 2, stored.last_read());
+			sqlite3_bind_int64(d_->selectFilesQuery_, 3, stored.last_stored());
+			sqlite3_bind_int(d_->selectFilesQuery_, 4, limit);
+			d_->loadingServer_ = server;
+			d_->loadingLimit_ = limit;
 		}
 
 		for (;;) {
@@ -1349,6 +1705,9 @@ int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
 			while (res == SQLITE_BUSY);
 
 			if (res == SQLITE_ROW) {
+				int64_t const id = d_->GetColumnInt64(d_->selectFilesQuery_, file_table_column_names::id);
+				d_->storedFiles_[d_->loadingServer_].read(id);
+
 				ret = d_->ParseFileFromRow(pItem);
 				if (ret > 0) {
 					break;
@@ -1357,6 +1716,8 @@ int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
 			else if (res == SQLITE_DONE) {
 				ret = 0;
 				sqlite3_reset(d_->selectFilesQuery_);
+
+				d_->storedFiles_[d_->loadingServer_].end_page(d_->loadingLimit_);
 				break;
 			}
 			else {
@@ -1373,6 +1734,12 @@ int64_t CQueueStorage::GetFile(CFileItem** pItem, int64_t server)
 	return ret;
 }
 
+bool CQueueStorage::HasPendingFiles(int64_t server) const
+{
+	auto it = d_->storedFiles_.find(server);
+	return it != d_->storedFiles_.end() && it->second.pending();
+}
+
 bool CQueueStorage::Clear()
 {
 	if (!d_->db_) {
@@ -1419,3 +1786,16 @@ bool CQueueStorage::Vacuum()
 {
 	return sqlite3_exec(d_->db_, "VACUUM", 0, 0, 0) == SQLITE_OK;
 }
+
+bool CQueueStorage::PurgeUnusedPaths()
+{
+	if (!d_->db_) {
+		return false;
+	}
+
+	d_->ClearCaches();
+
+	bool ret = sqlite3_exec(d_->db_, "DELETE FROM local_paths WHERE id NOT IN (SELECT local_path FROM files)", 0, 0, 0) == SQLITE_OK;
+	ret &= sqlite3_exec(d_->db_, "DELETE FROM remote_paths WHERE id NOT IN (SELECT remote_path FROM files)", 0, 0, 0) == SQLITE_OK;
+	return ret;
+}
@@ -1,6 +1,9 @@
 #ifndef FILEZILLA_INTERFACE_QUEUE_STORAGE_HEADER
 #define FILEZILLA_INTERFACE_QUEUE_STORAGE_HEADER
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
 #include <vector>
 #include <stdint.h>
 #include <string>
@@ -9,6 +12,109 @@ class CFileItem;
 class COptionsBase;
 class CServerItem;
 class Site;
+struct pending_items;
+
+// The stored file rows of a server. Rows are read in id order, a page at
+// a time. Rows of items no longer in the queue get deleted when saving.
+class stored_rows final
+{
+public:
+	// Rows with ids up to last_stored have not all been read yet
+	void set_pending(int64_t last_stored)
+	{
+		lastStored_ = last_stored;
+		complete_ = false;
+	}
+	void set_complete() { complete_ = true; }
+
+	void begin_page()
+	{
+		complete_ = false;
+		pageCount_ = 0;
+	}
+
+	// Call for every row read, even those not turning into queue items
+	void read(int64_t id)
+	{
+		++pageCount_;
+		if (id > 0) {
+			files_.push_back(id);
+			lastRead_ = id;
+		}
+	}
+
+	// Call after the last row of a page. Pass a negative limit if all rows got read.
+	void end_page(int limit)
+	{
+		if (limit < 0 || pageCount_ < limit || lastRead_ >= lastStored_) {
+			complete_ = true;
+		}
+	}
+
+	int64_t last_read() const { return lastRead_; }
+	int64_t last_stored() const { return lastStored_; }
+	bool complete() const { return complete_; }
+
+	// Whether there are rows left to read
+	bool pending() const { return !complete_ && !discard_; }
+
+	// The rows not read yet are deleted when saving
+	void discard()
+	{
+		if (!complete_) {
+			discard_ = true;
+		}
+	}
+
+	// Returns true once if the rows after last_read need to be deleted
+	bool take_discard()
+	{
+		bool const ret = discard_ && !complete_;
+		if (discard_) {
+			complete_ = true;
+			discard_ = false;
+		}
+		return ret;
+	}
+
+	// Takes the sorted ids of the read rows whose items are still in the
+	// queue and the ids of the rows just inserted, those are larger than all
+	// previous ones. Returns the ids of the rows to delete. If all rows of
+	// the server are to be deleted, returns nothing and sets all instead.
+	std::vector<int64_t> save(std::vector<int64_t> && kept, std::vector<int64_t> const& added, bool & all)
+	{
+		all = false;
+
+		// Pages read after inserting new rows
+		if (!std::is_sorted(files_.begin(), files_.end())) {
+			std::sort(files_.begin(), files_.end());
+		}
+
+		std::vector<int64_t> removed;
+		if (kept.empty() && added.empty() && complete_) {
+			all = !files_.empty();
+		}
+		else {
+			std::set_difference(files_.begin(), files_.end(), kept.begin(), kept.end(), std::back_inserter(removed));
+		}
+
+		kept.insert(kept.end(), added.begin(), added.end());
+		files_ = std::move(kept);
+
+		return removed;
+	}
+
+	size_t size() const { return files_.size(); }
+
+private:
+	std::vector<int64_t> files_;
+
+	int64_t lastRead_{};
+	int64_t lastStored_{std::numeric_limits<int64_t>::max()};
+	int pageCount_{};
+	bool complete_{true};
+	bool discard_{};
+};
 
 class CQueueStorage final
 {
@@ -31,6 +137,13 @@ public:
 
 	bool Vacuum();
 
+	// Deletes paths no longer used by any file. Call before loading.
+	bool PurgeUnusedPaths();
+
+	// Only writes what changed since loading or the last save: Inserts
+	// new items, updates those marked dirty and deletes the rows of the
+	// items no longer in the queue. Rows not loaded or saved through this
+	// instance are left alone.
 	bool SaveQueue(std::vector<CServerItem*> const& queue);
 
 	// > 0 = server id
@@ -38,7 +151,22 @@ public:
 	// < 0 = failure.
 	int64_t GetServer(Site& site, bool fromBeginning);
 
-	int64_t GetFile(CFileItem** pItem, int64_t server);
+	// Reads the next up to limit files of the server, pass server only
+	// on the first call of each batch. Later calls continue after the
+	// last row read.
+	// > 0 = file id, to be assigned to the item's storage_id_
+	//   0 = No more files in this batch
+	// < 0 = failure.
+	int64_t GetFile(CFileItem** pItem, int64_t server, int limit = -1);
+
+	// Number and size of the stored files of the server that have not been read yet
+	bool GetPendingFiles(int64_t server, pending_items & pending);
+
+	// Whether there are files of the server that have not been read yet
+	bool HasPendingFiles(int64_t server) const;
+
+	// Deletes the files not read yet on the next save
+	void DiscardPendingFiles(int64_t server);
 
 	std::wstring GetDatabaseFilename();
 
@@ -72,6 +72,7 @@ void CQueueViewFailed::OnRemoveAll(wxCommandEvent&)
 	}
 
 	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
+		RemoveFailedSegments(**iter);
 		delete *iter;
 	}
 	m_serverList.clear();
@@ -151,6 +152,7 @@ void CQueueViewFailed::OnRemoveSelected(wxCommandEvent&)
 				selectedItems.pop_front();
 			}
 		}
+		RemoveFailedSegments(*pItem);
 		RemoveItem(pItem, true, false, false);
 	}
 	DisplayNumberQueuedFiles();
@@ -162,6 +164,25 @@ void CQueueViewFailed::OnRemoveSelected(wxCommandEvent&)
 	}
 }
 
+void CQueueViewFailed::RemoveFailedSegments(CQueueItem& item)
+{
+	// Also used by the successful transfers, their parts are either
+	// assembled already or still needed for the other segments.
+	if (m_pQueue->GetQueueView_Failed() != this) {
+		return;
+	}
+
+	if (item.GetType() == QueueItemType::Server) {
+		unsigned int const childrenCount = item.GetChildrenCount(false);
+		for (unsigned int i = 0; i < childrenCount; ++i) {
+			RemoveFailedSegments(*item.GetChild(i, false));
+		}
+	}
+	else if (item.GetType() == QueueItemType::File) {
+		m_pQueue->GetQueueView()->RemoveFailedSegment(static_cast<CFileItem const&>(item));
+	}
+}
+
 bool CQueueViewFailed::RequeueFileItem(CFileItem* pFileItem, CServerItem* pServerItem)
 {
 	CQueueView* pQueueView = m_pQueue->GetQueueView();
@@ -12,6 +12,9 @@ protected:
 	bool RequeueFileItem(CFileItem* pItem, CServerItem* pServerItem);
 	bool RequeueServerItem(CServerItem* pServerItem);
 
+	// Lets the queue delete the parts of removed download segments
+	void RemoveFailedSegments(CQueueItem& item);
+
 	DECLARE_EVENT_TABLE()
 	void OnContextMenu(wxContextMenuEvent& event);
 	void OnRemoveAll(wxCommandEvent& event);
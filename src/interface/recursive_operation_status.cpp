@@ -116,8 +116,16 @@ void CRecursiveOperationStatus::UpdateText()
 		unsigned long long const countDirs = static_cast<unsigned long long>(operation->GetProcessedDirectories());
 		std::wstring const files = fz::sprintf(fztranslate("%llu file", "%llu files", countFiles), countFiles);
 		std::wstring const dirs = fz::sprintf(fztranslate("%llu directory", "%llu directories", countDirs), countDirs);
-		// @translator: Example: Processed 5 files in 1 directory
-		m_pTextCtrl[1]->SetLabel(wxString::Format(_("Processed %s in %s."), files, dirs));
+		if (!m_local && mode == recursive_operation::recursive_delete) {
+			unsigned long long const countDeleted = static_cast<unsigned long long>(m_state.GetRemoteRecursiveOperation()->GetDeletedFiles());
+			std::wstring const deleted = fz::sprintf(fztranslate("%llu file", "%llu files", countDeleted), countDeleted);
+			// @translator: Example: Processed 5 files in 1 directory, deleted 3 files
+			m_pTextCtrl[1]->SetLabel(wxString::Format(_("Processed %s in %s, deleted %s."), files, dirs, deleted));
+		}
+		else {
+			// @translator: Example: Processed 5 files in 1 directory
+			m_pTextCtrl[1]->SetLabel(wxString::Format(_("Processed %s in %s."), files, dirs));
+		}
 	}
 }
 
@@ -1,16 +1,25 @@
 #include "filezilla.h"
 #include "remote_recursive_operation.h"
+#include "asyncrequestqueue.h"
 #include "commandqueue.h"
 #include "chmoddialog.h"
 #include "filter_manager.h"
+#include "Mainfrm.h"
 #include "Options.h"
 #include "queue.h"
 
 #include "../commonui/misc.h"
 
+#include <libfilezilla/glue/wxinvoker.hpp>
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/recursive_remove.hpp>
 
+namespace {
+// Smaller batches are deleted on the browsing connection, changing into
+// the directory on another connection costs more than it saves.
+size_t const min_helper_delete_files = 16;
+}
+
 CRemoteRecursiveOperation::CRemoteRecursiveOperation(CState &state)
 : CStateEventHandler(state)
 , m_state(state)
@@ -21,6 +30,7 @@ CRemoteRecursiveOperation::CRemoteRecursiveOperation(CState &state)
 
 CRemoteRecursiveOperation::~CRemoteRecursiveOperation()
 {
+	ReleaseHelperEngines(false);
 }
 
 void CRemoteRecursiveOperation::OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data)
@@ -67,11 +77,32 @@ void CRemoteRecursiveOperation::do_start_recursive_operation(OperationMode mode,
 	m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
 	m_state.NotifyHandlers(STATECHANGE_REMOTE_RECURSION_STATUS);
 
+	helpersFailed_ = false;
+	deletedFiles_ = 0;
+
 	remote_recursive_operation::do_start_recursive_operation(mode, filters);
 }
 
 void CRemoteRecursiveOperation::process_command(std::unique_ptr<CCommand> pCommand)
 {
+	if (m_operationMode == recursive_delete) {
+		if (pCommand->GetId() == Command::del) {
+			// Larger batches of files get deleted on another connection
+			// while the operation continues to descend.
+			if (static_cast<CDeleteCommand const&>(*pCommand).GetFiles().size() >= min_helper_delete_files && StartOnHelperEngine(pCommand)) {
+				return;
+			}
+		}
+		else if (pCommand->GetId() == Command::removedir) {
+			// Directories can only be removed once they are empty
+			auto const& rmd = static_cast<CRemoveDirCommand const&>(*pCommand);
+			if (!deferredCommands_.empty() || DeletePending(CServerPath(rmd.GetPath(), rmd.GetSubDir()))) {
+				deferredCommands_.push_back(std::move(pCommand));
+				return;
+			}
+		}
+	}
+
 	m_state.m_pCommandQueue->ProcessCommand(pCommand.release(), CCommandQueue::recursiveOperation);
 }
 
@@ -135,6 +166,8 @@ void CRemoteRecursiveOperation::StopRecursiveOperation()
 {
 	bool notify = m_operationMode != recursive_none;
 	remote_recursive_operation::StopRecursiveOperation();
+	ReleaseHelperEngines(false);
+	deferredCommands_.clear();
 	if (notify) {
 		m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
 		m_state.NotifyHandlers(STATECHANGE_REMOTE_RECURSION_STATUS);
@@ -151,3 +184,262 @@ void CRemoteRecursiveOperation::SetImmediate(bool immediate)
 		}
 	}
 }
+
+int CRemoteRecursiveOperation::GetMaxHelperEngines() const
+{
+	Site const& site = m_state.GetSite();
+	if (!site || helpersFailed_) {
+		return 0;
+	}
+
+	int count = COptions::Get()->get_int(OPTION_RECURSIVE_LIST_CONNECTIONS);
+
+	int const max = site.server.MaximumMultipleConnections();
+	if (max) {
+		// The browsing connection and those of the queue count against the limit
+		int available = max - 1;
+		if (m_pQueue) {
+			available -= m_pQueue->GetConnectionCount(site.server);
+		}
+		count = std::min(count, available);
+	}
+
+	return std::max(count, 0);
+}
+
+size_t CRemoteRecursiveOperation::prefetch_capacity()
+{
+	int const max = GetMaxHelperEngines();
+
+	int busy = 0;
+	for (auto const& e : helperEngines_) {
+		if (e->busy_) {
+			++busy;
+		}
+	}
+
+	return max > busy ? static_cast<size_t>(max - busy) : 0;
+}
+
+bool CRemoteRecursiveOperation::prefetch_listing(CServerPath const& parent, std::wstring const& subdir, int flags)
+{
+	std::unique_ptr<CCommand> command = std::make_unique<CListCommand>(parent, subdir, flags);
+	return StartOnHelperEngine(command);
+}
+
+bool CRemoteRecursiveOperation::has_pending_commands()
+{
+	if (!deferredCommands_.empty()) {
+		return true;
+	}
+
+	for (auto const& e : helperEngines_) {
+		if (e->busy_ && e->command_->GetId() == Command::del) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool CRemoteRecursiveOperation::StartOnHelperEngine(std::unique_ptr<CCommand> & command)
+{
+	Site const& site = m_state.GetSite();
+	if (!site) {
+		return false;
+	}
+
+	helper_engine* e{};
+	for (auto & candidate : helperEngines_) {
+		if (!candidate->busy_) {
+			e = candidate.get();
+			break;
+		}
+	}
+	if (!e) {
+		if (static_cast<int>(helperEngines_.size()) >= GetMaxHelperEngines()) {
+			return false;
+		}
+
+		auto created = std::make_unique<helper_engine>();
+		created->engine_ = std::make_unique<CFileZillaEngine>(m_state.GetMainFrame().GetEngineContext(), fz::make_invoker(*this, [this](CFileZillaEngine* engine) { OnHelperEngineEvent(engine); }));
+		e = created.get();
+		helperEngines_.push_back(std::move(created));
+	}
+
+	int res;
+	if (e->engine_->IsConnected()) {
+		e->connecting_ = false;
+		res = e->engine_->Execute(*command);
+	}
+	else {
+		e->connecting_ = true;
+		res = e->engine_->Execute(CConnectCommand(site.server, site.Handle(), site.credentials, false));
+	}
+
+	if (res != FZ_REPLY_WOULDBLOCK) {
+		return false;
+	}
+
+	e->command_ = std::move(command);
+	e->busy_ = true;
+	return true;
+}
+
+void CRemoteRecursiveOperation::OnHelperEngineEvent(CFileZillaEngine* engine)
+{
+	auto it = std::find_if(helperEngines_.begin(), helperEngines_.end(), [engine](auto const& e) { return e->engine_.get() == engine; });
+	if (it == helperEngines_.end()) {
+		return;
+	}
+	helper_engine & e = **it;
+
+	std::unique_ptr<CNotification> notification = engine->GetNextNotification();
+	while (notification) {
+		switch (notification->GetID()) {
+		case nId_operation:
+			if (!ProcessHelperReply(e, static_cast<COperationNotification const&>(*notification).replyCode_)) {
+				// Engine got released
+				return;
+			}
+			break;
+		case nId_asyncrequest:
+			// E.g. certificates or host keys. Usually these are already trusted
+			// through the browsing connection and get answered right away.
+			m_state.GetMainFrame().GetAsyncRequestQueue().AddRequest(engine, unique_static_cast<CAsyncRequestNotification>(std::move(notification)));
+			break;
+		case nId_delete_progress:
+			ProcessDeleteProgress(static_cast<CDeleteProgressNotification const&>(*notification));
+			break;
+		case nId_listing:
+			if (e.command_ && e.command_->GetId() == Command::del) {
+				// Files got deleted, show the updated listing. Prefetched
+				// listings only end up in the directory cache.
+				auto const& listingNotification = static_cast<CDirectoryListingNotification const&>(*notification);
+				if (!listingNotification.GetPath().empty() && !listingNotification.Failed() && !listingNotification.GetPartialListing()) {
+					auto listing = std::make_shared<CDirectoryListing>();
+					if (engine->CacheLookup(listingNotification.GetPath(), *listing) == FZ_REPLY_OK) {
+						CContextManager::Get()->ProcessDirectoryListing(m_state.GetSite().server, listing, 0);
+					}
+				}
+			}
+			break;
+		default:
+			// The listings themselves end up in the directory cache
+			break;
+		}
+
+		notification = engine->GetNextNotification();
+	}
+}
+
+bool CRemoteRecursiveOperation::ProcessHelperReply(helper_engine & e, int replyCode)
+{
+	if (!e.busy_) {
+		return true;
+	}
+
+	bool executed = true;
+	if (e.connecting_) {
+		e.connecting_ = false;
+		if (replyCode == FZ_REPLY_OK) {
+			if (e.engine_->Execute(*e.command_) == FZ_REPLY_WOULDBLOCK) {
+				return true;
+			}
+		}
+		else {
+			// The server might not accept additional connections, don't try again
+			helpersFailed_ = true;
+		}
+		replyCode = FZ_REPLY_ERROR;
+		executed = false;
+	}
+
+	e.busy_ = false;
+
+	CFileZillaEngine const* engine = e.engine_.get();
+	std::unique_ptr<CCommand> command = std::move(e.command_);
+
+	if (helpersFailed_ || static_cast<int>(helperEngines_.size()) > GetMaxHelperEngines()) {
+		ReleaseHelperEngines(true);
+	}
+
+	if (command->GetId() == Command::list) {
+		auto const& list = static_cast<CListCommand const&>(*command);
+		PrefetchFinished(list.GetPath(), list.GetSubDir(), replyCode == FZ_REPLY_OK);
+	}
+	else {
+		DeleteFinished(std::move(command), executed);
+	}
+
+	// Finishing a deletion might have ended the operation
+	return std::any_of(helperEngines_.cbegin(), helperEngines_.cend(), [engine](auto const& h) { return h->engine_.get() == engine; });
+}
+
+void CRemoteRecursiveOperation::ReleaseHelperEngines(bool idle_only)
+{
+	for (auto it = helperEngines_.begin(); it != helperEngines_.end(); ) {
+		if (idle_only && (*it)->busy_) {
+			++it;
+			continue;
+		}
+		m_state.GetMainFrame().GetAsyncRequestQueue().ClearPending((*it)->engine_.get());
+		it = helperEngines_.erase(it);
+	}
+}
+
+void CRemoteRecursiveOperation::DeleteFinished(std::unique_ptr<CCommand> && command, bool executed)
+{
+	if (m_operationMode == recursive_none) {
+		return;
+	}
+
+	if (!executed) {
+		m_state.m_pCommandQueue->ProcessCommand(command.release(), CCommandQueue::recursiveOperation);
+	}
+
+	ProcessDeferredCommands();
+
+	if (recursion_roots_.empty()) {
+		// All directories have been visited, the operation only waited for
+		// the deletions to finish.
+		NextOperation();
+	}
+}
+
+bool CRemoteRecursiveOperation::DeletePending(CServerPath const& dir) const
+{
+	for (auto const& e : helperEngines_) {
+		if (e->busy_ && e->command_->GetId() == Command::del) {
+			CServerPath const path = static_cast<CDeleteCommand const&>(*e->command_).GetPath();
+			if (path.IsSubdirOf(dir, true, true)) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void CRemoteRecursiveOperation::ProcessDeferredCommands()
+{
+	while (!deferredCommands_.empty()) {
+		auto const& rmd = static_cast<CRemoveDirCommand const&>(*deferredCommands_.front());
+		if (DeletePending(CServerPath(rmd.GetPath(), rmd.GetSubDir()))) {
+			break;
+		}
+
+		m_state.m_pCommandQueue->ProcessCommand(deferredCommands_.front().release(), CCommandQueue::recursiveOperation);
+		deferredCommands_.pop_front();
+	}
+}
+
+void CRemoteRecursiveOperation::ProcessDeleteProgress(CDeleteProgressNotification const& notification)
+{
+	if (m_operationMode != recursive_delete) {
+		return;
+	}
+
+	deletedFiles_ += notification.deleted_;
+	m_state.NotifyHandlers(STATECHANGE_REMOTE_RECURSION_STATUS);
+}
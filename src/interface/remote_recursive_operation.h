@@ -7,7 +7,7 @@
 class CQueueView;
 class CActionAfterBlocker;
 
-class CRemoteRecursiveOperation final : public remote_recursive_operation, public CStateEventHandler
+class CRemoteRecursiveOperation final : public remote_recursive_operation, public CStateEventHandler, public wxEvtHandler
 {
 public:
 	CRemoteRecursiveOperation(CState& state);
@@ -20,6 +20,11 @@ public:
 
 	void SetQueue(CQueueView* pQueue) { m_pQueue = pQueue; }
 
+	void ProcessDeleteProgress(CDeleteProgressNotification const& notification);
+
+	// Number of files deleted by the current recursive deletion so far
+	uint64_t GetDeletedFiles() const { return deletedFiles_; }
+
 protected:
 	void do_start_recursive_operation(OperationMode mode, ActiveFilters const& filters) override;
 	void process_command(std::unique_ptr<CCommand>) override;
@@ -32,8 +37,46 @@ protected:
 	void handle_dir_listing_end() override;
 	void handle_listing_failed() override;
 
+	size_t prefetch_capacity() override;
+	bool prefetch_listing(CServerPath const& parent, std::wstring const& subdir, int flags) override;
+	bool has_pending_commands() override;
+
 	void OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data) override;
 
+	// Additional connections listing directories ahead of the operation
+	// and deleting files in parallel to it
+	struct helper_engine final
+	{
+		std::unique_ptr<CFileZillaEngine> engine_;
+		std::unique_ptr<CCommand> command_;
+		bool busy_{};
+		bool connecting_{};
+	};
+
+	int GetMaxHelperEngines() const;
+	bool StartOnHelperEngine(std::unique_ptr<CCommand> & command);
+	void OnHelperEngineEvent(CFileZillaEngine* engine);
+	bool ProcessHelperReply(helper_engine & e, int replyCode);
+	void ReleaseHelperEngines(bool idle_only);
+
+	// Called once a CDeleteCommand handed to a helper engine is done. If it
+	// could not be executed there, it is passed to the command queue instead.
+	void DeleteFinished(std::unique_ptr<CCommand> && command, bool executed);
+
+	// Whether files in the given directory or below are being deleted on helper engines
+	bool DeletePending(CServerPath const& dir) const;
+
+	// Passes deferred directory removals to the command queue, in order, for
+	// as long as nothing below them is still being deleted
+	void ProcessDeferredCommands();
+
+	std::vector<std::unique_ptr<helper_engine>> helperEngines_;
+	bool helpersFailed_{};
+
+	std::deque<std::unique_ptr<CCommand>> deferredCommands_;
+
+	uint64_t deletedFiles_{};
+
 	bool m_immediate{true};
 	bool added_to_queue_{};
 	CState& m_state;
@@ -728,10 +728,12 @@ bool CSearchDialog::Load()
 	}
 
 	m_results = new CSearchDialogFileList(this, 0, options_);
+	m_results->sortPool_ = &m_state.pool_;
 	ReplaceControl(XRCCTRL(*this, "ID_RESULTS", wxWindow), m_results);
 	m_results->SetFilelistStatusBar(pStatusBar);
 
 	m_remoteResults = new CSearchDialogFileList(this, 0, options_);
+	m_remoteResults->sortPool_ = &m_state.pool_;
 	ReplaceControl(XRCCTRL(*this, "ID_REMOTE_RESULTS", wxWindow), m_remoteResults);
 	m_remoteResults->SetFilelistStatusBar(m_remoteStatusBar);
 	m_remoteResults->Show(false);
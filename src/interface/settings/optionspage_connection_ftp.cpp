@@ -13,6 +13,8 @@ struct COptionsPageConnectionFTP::impl final
 	wxRadioButton* active_{};
 	wxCheckBox* fallback_{};
 	wxCheckBox* keepalive_{};
+	wxCheckBox* compression_{};
+	wxTextCtrl* compression_types_{};
 };
 
 COptionsPageConnectionFTP::COptionsPageConnectionFTP()
@@ -64,6 +66,17 @@ bool COptionsPageConnectionFTP::CreateControls(wxWindow* parent)
 		inner->Add(impl_->keepalive_);
 		inner->Add(new wxStaticText(box, nullID, _("A proper server does not require this. Contact the server administrator if you need this.")));
 	}
+	{
+		auto [box, inner] = lay.createStatBox(main, _("Compression"), 1);
+		impl_->compression_ = new wxCheckBox(box, nullID, _("&Compress directory listings and text files if the server supports it (MODE Z)"));
+		inner->Add(impl_->compression_);
+		inner->Add(new wxStaticText(box, nullID, _("Compressed file t&ypes, separated by |:")));
+		impl_->compression_types_ = new wxTextCtrl(box, nullID);
+		inner->Add(impl_->compression_types_, lay.grow);
+		impl_->compression_->Bind(wxEVT_CHECKBOX, [this](wxCommandEvent const& ev) {
+			impl_->compression_types_->Enable(ev.IsChecked());
+		});
+	}
 	return true;
 }
 
@@ -74,6 +87,9 @@ bool COptionsPageConnectionFTP::LoadPage()
 	impl_->active_->SetValue(!use_pasv);
 	impl_->fallback_->SetValue(m_pOptions->get_bool(OPTION_ALLOW_TRANSFERMODEFALLBACK));
 	impl_->keepalive_->SetValue(m_pOptions->get_bool(OPTION_FTP_SENDKEEPALIVE));
+	impl_->compression_->SetValue(m_pOptions->get_bool(OPTION_FTP_COMPRESSION));
+	impl_->compression_types_->ChangeValue(m_pOptions->get_string(OPTION_FTP_COMPRESSION_TYPES));
+	impl_->compression_types_->Enable(impl_->compression_->GetValue());
 	return true;
 }
 
@@ -82,5 +98,7 @@ bool COptionsPageConnectionFTP::SavePage()
 	m_pOptions->set(OPTION_USEPASV, impl_->passive_->GetValue() ? 1 : 0);
 	m_pOptions->set(OPTION_ALLOW_TRANSFERMODEFALLBACK, impl_->fallback_->GetValue() ? 1 : 0);
 	m_pOptions->set(OPTION_FTP_SENDKEEPALIVE, impl_->keepalive_->GetValue() ? 1 : 0);
+	m_pOptions->set(OPTION_FTP_COMPRESSION, impl_->compression_->GetValue() ? 1 : 0);
+	m_pOptions->set(OPTION_FTP_COMPRESSION_TYPES, impl_->compression_types_->GetValue().ToStdWstring());
 	return true;
 }
@@ -1312,6 +1312,14 @@ TransferSettingsSiteControls::TransferSettingsSiteControls(wxWindow & parent, Di
 	row->Add(spin, lay.valign);
 
 	limit->Bind(wxEVT_CHECKBOX, [spin](wxCommandEvent const& ev){ spin->Enable(ev.IsChecked()); });
+
+	row = lay.createFlex(0, 1);
+	sizer.Add(row);
+	row->Add(new wxStaticText(&parent, XRCID("ID_SFTP_WINDOW_LABEL"), _("Maximum outstanding SFTP &requests (MiB, 0 = automatic):")), lay.valign);
+	auto * window = new wxSpinCtrlEx(&parent, XRCID("ID_SFTP_WINDOW"), wxString(), wxDefaultPosition, wxSize(lay.dlgUnits(30), -1));
+	window->SetMaxLength(4);
+	window->SetRange(0, 1024);
+	row->Add(window, lay.valign);
 }
 
 void TransferSettingsSiteControls::SetSite(Site const& site)
@@ -1320,12 +1328,14 @@ void TransferSettingsSiteControls::SetSite(Site const& site)
 	xrc_call(parent_, "ID_TRANSFERMODE_ACTIVE", &wxWindow::Enable, !predefined_);
 	xrc_call(parent_, "ID_TRANSFERMODE_PASSIVE", &wxWindow::Enable, !predefined_);
 	xrc_call(parent_, "ID_LIMITMULTIPLE", &wxWindow::Enable, !predefined_);
+	xrc_call(parent_, "ID_SFTP_WINDOW", &wxWindow::Enable, !predefined_);
 
 	if (!site) {
 		xrc_call(parent_, "ID_TRANSFERMODE_DEFAULT", &wxRadioButton::SetValue, true);
 		xrc_call(parent_, "ID_LIMITMULTIPLE", &wxCheckBox::SetValue, false);
 		xrc_call(parent_, "ID_MAXMULTIPLE", &wxSpinCtrl::Enable, false);
 		xrc_call<wxSpinCtrl, int>(parent_, "ID_MAXMULTIPLE", &wxSpinCtrl::SetValue, 1);
+		xrc_call<wxSpinCtrl, int>(parent_, "ID_SFTP_WINDOW", &wxSpinCtrl::SetValue, 0);
 	}
 	else {
 		if (CServer::ProtocolHasFeature(site.server.GetProtocol(), ProtocolFeature::TransferMode)) {
@@ -1352,6 +1362,7 @@ void TransferSettingsSiteControls::SetSite(Site const& site)
 			xrc_call<wxSpinCtrl, int>(parent_, "ID_MAXMULTIPLE", &wxSpinCtrl::SetValue, 1);
 		}
 
+		xrc_call<wxSpinCtrl, int>(parent_, "ID_SFTP_WINDOW", &wxSpinCtrl::SetValue, fz::to_integral<int>(site.server.GetExtraParameter("sftp_window")));
 	}
 }
 
@@ -1379,6 +1390,16 @@ bool TransferSettingsSiteControls::UpdateSite(Site & site, bool)
 		site.server.MaximumMultipleConnections(0);
 	}
 
+	if (site.server.GetProtocol() == SFTP) {
+		int const window = xrc_call(parent_, "ID_SFTP_WINDOW", &wxSpinCtrl::GetValue);
+		if (window > 0) {
+			site.server.SetExtraParameter("sftp_window", fz::to_wstring(window));
+		}
+		else {
+			site.server.ClearExtraParameter("sftp_window");
+		}
+	}
+
 	return true;
 }
 
@@ -1388,6 +1409,9 @@ void TransferSettingsSiteControls::SetControlVisibility(ServerProtocol protocol,
 	xrc_call(parent_, "ID_TRANSFERMODE_DEFAULT", &wxWindow::Show, hasTransferMode);
 	xrc_call(parent_, "ID_TRANSFERMODE_ACTIVE", &wxWindow::Show, hasTransferMode);
 	xrc_call(parent_, "ID_TRANSFERMODE_PASSIVE", &wxWindow::Show, hasTransferMode);
+	bool const isSftp = protocol == SFTP;
+	xrc_call(parent_, "ID_SFTP_WINDOW_LABEL", &wxWindow::Show, isSftp);
+	xrc_call(parent_, "ID_SFTP_WINDOW", &wxWindow::Show, isSftp);
 	auto* transferModeLabel = XRCCTRL(parent_, "ID_TRANSFERMODE_LABEL", wxStaticText);
 	transferModeLabel->Show(hasTransferMode);
 	transferModeLabel->GetContainingSizer()->CalcMin();
@@ -24,12 +24,12 @@
 bool CStateFilterManager::FilenameFiltered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, bool local, int attributes, fz::datetime const& date) const
 {
 	if (local) {
-		if (m_localFilter && FilenameFilteredByFilter(m_localFilter, name, path, dir, size, attributes, date)) {
+		if (m_localFilter && m_localCompiled.filtered(name, path, dir, size, attributes, date)) {
 			return true;
 		}
 	}
 	else {
-		if (m_remoteFilter && FilenameFilteredByFilter(m_remoteFilter, name, path, dir, size, attributes, date)) {
+		if (m_remoteFilter && m_remoteCompiled.filtered(name, path, dir, size, attributes, date)) {
 			return true;
 		}
 	}
@@ -395,6 +395,9 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 	{
 		m_previouslyVisitedRemoteSubdir = m_pDirectoryListing->path.GetLastSegment();
 	}
+	else if (m_pDirectoryListing && m_pDirectoryListing->partial() && m_pDirectoryListing->path == pDirectoryListing->path) {
+		// Already determined when the partial listing got shown
+	}
 	else {
 		m_previouslyVisitedRemoteSubdir.clear();
 	}
@@ -467,6 +470,46 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 	return true;
 }
 
+void CState::AppendRemoteDir(CDirectoryListing const& partial)
+{
+	if (m_pDirectoryListing && m_pDirectoryListing->partial() &&
+		m_pDirectoryListing->path == partial.path && m_pDirectoryListing->m_firstListTime == partial.m_firstListTime)
+	{
+		// Copies share the entry blocks, only the last one gets copied
+		auto listing = std::make_shared<CDirectoryListing>(*m_pDirectoryListing);
+		listing->Append(partial);
+		m_pDirectoryListing = listing;
+	}
+	else {
+		if (m_pDirectoryListing && partial.path == m_pDirectoryListing->path.GetParent()) {
+			m_previouslyVisitedRemoteSubdir = m_pDirectoryListing->path.GetLastSegment();
+		}
+		else {
+			m_previouslyVisitedRemoteSubdir.clear();
+		}
+		m_pDirectoryListing = std::make_shared<CDirectoryListing>(partial);
+	}
+
+	bool const primary = true;
+	NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
+}
+
+void CState::EndPartialRemoteDir()
+{
+	if (!m_pDirectoryListing || !m_pDirectoryListing->partial()) {
+		return;
+	}
+
+	// Incomplete, mark it for a refresh
+	auto listing = std::make_shared<CDirectoryListing>(*m_pDirectoryListing);
+	listing->m_flags &= ~CDirectoryListing::listing_partial;
+	listing->m_flags |= CDirectoryListing::unsure_invalid;
+	m_pDirectoryListing = listing;
+
+	bool const primary = true;
+	NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
+}
+
 std::shared_ptr<CDirectoryListing> CState::GetRemoteDir() const
 {
 	return m_pDirectoryListing;
@@ -1098,6 +1141,8 @@ bool CState::IsLocalIdle(bool ignore_recursive) const
 
 void CState::ListingFailed(int)
 {
+	EndPartialRemoteDir();
+
 	bool const compare = m_changeDirFlags.compare;
 	m_changeDirFlags.compare = false;
 
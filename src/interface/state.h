@@ -68,14 +68,16 @@ public:
 	virtual bool FilenameFiltered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, bool local, int attributes, fz::datetime const& date) const override;
 
 	CFilter const& GetLocalFilter() const { return m_localFilter; }
-	void SetLocalFilter(CFilter const& filter) { m_localFilter = filter; }
+	void SetLocalFilter(CFilter const& filter) { m_localFilter = filter; m_localCompiled = compiled_filters({filter}); }
 
 	CFilter const& GetRemoteFilter() const { return m_remoteFilter; }
-	void SetRemoteFilter(CFilter const& filter) { m_remoteFilter = filter; }
+	void SetRemoteFilter(CFilter const& filter) { m_remoteFilter = filter; m_remoteCompiled = compiled_filters({filter}); }
 
 private:
 	CFilter m_localFilter;
 	CFilter m_remoteFilter;
+	compiled_filters m_localCompiled;
+	compiled_filters m_remoteCompiled;
 };
 
 class CState;
@@ -146,6 +148,12 @@ public:
 
 	bool ChangeRemoteDir(CServerPath const& path, std::wstring const& subdir = std::wstring(), int flags = 0, bool ignore_busy = false, bool compare = false);
 	bool SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, bool primary);
+
+	// Shows the entries of a listing that is still being retrieved
+	void AppendRemoteDir(CDirectoryListing const& partial);
+
+	// The listing being retrieved got aborted, keeps what was received so far
+	void EndPartialRemoteDir();
 	std::shared_ptr<CDirectoryListing> GetRemoteDir() const;
 	const CServerPath GetRemotePath() const;
 
@@ -182,6 +190,8 @@ public:
 	CLocalRecursiveOperation* GetLocalRecursiveOperation() { return m_pLocalRecursiveOperation; }
 	CRemoteRecursiveOperation* GetRemoteRecursiveOperation() { return m_pRemoteRecursiveOperation; }
 
+	CMainFrame& GetMainFrame() { return m_mainFrame; }
+
 	void NotifyHandlers(t_statechange_notifications notification, std::wstring const& data = std::wstring(), void const* data2 = 0);
 
 	bool SuccessfulConnect() const { return m_successful_connect; }
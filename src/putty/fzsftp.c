@@ -284,6 +284,11 @@ static unsigned int const notificationDelay = 10000000 / 10;
 #endif
 
 
+unsigned long fz_get_ticks(void)
+{
+    return GETTICKCOUNT();
+}
+
 int fz_timer_check(_fztimer *timer)
 {
 #ifdef _WINDOWS
@@ -28,6 +28,9 @@ typedef struct
 void fz_timer_init(_fztimer *timer);
 int fz_timer_check(_fztimer *timer);
 
+// Monotonic tick count in milliseconds
+unsigned long fz_get_ticks(void);
+
 uintptr_t next_int(char ** s);
 
 #endif
@@ -277,7 +277,8 @@ static void not_connected(void)
 /* ----------------------------------------------------------------------
  * The meat of the `get' and `put' commands.
  */
-int sftp_get_file(char *fname, char *outfname, bool restart)
+int sftp_get_file(char *fname, char *outfname, bool restart,
+                  uint64_t range_offset, uint64_t range_length)
 {
     struct fxp_handle *fh;
     struct sftp_packet *pktin;
@@ -331,7 +332,18 @@ int sftp_get_file(char *fname, char *outfname, bool restart)
      * thus put up a progress bar.
      */
     ret = 1;
-    xfer = xfer_download_init(fh, offset);
+    if (range_length) {
+        /*
+         * Only a byte range of the remote file is wanted. The local
+         * file receives the range starting at its own offset 0.
+         */
+        if (offset >= range_length)
+            xfer = xfer_download_init(fh, range_offset + range_length, range_offset + range_length);
+        else
+            xfer = xfer_download_init(fh, range_offset + offset, range_offset + range_length);
+    } else {
+        xfer = xfer_download_init(fh, offset, UINT64_MAX);
+    }
     while (!xfer_done(xfer)) {
         void *vbuf;
         int retd, len;
@@ -417,6 +429,8 @@ int sftp_put_file(char *fname, char *outfname, int restart)
     long permissions;
     _fztimer timer;
     int rinterval;
+    char *buffer;
+    int buflen;
 
     attrs.flags = 0;
 //FIXME    PUT_PERMISSIONS(attrs, permissions);
@@ -476,8 +490,9 @@ int sftp_put_file(char *fname, char *outfname, int restart)
      */
     xfer = xfer_upload_init(fh, offset);
     eof = false;
+    buflen = xfer_upload_chunk_size();
+    buffer = snewn(buflen, char);
     while ((!err && !eof) || !xfer_done(xfer)) {
-        char buffer[4096*4];
         int len, ret;
 
         while (xfer_upload_ready(xfer) && !err && !eof) {
@@ -487,7 +502,7 @@ int sftp_put_file(char *fname, char *outfname, int restart)
                     rinterval = 0;
                 }
             }
-            len = read_from_file(file, buffer, sizeof(buffer));
+            len = read_from_file(file, buffer, buflen);
             if (len == -1) {
                 fzprintf(sftpError, "error while reading local file");
                 err = true;
@@ -529,6 +544,7 @@ int sftp_put_file(char *fname, char *outfname, int restart)
         fzprintf(sftpTransfer, "%d", rinterval);
     }
 
+    sfree(buffer);
     xfer_cleanup(xfer);
 
   cleanup:
@@ -583,6 +599,27 @@ int sftp_cmd_keyfile(struct sftp_command *cmd)
     return 1;
 }
 
+int sftp_cmd_window(struct sftp_command *cmd)
+{
+    char *end;
+    uint64_t max;
+
+    if (cmd->nwords != 2) {
+        fzprintf(sftpError, "No window size given");
+        return 0;
+    }
+
+    max = strtoull(cmd->words[1], &end, 10);
+    if (*end) {
+        fzprintf(sftpError, "Invalid window size");
+        return 0;
+    }
+
+    xfer_set_window_max(max);
+
+    return 1;
+}
+
 int sftp_cmd_proxy(struct sftp_command *cmd)
 {
     int proxy_type;
@@ -827,6 +864,7 @@ int sftp_cmd_pwd(struct sftp_command *cmd)
 int sftp_general_get(struct sftp_command *cmd, int restart)
 {
     char *fname, *origfname, *outfname;
+    uint64_t range_offset, range_length;
     int ret;
 
     if (!backend) {
@@ -834,7 +872,7 @@ int sftp_general_get(struct sftp_command *cmd, int restart)
         return 0;
     }
 
-    if (cmd->nwords != 3) {
+    if (cmd->nwords != 3 && cmd->nwords != 5) {
         fzprintf(sftpError, "%s: expects a filename", cmd->words[0]);
         return 0;
     }
@@ -843,13 +881,27 @@ int sftp_general_get(struct sftp_command *cmd, int restart)
     origfname = cmd->words[1];
     outfname = cmd->words[2];
 
+    /*
+     * Optional byte range given as offset and length.
+     */
+    range_offset = 0;
+    range_length = 0;
+    if (cmd->nwords == 5) {
+        range_offset = strtoull(cmd->words[3], NULL, 10);
+        range_length = strtoull(cmd->words[4], NULL, 10);
+        if (!range_length) {
+            fzprintf(sftpError, "%s: invalid byte range", cmd->words[0]);
+            return 0;
+        }
+    }
+
     fname = canonify(origfname, false);
     if (!fname) {
         fzprintf(sftpError, "%s: canonify: %s", origfname, fxp_error());
         return 0;
     }
 
-    ret = sftp_get_file(fname, outfname, restart);
+    ret = sftp_get_file(fname, outfname, restart, range_offset, range_length);
     sfree(fname);
     return ret;
 }
@@ -1522,6 +1574,9 @@ static struct sftp_cmd_lookup {
     },
     {
         "rmdir", sftp_cmd_rmdir
+    },
+    {
+        "window", sftp_cmd_window
     }
 };
 
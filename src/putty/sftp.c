@@ -14,11 +14,28 @@
 
 #include "fzprintf.h"
 #include "fzsftp.h"
+#include "sftpwindow.h"
 
 static char *fxp_error_message;
 static int fxp_errtype;
 
+/*
+ * Size of individual read and write requests. Every server has to
+ * accept 32768 byte reads, larger sizes get used if the server
+ * announces its limits.
+ */
+static int fxp_read_size = 32768;
+static int fxp_write_size = 16384;
+
+/* Largest request size we are willing to use, well below the
+ * packet size bound in sftp_recv. */
+#define FXP_MAX_REQUEST_SIZE (256 * 1024)
+
+/* Upper limit of outstanding request data per transfer, 0 for default */
+static uint64_t xfer_window_max = 0;
+
 static void fxp_internal_error(const char *msg);
+static void fxp_limits(void);
 
 /* ----------------------------------------------------------------------
  * Client-specific parts of the send- and receive-packet system.
@@ -309,16 +326,74 @@ bool fxp_init(void)
         return false;
     }
     /*
-     * In principle, this packet might also contain extension-
-     * string pairs. We should work through them and look for any
-     * we recognise. In practice we don't currently do so because
-     * we know we don't recognise _any_.
+     * The rest of the packet consists of extension-name/data pairs.
      */
+    bool has_limits = false;
+    while (get_avail(pktin)) {
+        ptrlen name = get_string(pktin);
+        get_string(pktin);
+        if (get_err(pktin))
+            break;
+        if (ptrlen_eq_string(name, "limits@openssh.com"))
+            has_limits = true;
+    }
     sftp_pkt_free(pktin);
 
+    if (has_limits)
+        fxp_limits();
+
     return true;
 }
 
+/*
+ * Query the server's limits@openssh.com extension to pick larger
+ * read and write sizes. Failure is not fatal, the defaults are kept.
+ */
+static void fxp_limits(void)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout, *pktin;
+    uint64_t max_read, max_write;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "limits@openssh.com");
+    sftp_send(pktout);
+
+    sftp_register(req);
+    pktin = sftp_recv();
+    if (!pktin || sftp_find_request(pktin) != req) {
+        /* Our request did not get matched, it is still in the tree */
+        del234(sftp_requests, req);
+        sfree(req);
+        if (pktin)
+            sftp_pkt_free(pktin);
+        return;
+    }
+    sfree(req);
+
+    if (pktin->type != SSH_FXP_EXTENDED_REPLY) {
+        sftp_pkt_free(pktin);
+        return;
+    }
+
+    get_uint64(pktin); /* max packet length */
+    max_read = get_uint64(pktin);
+    max_write = get_uint64(pktin);
+    if (!get_err(pktin)) {
+        if (max_read > FXP_MAX_REQUEST_SIZE)
+            max_read = FXP_MAX_REQUEST_SIZE;
+        if (max_read > (uint64_t)fxp_read_size)
+            fxp_read_size = (int)max_read;
+        if (max_write > FXP_MAX_REQUEST_SIZE)
+            max_write = FXP_MAX_REQUEST_SIZE;
+        if (max_write > (uint64_t)fxp_write_size)
+            fxp_write_size = (int)max_write;
+        fzprintf(sftpVerbose, "Server limits: read size %d, write size %d", fxp_read_size, fxp_write_size);
+    }
+    sftp_pkt_free(pktin);
+}
+
 /*
  * Canonify a pathname.
  */
@@ -903,17 +978,29 @@ struct req {
     char *buffer;
     int len, retlen, complete;
     uint64_t offset;
+    unsigned long sent;
     struct req *next, *prev;
 };
 
 struct fxp_xfer {
-    uint64_t offset, furthestdata, filesize;
-    int req_totalsize, req_maxsize;
+    uint64_t offset, furthestdata, filesize, end;
+    uint64_t req_totalsize;
+    struct sftp_window window;
     bool eof, err;
     struct fxp_handle *fh;
     struct req *head, *tail;
 };
 
+void xfer_set_window_max(uint64_t max)
+{
+    xfer_window_max = max;
+}
+
+int xfer_upload_chunk_size(void)
+{
+    return fxp_write_size;
+}
+
 static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset)
 {
     struct fxp_xfer *xfer = snew(struct fxp_xfer);
@@ -922,9 +1009,10 @@ static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset)
     xfer->offset = offset;
     xfer->head = xfer->tail = NULL;
     xfer->req_totalsize = 0;
-    xfer->req_maxsize = 1048576*4;
+    sftp_window_init(&xfer->window, xfer_window_max, fz_get_ticks());
     xfer->err = false;
     xfer->filesize = UINT64_MAX;
+    xfer->end = UINT64_MAX;
     xfer->furthestdata = 0;
 
     return xfer;
@@ -941,8 +1029,17 @@ bool xfer_done(struct fxp_xfer *xfer)
 
 void xfer_download_queue(struct fxp_xfer *xfer)
 {
-    while (xfer->req_totalsize < xfer->req_maxsize &&
+    while (xfer->req_totalsize < xfer->window.size &&
            !xfer->eof && !xfer->err) {
+        if (xfer->offset >= xfer->end) {
+            /*
+             * Everything up to the requested end offset has been
+             * queued already, finish once outstanding requests are in.
+             */
+            xfer->eof = true;
+            break;
+        }
+
         /*
          * Queue a new read request.
          */
@@ -962,8 +1059,11 @@ void xfer_download_queue(struct fxp_xfer *xfer)
         xfer->tail = rr;
         rr->next = NULL;
 
-        rr->len = 32768;
+        rr->len = fxp_read_size;
+        if (xfer->end - xfer->offset < (uint64_t)rr->len)
+            rr->len = (int)(xfer->end - xfer->offset);
         rr->buffer = snewn(rr->len, char);
+        rr->sent = fz_get_ticks();
         sftp_register(req = fxp_read_send(xfer->fh, rr->offset, rr->len));
         fxp_set_userdata(req, rr);
 
@@ -976,10 +1076,11 @@ void xfer_download_queue(struct fxp_xfer *xfer)
     }
 }
 
-struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset)
+struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset, uint64_t end)
 {
     struct fxp_xfer *xfer = xfer_init(fh, offset);
 
+    xfer->end = end;
     xfer->eof = false;
     xfer_download_queue(xfer);
 
@@ -1007,6 +1108,8 @@ int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 #ifdef DEBUG_DOWNLOAD
     printf("read request %p has returned [%d]\n", rr, rr->retlen);
 #endif
+    if (rr->retlen > 0)
+        sftp_window_completed(&xfer->window, rr->retlen, rr->sent, fz_get_ticks());
 
     if ((rr->retlen < 0 && fxp_error_type()==SSH_FX_EOF) || rr->retlen == 0) {
         xfer->eof = true;
@@ -1132,7 +1235,7 @@ struct fxp_xfer *xfer_upload_init(struct fxp_handle *fh, uint64_t offset)
 
 bool xfer_upload_ready(struct fxp_xfer *xfer)
 {
-    return sftp_sendbuffer() == 0;
+    return sftp_sendbuffer() == 0 && xfer->req_totalsize < xfer->window.size;
 }
 
 void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
@@ -1155,6 +1258,7 @@ void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
 
     rr->len = len;
     rr->buffer = NULL;
+    rr->sent = fz_get_ticks();
     sftp_register(req = fxp_write_send(xfer->fh, buffer, rr->offset, len));
     fxp_set_userdata(req, rr);
 
@@ -1189,6 +1293,8 @@ int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 #ifdef DEBUG_UPLOAD
     printf("write request %p has returned [%d]\n", rr, ret ? 1 : 0);
 #endif
+    if (ret)
+        sftp_window_completed(&xfer->window, rr->len, rr->sent, fz_get_ticks());
 
     /*
      * Remove this one from the queue.
@@ -298,7 +298,11 @@ struct sftp_packet *sftp_recv(void);
 
 struct fxp_xfer;
 
-struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset);
+/*
+ * Downloads stop at the given end offset, pass UINT64_MAX to read up to
+ * the end of the file.
+ */
+struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset, uint64_t end);
 void xfer_download_queue(struct fxp_xfer *xfer);
 int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin);
 bool xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len);
@@ -308,6 +312,15 @@ bool xfer_upload_ready(struct fxp_xfer *xfer);
 void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len);
 int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin);
 
+/*
+ * Upper limit in bytes of outstanding request data per transfer,
+ * 0 restores the default. Applies to transfers started afterwards.
+ */
+void xfer_set_window_max(uint64_t max);
+
+/* Preferred size of the buffers passed to xfer_upload_data */
+int xfer_upload_chunk_size(void);
+
 bool xfer_done(struct fxp_xfer *xfer);
 void xfer_set_error(struct fxp_xfer *xfer);
 void xfer_cleanup(struct fxp_xfer *xfer);
@@ -0,0 +1,78 @@
+#ifndef FILEZILLA_PUTTY_SFTPWINDOW_HEADER
+#define FILEZILLA_PUTTY_SFTPWINDOW_HEADER
+
+#include <stdint.h>
+
+/*
+ * Controls how much request data a transfer keeps outstanding.
+ *
+ * The window starts out at SFTP_WINDOW_INITIAL and is resized once per
+ * measurement interval to twice the bandwidth-delay product, using the
+ * smallest observed request round-trip time and the throughput achieved
+ * during the interval. While the window is the limiting factor this
+ * doubles it each interval, once the link is saturated it settles.
+ */
+
+#define SFTP_WINDOW_INITIAL (4 * 1024 * 1024)
+#define SFTP_WINDOW_DEFAULT_MAX (64 * 1024 * 1024)
+
+/* Lower bound of the measurement interval, in milliseconds */
+#define SFTP_WINDOW_MIN_INTERVAL 100
+
+struct sftp_window {
+    uint64_t size, min, max;
+    unsigned long min_rtt; /* In milliseconds, 0 if not yet measured */
+    unsigned long interval_start;
+    uint64_t interval_bytes;
+};
+
+/*
+ * max is the upper limit of the window in bytes, 0 selects the default.
+ * now is the current tick count in milliseconds.
+ */
+static inline void sftp_window_init(struct sftp_window *w, uint64_t max,
+                                    unsigned long now)
+{
+    w->max = max ? max : SFTP_WINDOW_DEFAULT_MAX;
+    w->min = (w->max < SFTP_WINDOW_INITIAL) ? w->max : SFTP_WINDOW_INITIAL;
+    w->size = w->min;
+    w->min_rtt = 0;
+    w->interval_start = now;
+    w->interval_bytes = 0;
+}
+
+/*
+ * Call for every completed request of len bytes that got sent at tick
+ * count sent.
+ */
+static inline void sftp_window_completed(struct sftp_window *w, uint64_t len,
+                                         unsigned long sent, unsigned long now)
+{
+    unsigned long rtt = now - sent;
+    unsigned long elapsed, interval;
+    uint64_t target;
+
+    if (!rtt)
+        rtt = 1;
+    if (!w->min_rtt || rtt < w->min_rtt)
+        w->min_rtt = rtt;
+
+    w->interval_bytes += len;
+
+    elapsed = now - w->interval_start;
+    interval = (w->min_rtt > SFTP_WINDOW_MIN_INTERVAL) ? w->min_rtt : SFTP_WINDOW_MIN_INTERVAL;
+    if (elapsed < interval)
+        return;
+
+    target = w->interval_bytes * w->min_rtt / elapsed * 2;
+    if (target < w->min)
+        target = w->min;
+    else if (target > w->max)
+        target = w->max;
+    w->size = target;
+
+    w->interval_start = now;
+    w->interval_bytes = 0;
+}
+
+#endif
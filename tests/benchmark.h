@@ -0,0 +1,15 @@
+#ifndef FILEZILLA_TESTS_BENCHMARK_HEADER
+#define FILEZILLA_TESTS_BENCHMARK_HEADER
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <stdlib.h>
+
+// Benchmarks take long and report their timings on stderr. They are only
+// added to their test suite if FZ_BENCHMARK is set in the environment,
+// e.g. FZ_BENCHMARK=1 make check
+#define FZ_BENCHMARK_TEST(testMethod) \
+	if (getenv("FZ_BENCHMARK")) \
+		CPPUNIT_TEST(testMethod)
+
+#endif
@@ -0,0 +1,390 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/directorycache.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "benchmark.h"
+
+#include <iostream>
+
+/*
+ * This testsuite exercises the directory cache with many servers and
+ * listings: lookups, invalidation, pruning and snapshots. The benchmark
+ * reports the time taken by Store, Lookup and InvalidateFile.
+ */
+
+class CDirectoryCacheTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirectoryCacheTest);
+	CPPUNIT_TEST(testLookup);
+	CPPUNIT_TEST(testInvalidate);
+	CPPUNIT_TEST(testRemoveFiles);
+	CPPUNIT_TEST(testPrune);
+	CPPUNIT_TEST(testSnapshot);
+	CPPUNIT_TEST(testSnapshotCorrupt);
+	CPPUNIT_TEST(testServers);
+	FZ_BENCHMARK_TEST(testScale);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testLookup();
+	void testInvalidate();
+	void testRemoveFiles();
+	void testPrune();
+	void testSnapshot();
+	void testSnapshotCorrupt();
+	void testServers();
+	void testScale();
+
+protected:
+	struct timings
+	{
+		fz::duration store;
+		fz::duration lookup;
+		fz::duration invalidate;
+	};
+
+	// Stores, looks up and invalidates a listing of each directory on each server
+	static timings RunServers(int servers, int dirs);
+
+	std::string ReadFile();
+	void WriteFile(std::string const& data);
+
+	std::wstring file_;
+
+	static CServer MakeServer(int i);
+	static CDirectoryListing MakeListing(CServerPath const& path, int files);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirectoryCacheTest);
+
+void CDirectoryCacheTest::setUp()
+{
+	file_ = L"directorycachetest.dat";
+	fz::remove_file(fz::to_native(file_), false);
+}
+
+void CDirectoryCacheTest::tearDown()
+{
+	fz::remove_file(fz::to_native(file_), false);
+}
+
+std::string CDirectoryCacheTest::ReadFile()
+{
+	fz::file f(fz::to_native(file_), fz::file::reading, fz::file::existing);
+	CPPUNIT_ASSERT(f.opened());
+
+	std::string data;
+	data.resize(static_cast<size_t>(f.size()));
+	size_t pos{};
+	while (pos < data.size()) {
+		fz::rwresult read = f.read2(data.data() + pos, data.size() - pos);
+		CPPUNIT_ASSERT(read && read.value_);
+		pos += read.value_;
+	}
+	return data;
+}
+
+void CDirectoryCacheTest::WriteFile(std::string const& data)
+{
+	fz::file f(fz::to_native(file_), fz::file::writing, fz::file::empty);
+	CPPUNIT_ASSERT(f.opened());
+	CPPUNIT_ASSERT(f.write2(data.data(), data.size()) && f.fsync());
+}
+
+CServer CDirectoryCacheTest::MakeServer(int i)
+{
+	return CServer(FTP, DEFAULT, fz::sprintf(L"host%d.example.com", i), 21);
+}
+
+CDirectoryListing CDirectoryCacheTest::MakeListing(CServerPath const& path, int files)
+{
+	CDirectoryListing listing;
+	listing.path = path;
+	listing.m_firstListTime = fz::monotonic_clock::now();
+
+	std::vector<CDirentry> entries;
+	for (int i = 0; i < files; ++i) {
+		CDirentry entry;
+		entry.name = fz::sprintf(L"file%d", i);
+		entry.size = i;
+		entry.flags = (i % 10) ? 0 : CDirentry::flag_dir;
+		entries.emplace_back(std::move(entry));
+	}
+	listing.Assign(std::move(entries));
+
+	return listing;
+}
+
+void CDirectoryCacheTest::testLookup()
+{
+	CDirectoryCache cache;
+
+	CServer const server = MakeServer(0);
+	CServerPath const path(L"/foo/bar");
+	cache.Store(MakeListing(path, 5), server);
+
+	CDirectoryListing listing;
+	bool outdated{};
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, path, false, outdated));
+	CPPUNIT_ASSERT(!outdated);
+	CPPUNIT_ASSERT_EQUAL(size_t(5), listing.size());
+
+	// Different server, different path
+	CPPUNIT_ASSERT(!cache.Lookup(listing, MakeServer(1), path, false, outdated));
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server, CServerPath(L"/foo/BAR"), false, outdated));
+
+	// Replacing a listing
+	cache.Store(MakeListing(path, 7), server);
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, path, false, outdated));
+	CPPUNIT_ASSERT_EQUAL(size_t(7), listing.size());
+
+	cache.InvalidateServer(server);
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server, path, false, outdated));
+}
+
+void CDirectoryCacheTest::testInvalidate()
+{
+	CDirectoryCache cache;
+
+	CServer const server = MakeServer(0);
+	CServerPath const path(L"/foo");
+	CServerPath const sub(L"/foo/file0");
+	cache.Store(MakeListing(path, 5), server);
+	cache.Store(MakeListing(sub, 5), server);
+
+	// Affects the listing case-insensitively, file0 is a directory
+	CPPUNIT_ASSERT(cache.InvalidateFile(server, CServerPath(L"/FOO"), L"FILE1"));
+
+	CDirectoryListing listing;
+	bool outdated{};
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server, path, false, outdated));
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, path, true, outdated));
+	CPPUNIT_ASSERT(listing[1].flags & CDirentry::flag_unsure);
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, sub, false, outdated));
+
+	cache.InvalidateFile(server, path, L"file0");
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server, sub, false, outdated));
+
+	cache.RemoveDir(server, path, L"file0", CServerPath());
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server, sub, true, outdated));
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, path, true, outdated));
+}
+
+void CDirectoryCacheTest::testRemoveFiles()
+{
+	CDirectoryCache cache;
+
+	CServer const server = MakeServer(0);
+	CServerPath const path(L"/foo");
+	cache.Store(MakeListing(path, 300), server);
+
+	std::vector<std::wstring> files;
+	for (int i = 250; i > 100; --i) {
+		files.push_back(fz::sprintf(L"file%d", i));
+	}
+	CPPUNIT_ASSERT(cache.RemoveFiles(server, path, files));
+
+	CDirectoryListing listing;
+	bool outdated{};
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, path, true, outdated));
+	CPPUNIT_ASSERT_EQUAL(size_t(150), listing.size());
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file100"), listing[100].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file251"), listing[101].name);
+	CPPUNIT_ASSERT(!(listing.get_unsure_flags() & CDirectoryListing::unsure_invalid));
+
+	// Mismatching case only marks the entry as unsure
+	CPPUNIT_ASSERT(cache.RemoveFiles(server, path, {L"file1", L"FILE2"}));
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, path, true, outdated));
+	CPPUNIT_ASSERT_EQUAL(size_t(149), listing.size());
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file2"), listing[1].name);
+	CPPUNIT_ASSERT(listing[1].flags & CDirentry::flag_unsure);
+	CPPUNIT_ASSERT(listing.get_unsure_flags() & CDirectoryListing::unsure_invalid);
+}
+
+void CDirectoryCacheTest::testPrune()
+{
+	CDirectoryCache cache;
+
+	// Fill the cache up to the limit of 50000 listings with a single server
+	CServer const server = MakeServer(0);
+	CDirectoryListing listing = MakeListing(CServerPath(L"/"), 0);
+	int const limit = 50000;
+	for (int i = 0; i < limit; ++i) {
+		listing.path = CServerPath(fz::sprintf(L"/dir%d", i));
+		cache.Store(listing, server);
+	}
+
+	// Listings of other servers go over the limit, yet must not be evicted
+	// right away, regardless of the shard they end up in.
+	bool outdated{};
+	for (int i = 1; i <= 20; ++i) {
+		listing.path = CServerPath(L"/other");
+		cache.Store(listing, MakeServer(i));
+		CPPUNIT_ASSERT(cache.Lookup(listing, MakeServer(i), CServerPath(L"/other"), false, outdated));
+	}
+
+	// Storing into the large shard brings the cache back below the limit
+	listing.path = CServerPath(L"/last");
+	cache.Store(listing, server);
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, CServerPath(L"/last"), false, outdated));
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, CServerPath(fz::sprintf(L"/dir%d", limit - 1)), false, outdated));
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server, CServerPath(L"/dir0"), false, outdated));
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server, CServerPath(L"/dir20"), false, outdated));
+	CPPUNIT_ASSERT(cache.Lookup(listing, server, CServerPath(L"/dir21"), false, outdated));
+	for (int i = 1; i <= 20; ++i) {
+		CPPUNIT_ASSERT(cache.Lookup(listing, MakeServer(i), CServerPath(L"/other"), false, outdated));
+	}
+}
+
+void CDirectoryCacheTest::testSnapshot()
+{
+	CDirectoryCache cache;
+
+	CServer const server = MakeServer(0);
+	CServerPath const path(L"/foo");
+	CServerPath const sub(L"/foo/file0");
+
+	CDirectoryListing stored = MakeListing(path, 20);
+	stored.get(1).permissions = fz::shared_value<std::wstring>(L"rw-r--r--");
+	stored.get(1).ownerGroup = fz::shared_value<std::wstring>(L"user group");
+	stored.get(2).target = fz::sparse_optional<std::wstring>(L"/elsewhere");
+	stored.get(2).flags |= CDirentry::flag_link;
+	stored.get(3).time = fz::datetime(1234567890, fz::datetime::minutes);
+	stored.get(4).time = fz::datetime(1234567890, fz::datetime::milliseconds) + fz::duration::from_milliseconds(123);
+	cache.Store(stored, server);
+	cache.Store(MakeListing(sub, 3), server);
+	cache.Store(MakeListing(path, 5), MakeServer(1));
+
+	CPPUNIT_ASSERT(cache.Save(file_, 1024 * 1024));
+
+	// Read on first access
+	CDirectoryCache loaded;
+	loaded.SetSnapshotFile(file_);
+
+	CDirectoryListing listing;
+	bool outdated{};
+	CPPUNIT_ASSERT(loaded.Lookup(listing, server, path, false, outdated));
+	CPPUNIT_ASSERT_EQUAL(stored.size(), listing.size());
+	for (size_t i = 0; i < stored.size(); ++i) {
+		CPPUNIT_ASSERT(stored[i] == listing[i]);
+	}
+	CPPUNIT_ASSERT(loaded.Lookup(listing, server, sub, false, outdated));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), listing.size());
+	CPPUNIT_ASSERT(loaded.Lookup(listing, MakeServer(1), path, false, outdated));
+	CPPUNIT_ASSERT_EQUAL(size_t(5), listing.size());
+	CPPUNIT_ASSERT(!loaded.Lookup(listing, MakeServer(2), path, false, outdated));
+}
+
+void CDirectoryCacheTest::testSnapshotCorrupt()
+{
+	CServer const server = MakeServer(0);
+	CServerPath const path(L"/foo");
+
+	{
+		CDirectoryCache cache;
+		cache.Store(MakeListing(path, 10), server);
+		CPPUNIT_ASSERT(cache.Save(file_, 1024 * 1024));
+	}
+	std::string const data = ReadFile();
+
+	CDirectoryListing listing;
+	bool outdated{};
+
+	// Every truncation is either rejected or yields no listing
+	for (size_t len = 0; len < data.size(); ++len) {
+		WriteFile(data.substr(0, len));
+		CDirectoryCache cache;
+		cache.SetSnapshotFile(file_);
+		cache.Load();
+		CPPUNIT_ASSERT(!cache.Lookup(listing, server, path, true, outdated));
+	}
+
+	// An empty listing has its entry count in the last four bytes. A huge
+	// count must not be trusted.
+	{
+		CDirectoryCache cache;
+		cache.Store(MakeListing(path, 0), server);
+		CPPUNIT_ASSERT(cache.Save(file_, 1024 * 1024));
+	}
+	std::string corrupt = ReadFile();
+	CPPUNIT_ASSERT(corrupt.size() > 4);
+	corrupt.replace(corrupt.size() - 4, 4, 4, '\xff');
+	WriteFile(corrupt);
+
+	CDirectoryCache cache;
+	cache.SetSnapshotFile(file_);
+	CPPUNIT_ASSERT(cache.Load());
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server, path, true, outdated));
+}
+
+CDirectoryCacheTest::timings CDirectoryCacheTest::RunServers(int servers, int dirs)
+{
+	CDirectoryCache cache;
+	timings ret;
+
+	std::vector<CServer> serverList;
+	for (int i = 0; i < servers; ++i) {
+		serverList.push_back(MakeServer(i));
+	}
+
+	std::vector<CServerPath> paths;
+	for (int i = 0; i < dirs; ++i) {
+		paths.emplace_back(fz::sprintf(L"/data/dir%d/sub", i));
+	}
+
+	auto start = fz::monotonic_clock::now();
+	for (auto const& server : serverList) {
+		for (auto const& path : paths) {
+			cache.Store(MakeListing(path, 10), server);
+		}
+	}
+	ret.store = fz::monotonic_clock::now() - start;
+
+	start = fz::monotonic_clock::now();
+	CDirectoryListing listing;
+	bool outdated{};
+	for (auto const& server : serverList) {
+		for (auto const& path : paths) {
+			CPPUNIT_ASSERT(cache.Lookup(listing, server, path, true, outdated));
+		}
+	}
+	ret.lookup = fz::monotonic_clock::now() - start;
+
+	start = fz::monotonic_clock::now();
+	for (auto const& server : serverList) {
+		for (auto const& path : paths) {
+			cache.InvalidateFile(server, path, L"file5");
+		}
+	}
+	ret.invalidate = fz::monotonic_clock::now() - start;
+
+	CPPUNIT_ASSERT(!cache.Lookup(listing, serverList.front(), paths.front(), false, outdated));
+	CPPUNIT_ASSERT(cache.Lookup(listing, serverList.back(), paths.back(), true, outdated));
+	CPPUNIT_ASSERT(listing[5].flags & CDirentry::flag_unsure);
+
+	return ret;
+}
+
+void CDirectoryCacheTest::testServers()
+{
+	RunServers(20, 50);
+}
+
+void CDirectoryCacheTest::testScale()
+{
+	int const servers = 64;
+	int const dirs = 700;
+
+	auto const t = RunServers(servers, dirs);
+	std::cerr << fz::sprintf("\nDirectory cache, %d listings: store %dms, lookup %dms, invalidate %dms\n",
+		servers * dirs, t.store.get_milliseconds(), t.lookup.get_milliseconds(), t.invalidate.get_milliseconds());
+}
@@ -0,0 +1,412 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/directorylisting.h"
+
+#include <libfilezilla/format.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "benchmark.h"
+
+#include <iostream>
+#include <unordered_map>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/*
+ * This testsuite checks the block storage and the name index of
+ * CDirectoryListing. The benchmarks report the memory used per entry,
+ * compared to storing each entry in its own allocation, and the memory
+ * and lookup time of the name index, compared to a map of all names, and
+ * the cost of extending the index of a listing that shares it with a copy.
+ */
+
+class CDirectoryListingTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirectoryListingTest);
+	CPPUNIT_TEST(testBlocks);
+	CPPUNIT_TEST(testCopyOnWrite);
+	CPPUNIT_TEST(testRemoveEntries);
+	CPPUNIT_TEST(testMemory);
+	FZ_BENCHMARK_TEST(testMemoryScale);
+	CPPUNIT_TEST(testFind);
+	CPPUNIT_TEST(testFindIndex);
+	FZ_BENCHMARK_TEST(testFindScale);
+	CPPUNIT_TEST(testSharedIndex);
+	FZ_BENCHMARK_TEST(testSharedIndexScale);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testBlocks();
+	void testCopyOnWrite();
+	void testRemoveEntries();
+	void testMemory();
+	void testMemoryScale();
+	void testFind();
+	void testFindIndex();
+	void testFindScale();
+	void testSharedIndex();
+	void testSharedIndexScale();
+
+protected:
+	static std::vector<CDirentry> MakeEntries(size_t count);
+	static size_t Allocated();
+
+	// Memory taken by count entries, individually allocated and in blocks.
+	// Both are zero if the allocator cannot be queried.
+	static std::pair<size_t, size_t> MeasureMemory(size_t count);
+
+	struct index_stats
+	{
+		size_t mapMemory{};
+		size_t indexMemory{};
+		fz::duration build;
+		fz::duration lookup;
+		size_t lookups{};
+	};
+
+	// Builds the name index of count entries and looks up every 97th name
+	// rounds times. The memory is zero if the allocator cannot be queried.
+	static index_stats MeasureIndex(size_t count, size_t rounds);
+
+	// Appends entries one by one to a cached listing of count entries that
+	// a copy is taken of before each update. Returns the time taken.
+	static fz::duration AppendShared(size_t count, size_t updates);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirectoryListingTest);
+
+std::vector<CDirentry> CDirectoryListingTest::MakeEntries(size_t count)
+{
+	fz::shared_value<std::wstring> const permissions(std::wstring(L"-rw-r--r--"));
+	fz::shared_value<std::wstring> const ownerGroup(std::wstring(L"user group"));
+
+	std::vector<CDirentry> entries;
+	entries.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		CDirentry entry;
+		entry.name = fz::sprintf(L"file_%d.txt", i);
+		entry.size = static_cast<int64_t>(i);
+		entry.permissions = permissions;
+		entry.ownerGroup = ownerGroup;
+		entry.time = fz::datetime(static_cast<time_t>(1600000000 + i), fz::datetime::seconds);
+		entries.emplace_back(std::move(entry));
+	}
+	return entries;
+}
+
+size_t CDirectoryListingTest::Allocated()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+void CDirectoryListingTest::testBlocks()
+{
+	size_t const count = 1000;
+
+	CDirectoryListing listing;
+	listing.path = CServerPath(L"/");
+	listing.Assign(MakeEntries(count));
+	CPPUNIT_ASSERT_EQUAL(count, listing.size());
+	CPPUNIT_ASSERT(listing.has_perms());
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_500.txt"), listing[500].name);
+
+	// Following entries get renumbered across block boundaries
+	CPPUNIT_ASSERT(listing.RemoveEntry(10));
+	CPPUNIT_ASSERT_EQUAL(count - 1, listing.size());
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_11.txt"), listing[10].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_500.txt"), listing[499].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_999.txt"), listing[count - 2].name);
+	CPPUNIT_ASSERT(!listing.RemoveEntry(count - 1));
+
+	CDirentry entry;
+	entry.name = L"appended";
+	listing.Append(std::move(entry));
+	CPPUNIT_ASSERT_EQUAL(count, listing.size());
+	CPPUNIT_ASSERT_EQUAL(count - 1, listing.FindFile_CmpCase(L"appended"));
+	CPPUNIT_ASSERT_EQUAL(size_t(10), listing.FindFile_CmpNoCase(L"FILE_11.TXT"));
+
+	CDirectoryListing other = listing;
+	other.Append(listing);
+	CPPUNIT_ASSERT_EQUAL(count * 2, other.size());
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_0.txt"), other[count].name);
+	CPPUNIT_ASSERT_EQUAL(count, listing.size());
+}
+
+void CDirectoryListingTest::testCopyOnWrite()
+{
+	CDirectoryListing listing;
+	listing.Assign(MakeEntries(1000));
+
+	CDirectoryListing copy = listing;
+	copy.get(700).size = 42;
+	CPPUNIT_ASSERT_EQUAL(int64_t(42), copy[700].size);
+	CPPUNIT_ASSERT_EQUAL(int64_t(700), listing[700].size);
+
+	// Untouched blocks stay shared between the copies
+	CPPUNIT_ASSERT_EQUAL(&listing[0], &copy[0]);
+	CPPUNIT_ASSERT(&listing[700] != &copy[700]);
+
+	copy.RemoveEntry(0);
+	CPPUNIT_ASSERT_EQUAL(size_t(1000), listing.size());
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_0.txt"), listing[0].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_1.txt"), copy[0].name);
+
+	// Removal only copies the block containing the entry
+	CPPUNIT_ASSERT_EQUAL(&listing[500], &copy[499]);
+	CPPUNIT_ASSERT_EQUAL(&listing[999], &copy[998]);
+
+	// The name index is renumbered, not rebuilt
+	CPPUNIT_ASSERT_EQUAL(size_t(899), copy.FindFile_CmpCase(L"file_900.txt"));
+	copy.RemoveEntry(200);
+	CPPUNIT_ASSERT_EQUAL(size_t(898), copy.FindFile_CmpCase(L"file_900.txt"));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, copy.FindFile_CmpCase(L"file_201.txt"));
+	CPPUNIT_ASSERT_EQUAL(size_t(199), copy.FindFile_CmpNoCase(L"FILE_200.TXT"));
+	CPPUNIT_ASSERT_EQUAL(size_t(200), copy.FindFile_CmpNoCase(L"FILE_202.TXT"));
+	CPPUNIT_ASSERT_EQUAL(size_t(900), listing.FindFile_CmpCase(L"file_900.txt"));
+}
+
+void CDirectoryListingTest::testRemoveEntries()
+{
+	size_t const count = 1000;
+
+	CDirectoryListing listing;
+	listing.Assign(MakeEntries(count));
+
+	CDirectoryListing copy = listing;
+
+	std::vector<size_t> indexes;
+	for (size_t i = 300; i < count; i += 3) {
+		indexes.push_back(i);
+	}
+	indexes.push_back(count + 5);
+	CPPUNIT_ASSERT_EQUAL(size_t(234), copy.RemoveEntries(indexes));
+	CPPUNIT_ASSERT_EQUAL(count - 234, copy.size());
+	CPPUNIT_ASSERT(copy.get_unsure_flags() & CDirectoryListing::unsure_file_removed);
+
+	// Blocks without removed entries stay shared
+	CPPUNIT_ASSERT_EQUAL(&listing[0], &copy[0]);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_299.txt"), copy[299].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_301.txt"), copy[300].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_302.txt"), copy[301].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_304.txt"), copy[302].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring(L"file_998.txt"), copy[copy.size() - 1].name);
+	CPPUNIT_ASSERT_EQUAL(std::wstring::npos, copy.FindFile_CmpCase(L"file_300.txt"));
+	CPPUNIT_ASSERT_EQUAL(size_t(300), copy.FindFile_CmpCase(L"file_301.txt"));
+
+	CPPUNIT_ASSERT_EQUAL(count, listing.size());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.RemoveEntries({}));
+}
+
+std::pair<size_t, size_t> CDirectoryListingTest::MeasureMemory(size_t count)
+{
+	auto entries = MakeEntries(count);
+
+	size_t start = Allocated();
+	std::vector<fz::shared_value<CDirentry>> individual;
+	individual.reserve(count);
+	for (auto const& entry : entries) {
+		individual.emplace_back(entry);
+	}
+	size_t const before = Allocated() - start;
+	individual.clear();
+	individual.shrink_to_fit();
+
+	start = Allocated();
+	CDirectoryListing listing;
+	listing.Assign(std::vector<CDirentry>(entries));
+	size_t const after = Allocated() - start;
+	CPPUNIT_ASSERT_EQUAL(count, listing.size());
+
+	if (before) {
+		CPPUNIT_ASSERT(after < before);
+	}
+	return {before, after};
+}
+
+void CDirectoryListingTest::testMemory()
+{
+	MeasureMemory(5000);
+}
+
+void CDirectoryListingTest::testMemoryScale()
+{
+	size_t const count = 200000;
+
+	auto const [before, after] = MeasureMemory(count);
+	if (!before) {
+		std::cerr << "\nDirectory listing memory: not measurable on this platform\n";
+		return;
+	}
+
+	std::cerr << fz::sprintf("\nDirectory listing memory, %d entries: %d bytes per entry individually allocated, %d bytes per entry in blocks\n",
+		count, before / count, after / count);
+}
+
+void CDirectoryListingTest::testFind()
+{
+	CDirectoryListing listing;
+	listing.Assign(MakeEntries(1000));
+
+	CPPUNIT_ASSERT_EQUAL(size_t(500), listing.FindFile_CmpCase(L"file_500.txt"));
+	CPPUNIT_ASSERT_EQUAL(size_t(10), listing.FindFile_CmpCase(L"file_10.txt"));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpCase(L"FILE_10.txt"));
+	CPPUNIT_ASSERT_EQUAL(size_t(10), listing.FindFile_CmpNoCase(L"FILE_10.txt"));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpCase(L"missing"));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpNoCase(L"missing"));
+
+	// Appended entries are found without rebuilding the index
+	CDirentry entry;
+	entry.name = L"Appended";
+	listing.Append(std::move(entry));
+	CPPUNIT_ASSERT_EQUAL(size_t(1000), listing.FindFile_CmpCase(L"Appended"));
+	CPPUNIT_ASSERT_EQUAL(size_t(1000), listing.FindFile_CmpNoCase(L"appended"));
+
+	// The first of several matching entries is returned
+	entry.name = L"file_20.TXT";
+	listing.Append(std::move(entry));
+	CPPUNIT_ASSERT_EQUAL(size_t(20), listing.FindFile_CmpNoCase(L"File_20.txt"));
+	CPPUNIT_ASSERT_EQUAL(size_t(1001), listing.FindFile_CmpCase(L"file_20.TXT"));
+
+	listing.get(30).name = L"renamed";
+	listing.ClearFindMap();
+	CPPUNIT_ASSERT_EQUAL(size_t(30), listing.FindFile_CmpCase(L"renamed"));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpNoCase(L"file_30.txt"));
+
+	listing.RemoveEntry(0);
+	CPPUNIT_ASSERT_EQUAL(size_t(29), listing.FindFile_CmpCase(L"renamed"));
+}
+
+CDirectoryListingTest::index_stats CDirectoryListingTest::MeasureIndex(size_t count, size_t rounds)
+{
+	index_stats ret;
+
+	CDirectoryListing listing;
+	listing.Assign(MakeEntries(count));
+
+	size_t start = Allocated();
+	std::unordered_multimap<std::wstring, size_t> map;
+	for (size_t i = 0; i < count; ++i) {
+		map.emplace(fz::str_tolower(listing[i].name), i);
+	}
+	ret.mapMemory = Allocated() - start;
+	map.clear();
+
+	std::vector<std::wstring> names;
+	for (size_t i = 0; i < count; i += 97) {
+		names.emplace_back(fz::sprintf(L"FILE_%d.TXT", i));
+	}
+
+	// First lookup of a missing name builds the complete index
+	start = Allocated();
+	auto now = fz::monotonic_clock::now();
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpNoCase(L"missing"));
+	ret.build = fz::monotonic_clock::now() - now;
+	ret.indexMemory = Allocated() - start;
+
+	now = fz::monotonic_clock::now();
+	for (size_t r = 0; r < rounds; ++r) {
+		for (size_t i = 0; i < names.size(); ++i) {
+			CPPUNIT_ASSERT_EQUAL(i * 97, listing.FindFile_CmpNoCase(names[i]));
+		}
+	}
+	ret.lookup = fz::monotonic_clock::now() - now;
+	ret.lookups = rounds * names.size();
+
+	if (ret.mapMemory) {
+		CPPUNIT_ASSERT(ret.indexMemory < ret.mapMemory);
+	}
+
+	return ret;
+}
+
+void CDirectoryListingTest::testFindIndex()
+{
+	MeasureIndex(5000, 1);
+}
+
+void CDirectoryListingTest::testFindScale()
+{
+	size_t const count = 200000;
+
+	auto const stats = MeasureIndex(count, 20);
+	std::cerr << fz::sprintf("\nDirectory listing index, %d entries: build %dms, %d bytes per entry (map of names: %d), %dns per lookup\n",
+		count, stats.build.get_milliseconds(), stats.indexMemory / count, stats.mapMemory / count, stats.lookup.get_microseconds() * 1000 / stats.lookups);
+}
+
+void CDirectoryListingTest::testSharedIndex()
+{
+	CDirectoryListing listing;
+	listing.Assign(MakeEntries(5000));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpNoCase(L"missing"));
+
+	// Enough appended entries to merge the recently indexed ones a few times
+	CDirectoryListing copy = listing;
+	for (size_t i = 0; i < 1000; ++i) {
+		CDirentry entry;
+		entry.name = fz::sprintf(L"new_%d", i);
+		copy.Append(std::move(entry));
+		CPPUNIT_ASSERT_EQUAL(copy.size() - 1, copy.FindFile_CmpNoCase(fz::sprintf(L"NEW_%d", i)));
+
+		if (!(i % 100)) {
+			CDirectoryListing snapshot = copy;
+			entry.name = L"snapshot";
+			snapshot.Append(std::move(entry));
+			CPPUNIT_ASSERT_EQUAL(snapshot.size() - 1, snapshot.FindFile_CmpCase(L"snapshot"));
+			CPPUNIT_ASSERT_EQUAL(std::string::npos, copy.FindFile_CmpCase(L"snapshot"));
+		}
+	}
+
+	// Duplicates in the recently indexed entries still return the first match
+	CDirentry entry;
+	entry.name = L"FILE_3.TXT";
+	copy.Append(std::move(entry));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), copy.FindFile_CmpNoCase(L"file_3.txt"));
+	CPPUNIT_ASSERT_EQUAL(copy.size() - 1, copy.FindFile_CmpCase(L"FILE_3.TXT"));
+
+	CPPUNIT_ASSERT_EQUAL(size_t(4999), copy.FindFile_CmpCase(L"file_4999.txt"));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpNoCase(L"new_5"));
+	CPPUNIT_ASSERT_EQUAL(size_t(4999), listing.FindFile_CmpNoCase(L"FILE_4999.TXT"));
+
+	AppendShared(5000, 500);
+}
+
+fz::duration CDirectoryListingTest::AppendShared(size_t count, size_t updates)
+{
+	// A cached listing that the views hold a copy of while files get added
+	// to it one by one
+	CDirectoryListing cached;
+	cached.Assign(MakeEntries(count));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, cached.FindFile_CmpNoCase(L"missing"));
+
+	CDirentry entry;
+	auto const start = fz::monotonic_clock::now();
+	for (size_t i = 0; i < updates; ++i) {
+		CDirectoryListing view = cached;
+		std::wstring name = fz::sprintf(L"upload_%d", i);
+		CPPUNIT_ASSERT_EQUAL(std::string::npos, cached.FindFile_CmpNoCase(name));
+		entry.name = name;
+		cached.Append(std::move(entry));
+		CPPUNIT_ASSERT_EQUAL(cached.size() - 1, cached.FindFile_CmpNoCase(name));
+		CPPUNIT_ASSERT_EQUAL(std::string::npos, view.FindFile_CmpNoCase(name));
+	}
+	return fz::monotonic_clock::now() - start;
+}
+
+void CDirectoryListingTest::testSharedIndexScale()
+{
+	size_t const count = 200000;
+	size_t const updates = 10000;
+
+	auto const elapsed = AppendShared(count, updates);
+	std::cerr << fz::sprintf("\nDirectory listing shared with a copy, %d entries: %dus per added and looked up entry\n",
+		count, elapsed.get_microseconds() / updates);
+}
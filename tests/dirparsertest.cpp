@@ -5,6 +5,8 @@
 #include <libfilezilla/util.hpp>
 
 #include <cppunit/extensions/HelperMacros.h>
+#include "benchmark.h"
+#include <iostream>
 #include <list>
 
 #include <string.h>
@@ -30,7 +32,10 @@ class CDirectoryListingParserTest final : public CppUnit::TestFixture
 		CPPUNIT_TEST(testIndividual);
 	}
 	CPPUNIT_TEST(testAll);
+	CPPUNIT_TEST(testChunked);
 	CPPUNIT_TEST(testSpecial);
+	CPPUNIT_TEST(testChunks);
+	FZ_BENCHMARK_TEST(testThroughput);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -39,7 +44,10 @@ public:
 
 	void testIndividual();
 	void testAll();
+	void testChunked();
 	void testSpecial();
+	void testChunks();
+	void testThroughput();
 
 	static std::vector<t_entry> m_entries;
 
@@ -48,6 +56,10 @@ public:
 protected:
 	static void InitEntries();
 
+	// Parses a synthetic listing with the given number of lines, fed in
+	// chunks of the given size. Returns the time taken.
+	static fz::duration ParseSynthetic(size_t lines, size_t chunk);
+
 	t_entry m_entry;
 };
 
@@ -1511,6 +1523,33 @@ void CDirectoryListingParserTest::testAll()
 	}
 }
 
+void CDirectoryListingParserTest::testChunked()
+{
+	// Same as testAll, but lines get split over many small chunks
+	CServer server;
+	CDirectoryListingParser parser(0, server);
+	for (auto const& entry : m_entries) {
+		server.SetType(entry.serverType);
+		parser.SetServer(server);
+		for (size_t pos = 0; pos < entry.data.size(); pos += 7) {
+			size_t const len = std::min(size_t(7), entry.data.size() - pos);
+			char* data = new char[len];
+			memcpy(data, entry.data.c_str() + pos, len);
+			parser.AddData(data, len);
+		}
+	}
+	CDirectoryListing listing = parser.Parse(CServerPath());
+
+	CPPUNIT_ASSERT(listing.size() == m_entries.size());
+
+	unsigned int i = 0;
+	for (auto iter = m_entries.begin(); iter != m_entries.end(); iter++, i++) {
+		std::string msg = fz::sprintf("Data: %s  Expected:\n%s\n  Got:\n%s", iter->data, iter->reference.dump(), listing[i].dump());
+
+		CPPUNIT_ASSERT_MESSAGE(msg, listing[i] == iter->reference);
+	}
+}
+
 void CDirectoryListingParserTest::testSpecial()
 {
 	m_sync.lock();
@@ -1545,6 +1584,51 @@ void CDirectoryListingParserTest::testSpecial()
 	}
 }
 
+fz::duration CDirectoryListingParserTest::ParseSynthetic(size_t lines, size_t chunk)
+{
+	std::string data;
+	for (size_t i = 0; i < lines; ++i) {
+		data += fz::sprintf("-rw-r--r--   1 user     group    %10d Feb 23 17:05 file_%d.dat\r\n", i * 7, i);
+	}
+
+	CServer server;
+	CDirectoryListingParser parser(0, server);
+
+	auto const start = fz::monotonic_clock::now();
+	for (size_t pos = 0; pos < data.size(); pos += chunk) {
+		size_t const len = std::min(chunk, data.size() - pos);
+		char* p = new char[len];
+		memcpy(p, data.c_str() + pos, len);
+		parser.AddData(p, len);
+	}
+	CDirectoryListing listing = parser.Parse(CServerPath());
+	auto const elapsed = fz::monotonic_clock::now() - start;
+
+	CPPUNIT_ASSERT_EQUAL(lines, listing.size());
+	for (size_t i = 0; i < lines; i += 997) {
+		CPPUNIT_ASSERT_EQUAL(i, listing.FindFile_CmpCase(fz::sprintf(L"file_%d.dat", i)));
+		CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(i * 7), listing[i].size);
+	}
+	CPPUNIT_ASSERT_EQUAL(lines - 1, listing.FindFile_CmpCase(fz::sprintf(L"file_%d.dat", lines - 1)));
+
+	return elapsed;
+}
+
+void CDirectoryListingParserTest::testChunks()
+{
+	// Chunks ending in the middle of lines
+	ParseSynthetic(20000, 4096);
+}
+
+void CDirectoryListingParserTest::testThroughput()
+{
+	// Synthetic listing with a million lines, fed in 64 KiB chunks
+	size_t const lines = 1000000;
+
+	auto const elapsed = ParseSynthetic(lines, 65536);
+	std::cerr << fz::sprintf("\nListing parser, %d lines: %dms\n", lines, elapsed.get_milliseconds());
+}
+
 void CDirectoryListingParserTest::setUp()
 {
 }
@@ -0,0 +1,203 @@
+#include "../src/interface/filezilla.h"
+#include <wx/imaglist.h>
+#include <wx/scrolwin.h>
+#include <wx/listctrl.h>
+
+#include "../src/interface/filelistctrl.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "benchmark.h"
+
+#include <iostream>
+
+/*
+ * This testsuite checks that sorting with precomputed collation keys and
+ * sorting in parallel give the same order as the plain name comparisons.
+ * The benchmark reports the time taken by the different CFileListCtrlSort
+ * variants for a large listing.
+ */
+
+namespace {
+struct entry
+{
+	std::wstring name;
+	int64_t size{};
+	fz::datetime time;
+	bool dir{};
+
+	bool is_dir() const { return dir; }
+};
+}
+
+class CFileListSortTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CFileListSortTest);
+	CPPUNIT_TEST(testSortKey);
+	CPPUNIT_TEST(testSort);
+	FZ_BENCHMARK_TEST(testScale);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testSortKey();
+	void testSort();
+	void testScale();
+
+protected:
+	static std::vector<entry> MakeListing(size_t count);
+
+	// Sorts with the plain name comparison only, directories on top
+	static std::vector<unsigned int> SortPlain(std::vector<entry> const& listing, NameSortMode mode);
+
+	template<typename Comparison>
+	std::vector<unsigned int> Sort(std::vector<entry> const& listing, NameSortMode mode, fz::thread_pool * pool, fz::duration & elapsed);
+
+	fz::thread_pool pool_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CFileListSortTest);
+
+std::vector<entry> CFileListSortTest::MakeListing(size_t count)
+{
+	static wchar_t const* const templates[] = {
+		L"IMG_%d.JPG", L"img_%d.jpg", L"Report %d (final).pdf", L"backup-00%d.tar.gz",
+		L"file%d", L"File%d.TXT", L"v1.%d.2", L"%d", L"a%db%dc", L"\u00c4rger%d.txt"
+	};
+
+	std::vector<entry> listing;
+	listing.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		entry e;
+		size_t const n = (i * 7919) % (count / 3 + 1);
+		e.name = fz::sprintf(templates[i % (sizeof(templates) / sizeof(*templates))], n, i % 13);
+		e.size = static_cast<int64_t>((i * 104729) % 100000);
+		e.time = fz::datetime(static_cast<time_t>(1000000000 + (i * 7) % 5000), fz::datetime::seconds);
+		e.dir = !(i % 17);
+		listing.push_back(std::move(e));
+	}
+	return listing;
+}
+
+std::vector<unsigned int> CFileListSortTest::SortPlain(std::vector<entry> const& listing, NameSortMode mode)
+{
+	std::vector<unsigned int> indexes(listing.size());
+	for (size_t i = 0; i < indexes.size(); ++i) {
+		indexes[i] = static_cast<unsigned int>(i);
+	}
+	std::sort(indexes.begin(), indexes.end(), [&](unsigned int a, unsigned int b) {
+		if (listing[a].dir != listing[b].dir) {
+			return listing[a].dir;
+		}
+		return DoCmpName(listing[a], listing[b], mode) < 0;
+	});
+	return indexes;
+}
+
+template<typename Comparison>
+std::vector<unsigned int> CFileListSortTest::Sort(std::vector<entry> const& listing, NameSortMode mode, fz::thread_pool * pool, fz::duration & elapsed)
+{
+	std::vector<CGenericFileData> fileData(listing.size());
+	std::vector<unsigned int> indexes(listing.size());
+	for (size_t i = 0; i < indexes.size(); ++i) {
+		indexes[i] = static_cast<unsigned int>(i);
+	}
+
+	auto const start = fz::monotonic_clock::now();
+	Comparison object(listing, fileData, CFileListCtrlSortBase::dirsort_ontop, mode, nullptr);
+	object.Prepare();
+	ParallelSort(indexes.begin(), indexes.end(), SortPredicate(object), pool);
+	elapsed = fz::monotonic_clock::now() - start;
+
+	return indexes;
+}
+
+void CFileListSortTest::testSortKey()
+{
+	wchar_t const chars[] = L"0012389aAbBzZ._- \u00e4\u00c4\u0663";
+	size_t const count = sizeof(chars) / sizeof(*chars) - 1;
+
+	// All names up to three characters
+	std::vector<std::wstring> names{std::wstring()};
+	for (size_t len = 1; len <= 3; ++len) {
+		size_t const prev = names.size();
+		for (size_t i = 0; i < prev; ++i) {
+			if (names[i].size() == len - 1) {
+				for (size_t c = 0; c < count; ++c) {
+					names.push_back(names[i] + chars[c]);
+				}
+			}
+		}
+	}
+
+	for (auto mode : { NameSortMode::case_insensitive, NameSortMode::natural }) {
+		auto const cmp = CFileListCtrlSortBase::GetCmpFunction(mode);
+
+		std::vector<std::wstring> keys;
+		for (auto const& name : names) {
+			keys.push_back(CFileListCtrlSortBase::MakeSortKey(name, mode));
+		}
+
+		for (size_t a = 0; a < names.size(); a += 3) {
+			for (size_t b = 0; b < names.size(); ++b) {
+				int const res = CFileListCtrlSortBase::CmpSortKey(keys[a], keys[b]);
+				if (res) {
+					int const expected = cmp(names[a], names[b]);
+					CPPUNIT_ASSERT_MESSAGE(fz::to_utf8(names[a] + L" " + names[b]), (res < 0) == (expected < 0) && expected);
+				}
+			}
+		}
+	}
+}
+
+void CFileListSortTest::testSort()
+{
+	auto const listing = MakeListing(50000);
+
+	for (auto mode : { NameSortMode::case_insensitive, NameSortMode::case_sensitive, NameSortMode::natural }) {
+		auto const expected = SortPlain(listing, mode);
+
+		fz::duration elapsed;
+		for (fz::thread_pool * pool : { static_cast<fz::thread_pool*>(nullptr), &pool_ }) {
+			auto const sorted = Sort<CFileListCtrlSortName<std::vector<entry>, CGenericFileData>>(listing, mode, pool, elapsed);
+			CPPUNIT_ASSERT_EQUAL(expected.size(), sorted.size());
+			for (size_t i = 0; i < sorted.size(); ++i) {
+				// Names comparing equal may come in any order
+				entry const& e1 = listing[expected[i]];
+				entry const& e2 = listing[sorted[i]];
+				CPPUNIT_ASSERT_EQUAL(e1.dir, e2.dir);
+				CPPUNIT_ASSERT_EQUAL(0, DoCmpName(e1, e2, mode));
+			}
+		}
+	}
+}
+
+void CFileListSortTest::testScale()
+{
+	auto const listing = MakeListing(300000);
+
+	std::string results;
+	for (auto mode : { NameSortMode::case_insensitive, NameSortMode::natural }) {
+		auto start = fz::monotonic_clock::now();
+		SortPlain(listing, mode);
+		auto const plain = fz::monotonic_clock::now() - start;
+
+		fz::duration name, parallel, size, time;
+		Sort<CFileListCtrlSortName<std::vector<entry>, CGenericFileData>>(listing, mode, nullptr, name);
+		Sort<CFileListCtrlSortName<std::vector<entry>, CGenericFileData>>(listing, mode, &pool_, parallel);
+		Sort<CFileListCtrlSortSize<std::vector<entry>, CGenericFileData>>(listing, mode, &pool_, size);
+		Sort<CFileListCtrlSortTime<std::vector<entry>, CGenericFileData>>(listing, mode, &pool_, time);
+
+		results += fz::sprintf("\n  %s: plain %dms, keys %dms, parallel %dms, size %dms, time %dms",
+			mode == NameSortMode::natural ? "natural" : "case insensitive",
+			plain.get_milliseconds(), name.get_milliseconds(), parallel.get_milliseconds(),
+			size.get_milliseconds(), time.get_milliseconds());
+	}
+
+	std::cerr << fz::sprintf("\nSorting %d files:", listing.size()) << results << "\n";
+}
@@ -0,0 +1,188 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/commonui/filter.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "benchmark.h"
+
+#include <iostream>
+#include <tuple>
+
+/*
+ * This testsuite checks that compiled_filters gives the same results as
+ * filter_manager::FilenameFiltered for all kinds of conditions. The
+ * benchmark reports the time taken by both for a large number of files.
+ */
+
+class CFilterTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CFilterTest);
+	CPPUNIT_TEST(testEquivalence);
+	CPPUNIT_TEST(testLiteralRegex);
+	FZ_BENCHMARK_TEST(testScale);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testEquivalence();
+	void testLiteralRegex();
+	void testScale();
+
+protected:
+	static CFilter MakeFilter(CFilter::t_matchType matchType, bool matchCase, std::vector<std::tuple<t_filterType, int, std::wstring>> const& conditions);
+	static std::vector<CFilter> MakeFilters();
+	static std::vector<std::wstring> MakeNames(size_t count);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CFilterTest);
+
+CFilter CFilterTest::MakeFilter(CFilter::t_matchType matchType, bool matchCase, std::vector<std::tuple<t_filterType, int, std::wstring>> const& conditions)
+{
+	CFilter filter;
+	filter.matchType = matchType;
+	filter.matchCase = matchCase;
+	for (auto const& [type, cond, value] : conditions) {
+		CFilterCondition condition;
+		CPPUNIT_ASSERT(condition.set(type, value, cond, matchCase));
+		filter.filters.push_back(condition);
+	}
+	return filter;
+}
+
+std::vector<CFilter> CFilterTest::MakeFilters()
+{
+	std::vector<CFilter> filters;
+
+	// Similar to the default filters
+	filters.push_back(MakeFilter(CFilter::any, true, {
+		{filter_name, 1, L"CVS"}, {filter_name, 1, L".svn"}, {filter_name, 1, L".git"}
+	}));
+	filters.push_back(MakeFilter(CFilter::any, false, {
+		{filter_name, 3, L"~"}, {filter_name, 3, L".BAK"}, {filter_name, 4, L"^#.*#$"}
+	}));
+	filters.back().filterDirs = false;
+
+	// Regular expressions reducible to string comparisons
+	filters.push_back(MakeFilter(CFilter::any, false, {
+		{filter_name, 4, L"\\.TMP$"}, {filter_name, 4, L"^cache"}, {filter_path, 4, L"node_modules"}
+	}));
+
+	filters.push_back(MakeFilter(CFilter::all, true, {
+		{filter_name, 0, L"log"}, {filter_size, 0, L"1000"}, {filter_name, 5, L"keep"}
+	}));
+	filters.push_back(MakeFilter(CFilter::none, true, {
+		{filter_name, 2, L"file"}, {filter_size, 3, L"500000"}, {filter_date, 3, L"2000-01-01"}
+	}));
+	filters.push_back(MakeFilter(CFilter::not_all, false, {
+		{filter_path, 0, L"SUB"}, {filter_date, 0, L"2020-06-01"}, {filter_meta, 0, L"1"}
+	}));
+	return filters;
+}
+
+std::vector<std::wstring> CFilterTest::MakeNames(size_t count)
+{
+	static wchar_t const* const templates[] = {
+		L"file_%d.txt", L"File_%d.TMP", L"backup%d.bak", L"#autosave%d#", L"cache%d",
+		L"keep_log_%d", L"server%d.log", L"CVS", L".git", L"notes%d~", L"image%d.JPG"
+	};
+
+	std::vector<std::wstring> names;
+	names.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		names.push_back(fz::sprintf(templates[i % (sizeof(templates) / sizeof(*templates))], i));
+	}
+	return names;
+}
+
+void CFilterTest::testEquivalence()
+{
+	auto const filters = MakeFilters();
+	auto const names = MakeNames(5000);
+
+	std::wstring const paths[] = { L"/home/user", L"/home/user/Sub/dir", L"/srv/node_modules/x" };
+
+	for (size_t f = 0; f < filters.size(); ++f) {
+		std::vector<CFilter> single{filters[f]};
+		compiled_filters const compiled(single);
+
+		for (size_t i = 0; i < names.size(); ++i) {
+			std::wstring const& path = paths[i % 3];
+			bool const dir = !(i % 7);
+			int64_t const size = (i % 5) ? static_cast<int64_t>(i * 997 % 1000000) : -1;
+			int const attributes = (i % 4) ? static_cast<int>(i & 0777) : -1;
+			fz::datetime const date = (i % 6) ? fz::datetime(static_cast<time_t>(900000000 + i * 200000), fz::datetime::seconds) : fz::datetime();
+
+			bool const expected = filter_manager::FilenameFiltered(single, names[i], path, dir, size, attributes, date);
+			CPPUNIT_ASSERT_EQUAL_MESSAGE(fz::sprintf("filter %d, %s", f, fz::to_utf8(names[i])), expected, compiled.filtered(names[i], path, dir, size, attributes, date));
+		}
+	}
+
+	// And all of them at once
+	compiled_filters const compiled(filters);
+	for (auto const& name : names) {
+		CPPUNIT_ASSERT_EQUAL(filter_manager::FilenameFiltered(filters, name, L"/", false, 2000, 0644, fz::datetime()), compiled.filtered(name, L"/", false, 2000, 0644, fz::datetime()));
+	}
+
+	CPPUNIT_ASSERT(compiled_filters().empty());
+	CPPUNIT_ASSERT(!compiled_filters().filtered(L"foo", L"/", false, 0, 0, fz::datetime()));
+}
+
+void CFilterTest::testLiteralRegex()
+{
+	std::wstring const regexes[] = {
+		L"abc", L"^abc", L"abc$", L"^abc$", L"a\\.b", L"^$", L"$", L"a.c", L"ab*", L"\\d", L"[ab]", L"a|b", L"\\$x", L"^\\^"
+	};
+	std::wstring const names[] = {
+		L"abc", L"xabc", L"abcx", L"ABC", L"a.b", L"axb", L"", L"a1c", L"b", L"$x", L"^"
+	};
+
+	for (bool matchCase : { true, false }) {
+		for (auto const& r : regexes) {
+			std::vector<CFilter> filters{MakeFilter(CFilter::any, matchCase, {{filter_name, 4, r}})};
+			compiled_filters const compiled(filters);
+			for (auto const& name : names) {
+				CPPUNIT_ASSERT_EQUAL_MESSAGE(fz::to_utf8(r + L" " + name), filter_manager::FilenameFiltered(filters, name, L"/", false, 0, 0, fz::datetime()), compiled.filtered(name, L"/", false, 0, 0, fz::datetime()));
+			}
+		}
+	}
+}
+
+void CFilterTest::testScale()
+{
+	auto filters = MakeFilters();
+
+	// Matches nearly everything
+	filters.pop_back();
+
+	auto const names = MakeNames(200000);
+	std::wstring const path = L"/home/user/projects/filezilla/src";
+
+	size_t expected{};
+	auto start = fz::monotonic_clock::now();
+	for (auto const& name : names) {
+		if (filter_manager::FilenameFiltered(filters, name, path, false, 4096, 0644, fz::datetime())) {
+			++expected;
+		}
+	}
+	auto const plain = fz::monotonic_clock::now() - start;
+
+	size_t count{};
+	start = fz::monotonic_clock::now();
+	compiled_filters const compiled(filters);
+	for (auto const& name : names) {
+		if (compiled.filtered(name, path, false, 4096, 0644, fz::datetime())) {
+			++count;
+		}
+	}
+	auto const prepared = fz::monotonic_clock::now() - start;
+
+	CPPUNIT_ASSERT_EQUAL(expected, count);
+
+	std::cerr << fz::sprintf("\nFilters, %d files: FilenameFiltered %dms, compiled_filters %dms\n",
+		names.size(), plain.get_milliseconds(), prepared.get_milliseconds());
+}
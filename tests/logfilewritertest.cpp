@@ -0,0 +1,192 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/engine_options.h"
+#include "../src/include/logfile_writer.h"
+
+#include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <iostream>
+
+/*
+ * This testsuite checks that the log file writer writes all messages
+ * logged concurrently from several threads, and that flushing writes
+ * out everything logged so far. The benchmark reports the number of
+ * messages per second it accepts for different numbers of threads.
+ */
+
+namespace {
+class test_options final : public COptionsBase
+{
+public:
+	virtual void notify_changed() override {}
+};
+}
+
+class CLogfileWriterTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CLogfileWriterTest);
+	CPPUNIT_TEST(testWrite);
+	FZ_BENCHMARK_TEST(testThroughput);
+	CPPUNIT_TEST(testFlush);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testWrite();
+	void testThroughput();
+	void testFlush();
+
+protected:
+	// Logs count messages from each of the threads, returns the elapsed
+	// time including writing them out
+	fz::duration Run(logfile_writer & writer, size_t threads, size_t count);
+
+	std::string ReadLog();
+
+	fz::native_string file_;
+	test_options options_;
+	fz::thread_pool pool_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CLogfileWriterTest);
+
+void CLogfileWriterTest::setUp()
+{
+	file_ = fz::to_native(std::string("logfilewritertest.log"));
+	fz::remove_file(file_, false);
+
+	options_.set(OPTION_LOGGING_FILE, fz::to_wstring(file_));
+	options_.set(OPTION_LOGGING_FILE_SIZELIMIT, 0);
+}
+
+void CLogfileWriterTest::tearDown()
+{
+	fz::remove_file(file_, false);
+}
+
+fz::duration CLogfileWriterTest::Run(logfile_writer & writer, size_t threads, size_t count)
+{
+	std::wstring const msg = L"Response: 150 Opening BINARY mode data connection for file_transfer.bin (1048576 bytes)";
+
+	auto const start = fz::monotonic_clock::now();
+
+	std::vector<fz::async_task> tasks;
+	for (size_t t = 0; t < threads; ++t) {
+		tasks.emplace_back(pool_.spawn([&writer, &msg, t, count]() {
+			for (size_t i = 0; i < count; ++i) {
+				writer.log(fz::logmsg::reply, msg, fz::datetime::now(), t + 1);
+			}
+		}));
+	}
+	for (auto & task : tasks) {
+		task.join();
+	}
+	writer.flush();
+
+	return fz::monotonic_clock::now() - start;
+}
+
+std::string CLogfileWriterTest::ReadLog()
+{
+	fz::file f(file_, fz::file::reading);
+	CPPUNIT_ASSERT(f.opened());
+
+	std::string data;
+	data.resize(static_cast<size_t>(f.size()));
+	CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(data.size()), static_cast<int64_t>(f.read2(data.data(), data.size()).value_));
+	return data;
+}
+
+void CLogfileWriterTest::testWrite()
+{
+	fz::event_loop loop(pool_);
+
+	size_t const threads = 4;
+	size_t const count = 1000;
+
+	{
+		logfile_writer writer(options_, loop, pool_);
+		Run(writer, threads, count);
+
+		// Written before the writer goes away
+		writer.log(fz::logmsg::status, L"last", fz::datetime::now());
+	}
+
+	std::string const data = ReadLog();
+
+	std::vector<size_t> lines(threads + 1);
+	size_t pos = 0;
+	while (pos < data.size()) {
+		size_t const end = data.find('\n', pos);
+		CPPUNIT_ASSERT(end != std::string::npos);
+
+		// Timestamp, pid, engine id, prefix, message
+		auto const tokens = fz::strtok_view(std::string_view(data).substr(pos, end - pos), " \r");
+		CPPUNIT_ASSERT(tokens.size() >= 5);
+		if (tokens.back() == "last") {
+			++lines[0];
+		}
+		else {
+			size_t const id = fz::to_integral<size_t>(tokens[3]);
+			CPPUNIT_ASSERT(id >= 1 && id <= threads);
+			++lines[id];
+		}
+		pos = end + 1;
+	}
+
+	CPPUNIT_ASSERT_EQUAL(size_t(1), lines[0]);
+	for (size_t t = 1; t <= threads; ++t) {
+		CPPUNIT_ASSERT_EQUAL(count, lines[t]);
+	}
+}
+
+void CLogfileWriterTest::testThroughput()
+{
+	fz::event_loop loop(pool_);
+	logfile_writer writer(options_, loop, pool_);
+
+	size_t const count = 50000;
+
+	std::string results;
+	for (size_t threads : { 1, 4, 10 }) {
+		auto const elapsed = Run(writer, threads, count);
+		int64_t const ms = std::max(int64_t(1), elapsed.get_milliseconds());
+		results += fz::sprintf(" %d threads: %d messages/s,", threads, static_cast<int64_t>(threads * count) * 1000 / ms);
+	}
+	results.pop_back();
+
+	std::cerr << "\nLog file writer:" << results << "\n";
+}
+
+void CLogfileWriterTest::testFlush()
+{
+	fz::event_loop loop(pool_);
+	logfile_writer writer(options_, loop, pool_);
+
+	size_t const count = 1000;
+
+	size_t total{};
+	for (size_t threads : { 1, 4 }) {
+		Run(writer, threads, count);
+		total += threads * count;
+
+		// Everything is in the file while the writer is still alive
+		std::string const data = ReadLog();
+		CPPUNIT_ASSERT_EQUAL(total, static_cast<size_t>(std::count(data.cbegin(), data.cend(), '\n')));
+	}
+
+	// Same with a timeout, as used after a crash
+	writer.log(fz::logmsg::status, L"last", fz::datetime::now());
+	CPPUNIT_ASSERT(writer.flush(fz::duration::from_seconds(10)));
+	std::string const data = ReadLog();
+	CPPUNIT_ASSERT_EQUAL(total + 1, static_cast<size_t>(std::count(data.cbegin(), data.cend(), '\n')));
+}
@@ -0,0 +1,170 @@
+#include "../src/interface/queue_storage.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite checks the bookkeeping of the stored file rows of a
+ * queued server: reading them page by page, and which rows get deleted
+ * when saving.
+ */
+
+class CQueueStorageTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CQueueStorageTest);
+	CPPUNIT_TEST(testPages);
+	CPPUNIT_TEST(testSave);
+	CPPUNIT_TEST(testDiscard);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testPages();
+	void testSave();
+	void testDiscard();
+
+protected:
+	static void ReadPage(stored_rows & rows, int64_t first, int64_t last, int limit);
+	static std::vector<int64_t> Ids(int64_t first, int64_t last);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CQueueStorageTest);
+
+void CQueueStorageTest::ReadPage(stored_rows & rows, int64_t first, int64_t last, int limit)
+{
+	rows.begin_page();
+	for (int64_t id = first; id <= last; ++id) {
+		rows.read(id);
+	}
+	rows.end_page(limit);
+}
+
+std::vector<int64_t> CQueueStorageTest::Ids(int64_t first, int64_t last)
+{
+	std::vector<int64_t> ret;
+	for (int64_t id = first; id <= last; ++id) {
+		ret.push_back(id);
+	}
+	return ret;
+}
+
+void CQueueStorageTest::testPages()
+{
+	{
+		stored_rows rows;
+		rows.set_pending(25);
+		CPPUNIT_ASSERT(rows.pending());
+
+		ReadPage(rows, 1, 10, 10);
+		CPPUNIT_ASSERT(rows.pending());
+		CPPUNIT_ASSERT_EQUAL(int64_t(10), rows.last_read());
+
+		ReadPage(rows, 11, 20, 10);
+		CPPUNIT_ASSERT(rows.pending());
+
+		// Short page, nothing left
+		ReadPage(rows, 21, 25, 10);
+		CPPUNIT_ASSERT(!rows.pending());
+		CPPUNIT_ASSERT(rows.complete());
+		CPPUNIT_ASSERT_EQUAL(size_t(25), rows.size());
+	}
+
+	{
+		// Full last page, complete since the last stored row got read
+		stored_rows rows;
+		rows.set_pending(20);
+		ReadPage(rows, 1, 10, 10);
+		CPPUNIT_ASSERT(rows.pending());
+		ReadPage(rows, 11, 20, 10);
+		CPPUNIT_ASSERT(!rows.pending());
+	}
+
+	{
+		// Fewer rows than the limit
+		stored_rows rows;
+		rows.set_pending(10);
+		ReadPage(rows, 1, 10, 20);
+		CPPUNIT_ASSERT(!rows.pending());
+		CPPUNIT_ASSERT_EQUAL(int64_t(10), rows.last_read());
+	}
+
+	{
+		// Reading everything at once
+		stored_rows rows;
+		ReadPage(rows, 1, 5, -1);
+		CPPUNIT_ASSERT(rows.complete());
+	}
+}
+
+void CQueueStorageTest::testSave()
+{
+	stored_rows rows;
+	rows.set_pending(25);
+	ReadPage(rows, 1, 10, 10);
+
+	bool all{};
+
+	// Two loaded items removed
+	auto kept = Ids(1, 10);
+	kept.erase(kept.begin() + 4);
+	kept.erase(kept.begin() + 2);
+	auto removed = rows.save(std::vector<int64_t>(kept), {}, all);
+	CPPUNIT_ASSERT(!all);
+	CPPUNIT_ASSERT(removed == std::vector<int64_t>({3, 5}));
+
+	// A new item, stored after the rows not loaded yet
+	removed = rows.save(std::vector<int64_t>(kept), {26}, all);
+	CPPUNIT_ASSERT(!all);
+	CPPUNIT_ASSERT(removed.empty());
+
+	// The next page has lower ids than the new row
+	ReadPage(rows, 11, 20, 10);
+	CPPUNIT_ASSERT(rows.pending());
+	auto page = Ids(11, 20);
+	kept.insert(kept.end(), page.begin(), page.end());
+	kept.push_back(26);
+	removed = rows.save(std::vector<int64_t>(kept), {}, all);
+	CPPUNIT_ASSERT(!all);
+	CPPUNIT_ASSERT(removed.empty());
+
+	// All loaded items removed, the rows not loaded yet have to stay
+	removed = rows.save({}, {}, all);
+	CPPUNIT_ASSERT(!all);
+	CPPUNIT_ASSERT_EQUAL(kept.size(), removed.size());
+	CPPUNIT_ASSERT(removed == kept);
+
+	ReadPage(rows, 21, 25, 10);
+	CPPUNIT_ASSERT(rows.complete());
+
+	// Everything removed, can be deleted at once
+	removed = rows.save({}, {}, all);
+	CPPUNIT_ASSERT(all);
+	CPPUNIT_ASSERT(removed.empty());
+
+	removed = rows.save({}, {}, all);
+	CPPUNIT_ASSERT(!all);
+	CPPUNIT_ASSERT(removed.empty());
+}
+
+void CQueueStorageTest::testDiscard()
+{
+	stored_rows rows;
+	rows.set_pending(25);
+	ReadPage(rows, 1, 10, 10);
+
+	rows.discard();
+	CPPUNIT_ASSERT(!rows.pending());
+
+	// Rows after last_read are deleted once
+	CPPUNIT_ASSERT(rows.take_discard());
+	CPPUNIT_ASSERT_EQUAL(int64_t(10), rows.last_read());
+	CPPUNIT_ASSERT(rows.complete());
+	CPPUNIT_ASSERT(!rows.take_discard());
+
+	// Nothing to discard once complete
+	stored_rows complete;
+	ReadPage(complete, 1, 5, -1);
+	complete.discard();
+	CPPUNIT_ASSERT(!complete.take_discard());
+}
@@ -0,0 +1,174 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/commonui/remote_recursive_operation.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <utility>
+
+/*
+ * This testsuite checks which listings a recursive operation requests
+ * from the cache: only directories listed ahead of the operation on
+ * another connection may be sent from the cache without changing into
+ * them first.
+ */
+
+class CRemoteRecursionTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CRemoteRecursionTest);
+	CPPUNIT_TEST(testPrefetchedFlag);
+	CPPUNIT_TEST(testNoPrefetch);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testPrefetchedFlag();
+	void testNoPrefetch();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CRemoteRecursionTest);
+
+namespace {
+class test_operation final : public remote_recursive_operation
+{
+public:
+	using remote_recursive_operation::PrefetchFinished;
+	using remote_recursive_operation::ProcessDirectoryListing;
+
+	// Returns the flags of the listing last requested through process_command
+	int last_list_flags() const { return lists_.empty() ? -1 : lists_.back().second; }
+	CServerPath last_list_path() const { return lists_.empty() ? CServerPath() : lists_.back().first; }
+
+	std::vector<std::pair<CServerPath, int>> lists_;
+	std::vector<std::pair<CServerPath, int>> prefetches_;
+	size_t capacity_{};
+	bool finished_{};
+
+protected:
+	virtual void process_command(std::unique_ptr<CCommand> command) override
+	{
+		auto const* list = dynamic_cast<CListCommand const*>(command.get());
+		CPPUNIT_ASSERT(list);
+		CPPUNIT_ASSERT(list->valid());
+		lists_.emplace_back(CServerPath(list->GetPath(), list->GetSubDir()), list->GetFlags());
+	}
+
+	virtual void operation_finished() override { finished_ = true; }
+	virtual std::wstring sanitize_filename(std::wstring const& name) override { return name; }
+	virtual void handle_file(std::wstring const&, CLocalPath const&, CServerPath const&, int64_t) override {}
+	virtual void handle_empty_directory(CLocalPath const&) override {}
+	virtual void handle_invalid_dir_link(std::wstring const&, CLocalPath const&, CServerPath const&) override {}
+	virtual void handle_dir_listing_end() override {}
+	virtual void handle_listing_failed() override {}
+
+	virtual size_t prefetch_capacity() override { return capacity_; }
+
+	virtual bool prefetch_listing(CServerPath const& parent, std::wstring const& subdir, int flags) override
+	{
+		prefetches_.emplace_back(CServerPath(parent, subdir), flags);
+		--capacity_;
+		return true;
+	}
+};
+
+CDirectoryListing MakeListing(std::wstring const& path, std::vector<std::wstring> const& dirs)
+{
+	std::vector<CDirentry> entries;
+	for (auto const& dir : dirs) {
+		CDirentry entry;
+		entry.name = dir;
+		entry.flags = CDirentry::flag_dir;
+		entry.size = -1;
+		entries.emplace_back(std::move(entry));
+	}
+
+	CDirectoryListing listing;
+	listing.path = CServerPath(path);
+	listing.Assign(std::move(entries));
+	return listing;
+}
+}
+
+void CRemoteRecursionTest::testPrefetchedFlag()
+{
+	CServerPath const root(L"/root");
+
+	test_operation op;
+	op.capacity_ = 2;
+
+	recursion_root r(root, true);
+	r.add_dir_to_visit(root, std::wstring());
+	op.AddRecursionRoot(std::move(r));
+	op.start_recursive_operation(recursive_operation::recursive_list, ActiveFilters(), true);
+
+	CPPUNIT_ASSERT_EQUAL(size_t(1), op.lists_.size());
+	CPPUNIT_ASSERT(op.last_list_path() == root);
+	CPPUNIT_ASSERT_EQUAL(LIST_FLAG_REFRESH, op.last_list_flags());
+
+	auto listing = MakeListing(L"/root", {L"a", L"b", L"c"});
+	op.ProcessDirectoryListing(&listing);
+
+	// The operation lists a itself, b and c are listed ahead on other connections
+	CPPUNIT_ASSERT(op.last_list_path() == CServerPath(L"/root/a"));
+	CPPUNIT_ASSERT_EQUAL(LIST_FLAG_REFRESH, op.last_list_flags());
+	CPPUNIT_ASSERT_EQUAL(size_t(2), op.prefetches_.size());
+	CPPUNIT_ASSERT(op.prefetches_[0].first == CServerPath(L"/root/b"));
+	CPPUNIT_ASSERT(op.prefetches_[1].first == CServerPath(L"/root/c"));
+	for (auto const& prefetch : op.prefetches_) {
+		CPPUNIT_ASSERT(!(prefetch.second & LIST_FLAG_PREFETCHED));
+	}
+
+	op.PrefetchFinished(root, L"b", true);
+	op.PrefetchFinished(root, L"c", false);
+
+	listing = MakeListing(L"/root/a", {});
+	op.ProcessDirectoryListing(&listing);
+
+	// b has been listed in the meantime
+	CPPUNIT_ASSERT(op.last_list_path() == CServerPath(L"/root/b"));
+	CPPUNIT_ASSERT_EQUAL(LIST_FLAG_PREFETCHED, op.last_list_flags());
+
+	listing = MakeListing(L"/root/b", {});
+	op.ProcessDirectoryListing(&listing);
+
+	// Listing c on the other connection failed, it is listed as usual
+	CPPUNIT_ASSERT(op.last_list_path() == CServerPath(L"/root/c"));
+	CPPUNIT_ASSERT_EQUAL(LIST_FLAG_REFRESH, op.last_list_flags());
+
+	listing = MakeListing(L"/root/c", {});
+	op.ProcessDirectoryListing(&listing);
+
+	CPPUNIT_ASSERT_EQUAL(size_t(4), op.lists_.size());
+	CPPUNIT_ASSERT(op.finished_);
+	CPPUNIT_ASSERT(!op.IsActive());
+}
+
+void CRemoteRecursionTest::testNoPrefetch()
+{
+	CServerPath const root(L"/root");
+
+	test_operation op;
+
+	recursion_root r(root, true);
+	r.add_dir_to_visit(root, std::wstring());
+	op.AddRecursionRoot(std::move(r));
+	op.start_recursive_operation(recursive_operation::recursive_list, ActiveFilters(), false);
+
+	auto listing = MakeListing(L"/root", {L"a", L"b"});
+	op.ProcessDirectoryListing(&listing);
+
+	listing = MakeListing(L"/root/a", {});
+	op.ProcessDirectoryListing(&listing);
+
+	listing = MakeListing(L"/root/b", {});
+	op.ProcessDirectoryListing(&listing);
+
+	// Without listings on other connections, no listing may be taken from the cache unchecked
+	CPPUNIT_ASSERT(op.prefetches_.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(3), op.lists_.size());
+	for (auto const& list : op.lists_) {
+		CPPUNIT_ASSERT_EQUAL(0, list.second);
+	}
+	CPPUNIT_ASSERT(op.finished_);
+}
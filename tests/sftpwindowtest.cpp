@@ -0,0 +1,120 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "../src/putty/sftpwindow.h"
+
+#include <algorithm>
+#include <deque>
+
+/*
+ * This testsuite measures the throughput the SFTP request window achieves
+ * on a simulated link with injected latency, comparing it against the
+ * fixed window used previously.
+ */
+
+class CSftpWindowTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CSftpWindowTest);
+	CPPUNIT_TEST(testLowLatency);
+	CPPUNIT_TEST(testHighLatency);
+	CPPUNIT_TEST(testLimit);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testLowLatency();
+	void testHighLatency();
+	void testLimit();
+
+protected:
+	// Returns achieved throughput in bytes per millisecond
+	double Simulate(double bandwidth, double rtt, bool adaptive, uint64_t max = 0);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CSftpWindowTest);
+
+double CSftpWindowTest::Simulate(double bandwidth, double rtt, bool adaptive, uint64_t max)
+{
+	// Bandwidth in bytes per millisecond, rtt in milliseconds.
+	// Requests travel to the server in rtt / 2, the replies
+	// then queue up on the link on the way back.
+	uint64_t const total = 2ull * 1024 * 1024 * 1024;
+	uint64_t const request_size = 32768;
+
+	sftp_window window;
+	sftp_window_init(&window, max, 0);
+
+	struct request {
+		double arrival;
+		unsigned long sent;
+	};
+	std::deque<request> outstanding;
+
+	double now{};
+	double link_free{};
+	uint64_t queued{};
+	uint64_t done{};
+
+	while (done < total) {
+		uint64_t const limit = adaptive ? window.size : SFTP_WINDOW_INITIAL;
+		while (queued < total && outstanding.size() * request_size < limit) {
+			double const start = std::max(now + rtt / 2, link_free);
+			link_free = start + request_size / bandwidth;
+			outstanding.push_back({link_free + rtt / 2, static_cast<unsigned long>(now)});
+			queued += request_size;
+		}
+
+		auto const r = outstanding.front();
+		outstanding.pop_front();
+		now = r.arrival;
+		done += request_size;
+		sftp_window_completed(&window, request_size, r.sent, static_cast<unsigned long>(now));
+	}
+
+	return total / now;
+}
+
+void CSftpWindowTest::testLowLatency()
+{
+	// 100 MB/s with 2ms RTT, the initial window already suffices.
+	double const bandwidth = 100000;
+	double const adaptive = Simulate(bandwidth, 2, true);
+	double const fixed = Simulate(bandwidth, 2, false);
+
+	CPPUNIT_ASSERT(adaptive > bandwidth * 0.9);
+	CPPUNIT_ASSERT(adaptive > fixed * 0.95);
+}
+
+void CSftpWindowTest::testHighLatency()
+{
+	// 100 MB/s with 200ms RTT, a bandwidth-delay product of 20 MB.
+	double const bandwidth = 100000;
+	double const adaptive = Simulate(bandwidth, 200, true);
+	double const fixed = Simulate(bandwidth, 200, false);
+
+	CPPUNIT_ASSERT(fixed < bandwidth * 0.3);
+	CPPUNIT_ASSERT(adaptive > bandwidth * 0.8);
+
+	// 10 MB/s with 500ms RTT
+	CPPUNIT_ASSERT(Simulate(10000, 500, true) > 10000 * 0.8);
+}
+
+void CSftpWindowTest::testLimit()
+{
+	// The window never exceeds the configured limit.
+	double const bandwidth = 100000;
+	uint64_t const max = 8 * 1024 * 1024;
+	double const limited = Simulate(bandwidth, 200, true, max);
+
+	CPPUNIT_ASSERT(limited < (max / 200.0) * 1.05);
+	CPPUNIT_ASSERT(limited > (SFTP_WINDOW_INITIAL / 200.0) * 1.5);
+
+	sftp_window window;
+	sftp_window_init(&window, 1024 * 1024, 0);
+	CPPUNIT_ASSERT(window.size == 1024 * 1024);
+	for (unsigned long t = 0; t < 10000; t += 10) {
+		sftp_window_completed(&window, 1024 * 1024, t, t + 5);
+		CPPUNIT_ASSERT(window.size <= 1024 * 1024);
+	}
+}